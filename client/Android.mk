@@ -39,6 +39,7 @@ LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)/../include
 LOCAL_SHARED_LIBRARIES := $(libnativepower_CommonSharedLibraries)
 LOCAL_SRC_FILES := \
   power_manager_client.cc \
+  scoped_wake_lock.cc \
   wake_lock.cc \
 
 include $(BUILD_SHARED_LIBRARY)
@@ -63,6 +64,30 @@ LOCAL_SHARED_LIBRARIES := \
 
 LOCAL_SRC_FILES := \
   power_manager_client_unittest.cc \
+  scoped_wake_lock_unittest.cc \
   wake_lock_unittest.cc \
 
 include $(BUILD_NATIVE_TEST)
+
+# libnativepower_benchmarks executable
+# ========================================================
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := libnativepower_benchmarks
+ifdef BRILLO
+  LOCAL_MODULE_TAGS := eng
+endif
+LOCAL_CPP_EXTENSION := .cc
+LOCAL_CFLAGS := $(libnativepower_CommonCFlags)
+LOCAL_C_INCLUDES := $(libnativepower_CommonCIncludes)
+LOCAL_SHARED_LIBRARIES := \
+  $(libnativepower_CommonSharedLibraries) \
+  libbinderwrapper_test_support \
+  libnativepower \
+  libnativepower_test_support \
+
+LOCAL_SRC_FILES := \
+  benchmark_main.cc \
+  power_manager_client_benchmark.cc \
+
+include $(BUILD_NATIVE_BENCHMARK)
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <base/at_exit.h>
+#include <base/logging.h>
+#include <base/message_loop/message_loop.h>
+#include <benchmark/benchmark.h>
+#include <binderwrapper/binder_wrapper.h>
+#include <binderwrapper/stub_binder_wrapper.h>
+
+int main(int argc, char** argv) {
+  base::AtExitManager at_exit;
+  logging::SetMinLogLevel(logging::LOG_WARNING);
+  // Delivers one-way calls to PowerManagerStub.
+  base::MessageLoop message_loop;
+  // Benchmarks talk to an in-process PowerManagerStub.
+  android::BinderWrapper::InitForTesting(new android::StubBinderWrapper());
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  android::BinderWrapper::Destroy();
+  return 0;
+}
@@ -16,17 +16,34 @@
 
 #include <nativepower/power_manager_client.h>
 
+#include <algorithm>
+#include <utility>
+
 #include <base/bind.h>
+#include <base/bind_helpers.h>
+#include <base/location.h>
 #include <base/logging.h>
+#include <base/run_loop.h>
+#include <base/task_runner_util.h>
 #include <binder/IBinder.h>
+#include <binder/Parcel.h>
 #include <binderwrapper/binder_wrapper.h>
+#include <nativepower/BnPowerManager.h>
 #include <nativepower/constants.h>
+#include <nativepower/scoped_wake_lock.h>
 #include <nativepower/wake_lock.h>
 #include <powermanager/PowerManager.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
 
 namespace android {
 namespace {
 
+// Bounds on the delay between attempts to reconnect to the power manager after
+// it dies.
+const int kInitialReconnectDelayMs = 100;
+const int kMaxReconnectDelayMs = 5000;
+
 // Returns the string corresponding to |reason|. Values are hardcoded in
 // core/java/android/os/PowerManager.java.
 String16 ShutdownReasonToString16(ShutdownReason reason) {
@@ -55,12 +72,94 @@ String16 RebootReasonToString16(RebootReason reason) {
   }
 }
 
+// Reads a distribution written by BnPowerManager for
+// GET_SUSPEND_LATENCY_STATS from |reply| into |distribution|. Returns false if
+// the data is invalid.
+bool ReadLatencyDistribution(const Parcel& reply,
+                             LatencyDistribution* distribution) {
+  distribution->count = reply.readInt64();
+  distribution->min = base::TimeDelta::FromMicroseconds(reply.readInt64());
+  distribution->max = base::TimeDelta::FromMicroseconds(reply.readInt64());
+  distribution->total = base::TimeDelta::FromMicroseconds(reply.readInt64());
+  distribution->p50 = base::TimeDelta::FromMicroseconds(reply.readInt64());
+  distribution->p90 = base::TimeDelta::FromMicroseconds(reply.readInt64());
+  distribution->p99 = base::TimeDelta::FromMicroseconds(reply.readInt64());
+
+  // Each bucket occupies two int64s.
+  const int32_t num_buckets = reply.readInt32();
+  if (num_buckets < 0 ||
+      static_cast<size_t>(num_buckets) >
+          reply.dataAvail() / (2 * sizeof(int64_t))) {
+    LOG(ERROR) << "Got invalid latency bucket count " << num_buckets;
+    return false;
+  }
+  distribution->buckets.resize(num_buckets);
+  for (LatencyDistribution::Bucket& bucket : distribution->buckets) {
+    bucket.upper_bound = base::TimeDelta::FromMicroseconds(reply.readInt64());
+    bucket.count = reply.readInt64();
+  }
+  return true;
+}
+
+// A request to be sent by PowerManagerClient::ReacquireWakeLocks(), and the
+// flag to set once it succeeds.
+struct ReacquireRequest {
+  sp<IBinder> binder;
+  std::string tag;
+  std::string package;
+  base::TimeDelta timeout;
+  bool* acquired;
+};
+
+// Synchronously releases |lock| from |power_manager|. Runs on
+// PowerManagerClient's IPC thread.
+status_t ReleaseWakeLockOnIpcThread(const sp<IPowerManager>& power_manager,
+                                    const sp<IBinder>& lock,
+                                    const std::string& tag) {
+  status_t status =
+      power_manager->releaseWakeLock(lock, 0 /* flags */, false /* isOneWay */);
+  if (status != OK) {
+    LOG(ERROR) << "Wake lock release request for \"" << tag << "\" failed "
+               << "with status " << status;
+  }
+  return status;
+}
+
+// Appends a BnPowerManager::WAKE_LOCK_UPDATE_ACQUIRE entry for an
+// UPDATE_WAKE_LOCKS transaction to |data|.
+void WriteAcquireUpdate(Parcel* data,
+                        const sp<IBinder>& lock_binder,
+                        const std::string& tag,
+                        const std::string& package,
+                        base::TimeDelta timeout) {
+  data->writeInt32(BnPowerManager::WAKE_LOCK_UPDATE_ACQUIRE);
+  data->writeStrongBinder(lock_binder);
+  data->writeInt32(POWERMANAGER_PARTIAL_WAKE_LOCK);
+  data->writeString16(String16(tag.c_str()));
+  data->writeString16(String16(package.c_str()));
+  data->writeInt64(timeout.InMillisecondsRoundedUp());
+}
+
 }  // namespace
 
+PowerManagerClient::BinderPoolStats::BinderPoolStats()
+    : num_created(0),
+      num_reused(0),
+      num_recycled(0),
+      num_discarded(0) {}
+
+PowerManagerClient::SharedLock::SharedLock() : num_locks(0), acquired(false) {}
+
 PowerManagerClient::PowerManagerClient()
-    : weak_ptr_factory_(this) {}
+    : coalesce_wake_locks_(false),
+      num_coalesced_acquires_(0),
+      max_pooled_binders_(0),
+      num_reconnects_(0),
+      ipc_thread_("wake_lock_ipc"),
+      weak_ptr_factory_(this) {}
 
 PowerManagerClient::~PowerManagerClient() {
+  ipc_thread_.Stop();
   if (power_manager_.get()) {
     BinderWrapper::Get()->UnregisterForDeathNotifications(
         IInterface::asBinder(power_manager_));
@@ -68,6 +167,10 @@ PowerManagerClient::~PowerManagerClient() {
 }
 
 bool PowerManagerClient::Init() {
+  return Connect();
+}
+
+bool PowerManagerClient::Connect() {
   sp<IBinder> power_manager_binder =
       BinderWrapper::Get()->GetService(kPowerManagerServiceName);
   if (!power_manager_binder.get()) {
@@ -87,12 +190,154 @@ bool PowerManagerClient::Init() {
 std::unique_ptr<WakeLock> PowerManagerClient::CreateWakeLock(
     const std::string& tag,
     const std::string& package) {
-  std::unique_ptr<WakeLock> lock(new WakeLock(tag, package, this));
+  return CreateWakeLockWithTimeout(tag, package, base::TimeDelta());
+}
+
+std::unique_ptr<WakeLock> PowerManagerClient::CreateWakeLockWithTimeout(
+    const std::string& tag,
+    const std::string& package,
+    base::TimeDelta timeout) {
+  std::unique_ptr<WakeLock> lock(new WakeLock(tag, package, timeout, this));
+  lock->shared_ = coalesce_wake_locks_ && timeout <= base::TimeDelta();
   if (!lock->Init())
     lock.reset();
   return lock;
 }
 
+std::unique_ptr<WakeLock> PowerManagerClient::CreateWakeLockAsync(
+    const std::string& tag,
+    const std::string& package,
+    base::TimeDelta timeout,
+    const AcquireCallback& callback) {
+  std::unique_ptr<WakeLock> lock(new WakeLock(tag, package, timeout, this));
+  if (!lock->InitAsync(callback))
+    lock.reset();
+  return lock;
+}
+
+bool PowerManagerClient::UpdateWakeLocks(
+    const std::vector<WakeLockSpec>& new_locks,
+    std::vector<std::unique_ptr<WakeLock>>* locks_to_release,
+    std::vector<std::unique_ptr<WakeLock>>* created_locks) {
+  DCHECK(locks_to_release);
+  DCHECK(created_locks);
+  if (!power_manager_.get()) {
+    LOG(ERROR) << "Can't update wake locks; no connection to power manager";
+    return false;
+  }
+
+  // Locks that were never acquired (e.g. because the power manager restarted)
+  // don't need to be released. Coalesced locks release their shared requests
+  // (if no other locks use them) when they're destroyed after the
+  // transaction, so the new locks are still acquired first.
+  std::vector<WakeLock*> releases;
+  for (const auto& lock : *locks_to_release) {
+    if (lock->acquired_lock_ && !lock->shared_)
+      releases.push_back(lock.get());
+  }
+  const size_t num_updates = releases.size() + new_locks.size();
+  if (num_updates > static_cast<size_t>(BnPowerManager::kMaxWakeLockUpdates)) {
+    LOG(ERROR) << "Can't make " << num_updates << " wake lock updates at once";
+    return false;
+  }
+
+  // BnPowerManager::UPDATE_WAKE_LOCKS isn't part of IPowerManager, so the
+  // transaction is built by hand. Releases are sent first so the power
+  // manager never needs to hold both sets of locks.
+  Parcel data, reply;
+  data.writeInterfaceToken(IPowerManager::getInterfaceDescriptor());
+  data.writeInt32(num_updates);
+  for (WakeLock* lock : releases) {
+    data.writeInt32(BnPowerManager::WAKE_LOCK_UPDATE_RELEASE);
+    data.writeStrongBinder(lock->lock_binder_);
+  }
+  std::vector<std::unique_ptr<WakeLock>> locks;
+  for (const WakeLockSpec& spec : new_locks) {
+    locks.emplace_back(
+        new WakeLock(spec.tag, spec.package, spec.timeout, this));
+    WakeLock* lock = locks.back().get();
+    lock->lock_binder_ = GetLockBinder();
+    WriteAcquireUpdate(&data, lock->lock_binder_, spec.tag, spec.package,
+                       spec.timeout);
+  }
+
+  status_t status = IInterface::asBinder(power_manager_)
+      ->transact(BnPowerManager::UPDATE_WAKE_LOCKS, data, &reply);
+  if (status != OK) {
+    LOG(ERROR) << "Wake lock update request failed with status " << status;
+    return false;
+  }
+
+  // The released locks are destroyed without making further calls.
+  for (WakeLock* lock : releases)
+    lock->acquired_lock_ = false;
+  locks_to_release->clear();
+  for (auto& lock : locks) {
+    lock->acquired_lock_ = true;
+    created_locks->push_back(std::move(lock));
+  }
+  return true;
+}
+
+bool PowerManagerClient::GetWakeLockStats(std::vector<WakeLockStats>* stats) {
+  DCHECK(power_manager_.get());
+  DCHECK(stats);
+  stats->clear();
+
+  // BnPowerManager::GET_WAKE_LOCK_STATS isn't part of IPowerManager, so the
+  // transaction is built by hand.
+  Parcel data, reply;
+  data.writeInterfaceToken(IPowerManager::getInterfaceDescriptor());
+  status_t status = IInterface::asBinder(power_manager_)
+      ->transact(BnPowerManager::GET_WAKE_LOCK_STATS, data, &reply);
+  if (status != OK) {
+    LOG(ERROR) << "Wake lock stats request failed with status " << status;
+    return false;
+  }
+
+  const int32_t count = reply.readInt32();
+  if (count < 0) {
+    LOG(ERROR) << "Got invalid wake lock stats count " << count;
+    return false;
+  }
+  stats->reserve(count);
+  for (int32_t i = 0; i < count; ++i) {
+    WakeLockStats entry;
+    entry.uid = reply.readInt32();
+    entry.package = String8(reply.readString16()).string();
+    entry.tag = String8(reply.readString16()).string();
+    entry.acquire_count = reply.readInt64();
+    entry.active_count = reply.readInt32();
+    entry.total_hold_time =
+        base::TimeDelta::FromMilliseconds(reply.readInt64());
+    entry.max_hold_time = base::TimeDelta::FromMilliseconds(reply.readInt64());
+    entry.blamed_hold_time =
+        base::TimeDelta::FromMilliseconds(reply.readInt64());
+    stats->push_back(entry);
+  }
+  return true;
+}
+
+bool PowerManagerClient::GetSuspendLatencyStats(SuspendLatencyStats* stats) {
+  DCHECK(power_manager_.get());
+  DCHECK(stats);
+
+  Parcel data, reply;
+  data.writeInterfaceToken(IPowerManager::getInterfaceDescriptor());
+  status_t status = IInterface::asBinder(power_manager_)
+      ->transact(BnPowerManager::GET_SUSPEND_LATENCY_STATS, data, &reply);
+  if (status != OK) {
+    LOG(ERROR) << "Suspend latency stats request failed with status "
+               << status;
+    return false;
+  }
+
+  return ReadLatencyDistribution(reply, &stats->request_to_write) &&
+         ReadLatencyDistribution(reply, &stats->kernel) &&
+         ReadLatencyDistribution(reply, &stats->sleep) &&
+         ReadLatencyDistribution(reply, &stats->resume_to_report);
+}
+
 bool PowerManagerClient::Suspend(base::TimeDelta event_uptime,
                                  SuspendReason reason,
                                  int flags) {
@@ -130,11 +375,254 @@ bool PowerManagerClient::Reboot(RebootReason reason) {
   return true;
 }
 
+bool PowerManagerClient::TriggerReconnectForTesting() {
+  if (!reconnect_timer_.IsRunning())
+    return false;
+
+  reconnect_timer_.Stop();
+  Reconnect();
+  return true;
+}
+
+void PowerManagerClient::AddWakeLock(WakeLock* lock) {
+  wake_locks_.insert(lock);
+}
+
+void PowerManagerClient::RemoveWakeLock(WakeLock* lock) {
+  wake_locks_.erase(lock);
+}
+
+void PowerManagerClient::AddScopedWakeLock(ScopedWakeLock* lock) {
+  scoped_wake_locks_.insert(lock);
+}
+
+void PowerManagerClient::RemoveScopedWakeLock(ScopedWakeLock* lock) {
+  scoped_wake_locks_.erase(lock);
+}
+
+bool PowerManagerClient::AcquireSharedLock(WakeLock* lock) {
+  DCHECK(lock->shared_);
+  if (!power_manager_.get())
+    return false;
+
+  SharedLock& shared = shared_locks_[SharedLockKey(lock->tag_, lock->package_)];
+  if (shared.num_locks > 0) {
+    num_coalesced_acquires_++;
+  } else {
+    shared.binder = GetLockBinder();
+    status_t status = power_manager_->acquireWakeLock(
+        POWERMANAGER_PARTIAL_WAKE_LOCK, shared.binder,
+        String16(lock->tag_.c_str()), String16(lock->package_.c_str()));
+    if (status != OK) {
+      LOG(ERROR) << "Shared wake lock acquire request for \"" << lock->tag_
+                 << "\" failed with status " << status;
+      shared_locks_.erase(SharedLockKey(lock->tag_, lock->package_));
+      return false;
+    }
+    shared.acquired = true;
+  }
+
+  shared.num_locks++;
+  lock->lock_binder_ = shared.binder;
+  return true;
+}
+
+void PowerManagerClient::ReleaseSharedLock(WakeLock* lock) {
+  auto it = shared_locks_.find(SharedLockKey(lock->tag_, lock->package_));
+  DCHECK(it != shared_locks_.end());
+  SharedLock& shared = it->second;
+  if (--shared.num_locks > 0)
+    return;
+
+  ReleaseLockBinder(shared.binder, shared.acquired, lock->tag_);
+  shared_locks_.erase(it);
+}
+
+sp<IBinder> PowerManagerClient::GetLockBinder() {
+  if (binder_pool_.empty()) {
+    binder_pool_stats_.num_created++;
+    return BinderWrapper::Get()->CreateLocalBinder();
+  }
+  sp<IBinder> binder = binder_pool_.back();
+  binder_pool_.pop_back();
+  binder_pool_stats_.num_reused++;
+  return binder;
+}
+
+void PowerManagerClient::ReleaseLockBinder(const sp<IBinder>& binder,
+                                           bool acquired,
+                                           const std::string& tag) {
+  if (!binder.get())
+    return;
+
+  if (!acquired || !power_manager_.get()) {
+    // The current power manager doesn't know about the binder.
+    RecycleLockBinder(binder);
+    return;
+  }
+
+  // When pooling, the release is made synchronously on the IPC thread so that
+  // the binder can be reused once the power manager has dropped it.
+  scoped_refptr<base::SingleThreadTaskRunner> task_runner;
+  if (max_pooled_binders_ > 0)
+    task_runner = GetIpcTaskRunner();
+  if (task_runner.get()) {
+    base::PostTaskAndReplyWithResult(
+        task_runner.get(), FROM_HERE,
+        base::Bind(&ReleaseWakeLockOnIpcThread, power_manager_, binder, tag),
+        base::Bind(&PowerManagerClient::HandleLockBinderRelease,
+                   weak_ptr_factory_.GetWeakPtr(), binder));
+    return;
+  }
+
+  // Otherwise, the release is sent as a one-way call so that destroying the
+  // lock never blocks on the power manager. Binder delivers one-way calls to
+  // the power manager in order, and the binder is never reused, so a later
+  // acquisition from this process can't be undone by this release. At worst
+  // the power manager briefly sees both locks held.
+  status_t status = power_manager_->releaseWakeLock(
+      binder, 0 /* flags */, true /* isOneWay */);
+  if (status != OK) {
+    LOG(ERROR) << "Wake lock release request for \"" << tag << "\" failed "
+               << "with status " << status;
+  }
+}
+
+void PowerManagerClient::HandleLockBinderRelease(const sp<IBinder>& binder,
+                                                 status_t status) {
+  // After a failed release, the power manager may still hold the binder.
+  if (status == OK)
+    RecycleLockBinder(binder);
+}
+
+void PowerManagerClient::RecycleLockBinder(const sp<IBinder>& binder) {
+  if (max_pooled_binders_ == 0)
+    return;
+  if (binder_pool_.size() >= max_pooled_binders_) {
+    binder_pool_stats_.num_discarded++;
+    return;
+  }
+  binder_pool_.push_back(binder);
+  binder_pool_stats_.num_recycled++;
+}
+
+void PowerManagerClient::FlushIpcThreadForTesting() {
+  if (!ipc_thread_.IsRunning())
+    return;
+  base::RunLoop run_loop;
+  ipc_thread_.task_runner()->PostTaskAndReply(
+      FROM_HERE, base::Bind(&base::DoNothing), run_loop.QuitClosure());
+  run_loop.Run();
+}
+
+scoped_refptr<base::SingleThreadTaskRunner>
+PowerManagerClient::GetIpcTaskRunner() {
+  if (!ipc_thread_.IsRunning() && !ipc_thread_.Start()) {
+    LOG(ERROR) << "Failed to start " << ipc_thread_.thread_name() << " thread";
+    return nullptr;
+  }
+  return ipc_thread_.task_runner();
+}
+
 void PowerManagerClient::OnPowerManagerDied() {
-  LOG(WARNING) << "Power manager died";
+  LOG(WARNING) << "Power manager died; "
+               << wake_locks_.size() + scoped_wake_locks_.size()
+               << " wake lock(s) will be re-acquired after reconnecting";
   power_manager_.clear();
-  // TODO: Try to get a new handle periodically; also consider notifying
-  // previously-created WakeLock objects so they can reacquire locks.
+  for (WakeLock* lock : wake_locks_) {
+    if (!lock->shared_)
+      lock->acquired_lock_ = false;
+  }
+  for (ScopedWakeLock* lock : scoped_wake_locks_)
+    lock->acquired_ = false;
+  for (auto& it : shared_locks_)
+    it.second.acquired = false;
+
+  // If the power manager died again before the locks were re-acquired, the
+  // gap started with the first death.
+  if (death_time_.is_null())
+    death_time_ = base::TimeTicks::Now();
+  reconnect_delay_ =
+      base::TimeDelta::FromMilliseconds(kInitialReconnectDelayMs);
+  reconnect_timer_.Start(FROM_HERE, reconnect_delay_,
+                         base::Bind(&PowerManagerClient::Reconnect,
+                                    base::Unretained(this)));
+}
+
+void PowerManagerClient::Reconnect() {
+  if ((power_manager_.get() || Connect()) && ReacquireWakeLocks()) {
+    last_reconnect_gap_ = base::TimeTicks::Now() - death_time_;
+    death_time_ = base::TimeTicks();
+    num_reconnects_++;
+    LOG(INFO) << "Reconnected to power manager and re-acquired "
+              << wake_locks_.size() + scoped_wake_locks_.size()
+              << " wake lock(s) after "
+              << last_reconnect_gap_.InMilliseconds() << " ms";
+    if (!reconnect_callback_.is_null())
+      reconnect_callback_.Run(last_reconnect_gap_);
+    return;
+  }
+
+  reconnect_delay_ =
+      std::min(reconnect_delay_ * 2,
+               base::TimeDelta::FromMilliseconds(kMaxReconnectDelayMs));
+  reconnect_timer_.Start(FROM_HERE, reconnect_delay_,
+                         base::Bind(&PowerManagerClient::Reconnect,
+                                    base::Unretained(this)));
+}
+
+bool PowerManagerClient::ReacquireWakeLocks() {
+  // Requests that were re-acquired by an earlier, partially-successful
+  // attempt are skipped. Locks with timeouts get their full timeouts again,
+  // since the new power manager doesn't know when they were first acquired.
+  std::vector<ReacquireRequest> requests;
+  for (WakeLock* lock : wake_locks_) {
+    if (!lock->shared_ && !lock->acquired_lock_) {
+      requests.push_back(ReacquireRequest{lock->lock_binder_, lock->tag_,
+                                          lock->package_, lock->timeout_,
+                                          &lock->acquired_lock_});
+    }
+  }
+  for (ScopedWakeLock* lock : scoped_wake_locks_) {
+    if (!lock->acquired_) {
+      requests.push_back(ReacquireRequest{lock->binder_, lock->tag_,
+                                          lock->package_, base::TimeDelta(),
+                                          &lock->acquired_});
+    }
+  }
+  for (auto& it : shared_locks_) {
+    if (!it.second.acquired) {
+      requests.push_back(ReacquireRequest{it.second.binder, it.first.first,
+                                          it.first.second, base::TimeDelta(),
+                                          &it.second.acquired});
+    }
+  }
+
+  // Batches are only split if there are more requests than a single
+  // UPDATE_WAKE_LOCKS transaction can hold.
+  const size_t kMaxUpdates =
+      static_cast<size_t>(BnPowerManager::kMaxWakeLockUpdates);
+  for (size_t start = 0; start < requests.size(); start += kMaxUpdates) {
+    const size_t end = std::min(requests.size(), start + kMaxUpdates);
+    Parcel data, reply;
+    data.writeInterfaceToken(IPowerManager::getInterfaceDescriptor());
+    data.writeInt32(end - start);
+    for (size_t i = start; i < end; ++i) {
+      const ReacquireRequest& request = requests[i];
+      WriteAcquireUpdate(&data, request.binder, request.tag, request.package,
+                         request.timeout);
+    }
+    status_t status = IInterface::asBinder(power_manager_)
+        ->transact(BnPowerManager::UPDATE_WAKE_LOCKS, data, &reply);
+    if (status != OK) {
+      LOG(ERROR) << "Wake lock re-acquire request failed with status "
+                 << status;
+      return false;
+    }
+    for (size_t i = start; i < end; ++i)
+      *requests[i].acquired = true;
+  }
+  return true;
 }
 
 }  // namespace android
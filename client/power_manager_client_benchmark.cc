@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares acquiring and releasing N wake locks with individual transactions
+// against doing so with a single UPDATE_WAKE_LOCKS transaction, N overlapping
+// same-tag locks with and without client-side coalescing, creating and
+// destroying N locks with and without pooled binders, and refreshing a lock N
+// times by recreating a WakeLock versus re-acquiring a ScopedWakeLock. All
+// talk to a PowerManagerStub through StubBinderWrapper, so the results reflect
+// the per-transaction overhead in the client and in
+// BnPowerManager::onTransact() rather than kernel binder costs.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/logging.h>
+#include <base/run_loop.h>
+#include <base/strings/stringprintf.h>
+#include <benchmark/benchmark.h>
+#include <binder/IBinder.h>
+#include <binderwrapper/binder_wrapper.h>
+#include <binderwrapper/stub_binder_wrapper.h>
+#include <nativepower/constants.h>
+#include <nativepower/power_manager_client.h>
+#include <nativepower/power_manager_stub.h>
+#include <nativepower/scoped_wake_lock.h>
+#include <nativepower/wake_lock.h>
+
+namespace android {
+namespace {
+
+const char kPackage[] = "com.example.audio";
+
+// Registers a new PowerManagerStub and initializes |client| to talk to it.
+// Returns the stub, which is owned by the returned binder.
+sp<IBinder> InitClient(PowerManagerClient* client, PowerManagerStub** stub) {
+  *stub = new PowerManagerStub();
+  sp<IBinder> binder(*stub);
+  static_cast<StubBinderWrapper*>(BinderWrapper::Get())
+      ->SetBinderForService(kPowerManagerServiceName, binder);
+  CHECK(client->Init());
+  return binder;
+}
+
+// Returns |count| specs with distinct tags.
+std::vector<WakeLockSpec> CreateSpecs(int count) {
+  std::vector<WakeLockSpec> specs;
+  for (int i = 0; i < count; ++i)
+    specs.push_back(WakeLockSpec(base::StringPrintf("stream%d", i), kPackage));
+  return specs;
+}
+
+// Reports the number of transactions received by |stub| per iteration.
+void ReportTransactions(benchmark::State& state, PowerManagerStub* stub) {
+  state.counters["transactions_per_iteration"] =
+      static_cast<double>(stub->num_acquires() + stub->num_one_way_releases()) /
+      state.iterations();
+}
+
+void BM_SingleTransactions(benchmark::State& state) {
+  PowerManagerClient client;
+  PowerManagerStub* stub = nullptr;
+  sp<IBinder> binder = InitClient(&client, &stub);
+  const std::vector<WakeLockSpec> specs = CreateSpecs(state.range(0));
+
+  while (state.KeepRunning()) {
+    std::vector<std::unique_ptr<WakeLock>> locks;
+    for (const WakeLockSpec& spec : specs)
+      locks.push_back(client.CreateWakeLock(spec.tag, spec.package));
+    locks.clear();
+    // Deliver the one-way releases.
+    base::RunLoop().RunUntilIdle();
+  }
+  CHECK_EQ(0, stub->GetNumWakeLocks());
+  state.SetItemsProcessed(state.iterations() * specs.size());
+  ReportTransactions(state, stub);
+}
+BENCHMARK(BM_SingleTransactions)->RangeMultiplier(4)->Range(1, 256);
+
+void BM_BatchedTransaction(benchmark::State& state) {
+  PowerManagerClient client;
+  PowerManagerStub* stub = nullptr;
+  sp<IBinder> binder = InitClient(&client, &stub);
+  const std::vector<WakeLockSpec> specs = CreateSpecs(state.range(0));
+  const std::vector<WakeLockSpec> no_specs;
+
+  while (state.KeepRunning()) {
+    std::vector<std::unique_ptr<WakeLock>> locks, no_locks;
+    CHECK(client.UpdateWakeLocks(specs, &no_locks, &locks));
+    CHECK(client.UpdateWakeLocks(no_specs, &locks, &no_locks));
+  }
+  CHECK_EQ(0, stub->GetNumWakeLocks());
+  state.SetItemsProcessed(state.iterations() * specs.size());
+  state.counters["transactions_per_iteration"] =
+      static_cast<double>(stub->GetNumWakeLockBatches()) / state.iterations();
+}
+BENCHMARK(BM_BatchedTransaction)->RangeMultiplier(4)->Range(1, 256);
+
+// Creates |state.range(0)| overlapping locks with the same tag and then
+// destroys them, with coalescing enabled or disabled per |coalesce|.
+void RunSameTagLocks(benchmark::State& state, bool coalesce) {
+  PowerManagerClient client;
+  client.set_coalesce_wake_locks(coalesce);
+  PowerManagerStub* stub = nullptr;
+  sp<IBinder> binder = InitClient(&client, &stub);
+  const int count = state.range(0);
+
+  while (state.KeepRunning()) {
+    std::vector<std::unique_ptr<WakeLock>> locks;
+    for (int i = 0; i < count; ++i)
+      locks.push_back(client.CreateWakeLock("stream", kPackage));
+    locks.clear();
+    base::RunLoop().RunUntilIdle();
+  }
+  CHECK_EQ(0, stub->GetNumWakeLocks());
+  state.SetItemsProcessed(state.iterations() * count);
+  ReportTransactions(state, stub);
+}
+
+void BM_UncoalescedLocks(benchmark::State& state) {
+  RunSameTagLocks(state, false);
+}
+BENCHMARK(BM_UncoalescedLocks)->RangeMultiplier(4)->Range(1, 256);
+
+void BM_CoalescedLocks(benchmark::State& state) {
+  RunSameTagLocks(state, true);
+}
+BENCHMARK(BM_CoalescedLocks)->RangeMultiplier(4)->Range(1, 256);
+
+// Creates and destroys |state.range(0)| locks one at a time, keeping up to
+// |max_pooled_binders| binders for reuse. Each iteration waits until all
+// releases have been handled.
+void RunCreateDestroy(benchmark::State& state, size_t max_pooled_binders) {
+  PowerManagerClient client;
+  client.set_max_pooled_binders(max_pooled_binders);
+  PowerManagerStub* stub = nullptr;
+  sp<IBinder> binder = InitClient(&client, &stub);
+  const int count = state.range(0);
+
+  while (state.KeepRunning()) {
+    for (int i = 0; i < count; ++i)
+      CHECK(client.CreateWakeLock("stream", kPackage));
+    base::RunLoop().RunUntilIdle();
+    client.FlushIpcThreadForTesting();
+  }
+  CHECK_EQ(0, stub->GetNumWakeLocks());
+  state.SetItemsProcessed(state.iterations() * count);
+  state.counters["binders_created"] = client.binder_pool_stats().num_created;
+}
+
+void BM_UnpooledBinders(benchmark::State& state) {
+  RunCreateDestroy(state, 0);
+}
+BENCHMARK(BM_UnpooledBinders)->RangeMultiplier(4)->Range(1, 256);
+
+void BM_PooledBinders(benchmark::State& state) {
+  RunCreateDestroy(state, 16);
+}
+BENCHMARK(BM_PooledBinders)->RangeMultiplier(4)->Range(1, 256);
+
+// Keeps a lock held across |state.range(0)| events by replacing a
+// heap-allocated WakeLock for each one, as callers of CreateWakeLock() do.
+void BM_RecreatedWakeLock(benchmark::State& state) {
+  PowerManagerClient client;
+  PowerManagerStub* stub = nullptr;
+  sp<IBinder> binder = InitClient(&client, &stub);
+  const int count = state.range(0);
+
+  while (state.KeepRunning()) {
+    std::unique_ptr<WakeLock> lock;
+    for (int i = 0; i < count; ++i)
+      lock = client.CreateWakeLock("stream", kPackage);
+    lock.reset();
+    base::RunLoop().RunUntilIdle();
+  }
+  CHECK_EQ(0, stub->GetNumWakeLocks());
+  state.SetItemsProcessed(state.iterations() * count);
+  ReportTransactions(state, stub);
+}
+BENCHMARK(BM_RecreatedWakeLock)->RangeMultiplier(4)->Range(1, 256);
+
+// Like BM_RecreatedWakeLock, but re-acquires an inline ScopedWakeLock instead.
+void BM_ScopedWakeLock(benchmark::State& state) {
+  PowerManagerClient client;
+  PowerManagerStub* stub = nullptr;
+  sp<IBinder> binder = InitClient(&client, &stub);
+  const int count = state.range(0);
+  ScopedWakeLock lock(&client, "stream", kPackage);
+
+  while (state.KeepRunning()) {
+    for (int i = 0; i < count; ++i)
+      CHECK(lock.Acquire());
+    lock.Release();
+    base::RunLoop().RunUntilIdle();
+  }
+  CHECK_EQ(0, stub->GetNumWakeLocks());
+  state.SetItemsProcessed(state.iterations() * count);
+  ReportTransactions(state, stub);
+}
+BENCHMARK(BM_ScopedWakeLock)->RangeMultiplier(4)->Range(1, 256);
+
+}  // namespace
+}  // namespace android
@@ -14,14 +14,24 @@
  * limitations under the License.
  */
 
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <base/bind.h>
 #include <base/logging.h>
 #include <base/macros.h>
+#include <base/message_loop/message_loop.h>
+#include <base/run_loop.h>
 #include <base/time/time.h>
 #include <binderwrapper/binder_test_base.h>
 #include <binderwrapper/stub_binder_wrapper.h>
 #include <nativepower/constants.h>
 #include <nativepower/power_manager_client.h>
 #include <nativepower/power_manager_stub.h>
+#include <nativepower/suspend_latency_stats.h>
+#include <nativepower/wake_lock.h>
+#include <nativepower/wake_lock_stats.h>
 
 namespace android {
 
@@ -37,6 +47,8 @@ class PowerManagerClientTest : public BinderTestBase {
   ~PowerManagerClientTest() override = default;
 
  protected:
+  // Needed for one-way calls made by WakeLock's destructor.
+  base::MessageLoop message_loop_;
   PowerManagerStub* power_manager_;  // Owned by |power_manager_binder_|.
   sp<IBinder> power_manager_binder_;
   PowerManagerClient client_;
@@ -45,6 +57,347 @@ class PowerManagerClientTest : public BinderTestBase {
   DISALLOW_COPY_AND_ASSIGN(PowerManagerClientTest);
 };
 
+TEST_F(PowerManagerClientTest, GetWakeLockStats) {
+  std::vector<WakeLockStats> stats;
+  ASSERT_TRUE(client_.GetWakeLockStats(&stats));
+  EXPECT_TRUE(stats.empty());
+
+  const uid_t kUid = 123;
+  binder_wrapper()->set_calling_uid(kUid);
+  std::unique_ptr<WakeLock> lock = client_.CreateWakeLock("foo", "bar");
+  ASSERT_TRUE(lock.get());
+
+  ASSERT_TRUE(client_.GetWakeLockStats(&stats));
+  ASSERT_EQ(1u, stats.size());
+  EXPECT_EQ(kUid, stats[0].uid);
+  EXPECT_EQ("bar", stats[0].package);
+  EXPECT_EQ("foo", stats[0].tag);
+  EXPECT_EQ(1, stats[0].acquire_count);
+  EXPECT_EQ(1, stats[0].active_count);
+}
+
+TEST_F(PowerManagerClientTest, GetSuspendLatencyStats) {
+  SuspendLatencyStats stats;
+  ASSERT_TRUE(client_.GetSuspendLatencyStats(&stats));
+  EXPECT_EQ(0, stats.kernel.count);
+  EXPECT_TRUE(stats.kernel.buckets.empty());
+
+  SuspendLatencyStats expected;
+  expected.kernel.count = 3;
+  expected.kernel.max = base::TimeDelta::FromMilliseconds(250);
+  expected.kernel.p99 = base::TimeDelta::FromMilliseconds(250);
+  expected.kernel.buckets.resize(2);
+  expected.kernel.buckets[0].upper_bound =
+      base::TimeDelta::FromMicroseconds(1023);
+  expected.kernel.buckets[0].count = 2;
+  expected.kernel.buckets[1].upper_bound =
+      base::TimeDelta::FromMilliseconds(250);
+  expected.kernel.buckets[1].count = 1;
+  expected.resume_to_report.count = 1;
+  power_manager_->set_suspend_latency_stats(expected);
+
+  ASSERT_TRUE(client_.GetSuspendLatencyStats(&stats));
+  EXPECT_EQ(0, stats.request_to_write.count);
+  EXPECT_EQ(3, stats.kernel.count);
+  EXPECT_EQ(expected.kernel.max, stats.kernel.max);
+  EXPECT_EQ(expected.kernel.p99, stats.kernel.p99);
+  ASSERT_EQ(2u, stats.kernel.buckets.size());
+  EXPECT_EQ(expected.kernel.buckets[1].upper_bound,
+            stats.kernel.buckets[1].upper_bound);
+  EXPECT_EQ(1, stats.kernel.buckets[1].count);
+  EXPECT_EQ(0, stats.sleep.count);
+  EXPECT_EQ(1, stats.resume_to_report.count);
+}
+
+TEST_F(PowerManagerClientTest, UpdateWakeLocks) {
+  std::vector<std::unique_ptr<WakeLock>> locks, released;
+  std::vector<WakeLockSpec> specs;
+  specs.push_back(WakeLockSpec("a", "pkg"));
+  specs.push_back(WakeLockSpec("b", "pkg"));
+  specs[1].timeout = base::TimeDelta::FromSeconds(5);
+  ASSERT_TRUE(client_.UpdateWakeLocks(specs, &released, &locks));
+  ASSERT_EQ(2u, locks.size());
+  EXPECT_EQ(2, power_manager_->GetNumWakeLocks());
+  EXPECT_EQ(1, power_manager_->GetNumWakeLockBatches());
+  ASSERT_EQ(2u, binder_wrapper()->local_binders().size());
+  EXPECT_EQ(base::TimeDelta::FromSeconds(5),
+            power_manager_->GetWakeLockTimeout(
+                binder_wrapper()->local_binders()[1]));
+
+  // Replace the first lock with a new one in a single batch.
+  released.push_back(std::move(locks[0]));
+  locks.erase(locks.begin());
+  specs.resize(1);
+  specs[0] = WakeLockSpec("c", "pkg");
+  ASSERT_TRUE(client_.UpdateWakeLocks(specs, &released, &locks));
+  EXPECT_TRUE(released.empty());
+  ASSERT_EQ(2u, locks.size());
+  EXPECT_EQ(2, power_manager_->GetNumWakeLocks());
+  EXPECT_EQ(2, power_manager_->GetNumWakeLockBatches());
+  EXPECT_EQ("", power_manager_->GetWakeLockString(
+                    binder_wrapper()->local_binders()[0]));
+
+  // Release the remaining locks.
+  released.swap(locks);
+  ASSERT_TRUE(client_.UpdateWakeLocks(std::vector<WakeLockSpec>(), &released,
+                                      &locks));
+  EXPECT_TRUE(locks.empty());
+  EXPECT_EQ(0, power_manager_->GetNumWakeLocks());
+}
+
+// Records the gap reported by PowerManagerClient after reconnecting.
+void RecordReconnectGap(std::vector<base::TimeDelta>* gaps,
+                        base::TimeDelta gap) {
+  gaps->push_back(gap);
+}
+
+TEST_F(PowerManagerClientTest, ReconnectAfterDeath) {
+  std::vector<base::TimeDelta> gaps;
+  client_.set_reconnect_callback(base::Bind(&RecordReconnectGap, &gaps));
+  std::unique_ptr<WakeLock> lock1 = client_.CreateWakeLock("a", "pkg");
+  std::unique_ptr<WakeLock> lock2 = client_.CreateWakeLockWithTimeout(
+      "b", "pkg", base::TimeDelta::FromSeconds(5));
+  std::unique_ptr<WakeLock> lock3 = client_.CreateWakeLock("c", "pkg");
+  ASSERT_TRUE(lock1 && lock2 && lock3);
+  ASSERT_EQ(3u, binder_wrapper()->local_binders().size());
+  EXPECT_FALSE(client_.TriggerReconnectForTesting());
+
+  // While the service is unavailable, reconnection attempts should fail.
+  binder_wrapper()->SetBinderForService(kPowerManagerServiceName,
+                                        sp<IBinder>());
+  binder_wrapper()->NotifyAboutBinderDeath(power_manager_binder_);
+  EXPECT_FALSE(client_.power_manager().get());
+  EXPECT_TRUE(client_.TriggerReconnectForTesting());
+  EXPECT_FALSE(client_.power_manager().get());
+  EXPECT_EQ(0, client_.num_reconnects());
+
+  // A lock destroyed in the meantime shouldn't be released or re-acquired.
+  lock3.reset();
+
+  // Once the power manager is back, the remaining locks should be re-acquired
+  // in a single batch.
+  PowerManagerStub* new_power_manager = new PowerManagerStub();
+  sp<IBinder> new_power_manager_binder(new_power_manager);
+  binder_wrapper()->SetBinderForService(kPowerManagerServiceName,
+                                        new_power_manager_binder);
+  EXPECT_TRUE(client_.TriggerReconnectForTesting());
+  EXPECT_TRUE(client_.power_manager().get());
+  EXPECT_EQ(2, new_power_manager->GetNumWakeLocks());
+  EXPECT_EQ(1, new_power_manager->GetNumWakeLockBatches());
+  EXPECT_EQ(base::TimeDelta::FromSeconds(5),
+            new_power_manager->GetWakeLockTimeout(
+                binder_wrapper()->local_binders()[1]));
+  EXPECT_EQ("", new_power_manager->GetWakeLockString(
+                    binder_wrapper()->local_binders()[2]));
+  EXPECT_EQ(1, client_.num_reconnects());
+  ASSERT_EQ(1u, gaps.size());
+  EXPECT_EQ(client_.last_reconnect_gap(), gaps[0]);
+  EXPECT_GE(gaps[0], base::TimeDelta());
+  EXPECT_FALSE(client_.TriggerReconnectForTesting());
+
+  // The old instance shouldn't have been contacted.
+  EXPECT_EQ(0, power_manager_->num_one_way_releases());
+
+  // Destroying the locks should release them from the new instance.
+  lock1.reset();
+  lock2.reset();
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(0, new_power_manager->GetNumWakeLocks());
+  EXPECT_EQ(2, new_power_manager->num_one_way_releases());
+}
+
+TEST_F(PowerManagerClientTest, CoalesceWakeLocks) {
+  client_.set_coalesce_wake_locks(true);
+
+  // Locks with the same tag and package should share a single request.
+  std::unique_ptr<WakeLock> lock1 = client_.CreateWakeLock("a", "pkg");
+  std::unique_ptr<WakeLock> lock2 = client_.CreateWakeLock("a", "pkg");
+  std::unique_ptr<WakeLock> lock3 = client_.CreateWakeLock("a", "pkg");
+  ASSERT_TRUE(lock1 && lock2 && lock3);
+  EXPECT_EQ(1, power_manager_->num_acquires());
+  EXPECT_EQ(1, power_manager_->GetNumWakeLocks());
+  EXPECT_EQ(2, client_.num_coalesced_acquires());
+  ASSERT_EQ(1u, binder_wrapper()->local_binders().size());
+
+  // Different tags, different packages, and timeouts get their own requests.
+  std::unique_ptr<WakeLock> other_tag = client_.CreateWakeLock("b", "pkg");
+  std::unique_ptr<WakeLock> other_package =
+      client_.CreateWakeLock("a", "pkg2");
+  std::unique_ptr<WakeLock> timed = client_.CreateWakeLockWithTimeout(
+      "a", "pkg", base::TimeDelta::FromSeconds(5));
+  ASSERT_TRUE(other_tag && other_package && timed);
+  EXPECT_EQ(4, power_manager_->num_acquires());
+  EXPECT_EQ(4, power_manager_->GetNumWakeLocks());
+  EXPECT_EQ(2, client_.num_coalesced_acquires());
+  other_tag.reset();
+  other_package.reset();
+  timed.reset();
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(3, power_manager_->num_one_way_releases());
+
+  // The shared request should survive until the last lock is destroyed.
+  lock1.reset();
+  lock3.reset();
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(1, power_manager_->GetNumWakeLocks());
+  EXPECT_EQ(3, power_manager_->num_one_way_releases());
+
+  // After a restart, the shared request should be re-acquired once.
+  std::unique_ptr<WakeLock> lock4 = client_.CreateWakeLock("a", "pkg");
+  ASSERT_TRUE(lock4);
+  EXPECT_EQ(3, client_.num_coalesced_acquires());
+  binder_wrapper()->NotifyAboutBinderDeath(power_manager_binder_);
+  PowerManagerStub* new_power_manager = new PowerManagerStub();
+  sp<IBinder> new_power_manager_binder(new_power_manager);
+  binder_wrapper()->SetBinderForService(kPowerManagerServiceName,
+                                        new_power_manager_binder);
+  EXPECT_TRUE(client_.TriggerReconnectForTesting());
+  EXPECT_EQ(1, new_power_manager->GetNumWakeLocks());
+  EXPECT_EQ(1, new_power_manager->GetNumWakeLockBatches());
+
+  lock2.reset();
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(1, new_power_manager->GetNumWakeLocks());
+  lock4.reset();
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(0, new_power_manager->GetNumWakeLocks());
+  EXPECT_EQ(1, new_power_manager->num_one_way_releases());
+
+  // A new lock with the same tag should use a new binder, since the old one's
+  // release may still be in flight.
+  const size_t num_binders = binder_wrapper()->local_binders().size();
+  std::unique_ptr<WakeLock> lock5 = client_.CreateWakeLock("a", "pkg");
+  ASSERT_TRUE(lock5);
+  EXPECT_EQ(num_binders + 1, binder_wrapper()->local_binders().size());
+  EXPECT_EQ(1, new_power_manager->GetNumWakeLocks());
+}
+
+// Records the result of an asynchronous acquisition and stops |run_loop|.
+void RecordAcquireResult(base::RunLoop* run_loop,
+                         std::vector<bool>* results,
+                         bool success) {
+  results->push_back(success);
+  run_loop->Quit();
+}
+
+TEST_F(PowerManagerClientTest, CreateWakeLockAsync) {
+  const uid_t kUid = 123;
+  binder_wrapper()->set_calling_uid(kUid);
+  power_manager_->set_acquire_latency(base::TimeDelta::FromMilliseconds(50));
+  std::vector<bool> results;
+
+  // The lock should be returned before the power manager sees it.
+  base::RunLoop run_loop;
+  std::unique_ptr<WakeLock> lock = client_.CreateWakeLockAsync(
+      "a", "pkg", base::TimeDelta(),
+      base::Bind(&RecordAcquireResult, &run_loop, &results));
+  ASSERT_TRUE(lock);
+  EXPECT_TRUE(results.empty());
+  run_loop.Run();
+  ASSERT_EQ(1u, results.size());
+  EXPECT_TRUE(results[0]);
+  EXPECT_EQ(1, power_manager_->GetNumWakeLocks());
+  ASSERT_EQ(1u, binder_wrapper()->local_binders().size());
+  EXPECT_EQ(PowerManagerStub::ConstructWakeLockString("a", "pkg", kUid),
+            power_manager_->GetWakeLockString(
+                binder_wrapper()->local_binders()[0]));
+
+  // Destroying a completed lock should release it normally.
+  lock.reset();
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(0, power_manager_->GetNumWakeLocks());
+  EXPECT_EQ(1, power_manager_->num_one_way_releases());
+
+  // A lock destroyed before its acquisition completes should be released once
+  // the acquisition finishes, and its callback shouldn't run. Requests are
+  // handled in order, so the second lock's callback runs after the first lock
+  // has been released.
+  std::unique_ptr<WakeLock> early_lock = client_.CreateWakeLockAsync(
+      "b", "pkg", base::TimeDelta(),
+      base::Bind(&RecordAcquireResult, &run_loop, &results));
+  ASSERT_TRUE(early_lock);
+  early_lock.reset();
+  base::RunLoop second_run_loop;
+  std::unique_ptr<WakeLock> timed_lock = client_.CreateWakeLockAsync(
+      "c", "pkg", base::TimeDelta::FromSeconds(5),
+      base::Bind(&RecordAcquireResult, &second_run_loop, &results));
+  ASSERT_TRUE(timed_lock);
+  second_run_loop.Run();
+  base::RunLoop().RunUntilIdle();
+  ASSERT_EQ(2u, results.size());
+  EXPECT_TRUE(results[1]);
+  EXPECT_EQ(3, power_manager_->num_acquires());
+  EXPECT_EQ(1, power_manager_->GetNumWakeLocks());
+  ASSERT_EQ(3u, binder_wrapper()->local_binders().size());
+  EXPECT_EQ("", power_manager_->GetWakeLockString(
+                    binder_wrapper()->local_binders()[1]));
+  EXPECT_EQ(base::TimeDelta::FromSeconds(5),
+            power_manager_->GetWakeLockTimeout(
+                binder_wrapper()->local_binders()[2]));
+
+  // Without a connection, no lock should be returned.
+  binder_wrapper()->NotifyAboutBinderDeath(power_manager_binder_);
+  EXPECT_FALSE(client_.CreateWakeLockAsync(
+      "d", "pkg", base::TimeDelta(),
+      base::Bind(&RecordAcquireResult, &run_loop, &results)));
+}
+
+TEST_F(PowerManagerClientTest, PoolBinders) {
+  const uid_t kUid = 123;
+  binder_wrapper()->set_calling_uid(kUid);
+  client_.set_max_pooled_binders(2);
+
+  // Binders should be pooled once the power manager confirms their release.
+  std::unique_ptr<WakeLock> lock1 = client_.CreateWakeLock("a", "pkg");
+  std::unique_ptr<WakeLock> lock2 = client_.CreateWakeLock("b", "pkg");
+  std::unique_ptr<WakeLock> lock3 = client_.CreateWakeLock("c", "pkg");
+  ASSERT_TRUE(lock1 && lock2 && lock3);
+  EXPECT_EQ(3, client_.binder_pool_stats().num_created);
+  lock1.reset();
+  lock2.reset();
+  lock3.reset();
+  EXPECT_EQ(0u, client_.num_pooled_binders());
+  client_.FlushIpcThreadForTesting();
+  EXPECT_EQ(0, power_manager_->GetNumWakeLocks());
+  EXPECT_EQ(0, power_manager_->num_one_way_releases());
+  EXPECT_EQ(2u, client_.num_pooled_binders());
+  EXPECT_EQ(2, client_.binder_pool_stats().num_recycled);
+  EXPECT_EQ(1, client_.binder_pool_stats().num_discarded);
+
+  // New locks should use pooled binders before creating more.
+  lock1 = client_.CreateWakeLock("d", "pkg");
+  lock2 = client_.CreateWakeLock("e", "pkg");
+  lock3 = client_.CreateWakeLock("f", "pkg");
+  ASSERT_TRUE(lock1 && lock2 && lock3);
+  EXPECT_EQ(0u, client_.num_pooled_binders());
+  EXPECT_EQ(2, client_.binder_pool_stats().num_reused);
+  EXPECT_EQ(4, client_.binder_pool_stats().num_created);
+  ASSERT_EQ(4u, binder_wrapper()->local_binders().size());
+  EXPECT_EQ(3, power_manager_->GetNumWakeLocks());
+  EXPECT_EQ(PowerManagerStub::ConstructWakeLockString("d", "pkg", kUid),
+            power_manager_->GetWakeLockString(
+                binder_wrapper()->local_binders()[1]));
+  EXPECT_EQ(PowerManagerStub::ConstructWakeLockString("e", "pkg", kUid),
+            power_manager_->GetWakeLockString(
+                binder_wrapper()->local_binders()[0]));
+
+  // UpdateWakeLocks() releases synchronously, so its binders should be pooled
+  // right away.
+  std::vector<std::unique_ptr<WakeLock>> locks, created;
+  locks.push_back(std::move(lock1));
+  locks.push_back(std::move(lock2));
+  ASSERT_TRUE(client_.UpdateWakeLocks(std::vector<WakeLockSpec>(), &locks,
+                                      &created));
+  EXPECT_EQ(1, power_manager_->GetNumWakeLocks());
+  EXPECT_EQ(2u, client_.num_pooled_binders());
+  EXPECT_EQ(4, client_.binder_pool_stats().num_recycled);
+
+  // Without a power manager, there's nothing to release, but the pool is full.
+  binder_wrapper()->NotifyAboutBinderDeath(power_manager_binder_);
+  lock3.reset();
+  EXPECT_EQ(2, client_.binder_pool_stats().num_discarded);
+}
+
 TEST_F(PowerManagerClientTest, Suspend) {
   EXPECT_EQ(0, power_manager_->num_suspend_requests());
 
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <nativepower/scoped_wake_lock.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <base/bind.h>
+#include <base/location.h>
+#include <base/logging.h>
+#include <binder/IBinder.h>
+#include <nativepower/power_manager_client.h>
+#include <powermanager/IPowerManager.h>
+#include <powermanager/PowerManager.h>
+#include <utils/String16.h>
+
+namespace android {
+
+ScopedWakeLock::ScopedWakeLock()
+    : client_(nullptr),
+      held_(false),
+      acquired_(false),
+      release_sent_(false) {}
+
+ScopedWakeLock::ScopedWakeLock(PowerManagerClient* client,
+                               const std::string& tag,
+                               const std::string& package)
+    : client_(client),
+      tag_(tag),
+      package_(package),
+      held_(false),
+      acquired_(false),
+      release_sent_(false) {
+  DCHECK(client_);
+}
+
+ScopedWakeLock::ScopedWakeLock(ScopedWakeLock&& other)
+    : client_(nullptr),
+      held_(false),
+      acquired_(false),
+      release_sent_(false) {
+  TakeFrom(&other);
+}
+
+ScopedWakeLock& ScopedWakeLock::operator=(ScopedWakeLock&& other) {
+  if (this != &other) {
+    ReleaseBinder();
+    TakeFrom(&other);
+  }
+  return *this;
+}
+
+ScopedWakeLock::~ScopedWakeLock() {
+  ReleaseBinder();
+}
+
+bool ScopedWakeLock::Acquire() {
+  if (!client_) {
+    LOG(ERROR) << "Can't acquire empty wake lock";
+    return false;
+  }
+  timeout_timer_.Stop();
+  if (held_)
+    return true;
+
+  sp<IPowerManager> power_manager = client_->power_manager();
+  if (!power_manager.get()) {
+    LOG(ERROR) << "Can't acquire wake lock for \"" << tag_ << "\"; no "
+               << "connection to power manager";
+    return false;
+  }
+
+  // The binder is kept across acquisitions, including failed ones.
+  if (!binder_.get())
+    binder_ = client_->GetLockBinder();
+  status_t status = power_manager->acquireWakeLock(
+      POWERMANAGER_PARTIAL_WAKE_LOCK, binder_, String16(tag_.c_str()),
+      String16(package_.c_str()), release_sent_ /* isOneWay */);
+  if (status != OK) {
+    LOG(ERROR) << "Wake lock acquire request for \"" << tag_ << "\" failed "
+               << "with status " << status;
+    return false;
+  }
+
+  held_ = true;
+  acquired_ = true;
+  client_->AddScopedWakeLock(this);
+  return true;
+}
+
+bool ScopedWakeLock::AcquireWithTimeout(base::TimeDelta timeout) {
+  if (!Acquire())
+    return false;
+  StartTimeoutTimer(timeout);
+  return true;
+}
+
+void ScopedWakeLock::Release() {
+  timeout_timer_.Stop();
+  if (!held_)
+    return;
+
+  held_ = false;
+  client_->RemoveScopedWakeLock(this);
+  // The binder is kept for the next acquisition. The release is sent one-way
+  // so that it doesn't wait for the power manager; see |release_sent_|.
+  sp<IPowerManager> power_manager = client_->power_manager();
+  if (acquired_ && power_manager.get()) {
+    status_t status = power_manager->releaseWakeLock(
+        binder_, 0 /* flags */, true /* isOneWay */);
+    if (status != OK) {
+      LOG(ERROR) << "Wake lock release request for \"" << tag_ << "\" failed "
+                 << "with status " << status;
+    }
+    release_sent_ = true;
+  }
+  acquired_ = false;
+}
+
+void ScopedWakeLock::ReleaseBinder() {
+  // Once a one-way release has been sent, the power manager may still hold
+  // the binder, so it's dropped instead of being pooled.
+  if (release_sent_) {
+    Release();
+  } else {
+    timeout_timer_.Stop();
+    if (held_)
+      client_->RemoveScopedWakeLock(this);
+    if (client_)
+      client_->ReleaseLockBinder(binder_, acquired_, tag_);
+  }
+  binder_.clear();
+  held_ = false;
+  acquired_ = false;
+  release_sent_ = false;
+}
+
+void ScopedWakeLock::TakeFrom(ScopedWakeLock* other) {
+  DCHECK(!held_);
+  client_ = other->client_;
+  tag_ = std::move(other->tag_);
+  package_ = std::move(other->package_);
+  binder_ = other->binder_;
+  held_ = other->held_;
+  acquired_ = other->acquired_;
+  release_sent_ = other->release_sent_;
+  if (other->timeout_timer_.IsRunning()) {
+    StartTimeoutTimer(std::max(
+        other->timeout_timer_.desired_run_time() - base::TimeTicks::Now(),
+        base::TimeDelta()));
+  }
+
+  if (held_) {
+    client_->RemoveScopedWakeLock(other);
+    client_->AddScopedWakeLock(this);
+  }
+  other->timeout_timer_.Stop();
+  other->client_ = nullptr;
+  other->tag_.clear();
+  other->package_.clear();
+  other->binder_.clear();
+  other->held_ = false;
+  other->acquired_ = false;
+  other->release_sent_ = false;
+}
+
+void ScopedWakeLock::StartTimeoutTimer(base::TimeDelta delay) {
+  timeout_timer_.Start(FROM_HERE, delay,
+                       base::Bind(&ScopedWakeLock::Release,
+                                  base::Unretained(this)));
+}
+
+}  // namespace android
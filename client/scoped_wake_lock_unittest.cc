@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utility>
+
+#include <base/logging.h>
+#include <base/macros.h>
+#include <base/message_loop/message_loop.h>
+#include <base/run_loop.h>
+#include <base/time/time.h>
+#include <binder/IBinder.h>
+#include <binderwrapper/binder_test_base.h>
+#include <binderwrapper/stub_binder_wrapper.h>
+#include <nativepower/constants.h>
+#include <nativepower/power_manager_client.h>
+#include <nativepower/power_manager_stub.h>
+#include <nativepower/scoped_wake_lock.h>
+
+namespace android {
+
+class ScopedWakeLockTest : public BinderTestBase {
+ public:
+  ScopedWakeLockTest()
+      : power_manager_(new PowerManagerStub()),
+        power_manager_binder_(power_manager_) {
+    binder_wrapper()->SetBinderForService(kPowerManagerServiceName,
+                                          power_manager_binder_);
+    CHECK(client_.Init());
+  }
+  ~ScopedWakeLockTest() override = default;
+
+ protected:
+  // Delivers one-way calls queued by |power_manager_| and runs timers with
+  // zero delays.
+  void RunLoop() { base::RunLoop().RunUntilIdle(); }
+
+  base::MessageLoop message_loop_;
+  PowerManagerStub* power_manager_;  // Owned by |power_manager_binder_|.
+  sp<IBinder> power_manager_binder_;
+  PowerManagerClient client_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ScopedWakeLockTest);
+};
+
+TEST_F(ScopedWakeLockTest, AcquireAndRelease) {
+  const uid_t kUid = 123;
+  binder_wrapper()->set_calling_uid(kUid);
+
+  // The lock shouldn't be acquired until it's requested.
+  ScopedWakeLock lock(&client_, "foo", "bar");
+  EXPECT_FALSE(lock.is_held());
+  EXPECT_EQ(0, power_manager_->num_acquires());
+
+  ASSERT_TRUE(lock.Acquire());
+  EXPECT_TRUE(lock.is_held());
+  ASSERT_EQ(1, power_manager_->GetNumWakeLocks());
+  ASSERT_EQ(1u, binder_wrapper()->local_binders().size());
+  EXPECT_EQ(
+      PowerManagerStub::ConstructWakeLockString("foo", "bar", kUid),
+      power_manager_->GetWakeLockString(binder_wrapper()->local_binders()[0]));
+
+  // Acquiring a held lock shouldn't contact the power manager.
+  ASSERT_TRUE(lock.Acquire());
+  EXPECT_EQ(1, power_manager_->num_acquires());
+
+  lock.Release();
+  EXPECT_FALSE(lock.is_held());
+  RunLoop();
+  EXPECT_EQ(0, power_manager_->GetNumWakeLocks());
+  EXPECT_EQ(1, power_manager_->num_one_way_releases());
+  lock.Release();
+  EXPECT_EQ(1, power_manager_->num_one_way_releases());
+
+  // The lock should be re-acquired with the same binder. The acquisition is
+  // sent one-way so that it's handled after the earlier release.
+  ASSERT_TRUE(lock.Acquire());
+  EXPECT_EQ(1, power_manager_->num_one_way_acquires());
+  RunLoop();
+  EXPECT_EQ(1, power_manager_->GetNumWakeLocks());
+  ASSERT_EQ(1u, binder_wrapper()->local_binders().size());
+  EXPECT_EQ(
+      PowerManagerStub::ConstructWakeLockString("foo", "bar", kUid),
+      power_manager_->GetWakeLockString(binder_wrapper()->local_binders()[0]));
+
+  // A release that's still queued shouldn't undo the next acquisition.
+  lock.Release();
+  ASSERT_TRUE(lock.Acquire());
+  RunLoop();
+  EXPECT_EQ(1, power_manager_->GetNumWakeLocks());
+  EXPECT_EQ(1u, binder_wrapper()->local_binders().size());
+
+  // An empty lock can't be acquired.
+  ScopedWakeLock empty_lock;
+  EXPECT_FALSE(empty_lock.Acquire());
+}
+
+TEST_F(ScopedWakeLockTest, Move) {
+  ScopedWakeLock lock1(&client_, "a", "pkg");
+  ASSERT_TRUE(lock1.Acquire());
+
+  // Moving a held lock shouldn't contact the power manager.
+  ScopedWakeLock lock2(std::move(lock1));
+  EXPECT_FALSE(lock1.is_held());
+  EXPECT_TRUE(lock2.is_held());
+  EXPECT_FALSE(lock1.Acquire());
+  EXPECT_EQ(1, power_manager_->num_acquires());
+  EXPECT_EQ(1, power_manager_->GetNumWakeLocks());
+
+  // Assigning to a held lock should release its previous lock.
+  ScopedWakeLock lock3(&client_, "b", "pkg");
+  ASSERT_TRUE(lock3.Acquire());
+  lock3 = std::move(lock2);
+  EXPECT_FALSE(lock2.is_held());
+  EXPECT_TRUE(lock3.is_held());
+  RunLoop();
+  EXPECT_EQ(1, power_manager_->GetNumWakeLocks());
+  EXPECT_EQ(
+      "", power_manager_->GetWakeLockString(
+              binder_wrapper()->local_binders()[1]));
+
+  // The moved lock should still be re-acquired after a restart.
+  binder_wrapper()->NotifyAboutBinderDeath(power_manager_binder_);
+  PowerManagerStub* new_power_manager = new PowerManagerStub();
+  sp<IBinder> new_power_manager_binder(new_power_manager);
+  binder_wrapper()->SetBinderForService(kPowerManagerServiceName,
+                                        new_power_manager_binder);
+  EXPECT_TRUE(client_.TriggerReconnectForTesting());
+  EXPECT_EQ(1, new_power_manager->GetNumWakeLocks());
+  EXPECT_NE("", new_power_manager->GetWakeLockString(
+                    binder_wrapper()->local_binders()[0]));
+
+  // Destroying the lock should release it from the new instance.
+  {
+    ScopedWakeLock lock4(std::move(lock3));
+  }
+  RunLoop();
+  EXPECT_EQ(0, new_power_manager->GetNumWakeLocks());
+  EXPECT_EQ(1, new_power_manager->num_one_way_releases());
+}
+
+TEST_F(ScopedWakeLockTest, Timeout) {
+  ScopedWakeLock lock(&client_, "foo", "bar");
+  ASSERT_TRUE(lock.AcquireWithTimeout(base::TimeDelta()));
+  EXPECT_EQ(1, power_manager_->GetNumWakeLocks());
+  RunLoop();
+  EXPECT_FALSE(lock.is_held());
+  RunLoop();
+  EXPECT_EQ(0, power_manager_->GetNumWakeLocks());
+
+  // Acquire() should cancel the timeout, and a moved lock should keep it.
+  ASSERT_TRUE(lock.AcquireWithTimeout(base::TimeDelta()));
+  ASSERT_TRUE(lock.Acquire());
+  RunLoop();
+  EXPECT_TRUE(lock.is_held());
+  ASSERT_TRUE(lock.AcquireWithTimeout(base::TimeDelta()));
+  EXPECT_EQ(2, power_manager_->num_acquires());
+  ScopedWakeLock moved_lock(std::move(lock));
+  RunLoop();
+  EXPECT_FALSE(moved_lock.is_held());
+  RunLoop();
+  EXPECT_EQ(0, power_manager_->GetNumWakeLocks());
+}
+
+}  // namespace android
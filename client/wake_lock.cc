@@ -16,34 +16,126 @@
 
 #include <nativepower/wake_lock.h>
 
+#include <base/bind.h>
+#include <base/location.h>
 #include <base/logging.h>
-#include <binderwrapper/binder_wrapper.h>
+#include <binder/Parcel.h>
+#include <nativepower/BnPowerManager.h>
 #include <nativepower/power_manager_client.h>
 #include <powermanager/IPowerManager.h>
 #include <powermanager/PowerManager.h>
 
 namespace android {
+namespace {
+
+// Sends BnPowerManager::ACQUIRE_WAKE_LOCK_WITH_TIMEOUT, which isn't part of
+// IPowerManager, to |power_manager|.
+status_t AcquireWakeLockWithTimeout(const sp<IPowerManager>& power_manager,
+                                    int flags,
+                                    const sp<IBinder>& lock,
+                                    const String16& tag,
+                                    const String16& package_name,
+                                    base::TimeDelta timeout) {
+  Parcel data, reply;
+  data.writeInterfaceToken(IPowerManager::getInterfaceDescriptor());
+  data.writeStrongBinder(lock);
+  data.writeInt32(flags);
+  data.writeString16(tag);
+  data.writeString16(package_name);
+  // Rounding up keeps sub-millisecond timeouts from being sent as zero.
+  data.writeInt64(timeout.InMillisecondsRoundedUp());
+  return IInterface::asBinder(power_manager)
+      ->transact(BnPowerManager::ACQUIRE_WAKE_LOCK_WITH_TIMEOUT, data, &reply);
+}
+
+// Acquires |lock| from |power_manager|, with a timeout if |timeout| is
+// positive.
+status_t AcquireWakeLock(const sp<IPowerManager>& power_manager,
+                         const sp<IBinder>& lock,
+                         const std::string& tag,
+                         const std::string& package,
+                         base::TimeDelta timeout) {
+  if (timeout > base::TimeDelta()) {
+    return AcquireWakeLockWithTimeout(
+        power_manager, POWERMANAGER_PARTIAL_WAKE_LOCK, lock,
+        String16(tag.c_str()), String16(package.c_str()), timeout);
+  }
+  return power_manager->acquireWakeLock(
+      POWERMANAGER_PARTIAL_WAKE_LOCK,
+      lock, String16(tag.c_str()), String16(package.c_str()));
+}
+
+}  // namespace
+
+struct WakeLock::AsyncRequest
+    : public base::RefCountedThreadSafe<AsyncRequest> {
+  AsyncRequest(const sp<IPowerManager>& power_manager,
+               const sp<IBinder>& lock,
+               const std::string& tag,
+               const std::string& package,
+               base::TimeDelta timeout)
+      : power_manager(power_manager),
+        lock(lock),
+        tag(tag),
+        package(package),
+        timeout(timeout),
+        status(NO_INIT) {}
+
+  // Instance that the request is sent to.
+  const sp<IPowerManager> power_manager;
+
+  const sp<IBinder> lock;
+  const std::string tag;
+  const std::string package;
+  const base::TimeDelta timeout;
+
+  // Result of the request. Written by SendAsyncAcquire() and read by tasks
+  // that run after it.
+  status_t status;
+
+ private:
+  friend class base::RefCountedThreadSafe<AsyncRequest>;
+  ~AsyncRequest() = default;
+
+  DISALLOW_COPY_AND_ASSIGN(AsyncRequest);
+};
 
 WakeLock::WakeLock(const std::string& tag,
                    const std::string& package,
+                   base::TimeDelta timeout,
                    PowerManagerClient* client)
     : acquired_lock_(false),
+      shared_(false),
       tag_(tag),
       package_(package),
-      client_(client) {
+      timeout_(timeout),
+      client_(client),
+      weak_ptr_factory_(this) {
   DCHECK(client_);
+  client_->AddWakeLock(this);
 }
 
 WakeLock::~WakeLock() {
-  sp<IPowerManager> power_manager = client_->power_manager();
-  if (acquired_lock_ && power_manager.get()) {
-    status_t status =
-        power_manager->releaseWakeLock(lock_binder_, 0 /* flags */);
-    if (status != OK) {
-      LOG(ERROR) << "Wake lock release request for \"" << tag_ << "\" failed "
-                 << "with status " << status;
-    }
+  if (pending_request_.get()) {
+    // The acquisition is still in flight, so release the lock from the IPC
+    // thread once it completes. The lock may also be released below if the
+    // power manager restarted and the lock was re-acquired in the meantime.
+    scoped_refptr<base::SingleThreadTaskRunner> task_runner =
+        client_->GetIpcTaskRunner();
+    DCHECK(task_runner.get());
+    task_runner->PostTask(
+        FROM_HERE, base::Bind(&WakeLock::SendAsyncRelease, pending_request_));
+  }
+
+  if (shared_) {
+    if (acquired_lock_)
+      client_->ReleaseSharedLock(this);
+  } else if (acquired_lock_ || !pending_request_.get()) {
+    // A binder still owned by an in-flight request isn't released (or reused)
+    // here unless the lock was re-acquired after the power manager restarted.
+    client_->ReleaseLockBinder(lock_binder_, acquired_lock_, tag_);
   }
+  client_->RemoveWakeLock(this);
 }
 
 bool WakeLock::Init() {
@@ -54,10 +146,14 @@ bool WakeLock::Init() {
     return false;
   }
 
-  lock_binder_ = BinderWrapper::Get()->CreateLocalBinder();
-  status_t status = power_manager->acquireWakeLock(
-      POWERMANAGER_PARTIAL_WAKE_LOCK,
-      lock_binder_, String16(tag_.c_str()), String16(package_.c_str()));
+  if (shared_) {
+    acquired_lock_ = client_->AcquireSharedLock(this);
+    return acquired_lock_;
+  }
+
+  lock_binder_ = client_->GetLockBinder();
+  status_t status =
+      AcquireWakeLock(power_manager, lock_binder_, tag_, package_, timeout_);
   if (status != OK) {
     LOG(ERROR) << "Wake lock acquire request for \"" << tag_ << "\" failed "
                << "with status " << status;
@@ -68,4 +164,63 @@ bool WakeLock::Init() {
   return true;
 }
 
+bool WakeLock::InitAsync(const base::Callback<void(bool)>& callback) {
+  sp<IPowerManager> power_manager = client_->power_manager();
+  if (!power_manager.get()) {
+    LOG(ERROR) << "Can't acquire wake lock for \"" << tag_ << "\"; no "
+               << "connection to power manager";
+    return false;
+  }
+  scoped_refptr<base::SingleThreadTaskRunner> task_runner =
+      client_->GetIpcTaskRunner();
+  if (!task_runner.get())
+    return false;
+
+  lock_binder_ = client_->GetLockBinder();
+  pending_request_ =
+      new AsyncRequest(power_manager, lock_binder_, tag_, package_, timeout_);
+  return task_runner->PostTaskAndReply(
+      FROM_HERE, base::Bind(&WakeLock::SendAsyncAcquire, pending_request_),
+      base::Bind(&WakeLock::HandleAsyncAcquire,
+                 weak_ptr_factory_.GetWeakPtr(), callback));
+}
+
+// static
+void WakeLock::SendAsyncAcquire(const scoped_refptr<AsyncRequest>& request) {
+  request->status =
+      AcquireWakeLock(request->power_manager, request->lock, request->tag,
+                      request->package, request->timeout);
+}
+
+// static
+void WakeLock::SendAsyncRelease(const scoped_refptr<AsyncRequest>& request) {
+  if (request->status != OK)
+    return;
+
+  // This thread never needs to avoid blocking, so the release is synchronous.
+  status_t status = request->power_manager->releaseWakeLock(
+      request->lock, 0 /* flags */, false /* isOneWay */);
+  if (status != OK) {
+    LOG(ERROR) << "Wake lock release request for \"" << request->tag
+               << "\" failed with status " << status;
+  }
+}
+
+void WakeLock::HandleAsyncAcquire(const base::Callback<void(bool)>& callback) {
+  scoped_refptr<AsyncRequest> request;
+  request.swap(pending_request_);
+  DCHECK(request.get());
+
+  if (request->status != OK) {
+    LOG(ERROR) << "Wake lock acquire request for \"" << tag_ << "\" failed "
+               << "with status " << request->status;
+  } else if (request->power_manager.get() == client_->power_manager().get()) {
+    acquired_lock_ = true;
+  }
+  // Otherwise, the power manager died while the request was in flight, and
+  // PowerManagerClient re-acquires the lock (or already did so) from the new
+  // instance.
+  callback.Run(acquired_lock_);
+}
+
 }  // namespace android
@@ -18,6 +18,9 @@
 
 #include <base/logging.h>
 #include <base/macros.h>
+#include <base/message_loop/message_loop.h>
+#include <base/run_loop.h>
+#include <base/time/time.h>
 #include <binder/Binder.h>
 #include <binder/IBinder.h>
 #include <binderwrapper/binder_test_base.h>
@@ -41,6 +44,10 @@ class WakeLockTest : public BinderTestBase {
   ~WakeLockTest() override = default;
 
  protected:
+  // Delivers one-way calls queued by |power_manager_|.
+  void RunLoop() { base::RunLoop().RunUntilIdle(); }
+
+  base::MessageLoop message_loop_;
   PowerManagerStub* power_manager_;  // Owned by |power_manager_binder_|.
   sp<IBinder> power_manager_binder_;
   PowerManagerClient client_;
@@ -59,8 +66,51 @@ TEST_F(WakeLockTest, CreateAndDestroy) {
       PowerManagerStub::ConstructWakeLockString("foo", "bar", kUid),
       power_manager_->GetWakeLockString(binder_wrapper()->local_binders()[0]));
 
+  // The release should be sent as a one-way call.
+  lock.reset();
+  EXPECT_EQ(1, power_manager_->num_one_way_releases());
+  RunLoop();
+  EXPECT_EQ(0, power_manager_->GetNumWakeLocks());
+}
+
+TEST_F(WakeLockTest, DestructorDoesNotWaitForRelease) {
+  std::unique_ptr<WakeLock> lock(client_.CreateWakeLock("foo", "bar"));
+  ASSERT_TRUE(lock);
+
+  // The destructor should return while the power manager still has the
+  // release queued.
+  lock.reset();
+  EXPECT_EQ(1, power_manager_->num_pending_one_way_releases());
+  EXPECT_EQ(1, power_manager_->GetNumWakeLocks());
+
+  RunLoop();
+  EXPECT_EQ(0, power_manager_->num_pending_one_way_releases());
+  EXPECT_EQ(0, power_manager_->GetNumWakeLocks());
+}
+
+TEST_F(WakeLockTest, Timeout) {
+  const auto kTimeout = base::TimeDelta::FromSeconds(2);
+  std::unique_ptr<WakeLock> lock(
+      client_.CreateWakeLockWithTimeout("foo", "bar", kTimeout));
+  ASSERT_TRUE(lock);
+  ASSERT_EQ(1, power_manager_->GetNumWakeLocks());
+  ASSERT_EQ(1u, binder_wrapper()->local_binders().size());
+  EXPECT_EQ(kTimeout, power_manager_->GetWakeLockTimeout(
+                          binder_wrapper()->local_binders()[0]));
+
   lock.reset();
+  RunLoop();
   EXPECT_EQ(0, power_manager_->GetNumWakeLocks());
+
+  // Sub-millisecond timeouts should be rounded up rather than sent as zero.
+  lock = client_.CreateWakeLockWithTimeout(
+      "foo", "bar", base::TimeDelta::FromMicroseconds(500));
+  ASSERT_TRUE(lock);
+  ASSERT_EQ(1, power_manager_->GetNumWakeLocks());
+  ASSERT_EQ(2u, binder_wrapper()->local_binders().size());
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(1),
+            power_manager_->GetWakeLockTimeout(
+                binder_wrapper()->local_binders()[1]));
 }
 
 TEST_F(WakeLockTest, PowerManagerDeath) {
@@ -70,6 +120,7 @@ TEST_F(WakeLockTest, PowerManagerDeath) {
   // Since PowerManagerClient was informed that the power manager died, WakeLock
   // shouldn't try to release its lock on destruction.
   lock.reset();
+  RunLoop();
   EXPECT_EQ(1, power_manager_->GetNumWakeLocks());
 }
 
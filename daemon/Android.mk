@@ -79,10 +79,21 @@ LOCAL_SHARED_LIBRARIES := \
   libbrillo \
 
 LOCAL_SRC_FILES := \
+  autosleeper.cc \
   BnPowerManager.cc \
+  cross_thread_timer.cc \
+  latency_histogram.cc \
   power_manager.cc \
+  resume_collector.cc \
+  string_pool.cc \
+  suspend_retrier.cc \
+  suspender.cc \
+  sysfs_writer.cc \
   system_property_setter.cc \
+  timer_wheel.cc \
+  wake_lock_event_log.cc \
   wake_lock_manager.cc \
+  wake_lock_stats_table.cc \
 
 include $(BUILD_STATIC_LIBRARY)
 
@@ -96,19 +107,62 @@ ifdef BRILLO
 endif
 LOCAL_CPP_EXTENSION := .cc
 LOCAL_CFLAGS := $(nativepowerman_CommonCFlags)
-LOCAL_STATIC_LIBRARIES := libnativepowerman libgtest libBionicGtestMain
+LOCAL_STATIC_LIBRARIES := \
+  libchrome_test_helpers \
+  libgtest \
+  libBionicGtestMain \
+  libnativepowerman \
+
 LOCAL_SHARED_LIBRARIES := \
   $(nativepowerman_CommonSharedLibraries) \
   libbinderwrapper_test_support \
   libnativepower_test_support \
 
 LOCAL_SRC_FILES := \
+  autosleeper_unittest.cc \
+  binder_map_unittest.cc \
+  cross_thread_timer_unittest.cc \
+  latency_histogram_unittest.cc \
   power_manager_unittest.cc \
+  resume_collector_unittest.cc \
+  small_array_unittest.cc \
+  string_pool_unittest.cc \
+  suspend_retrier_unittest.cc \
+  suspender_test_util.cc \
+  suspender_unittest.cc \
+  sysfs_writer_unittest.cc \
   system_property_setter_stub.cc \
+  timer_wheel_unittest.cc \
+  wake_lock_event_log_unittest.cc \
   wake_lock_manager_unittest.cc \
+  wake_lock_stats_table_unittest.cc \
 
 include $(BUILD_NATIVE_TEST)
 
+# nativepowerman_benchmarks executable
+# ========================================================
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := nativepowerman_benchmarks
+ifdef BRILLO
+  LOCAL_MODULE_TAGS := eng
+endif
+LOCAL_CPP_EXTENSION := .cc
+LOCAL_CFLAGS := $(nativepowerman_CommonCFlags)
+LOCAL_STATIC_LIBRARIES := libnativepowerman
+LOCAL_SHARED_LIBRARIES := \
+  $(nativepowerman_CommonSharedLibraries) \
+  libbrillo \
+
+LOCAL_SRC_FILES := \
+  allocation_counter.cc \
+  benchmark_main.cc \
+  binder_map_benchmark.cc \
+  string_pool_benchmark.cc \
+  sysfs_writer_benchmark.cc \
+
+include $(BUILD_NATIVE_BENCHMARK)
+
 # libnativepower_test_support shared library
 # ========================================================
 
@@ -121,8 +175,14 @@ LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)/../include
 LOCAL_SHARED_LIBRARIES := $(nativepowerman_CommonSharedLibraries)
 LOCAL_SRC_FILES := \
   BnPowerManager.cc \
+  cross_thread_timer.cc \
   power_manager_stub.cc \
+  string_pool.cc \
+  sysfs_writer.cc \
+  timer_wheel.cc \
+  wake_lock_event_log.cc \
   wake_lock_manager.cc \
+  wake_lock_stats_table.cc \
   wake_lock_manager_stub.cc \
 
 include $(BUILD_SHARED_LIBRARY)
@@ -17,13 +17,35 @@
 #include <nativepower/BnPowerManager.h>
 
 #include <binder/Parcel.h>
+#include <utils/String16.h>
 
 namespace android {
+namespace {
+
+// Writes |distribution| to |reply| as described for GET_SUSPEND_LATENCY_STATS.
+void WriteLatencyDistribution(const LatencyDistribution& distribution,
+                              Parcel* reply) {
+  reply->writeInt64(distribution.count);
+  reply->writeInt64(distribution.min.InMicroseconds());
+  reply->writeInt64(distribution.max.InMicroseconds());
+  reply->writeInt64(distribution.total.InMicroseconds());
+  reply->writeInt64(distribution.p50.InMicroseconds());
+  reply->writeInt64(distribution.p90.InMicroseconds());
+  reply->writeInt64(distribution.p99.InMicroseconds());
+  reply->writeInt32(distribution.buckets.size());
+  for (const LatencyDistribution::Bucket& bucket : distribution.buckets) {
+    reply->writeInt64(bucket.upper_bound.InMicroseconds());
+    reply->writeInt64(bucket.count);
+  }
+}
+
+}  // namespace
 
 status_t BnPowerManager::onTransact(uint32_t code,
                                     const Parcel& data,
                                     Parcel* reply,
                                     uint32_t flags) {
+  const bool one_way = flags & IBinder::FLAG_ONEWAY;
   switch (code) {
     case IPowerManager::ACQUIRE_WAKE_LOCK: {
       // The parameter orders in IPowerManager.aidl and IPowerManager.h don't
@@ -35,7 +57,7 @@ status_t BnPowerManager::onTransact(uint32_t code,
       String16 tag = data.readString16();
       String16 package_name = data.readString16();
       // Ignore work source and history.
-      return acquireWakeLock(flags, lock, tag, package_name);
+      return acquireWakeLock(flags, lock, tag, package_name, one_way);
     }
     case IPowerManager::ACQUIRE_WAKE_LOCK_UID: {
       CHECK_INTERFACE(IPowerManager, data, reply);
@@ -44,19 +66,98 @@ status_t BnPowerManager::onTransact(uint32_t code,
       String16 tag = data.readString16();
       String16 package_name = data.readString16();
       int32_t uid = data.readInt32();
-      return acquireWakeLockWithUid(flags, lock, tag, package_name, uid);
+      return acquireWakeLockWithUid(flags, lock, tag, package_name, uid,
+                                    one_way);
+    }
+    case ACQUIRE_WAKE_LOCK_WITH_TIMEOUT: {
+      CHECK_INTERFACE(IPowerManager, data, reply);
+      sp<IBinder> lock = data.readStrongBinder();
+      int32_t flags = data.readInt32();
+      String16 tag = data.readString16();
+      String16 package_name = data.readString16();
+      int64_t timeout_ms = data.readInt64();
+      return acquireWakeLockWithTimeout(flags, lock, tag, package_name,
+                                        timeout_ms);
+    }
+    case GET_WAKE_LOCK_STATS: {
+      CHECK_INTERFACE(IPowerManager, data, reply);
+      std::vector<WakeLockStats> stats;
+      status_t status = getWakeLockStats(&stats);
+      if (status != OK)
+        return status;
+      reply->writeInt32(stats.size());
+      for (const WakeLockStats& entry : stats) {
+        reply->writeInt32(entry.uid);
+        reply->writeString16(String16(entry.package.c_str()));
+        reply->writeString16(String16(entry.tag.c_str()));
+        reply->writeInt64(entry.acquire_count);
+        reply->writeInt32(entry.active_count);
+        reply->writeInt64(entry.total_hold_time.InMilliseconds());
+        reply->writeInt64(entry.max_hold_time.InMilliseconds());
+        reply->writeInt64(entry.blamed_hold_time.InMilliseconds());
+      }
+      return OK;
+    }
+    case GET_SUSPEND_LATENCY_STATS: {
+      CHECK_INTERFACE(IPowerManager, data, reply);
+      SuspendLatencyStats stats;
+      status_t status = getSuspendLatencyStats(&stats);
+      if (status != OK)
+        return status;
+      WriteLatencyDistribution(stats.request_to_write, reply);
+      WriteLatencyDistribution(stats.kernel, reply);
+      WriteLatencyDistribution(stats.sleep, reply);
+      WriteLatencyDistribution(stats.resume_to_report, reply);
+      return OK;
+    }
+    case UPDATE_WAKE_LOCKS: {
+      CHECK_INTERFACE(IPowerManager, data, reply);
+      const int32_t count = data.readInt32();
+      if (count < 0 || count > kMaxWakeLockUpdates)
+        return BAD_VALUE;
+
+      // Parse the entire batch before applying any of it.
+      std::vector<WakeLockUpdate> updates(count);
+      for (WakeLockUpdate& update : updates) {
+        const int32_t type = data.readInt32();
+        update.lock = data.readStrongBinder();
+        if (!update.lock.get())
+          return BAD_VALUE;
+        if (type == WAKE_LOCK_UPDATE_ACQUIRE) {
+          update.flags = data.readInt32();
+          update.tag = data.readString16();
+          update.package_name = data.readString16();
+          update.timeout_ms = data.readInt64();
+          if (update.timeout_ms < 0)
+            return BAD_VALUE;
+        } else if (type != WAKE_LOCK_UPDATE_RELEASE) {
+          return BAD_VALUE;
+        }
+        update.type = static_cast<WakeLockUpdateType>(type);
+      }
+      return updateWakeLocks(updates);
     }
     case IPowerManager::RELEASE_WAKE_LOCK: {
       CHECK_INTERFACE(IPowerManager, data, reply);
       sp<IBinder> lock = data.readStrongBinder();
       int32_t flags = data.readInt32();
-      return releaseWakeLock(lock, flags);
+      return releaseWakeLock(lock, flags, one_way);
     }
     case IPowerManager::UPDATE_WAKE_LOCK_UIDS: {
       CHECK_INTERFACE(IPowerManager, data, reply);
       sp<IBinder> lock = data.readStrongBinder();
-      // TODO: There's no Parcel::readInt32Array(). Add one.
-      return updateWakeLockUids(lock, 0, nullptr);
+      // Parcel::writeInt32Array() writes the length (or -1 for a null array)
+      // followed by the values, which are read in place rather than copied.
+      const int32_t len = data.readInt32();
+      if (len <= 0)
+        return updateWakeLockUids(lock, 0, nullptr, one_way);
+      if (static_cast<size_t>(len) > data.dataAvail() / sizeof(int32_t))
+        return BAD_VALUE;
+      const int32_t* uids = static_cast<const int32_t*>(
+          data.readInplace(len * sizeof(int32_t)));
+      if (!uids)
+        return BAD_VALUE;
+      return updateWakeLockUids(lock, len, uids, one_way);
     }
     case IPowerManager::POWER_HINT: {
       CHECK_INTERFACE(IPowerManager, data, reply);
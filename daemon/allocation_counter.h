@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSTEM_NATIVEPOWER_DAEMON_ALLOCATION_COUNTER_H_
+#define SYSTEM_NATIVEPOWER_DAEMON_ALLOCATION_COUNTER_H_
+
+#include <stdint.h>
+
+namespace android {
+
+// Returns the number of times that operator new has been called so far. Only
+// available in nativepowerman_benchmarks, which replaces the global allocation
+// functions to count calls.
+int64_t GetNumAllocations();
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_DAEMON_ALLOCATION_COUNTER_H_
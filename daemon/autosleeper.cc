@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "autosleeper.h"
+
+#include <algorithm>
+
+#include <base/bind.h>
+#include <base/location.h>
+#include <base/logging.h>
+#include <base/thread_task_runner_handle.h>
+#include <base/time/default_tick_clock.h>
+
+namespace android {
+namespace {
+
+// Path to the real sysfs file used to control kernel autosleep.
+const char kDefaultAutosleepPath[] = "/sys/power/autosleep";
+
+// Default back-off between failed attempts in USERSPACE mode. These match the
+// limits used by libsuspend's wakeup_count loop.
+const int kDefaultInitialBackoffMs = 100;
+const int kDefaultMaxBackoffSec = 60;
+
+}  // namespace
+
+const char Autosleeper::kAutosleepEnable[] = "mem";
+const char Autosleeper::kAutosleepDisable[] = "off";
+
+Autosleeper::Options::Options()
+    : mode(Mode::OFF),
+      initial_backoff(
+          base::TimeDelta::FromMilliseconds(kDefaultInitialBackoffMs)),
+      max_backoff(base::TimeDelta::FromSeconds(kDefaultMaxBackoffSec)) {}
+
+Autosleeper::Autosleeper(Suspender* suspender)
+    : suspender_(suspender),
+      autosleep_path_(kDefaultAutosleepPath),
+      clock_(new base::DefaultTickClock()),
+      kernel_autosleep_enabled_(false),
+      idle_(true),
+      attempt_pending_(false),
+      retry_timer_(base::Bind(&Autosleeper::HandleRetryTimeout,
+                              base::Unretained(this))),
+      num_attempts_(0),
+      weak_ptr_factory_(this) {
+  DCHECK(suspender_);
+}
+
+Autosleeper::~Autosleeper() {
+  // Leave the kernel in the state it was in before the daemon started.
+  if (kernel_autosleep_enabled_)
+    autosleep_writer_.Write(kAutosleepDisable);
+}
+
+bool Autosleeper::Init(const Options& options) {
+  options_ = options;
+  task_runner_ = base::ThreadTaskRunnerHandle::Get();
+  weak_this_ = weak_ptr_factory_.GetWeakPtr();
+
+  switch (options_.mode) {
+    case Mode::OFF:
+      break;
+    case Mode::KERNEL:
+      if (!autosleep_writer_.Open(autosleep_path_) ||
+          !autosleep_writer_.Write(kAutosleepEnable)) {
+        LOG(ERROR) << "Failed to enable kernel autosleep via "
+                   << autosleep_path_.value();
+        return false;
+      }
+      kernel_autosleep_enabled_ = true;
+      LOG(INFO) << "Enabled kernel autosleep";
+      break;
+    case Mode::USERSPACE:
+      LOG(INFO) << "Enabled userspace autosleep";
+      MaybeRequestAttempt();
+      break;
+  }
+  return true;
+}
+
+void Autosleeper::SetKernelLockHeld(bool held) {
+  if (options_.mode != Mode::USERSPACE)
+    return;
+  task_runner_->PostTask(
+      FROM_HERE,
+      base::Bind(&Autosleeper::HandleIdleChange, weak_this_, !held));
+}
+
+void Autosleeper::HandleSuspendResult(const Suspender::Result& result) {
+  DCHECK(result.autosleep);
+  attempt_pending_ = false;
+
+  switch (result.status) {
+    case Suspender::Result::Status::SUSPENDED:
+      backoff_ = base::TimeDelta();
+      break;
+    case Suspender::Result::Status::STALE:
+      NOTREACHED() << "Autosleep attempts are never stale";
+      break;
+    case Suspender::Result::Status::AVOIDED:
+    case Suspender::Result::Status::ABORTED:
+    case Suspender::Result::Status::FAILED:
+      backoff_ = backoff_ <= base::TimeDelta()
+                     ? options_.initial_backoff
+                     : std::min(backoff_ * 2, options_.max_backoff);
+      retry_time_ = clock_->NowTicks() + backoff_;
+      VLOG(1) << "Retrying autosleep in " << backoff_.InMilliseconds()
+              << " ms";
+      if (idle_)
+        retry_timer_.Start(backoff_);
+      return;
+  }
+  MaybeRequestAttempt();
+}
+
+bool Autosleeper::TriggerRetryForTesting() {
+  if (!retry_timer_.Stop())
+    return false;
+
+  HandleRetryTimeout();
+  return true;
+}
+
+void Autosleeper::HandleIdleChange(bool idle) {
+  idle_ = idle;
+  if (!idle_) {
+    // The attempt will be retried (still backed off) once the lock is
+    // released again.
+    retry_timer_.Stop();
+    return;
+  }
+
+  const base::TimeTicks now = clock_->NowTicks();
+  if (!attempt_pending_ && now < retry_time_)
+    retry_timer_.Start(retry_time_ - now);
+  else
+    MaybeRequestAttempt();
+}
+
+void Autosleeper::MaybeRequestAttempt() {
+  if (options_.mode != Mode::USERSPACE || !idle_ || attempt_pending_ ||
+      retry_timer_.IsRunning()) {
+    return;
+  }
+
+  attempt_pending_ = true;
+  num_attempts_++;
+  suspender_->RequestAutosleep();
+}
+
+void Autosleeper::HandleRetryTimeout() {
+  if (retry_timer_.RestartIfEarly(retry_time_, clock_->NowTicks()))
+    return;
+  MaybeRequestAttempt();
+}
+
+}  // namespace android
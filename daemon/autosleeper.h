@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SYSTEM_NATIVEPOWER_DAEMON_AUTOSLEEPER_H_
+#define SYSTEM_NATIVEPOWER_DAEMON_AUTOSLEEPER_H_
+
+#include <atomic>
+#include <memory>
+
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/memory/ref_counted.h>
+#include <base/memory/weak_ptr.h>
+#include <base/single_thread_task_runner.h>
+#include <base/time/tick_clock.h>
+#include <base/time/time.h>
+
+#include "cross_thread_timer.h"
+#include "suspender.h"
+#include "sysfs_writer.h"
+
+namespace android {
+
+// Suspends the system opportunistically whenever no wake lock requests are
+// held.
+//
+// In KERNEL mode, the kernel's own autosleep is enabled via sysfs. The kernel
+// then suspends whenever no wakeup sources are active, and WakeLockManager's
+// kernel wake lock keeps it awake while requests are held. The daemon isn't
+// told about these suspends, so ResumeCollector doesn't record them.
+//
+// In USERSPACE mode, a suspend attempt is made through Suspender (and hence
+// the wakeup_count handshake) each time the kernel wake lock is released and
+// again after each resume while it remains released. Attempts that don't
+// suspend the system are retried after an exponentially-increasing delay.
+class Autosleeper {
+ public:
+  // Value written to the autosleep file to enable kernel autosleep.
+  static const char kAutosleepEnable[];
+
+  // Value written to the autosleep file to disable kernel autosleep.
+  static const char kAutosleepDisable[];
+
+  enum class Mode {
+    OFF,
+    KERNEL,
+    USERSPACE,
+  };
+
+  // Tunable behavior.
+  struct Options {
+    Options();
+
+    Mode mode;
+
+    // Delay before retrying after the first failed attempt in USERSPACE mode.
+    // The delay doubles after each consecutive failure, up to |max_backoff|,
+    // and is reset by a successful suspend.
+    base::TimeDelta initial_backoff;
+    base::TimeDelta max_backoff;
+  };
+
+  // |suspender| is used in USERSPACE mode and must outlive this object.
+  explicit Autosleeper(Suspender* suspender);
+  ~Autosleeper();
+
+  // Must be called before Init().
+  void set_autosleep_path_for_testing(const base::FilePath& path) {
+    autosleep_path_ = path;
+  }
+
+  // Takes ownership of |clock|, which is used to compute retry deadlines.
+  void set_tick_clock_for_testing(std::unique_ptr<base::TickClock> clock) {
+    clock_ = std::move(clock);
+  }
+
+  Mode mode() const { return options_.mode; }
+
+  // Number of suspend attempts requested in USERSPACE mode.
+  int num_attempts() const { return num_attempts_; }
+
+  // Delay that will precede the next attempt, or zero if the last attempt
+  // suspended the system (or none has failed yet).
+  base::TimeDelta current_backoff() const { return backoff_; }
+
+  // Applies |options|. The system is considered idle until
+  // SetKernelLockHeld(true) is called, so in USERSPACE mode an attempt is
+  // made immediately. Must be called on a thread with a message loop, which
+  // is used for all subsequent work. Returns false if kernel autosleep
+  // couldn't be enabled.
+  bool Init(const Options& options);
+
+  // Reports whether WakeLockManager holds the kernel wake lock. May be called
+  // on any thread, including while other locks are held; the change is
+  // handled asynchronously on the Init() thread.
+  void SetKernelLockHeld(bool held);
+
+  // Must be called with the result of each attempt requested via
+  // Suspender::RequestAutosleep(), i.e. with |result.autosleep| set.
+  void HandleSuspendResult(const Suspender::Result& result);
+
+  // Runs the pending retry immediately. The attempt is only made if |clock_|
+  // has reached the retry deadline; otherwise the retry is rescheduled.
+  // Returns false if no retry was pending.
+  bool TriggerRetryForTesting();
+
+ private:
+  // Updates |idle_| on the Init() thread.
+  void HandleIdleChange(bool idle);
+
+  // Requests an attempt if the system is idle and no attempt or retry is
+  // pending.
+  void MaybeRequestAttempt();
+
+  // Called by |retry_timer_|.
+  void HandleRetryTimeout();
+
+  Suspender* suspender_;  // Not owned.
+
+  base::FilePath autosleep_path_;
+  SysfsWriter autosleep_writer_;
+
+  std::unique_ptr<base::TickClock> clock_;
+
+  Options options_;
+
+  // True if kernel autosleep was enabled by Init().
+  bool kernel_autosleep_enabled_;
+
+  // True if the kernel wake lock isn't held.
+  bool idle_;
+
+  // True while an attempt is being handled by |suspender_|.
+  bool attempt_pending_;
+
+  // Delay before the next retry and the time at which it's due.
+  base::TimeDelta backoff_;
+  base::TimeTicks retry_time_;
+
+  // Runs HandleRetryTimeout() once |retry_time_| is reached.
+  CrossThreadTimer retry_timer_;
+
+  // Updated on |task_runner_|, but may be read from other threads.
+  std::atomic<int> num_attempts_;
+
+  // Thread that Init() was called on.
+  scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
+
+  // Created by Init() and copied into tasks posted by SetKernelLockHeld().
+  base::WeakPtr<Autosleeper> weak_this_;
+  base::WeakPtrFactory<Autosleeper> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(Autosleeper);
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_DAEMON_AUTOSLEEPER_H_
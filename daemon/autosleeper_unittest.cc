@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <errno.h>
+
+#include <string>
+
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/macros.h>
+#include <base/run_loop.h>
+#include <gtest/gtest.h>
+
+#include "autosleeper.h"
+#include "suspender.h"
+#include "suspender_test_util.h"
+
+namespace android {
+
+class AutosleeperTest : public SuspenderTestBase {
+ public:
+  AutosleeperTest() : autosleeper_(&suspender_) {
+    autosleep_path_ = temp_dir_.path().Append("autosleep");
+    CHECK(base::WriteFile(autosleep_path_, "", 0) == 0);
+
+    InitSuspender();
+    autosleeper_.set_tick_clock_for_testing(CreateTickClock());
+    autosleeper_.set_autosleep_path_for_testing(autosleep_path_);
+
+    options_.mode = Autosleeper::Mode::USERSPACE;
+    options_.initial_backoff = base::TimeDelta::FromSeconds(1);
+    options_.max_backoff = base::TimeDelta::FromSeconds(4);
+  }
+  ~AutosleeperTest() override = default;
+
+ protected:
+  // Passes the most recent result to |autosleeper_|. Results aren't passed
+  // automatically, so that tests control when the next attempt is requested.
+  void ForwardLastResult() {
+    CHECK(!results_.empty());
+    autosleeper_.HandleSuspendResult(results_.back());
+  }
+
+  // Reports a kernel lock transition and runs the resulting task.
+  void SetKernelLockHeld(bool held) {
+    autosleeper_.SetKernelLockHeld(held);
+    base::RunLoop().RunUntilIdle();
+  }
+
+  // File within |temp_dir_| simulating /sys/power/autosleep.
+  base::FilePath autosleep_path_;
+
+  Autosleeper autosleeper_;
+  Autosleeper::Options options_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(AutosleeperTest);
+};
+
+TEST_F(AutosleeperTest, UserspaceSuspendsWhileUnlocked) {
+  // The kernel lock isn't held initially, so an attempt should be made
+  // immediately.
+  ASSERT_TRUE(autosleeper_.Init(options_));
+  EXPECT_EQ(1, autosleeper_.num_attempts());
+  Flush();
+  ASSERT_EQ(1u, results_.size());
+  EXPECT_TRUE(results_[0].autosleep);
+  EXPECT_EQ(Suspender::Result::Status::SUSPENDED, results_[0].status);
+  EXPECT_EQ(Suspender::kPowerStateSuspend, ReadFile(power_state_path_));
+
+  // If a lock is acquired after resuming, no further attempts should be made.
+  SetKernelLockHeld(true);
+  ForwardLastResult();
+  EXPECT_EQ(1, autosleeper_.num_attempts());
+  EXPECT_EQ(base::TimeDelta(), autosleeper_.current_backoff());
+
+  // Releasing the lock should trigger another attempt.
+  ASSERT_EQ(0, base::WriteFile(power_state_path_, "", 0));
+  SetKernelLockHeld(false);
+  EXPECT_EQ(2, autosleeper_.num_attempts());
+  Flush();
+  ASSERT_EQ(2u, results_.size());
+  EXPECT_EQ(Suspender::kPowerStateSuspend, ReadFile(power_state_path_));
+
+  // While the lock remains released, the system should be suspended again
+  // right after resuming.
+  ForwardLastResult();
+  EXPECT_EQ(3, autosleeper_.num_attempts());
+  Flush();
+  EXPECT_EQ(3u, results_.size());
+}
+
+TEST_F(AutosleeperTest, BackOffAfterFailures) {
+  SetWriteError(suspender_.power_state_writer_for_testing(), EIO);
+  ASSERT_TRUE(autosleeper_.Init(options_));
+  Flush();
+  ASSERT_EQ(1u, results_.size());
+  EXPECT_EQ(Suspender::Result::Status::FAILED, results_[0].status);
+  ForwardLastResult();
+  EXPECT_EQ(options_.initial_backoff, autosleeper_.current_backoff());
+
+  // The retry shouldn't be made before the clock reaches the deadline.
+  EXPECT_TRUE(autosleeper_.TriggerRetryForTesting());
+  EXPECT_EQ(1, autosleeper_.num_attempts());
+
+  // The delay should double after each failure until it reaches the maximum.
+  const int kExpectedBackoffSec[] = {2, 4, 4};
+  for (size_t i = 0; i < arraysize(kExpectedBackoffSec); ++i) {
+    clock_->Advance(autosleeper_.current_backoff());
+    EXPECT_TRUE(autosleeper_.TriggerRetryForTesting());
+    EXPECT_EQ(static_cast<int>(i) + 2, autosleeper_.num_attempts());
+    Flush();
+    ForwardLastResult();
+    EXPECT_EQ(base::TimeDelta::FromSeconds(kExpectedBackoffSec[i]),
+              autosleeper_.current_backoff());
+  }
+
+  // After a successful attempt, the delay should be reset and the next
+  // attempt should be made immediately.
+  SetWriteError(suspender_.power_state_writer_for_testing(), 0);
+  clock_->Advance(autosleeper_.current_backoff());
+  EXPECT_TRUE(autosleeper_.TriggerRetryForTesting());
+  EXPECT_EQ(5, autosleeper_.num_attempts());
+  Flush();
+  EXPECT_EQ(Suspender::Result::Status::SUSPENDED, results_.back().status);
+  ForwardLastResult();
+  EXPECT_EQ(base::TimeDelta(), autosleeper_.current_backoff());
+  EXPECT_EQ(6, autosleeper_.num_attempts());
+  EXPECT_FALSE(autosleeper_.TriggerRetryForTesting());
+  Flush();
+}
+
+TEST_F(AutosleeperTest, AvoidedSuspendBacksOff) {
+  // A wakeup event during the handshake should also be retried later.
+  SetWriteError(suspender_.wakeup_count_writer_for_testing(), EINVAL);
+  ASSERT_TRUE(autosleeper_.Init(options_));
+  Flush();
+  ASSERT_EQ(1u, results_.size());
+  EXPECT_EQ(Suspender::Result::Status::AVOIDED, results_[0].status);
+  ForwardLastResult();
+  EXPECT_EQ(options_.initial_backoff, autosleeper_.current_backoff());
+  EXPECT_EQ(1, autosleeper_.num_attempts());
+  EXPECT_EQ("", ReadFile(power_state_path_));
+}
+
+TEST_F(AutosleeperTest, LockCancelsRetry) {
+  SetWriteError(suspender_.power_state_writer_for_testing(), EIO);
+  ASSERT_TRUE(autosleeper_.Init(options_));
+  Flush();
+  ForwardLastResult();
+
+  // Acquiring the lock should cancel the pending retry.
+  SetKernelLockHeld(true);
+  EXPECT_FALSE(autosleeper_.TriggerRetryForTesting());
+
+  // If the lock is released after the deadline, the retry should be made
+  // immediately.
+  clock_->Advance(base::TimeDelta::FromSeconds(10));
+  SetKernelLockHeld(false);
+  EXPECT_EQ(2, autosleeper_.num_attempts());
+  Flush();
+  ForwardLastResult();
+  EXPECT_EQ(base::TimeDelta::FromSeconds(2), autosleeper_.current_backoff());
+
+  // Otherwise, it should wait for the rest of the back-off.
+  SetKernelLockHeld(true);
+  SetKernelLockHeld(false);
+  EXPECT_EQ(2, autosleeper_.num_attempts());
+  EXPECT_TRUE(autosleeper_.TriggerRetryForTesting());
+  EXPECT_EQ(2, autosleeper_.num_attempts());
+  clock_->Advance(base::TimeDelta::FromSeconds(2));
+  EXPECT_TRUE(autosleeper_.TriggerRetryForTesting());
+  EXPECT_EQ(3, autosleeper_.num_attempts());
+  Flush();
+}
+
+TEST_F(AutosleeperTest, Kernel) {
+  {
+    Autosleeper autosleeper(&suspender_);
+    autosleeper.set_autosleep_path_for_testing(autosleep_path_);
+    options_.mode = Autosleeper::Mode::KERNEL;
+    ASSERT_TRUE(autosleeper.Init(options_));
+    EXPECT_EQ(Autosleeper::kAutosleepEnable, ReadFile(autosleep_path_));
+
+    // The kernel makes its own attempts.
+    autosleeper.SetKernelLockHeld(false);
+    Flush();
+    EXPECT_EQ(0, autosleeper.num_attempts());
+    EXPECT_TRUE(results_.empty());
+  }
+
+  // Kernel autosleep should be disabled on destruction.
+  EXPECT_EQ(Autosleeper::kAutosleepDisable, ReadFile(autosleep_path_));
+
+  // Init() should fail if the autosleep file isn't writable.
+  Autosleeper autosleeper(&suspender_);
+  autosleeper.set_autosleep_path_for_testing(
+      temp_dir_.path().Append("missing"));
+  EXPECT_FALSE(autosleeper.Init(options_));
+}
+
+TEST_F(AutosleeperTest, Off) {
+  options_.mode = Autosleeper::Mode::OFF;
+  ASSERT_TRUE(autosleeper_.Init(options_));
+  SetKernelLockHeld(false);
+  Flush();
+  EXPECT_EQ(0, autosleeper_.num_attempts());
+  EXPECT_TRUE(results_.empty());
+  EXPECT_EQ("", ReadFile(autosleep_path_));
+}
+
+}  // namespace android
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSTEM_NATIVEPOWER_DAEMON_BINDER_MAP_H_
+#define SYSTEM_NATIVEPOWER_DAEMON_BINDER_MAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+#include <base/logging.h>
+#include <base/macros.h>
+#include <binder/IBinder.h>
+#include <utils/StrongPointer.h>
+
+namespace android {
+
+// Hash table keyed by binder identity (i.e. the IBinder pointer), using open
+// addressing with linear probing so that entries live in a single contiguous
+// array. Erasure uses backward-shift deletion, so no tombstones accumulate as
+// entries churn.
+//
+// Pointers returned by Find() and FindOrInsert() are invalidated by any
+// subsequent insertion or erasure. |Value| must be default-constructible and
+// movable.
+template <typename Value>
+class BinderMap {
+ public:
+  struct Entry {
+    sp<IBinder> key;
+    Value value;
+  };
+
+  // Iterates over occupied entries in unspecified order.
+  class const_iterator {
+   public:
+    const_iterator(const std::vector<Entry>* entries, size_t index)
+        : entries_(entries), index_(index) {
+      SkipEmpty();
+    }
+
+    const Entry& operator*() const { return (*entries_)[index_]; }
+    const Entry* operator->() const { return &(*entries_)[index_]; }
+    const_iterator& operator++() {
+      index_++;
+      SkipEmpty();
+      return *this;
+    }
+    bool operator==(const const_iterator& other) const {
+      return index_ == other.index_;
+    }
+    bool operator!=(const const_iterator& other) const {
+      return index_ != other.index_;
+    }
+
+   private:
+    void SkipEmpty() {
+      while (index_ < entries_->size() && !(*entries_)[index_].key.get())
+        index_++;
+    }
+
+    const std::vector<Entry>* entries_;
+    size_t index_;
+  };
+
+  BinderMap() : size_(0) {}
+  ~BinderMap() = default;
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const_iterator begin() const { return const_iterator(&entries_, 0); }
+  const_iterator end() const {
+    return const_iterator(&entries_, entries_.size());
+  }
+
+  // Returns the value associated with |binder|, or null if it isn't present.
+  Value* Find(const sp<IBinder>& binder) {
+    const size_t index = Probe(binder.get());
+    return index != kNotFound && entries_[index].key.get()
+        ? &entries_[index].value
+        : nullptr;
+  }
+  const Value* Find(const sp<IBinder>& binder) const {
+    return const_cast<BinderMap*>(this)->Find(binder);
+  }
+
+  // Returns the value associated with |binder|, inserting a default-constructed
+  // value if one isn't already present. |inserted| is set to true if a new
+  // entry was created. Lookup and insertion share a single probe sequence.
+  Value* FindOrInsert(const sp<IBinder>& binder, bool* inserted) {
+    DCHECK(binder.get());
+    size_t index = Probe(binder.get());
+    if (index != kNotFound && entries_[index].key.get()) {
+      *inserted = false;
+      return &entries_[index].value;
+    }
+
+    // Only insertions can grow the table, so lookups of existing keys never
+    // invalidate pointers.
+    if ((size_ + 1) * kMaxLoadDenominator >
+        entries_.size() * kMaxLoadNumerator) {
+      Resize(entries_.empty() ? kMinCapacity : entries_.size() * 2);
+      index = Probe(binder.get());
+    }
+
+    Entry& entry = entries_[index];
+    entry.key = binder;
+    size_++;
+    *inserted = true;
+    return &entry.value;
+  }
+
+  // Removes the entry for |binder|, returning false if it wasn't present.
+  bool Erase(const sp<IBinder>& binder) {
+    size_t hole = Probe(binder.get());
+    if (hole == kNotFound || !entries_[hole].key.get())
+      return false;
+
+    // Shift later members of the probe run back into the hole so that lookups
+    // never need to skip over deleted slots.
+    const size_t mask = entries_.size() - 1;
+    for (size_t next = (hole + 1) & mask; entries_[next].key.get();
+         next = (next + 1) & mask) {
+      const size_t home = Bucket(entries_[next].key.get());
+      if (((next - home) & mask) >= ((next - hole) & mask)) {
+        entries_[hole] = std::move(entries_[next]);
+        hole = next;
+      }
+    }
+    entries_[hole].key.clear();
+    entries_[hole].value = Value();
+    size_--;
+    return true;
+  }
+
+  // Removes all entries.
+  void Clear() {
+    entries_.clear();
+    size_ = 0;
+  }
+
+ private:
+  static const size_t kNotFound = static_cast<size_t>(-1);
+  static const size_t kMinCapacity = 16;
+
+  // Maximum fraction of occupied slots before the table is grown.
+  static const size_t kMaxLoadNumerator = 3;
+  static const size_t kMaxLoadDenominator = 4;
+
+  // Returns the preferred slot for |binder|. Heap pointers are aligned and
+  // clustered, so their bits are mixed before masking.
+  size_t Bucket(const IBinder* binder) const {
+    uint64_t hash = reinterpret_cast<uintptr_t>(binder);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return static_cast<size_t>(hash) & (entries_.size() - 1);
+  }
+
+  // Returns the index of |binder|'s slot, or of the empty slot where it would
+  // be inserted. Returns kNotFound if the table has no storage.
+  size_t Probe(const IBinder* binder) const {
+    if (entries_.empty())
+      return kNotFound;
+    const size_t mask = entries_.size() - 1;
+    size_t index = Bucket(binder);
+    while (entries_[index].key.get() && entries_[index].key.get() != binder)
+      index = (index + 1) & mask;
+    return index;
+  }
+
+  // Rehashes all entries into a table with |capacity| slots, which must be a
+  // power of two.
+  void Resize(size_t capacity) {
+    DCHECK_EQ(capacity & (capacity - 1), 0u);
+    std::vector<Entry> old_entries(capacity);
+    old_entries.swap(entries_);
+    for (Entry& entry : old_entries) {
+      if (entry.key.get())
+        entries_[Probe(entry.key.get())] = std::move(entry);
+    }
+  }
+
+  // Slots, with empty ones holding null keys. The size is always zero or a
+  // power of two.
+  std::vector<Entry> entries_;
+
+  // Number of occupied slots.
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(BinderMap);
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_DAEMON_BINDER_MAP_H_
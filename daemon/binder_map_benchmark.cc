@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the wake lock request table (BinderMap) with the std::map that it
+// replaced, with between 10 and 100k live requests.
+
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <binder/Binder.h>
+#include <binder/IBinder.h>
+
+#include "binder_map.h"
+
+namespace android {
+namespace {
+
+// Stand-in for WakeLockManager::Request.
+struct Request {
+  Request() : uid(-1) {}
+  Request(const std::string& tag, const std::string& package, uid_t uid)
+      : tag(tag), package(package), uid(uid) {}
+
+  std::string tag;
+  std::string package;
+  uid_t uid;
+};
+
+// Operations performed on the table, mirroring how WakeLockManager used
+// std::map before it was replaced.
+class StdMapTable {
+ public:
+  bool Add(const sp<IBinder>& binder, const Request& request) {
+    const bool new_request = !requests_.count(binder);
+    requests_[binder] = request;
+    return new_request;
+  }
+  bool Remove(const sp<IBinder>& binder) { return requests_.erase(binder); }
+
+ private:
+  std::map<sp<IBinder>, Request> requests_;
+};
+
+class BinderMapTable {
+ public:
+  bool Add(const sp<IBinder>& binder, const Request& request) {
+    bool new_request = false;
+    *requests_.FindOrInsert(binder, &new_request) = request;
+    return new_request;
+  }
+  bool Remove(const sp<IBinder>& binder) { return requests_.Erase(binder); }
+
+ private:
+  BinderMap<Request> requests_;
+};
+
+// Returns |count| newly-created binders.
+std::vector<sp<IBinder>> CreateBinders(int count) {
+  std::vector<sp<IBinder>> binders;
+  binders.reserve(count);
+  for (int i = 0; i < count; ++i)
+    binders.push_back(new BBinder());
+  return binders;
+}
+
+// Measures adding a new request and removing an old one while state.range(0)
+// requests are live.
+template <typename Table>
+void BM_AddRemove(benchmark::State& state) {
+  const int num_live = state.range(0);
+  std::vector<sp<IBinder>> binders = CreateBinders(num_live * 2);
+  const Request request("tag", "package", 1000);
+  Table table;
+  for (int i = 0; i < num_live; ++i)
+    table.Add(binders[i], request);
+
+  size_t added = num_live, removed = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(table.Add(binders[added], request));
+    benchmark::DoNotOptimize(table.Remove(binders[removed]));
+    added = (added + 1) % binders.size();
+    removed = (removed + 1) % binders.size();
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+
+// Measures updating an existing request while state.range(0) requests are
+// live.
+template <typename Table>
+void BM_Update(benchmark::State& state) {
+  const int num_live = state.range(0);
+  std::vector<sp<IBinder>> binders = CreateBinders(num_live);
+  const Request request("tag", "package", 1000);
+  Table table;
+  for (const auto& binder : binders)
+    table.Add(binder, request);
+
+  size_t index = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(table.Add(binders[index], request));
+    index = (index + 1) % binders.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_AddRemove, StdMapTable)
+    ->RangeMultiplier(10)->Range(10, 100000);
+BENCHMARK_TEMPLATE(BM_AddRemove, BinderMapTable)
+    ->RangeMultiplier(10)->Range(10, 100000);
+BENCHMARK_TEMPLATE(BM_Update, StdMapTable)
+    ->RangeMultiplier(10)->Range(10, 100000);
+BENCHMARK_TEMPLATE(BM_Update, BinderMapTable)
+    ->RangeMultiplier(10)->Range(10, 100000);
+
+}  // namespace
+}  // namespace android
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <map>
+#include <vector>
+
+#include <binder/Binder.h>
+#include <binder/IBinder.h>
+#include <gtest/gtest.h>
+
+#include "binder_map.h"
+
+namespace android {
+
+TEST(BinderMapTest, Basic) {
+  BinderMap<int> map;
+  EXPECT_TRUE(map.empty());
+
+  sp<IBinder> binder1 = new BBinder();
+  sp<IBinder> binder2 = new BBinder();
+  EXPECT_EQ(nullptr, map.Find(binder1));
+  EXPECT_FALSE(map.Erase(binder1));
+
+  bool inserted = false;
+  *map.FindOrInsert(binder1, &inserted) = 1;
+  EXPECT_TRUE(inserted);
+  *map.FindOrInsert(binder2, &inserted) = 2;
+  EXPECT_TRUE(inserted);
+  EXPECT_EQ(2u, map.size());
+
+  // Looking up an existing key should return its value without inserting.
+  int* value = map.FindOrInsert(binder1, &inserted);
+  EXPECT_FALSE(inserted);
+  EXPECT_EQ(1, *value);
+  EXPECT_EQ(2u, map.size());
+
+  EXPECT_TRUE(map.Erase(binder1));
+  EXPECT_EQ(nullptr, map.Find(binder1));
+  ASSERT_NE(nullptr, map.Find(binder2));
+  EXPECT_EQ(2, *map.Find(binder2));
+  EXPECT_EQ(1u, map.size());
+}
+
+TEST(BinderMapTest, LookupDoesNotResize) {
+  // Fill the initial table up to the point where the next insertion grows it.
+  std::vector<sp<IBinder>> binders;
+  BinderMap<int> map;
+  bool inserted = false;
+  for (int i = 0; i < 12; ++i) {
+    binders.push_back(new BBinder());
+    *map.FindOrInsert(binders.back(), &inserted) = i;
+    ASSERT_TRUE(inserted);
+  }
+
+  // Looking up an existing key shouldn't move its value.
+  int* value = map.Find(binders[0]);
+  ASSERT_NE(nullptr, value);
+  EXPECT_EQ(value, map.FindOrInsert(binders[0], &inserted));
+  EXPECT_FALSE(inserted);
+  EXPECT_EQ(value, map.Find(binders[0]));
+
+  // Inserting a new key should still grow the table.
+  binders.push_back(new BBinder());
+  *map.FindOrInsert(binders.back(), &inserted) = 12;
+  EXPECT_TRUE(inserted);
+  EXPECT_EQ(13u, map.size());
+  for (int i = 0; i < 13; ++i) {
+    ASSERT_NE(nullptr, map.Find(binders[i]));
+    EXPECT_EQ(i, *map.Find(binders[i]));
+  }
+}
+
+TEST(BinderMapTest, ManyEntries) {
+  // Insert enough entries to force several resizes and plenty of collisions,
+  // then remove every other one and check that the remaining entries are still
+  // reachable after backward-shift deletion.
+  const int kNumBinders = 1000;
+  std::vector<sp<IBinder>> binders;
+  BinderMap<int> map;
+  for (int i = 0; i < kNumBinders; ++i) {
+    binders.push_back(new BBinder());
+    bool inserted = false;
+    *map.FindOrInsert(binders.back(), &inserted) = i;
+    ASSERT_TRUE(inserted);
+  }
+  EXPECT_EQ(static_cast<size_t>(kNumBinders), map.size());
+
+  for (int i = 0; i < kNumBinders; i += 2)
+    EXPECT_TRUE(map.Erase(binders[i]));
+  EXPECT_EQ(static_cast<size_t>(kNumBinders / 2), map.size());
+
+  for (int i = 0; i < kNumBinders; ++i) {
+    const int* value = map.Find(binders[i]);
+    if (i % 2 == 0) {
+      EXPECT_EQ(nullptr, value) << "binder " << i;
+    } else {
+      ASSERT_NE(nullptr, value) << "binder " << i;
+      EXPECT_EQ(i, *value);
+    }
+  }
+
+  // Iteration should visit each remaining entry exactly once.
+  std::map<IBinder*, int> seen;
+  for (const auto& entry : map)
+    seen[entry.key.get()] = entry.value;
+  EXPECT_EQ(static_cast<size_t>(kNumBinders / 2), seen.size());
+  for (int i = 1; i < kNumBinders; i += 2)
+    EXPECT_EQ(i, seen[binders[i].get()]);
+}
+
+}  // namespace android
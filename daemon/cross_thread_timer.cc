@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cross_thread_timer.h"
+
+#include <base/bind.h>
+#include <base/location.h>
+#include <base/logging.h>
+#include <base/thread_task_runner_handle.h>
+
+namespace android {
+
+CrossThreadTimer::CrossThreadTimer(const base::Closure& closure)
+    : closure_(closure),
+      task_runner_(base::ThreadTaskRunnerHandle::Get()),
+      generation_(0),
+      running_(false),
+      weak_ptr_factory_(this) {
+  weak_this_ = weak_ptr_factory_.GetWeakPtr();
+}
+
+CrossThreadTimer::~CrossThreadTimer() {
+  DCHECK(task_runner_->BelongsToCurrentThread());
+}
+
+bool CrossThreadTimer::IsRunning() const {
+  return running_;
+}
+
+void CrossThreadTimer::Start(base::TimeDelta delay) {
+  base::AutoLock lock(lock_);
+  StartLocked(delay);
+}
+
+bool CrossThreadTimer::StartIfStopped(base::TimeDelta delay) {
+  // A pending run hasn't started the closure yet, so there's nothing to do.
+  // The flag is rechecked under the lock in case the run has just begun.
+  if (running_)
+    return false;
+
+  base::AutoLock lock(lock_);
+  if (running_)
+    return false;
+  StartLocked(delay);
+  return true;
+}
+
+bool CrossThreadTimer::Stop() {
+  base::AutoLock lock(lock_);
+  const bool was_running = running_;
+  generation_++;
+  running_ = false;
+  return was_running;
+}
+
+bool CrossThreadTimer::RestartIfEarly(base::TimeTicks deadline,
+                                      base::TimeTicks now) {
+  if (now >= deadline)
+    return false;
+  Start(deadline - now);
+  return true;
+}
+
+void CrossThreadTimer::StartLocked(base::TimeDelta delay) {
+  lock_.AssertAcquired();
+  generation_++;
+  running_ = true;
+  task_runner_->PostDelayedTask(
+      FROM_HERE,
+      base::Bind(&CrossThreadTimer::HandleTimeout, weak_this_, generation_),
+      delay);
+}
+
+void CrossThreadTimer::HandleTimeout(uint64_t generation) {
+  {
+    base::AutoLock lock(lock_);
+    if (generation != generation_ || !running_)
+      return;
+    running_ = false;
+  }
+  // The lock is released first so that the closure can restart the timer.
+  closure_.Run();
+}
+
+}  // namespace android
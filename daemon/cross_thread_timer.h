@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSTEM_NATIVEPOWER_DAEMON_CROSS_THREAD_TIMER_H_
+#define SYSTEM_NATIVEPOWER_DAEMON_CROSS_THREAD_TIMER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/memory/ref_counted.h>
+#include <base/memory/weak_ptr.h>
+#include <base/single_thread_task_runner.h>
+#include <base/synchronization/lock.h>
+#include <base/time/time.h>
+
+namespace android {
+
+// One-shot timer that, unlike base::Timer, may be started and stopped from any
+// thread. The closure always runs on the thread that created the timer, which
+// must have a message loop and must also be the thread that destroys it.
+class CrossThreadTimer {
+ public:
+  explicit CrossThreadTimer(const base::Closure& closure);
+  ~CrossThreadTimer();
+
+  // Returns true if the closure is scheduled to run.
+  bool IsRunning() const;
+
+  // Schedules the closure to run after |delay|, replacing any pending run.
+  void Start(base::TimeDelta delay);
+
+  // Like Start(), but does nothing if the timer is already running, so that
+  // repeated calls don't postpone the closure. Returns true if the timer was
+  // started. While the timer is running, this returns without taking |lock_|,
+  // so it's cheap to call on every event that needs the closure to run.
+  bool StartIfStopped(base::TimeDelta delay);
+
+  // Cancels the pending run, returning true if there was one.
+  bool Stop();
+
+  // Meant to be called by the closure when it runs. Timers may fire slightly
+  // early relative to clocks other than the message loop's, so if |now| is
+  // still before |deadline|, this restarts the timer for the remaining time
+  // and returns true, and the closure should return without doing anything.
+  bool RestartIfEarly(base::TimeTicks deadline, base::TimeTicks now);
+
+ private:
+  // Posts a task to run the closure after |delay|. |lock_| must be held.
+  void StartLocked(base::TimeDelta delay);
+
+  // Runs the closure if |generation| is still current.
+  void HandleTimeout(uint64_t generation);
+
+  const base::Closure closure_;
+  scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
+
+  base::Lock lock_;
+
+  // Incremented whenever the timer is started or stopped so that stale tasks
+  // can be ignored. Guarded by |lock_|.
+  uint64_t generation_;
+
+  // True while a run is pending. Only written while |lock_| is held, and
+  // cleared before the closure runs.
+  std::atomic<bool> running_;
+
+  // Created on the timer's thread and copied into posted tasks. Weak pointers
+  // may be copied on any thread, but are only dereferenced on |task_runner_|.
+  base::WeakPtr<CrossThreadTimer> weak_this_;
+  base::WeakPtrFactory<CrossThreadTimer> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(CrossThreadTimer);
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_DAEMON_CROSS_THREAD_TIMER_H_
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <base/bind.h>
+#include <base/location.h>
+#include <base/macros.h>
+#include <base/message_loop/message_loop.h>
+#include <base/run_loop.h>
+#include <base/threading/platform_thread.h>
+#include <base/threading/thread.h>
+#include <gtest/gtest.h>
+
+#include "cross_thread_timer.h"
+
+namespace android {
+
+class CrossThreadTimerTest : public testing::Test {
+ public:
+  CrossThreadTimerTest()
+      : timer_(base::Bind(&CrossThreadTimerTest::HandleTimeout,
+                          base::Unretained(this))),
+        num_runs_(0) {}
+  ~CrossThreadTimerTest() override = default;
+
+ protected:
+  void HandleTimeout() {
+    num_runs_++;
+    run_thread_ = base::PlatformThread::CurrentId();
+  }
+
+  // Runs tasks that are ready to run. Delayed tasks are left alone, so
+  // timers started with nonzero delays won't fire.
+  void RunLoop() { base::RunLoop().RunUntilIdle(); }
+
+  base::MessageLoop message_loop_;
+  CrossThreadTimer timer_;
+
+  // Number of HandleTimeout() calls and the thread of the last one.
+  int num_runs_;
+  base::PlatformThreadId run_thread_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CrossThreadTimerTest);
+};
+
+TEST_F(CrossThreadTimerTest, StartAndStop) {
+  EXPECT_FALSE(timer_.IsRunning());
+  timer_.Start(base::TimeDelta());
+  EXPECT_TRUE(timer_.IsRunning());
+  RunLoop();
+  EXPECT_EQ(1, num_runs_);
+  EXPECT_FALSE(timer_.IsRunning());
+
+  // Stopping the timer should cancel the pending run.
+  timer_.Start(base::TimeDelta());
+  EXPECT_TRUE(timer_.Stop());
+  EXPECT_FALSE(timer_.Stop());
+  RunLoop();
+  EXPECT_EQ(1, num_runs_);
+}
+
+TEST_F(CrossThreadTimerTest, Restart) {
+  // Start() should replace the pending run...
+  timer_.Start(base::TimeDelta());
+  timer_.Start(base::TimeDelta::FromHours(1));
+  RunLoop();
+  EXPECT_EQ(0, num_runs_);
+  EXPECT_TRUE(timer_.IsRunning());
+
+  // ... but StartIfStopped() shouldn't.
+  timer_.Start(base::TimeDelta());
+  EXPECT_FALSE(timer_.StartIfStopped(base::TimeDelta::FromHours(1)));
+  RunLoop();
+  EXPECT_EQ(1, num_runs_);
+  EXPECT_TRUE(timer_.StartIfStopped(base::TimeDelta()));
+  RunLoop();
+  EXPECT_EQ(2, num_runs_);
+}
+
+TEST_F(CrossThreadTimerTest, RestartIfEarly) {
+  const base::TimeTicks kDeadline =
+      base::TimeTicks() + base::TimeDelta::FromSeconds(10);
+
+  // A run before the deadline should be rescheduled for the remaining time.
+  EXPECT_TRUE(timer_.RestartIfEarly(
+      kDeadline, kDeadline - base::TimeDelta::FromMilliseconds(5)));
+  EXPECT_TRUE(timer_.IsRunning());
+  RunLoop();
+  EXPECT_EQ(0, num_runs_);
+  EXPECT_TRUE(timer_.Stop());
+
+  // Runs at or after the deadline should leave the timer stopped.
+  EXPECT_FALSE(timer_.RestartIfEarly(kDeadline, kDeadline));
+  EXPECT_FALSE(timer_.RestartIfEarly(
+      kDeadline, kDeadline + base::TimeDelta::FromSeconds(1)));
+  EXPECT_FALSE(timer_.IsRunning());
+}
+
+TEST_F(CrossThreadTimerTest, StartFromOtherThread) {
+  base::Thread thread("CrossThreadTimerTest");
+  ASSERT_TRUE(thread.Start());
+  thread.task_runner()->PostTask(
+      FROM_HERE, base::Bind(&CrossThreadTimer::Start,
+                            base::Unretained(&timer_), base::TimeDelta()));
+  thread.Stop();
+
+  // The closure should run on the timer's own thread.
+  EXPECT_TRUE(timer_.IsRunning());
+  RunLoop();
+  EXPECT_EQ(1, num_runs_);
+  EXPECT_EQ(base::PlatformThread::CurrentId(), run_thread_);
+}
+
+}  // namespace android
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <base/format_macros.h>
+#include <base/logging.h>
+#include <base/strings/stringprintf.h>
+
+namespace android {
+
+LatencyHistogram::LatencyHistogram()
+    : count_(0), min_us_(0), max_us_(0), total_us_(0) {
+  std::fill(counts_, counts_ + kNumBuckets, 0);
+}
+
+LatencyHistogram::~LatencyHistogram() = default;
+
+// static
+size_t LatencyHistogram::GetBucketIndex(uint64_t value_us) {
+  if (value_us < static_cast<uint64_t>(kSubBuckets))
+    return value_us;
+
+  // Keep the kSubBucketBits bits below the most significant one, so that
+  // |value_us >> shift| is in [kSubBuckets, 2 * kSubBuckets).
+  const int msb = 63 - __builtin_clzll(value_us);
+  const int shift = msb - kSubBucketBits;
+  return shift * kSubBuckets + (value_us >> shift);
+}
+
+// static
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t index) {
+  DCHECK_LT(index, kNumBuckets);
+  if (index < static_cast<size_t>(kSubBuckets))
+    return index;
+
+  const int shift = index / kSubBuckets - 1;
+  const uint64_t lower = static_cast<uint64_t>(index % kSubBuckets +
+                                               kSubBuckets) << shift;
+  return lower + ((1ULL << shift) - 1);
+}
+
+void LatencyHistogram::Add(base::TimeDelta latency) {
+  const int64_t value_us = std::max<int64_t>(latency.InMicroseconds(), 0);
+  counts_[GetBucketIndex(value_us)]++;
+  min_us_ = count_ ? std::min(min_us_, value_us) : value_us;
+  max_us_ = std::max(max_us_, value_us);
+  total_us_ += value_us;
+  count_++;
+}
+
+base::TimeDelta LatencyHistogram::GetPercentile(double percentile) const {
+  if (!count_)
+    return base::TimeDelta();
+
+  // Find the bucket containing the sample at this (one-based) rank.
+  const int64_t rank = std::max<int64_t>(
+      static_cast<int64_t>(std::ceil(percentile / 100.0 * count_)), 1);
+  int64_t seen = 0;
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    seen += counts_[i];
+    if (seen >= rank) {
+      const uint64_t bound =
+          std::min<uint64_t>(GetBucketUpperBound(i), max_us_);
+      return base::TimeDelta::FromMicroseconds(bound);
+    }
+  }
+  return base::TimeDelta::FromMicroseconds(max_us_);
+}
+
+void LatencyHistogram::GetDistribution(
+    LatencyDistribution* distribution) const {
+  distribution->count = count_;
+  distribution->min = base::TimeDelta::FromMicroseconds(min_us_);
+  distribution->max = base::TimeDelta::FromMicroseconds(max_us_);
+  distribution->total = base::TimeDelta::FromMicroseconds(total_us_);
+  distribution->p50 = GetPercentile(50);
+  distribution->p90 = GetPercentile(90);
+  distribution->p99 = GetPercentile(99);
+  distribution->buckets.clear();
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    if (!counts_[i])
+      continue;
+    LatencyDistribution::Bucket bucket;
+    bucket.upper_bound =
+        base::TimeDelta::FromMicroseconds(GetBucketUpperBound(i));
+    bucket.count = counts_[i];
+    distribution->buckets.push_back(bucket);
+  }
+}
+
+void LatencyHistogram::AppendSummary(std::string* output) const {
+  base::StringAppendF(
+      output,
+      "count=%" PRId64 " p50=%" PRId64 "us p90=%" PRId64 "us p99=%" PRId64
+      "us max=%" PRId64 "us\n",
+      count_, GetPercentile(50).InMicroseconds(),
+      GetPercentile(90).InMicroseconds(), GetPercentile(99).InMicroseconds(),
+      max_us_);
+}
+
+}  // namespace android
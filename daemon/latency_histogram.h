@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SYSTEM_NATIVEPOWER_DAEMON_LATENCY_HISTOGRAM_H_
+#define SYSTEM_NATIVEPOWER_DAEMON_LATENCY_HISTOGRAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include <base/macros.h>
+#include <base/time/time.h>
+#include <nativepower/suspend_latency_stats.h>
+
+namespace android {
+
+// Histogram of durations with microsecond resolution. Each power-of-two range
+// of values is split into kSubBuckets linear buckets, so recording is O(1),
+// storage is fixed, and any reported percentile is within 1/kSubBuckets of
+// the true value. Not thread-safe.
+class LatencyHistogram {
+ public:
+  // Number of linear buckets per power of two.
+  static const int kSubBucketBits = 3;
+  static const int kSubBuckets = 1 << kSubBucketBits;
+
+  // Values below kSubBuckets get their own buckets; each larger power of two
+  // up to 2^63 gets kSubBuckets.
+  static const size_t kNumBuckets = kSubBuckets * (64 - kSubBucketBits + 1);
+
+  LatencyHistogram();
+  ~LatencyHistogram();
+
+  int64_t count() const { return count_; }
+
+  // Records |latency|. Negative durations are recorded as zero.
+  void Add(base::TimeDelta latency);
+
+  // Returns the upper bound of the bucket containing the |percentile|th
+  // percentile (in [0, 100]), clamped to the maximum recorded duration, or
+  // zero if nothing has been recorded.
+  base::TimeDelta GetPercentile(double percentile) const;
+
+  // Copies the histogram's contents to |distribution|.
+  void GetDistribution(LatencyDistribution* distribution) const;
+
+  // Appends a one-line summary (count, percentiles and maximum) to |output|.
+  void AppendSummary(std::string* output) const;
+
+  // Returns the index of the bucket that |value_us| falls into, and the
+  // largest value in bucket |index|. Exposed for testing.
+  static size_t GetBucketIndex(uint64_t value_us);
+  static uint64_t GetBucketUpperBound(size_t index);
+
+ private:
+  int64_t counts_[kNumBuckets];
+  int64_t count_;
+  int64_t min_us_;
+  int64_t max_us_;
+  int64_t total_us_;
+
+  DISALLOW_COPY_AND_ASSIGN(LatencyHistogram);
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_DAEMON_LATENCY_HISTOGRAM_H_
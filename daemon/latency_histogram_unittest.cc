@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdint.h>
+
+#include <string>
+
+#include <base/time/time.h>
+#include <gtest/gtest.h>
+#include <nativepower/suspend_latency_stats.h>
+
+#include "latency_histogram.h"
+
+namespace android {
+
+TEST(LatencyHistogramTest, Buckets) {
+  // Small values should get their own buckets.
+  for (uint64_t i = 0; i < 16; ++i) {
+    EXPECT_EQ(i, LatencyHistogram::GetBucketIndex(i));
+    EXPECT_EQ(i, LatencyHistogram::GetBucketUpperBound(i));
+  }
+
+  // Larger ones should share buckets spanning 1/8 of their power of two.
+  EXPECT_EQ(16u, LatencyHistogram::GetBucketIndex(16));
+  EXPECT_EQ(16u, LatencyHistogram::GetBucketIndex(17));
+  EXPECT_EQ(17u, LatencyHistogram::GetBucketIndex(18));
+  EXPECT_EQ(17u, LatencyHistogram::GetBucketUpperBound(16));
+  EXPECT_EQ(1023u, LatencyHistogram::GetBucketUpperBound(
+                       LatencyHistogram::GetBucketIndex(1000)));
+  EXPECT_EQ(LatencyHistogram::kNumBuckets - 1,
+            LatencyHistogram::GetBucketIndex(UINT64_MAX));
+  EXPECT_EQ(UINT64_MAX, LatencyHistogram::GetBucketUpperBound(
+                            LatencyHistogram::kNumBuckets - 1));
+
+  // Each bucket's upper bound should be in the bucket, and the next value in
+  // the following one.
+  for (size_t i = 0; i + 1 < LatencyHistogram::kNumBuckets; ++i) {
+    const uint64_t bound = LatencyHistogram::GetBucketUpperBound(i);
+    EXPECT_EQ(i, LatencyHistogram::GetBucketIndex(bound));
+    EXPECT_EQ(i + 1, LatencyHistogram::GetBucketIndex(bound + 1));
+  }
+}
+
+TEST(LatencyHistogramTest, Percentiles) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(base::TimeDelta(), histogram.GetPercentile(50));
+
+  // Record 1 ms through 100 ms.
+  for (int i = 1; i <= 100; ++i)
+    histogram.Add(base::TimeDelta::FromMilliseconds(i));
+  EXPECT_EQ(100, histogram.count());
+
+  // Percentiles should be within 1/8 above the true value.
+  const int kPercentiles[] = {1, 50, 90, 99};
+  for (int percentile : kPercentiles) {
+    const int64_t expected_us = percentile * 1000;
+    const int64_t actual_us =
+        histogram.GetPercentile(percentile).InMicroseconds();
+    EXPECT_GE(actual_us, expected_us);
+    EXPECT_LE(actual_us, expected_us + expected_us / 8);
+  }
+
+  // The maximum shouldn't be rounded up to its bucket's bound.
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(100),
+            histogram.GetPercentile(100));
+
+  // Negative durations should be counted as zero.
+  histogram.Add(base::TimeDelta::FromMicroseconds(-5));
+  EXPECT_EQ(base::TimeDelta(), histogram.GetPercentile(0));
+}
+
+TEST(LatencyHistogramTest, Distribution) {
+  LatencyHistogram histogram;
+  histogram.Add(base::TimeDelta::FromMicroseconds(3));
+  histogram.Add(base::TimeDelta::FromMicroseconds(1000));
+  histogram.Add(base::TimeDelta::FromMicroseconds(1010));
+
+  LatencyDistribution distribution;
+  histogram.GetDistribution(&distribution);
+  EXPECT_EQ(3, distribution.count);
+  EXPECT_EQ(base::TimeDelta::FromMicroseconds(3), distribution.min);
+  EXPECT_EQ(base::TimeDelta::FromMicroseconds(1010), distribution.max);
+  EXPECT_EQ(base::TimeDelta::FromMicroseconds(2013), distribution.total);
+  EXPECT_EQ(base::TimeDelta::FromMicroseconds(1010), distribution.p50);
+  ASSERT_EQ(2u, distribution.buckets.size());
+  EXPECT_EQ(base::TimeDelta::FromMicroseconds(3),
+            distribution.buckets[0].upper_bound);
+  EXPECT_EQ(1, distribution.buckets[0].count);
+  EXPECT_EQ(base::TimeDelta::FromMicroseconds(1023),
+            distribution.buckets[1].upper_bound);
+  EXPECT_EQ(2, distribution.buckets[1].count);
+
+  std::string summary;
+  histogram.AppendSummary(&summary);
+  EXPECT_EQ("count=3 p50=1010us p90=1010us p99=1010us max=1010us\n", summary);
+}
+
+}  // namespace android
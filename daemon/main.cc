@@ -16,8 +16,11 @@
 
 #include <sysexits.h>
 
+#include <string>
+
 #include <base/logging.h>
 #include <base/macros.h>
+#include <binder/ProcessState.h>
 #include <binderwrapper/binder_wrapper.h>
 #include <brillo/binder_watcher.h>
 #include <brillo/daemons/daemon.h>
@@ -29,7 +32,15 @@ namespace {
 
 class PowerManagerDaemon : public brillo::Daemon {
  public:
-  PowerManagerDaemon() = default;
+  PowerManagerDaemon(
+      const android::WakeLockManager::Options& wake_lock_options,
+      const android::Autosleeper::Options& autosleep_options,
+      const android::SuspendRetrier::Options& suspend_retry_options,
+      int binder_threads)
+      : wake_lock_options_(wake_lock_options),
+        autosleep_options_(autosleep_options),
+        suspend_retry_options_(suspend_retry_options),
+        binder_threads_(binder_threads) {}
   ~PowerManagerDaemon() override = default;
 
  private:
@@ -40,26 +51,120 @@ class PowerManagerDaemon : public brillo::Daemon {
       return result;
 
     android::BinderWrapper::Create();
-    if (!binder_watcher_.Init())
-      return EX_OSERR;
+    power_manager_.set_wake_lock_manager_options(wake_lock_options_);
+    power_manager_.set_autosleep_options(autosleep_options_);
+    power_manager_.set_suspend_retry_options(suspend_retry_options_);
     if (!power_manager_.Init())
       return EX_OSERR;
 
+    if (binder_threads_ > 0) {
+      // Incoming transactions are handled by the pool, leaving the message
+      // loop to run timers. PowerManager is registered first so that no
+      // transactions arrive before it's initialized.
+      android::sp<android::ProcessState> process =
+          android::ProcessState::self();
+      process->setThreadPoolMaxThreadCount(binder_threads_);
+      process->startThreadPool();
+      LOG(INFO) << "Handling binder transactions on " << binder_threads_
+                << " thread(s)";
+    } else if (!binder_watcher_.Init()) {
+      return EX_OSERR;
+    }
+
     LOG(INFO) << "Initialization complete";
     return EX_OK;
   }
 
+  const android::WakeLockManager::Options wake_lock_options_;
+  const android::Autosleeper::Options autosleep_options_;
+  const android::SuspendRetrier::Options suspend_retry_options_;
+
+  // Size of the binder thread pool, or 0 to handle transactions on the
+  // message loop via |binder_watcher_|.
+  const int binder_threads_;
+
   brillo::BinderWatcher binder_watcher_;
   android::PowerManager power_manager_;
 
   DISALLOW_COPY_AND_ASSIGN(PowerManagerDaemon);
 };
 
+// Parses the value of the --autosleep flag into |mode|, returning false if it
+// isn't recognized.
+bool ParseAutosleepMode(const std::string& value,
+                        android::Autosleeper::Mode* mode) {
+  if (value == "off")
+    *mode = android::Autosleeper::Mode::OFF;
+  else if (value == "kernel")
+    *mode = android::Autosleeper::Mode::KERNEL;
+  else if (value == "userspace")
+    *mode = android::Autosleeper::Mode::USERSPACE;
+  else
+    return false;
+  return true;
+}
+
 }  // namespace
 
 int main(int argc, char *argv[]) {
+  DEFINE_int32(release_delay_ms, 0,
+               "Milliseconds to keep holding the kernel wake lock after the "
+               "last wake lock request is released");
+  DEFINE_int32(kernel_lock_timeout_ms, 0,
+               "If nonzero, timeout for the kernel wake lock, which is "
+               "re-armed periodically while wake lock requests are active");
+  DEFINE_int32(binder_threads, 0,
+               "If nonzero, number of threads used to handle binder "
+               "transactions concurrently instead of on the main thread");
+  DEFINE_string(autosleep, "off",
+                "Suspend whenever no wake locks are held: \"kernel\" uses "
+                "the kernel's autosleep and \"userspace\" makes attempts "
+                "from the daemon");
+  DEFINE_int32(autosleep_initial_backoff_ms, 100,
+               "Milliseconds to wait before retrying after a failed "
+               "userspace autosleep attempt; doubles after each failure");
+  DEFINE_int32(autosleep_max_backoff_ms, 60000,
+               "Maximum milliseconds between failed userspace autosleep "
+               "attempts");
+  DEFINE_int32(suspend_max_retries, 5,
+               "Number of times to retry a goToSleep() request that the "
+               "kernel refuses before giving up; 0 disables retries");
+  DEFINE_int32(suspend_retry_initial_delay_ms, 1000,
+               "Milliseconds to wait before retrying a refused goToSleep() "
+               "request; doubles after each failure and is randomly "
+               "shortened by up to half");
+  DEFINE_int32(suspend_retry_max_delay_ms, 30000,
+               "Maximum milliseconds between retries of a refused "
+               "goToSleep() request");
+
   // This also initializes base::CommandLine(), which is needed for logging.
   brillo::FlagHelper::Init(argc, argv, "Power management daemon");
   logging::InitLogging(logging::LoggingSettings());
-  return PowerManagerDaemon().Run();
+
+  android::WakeLockManager::Options wake_lock_options;
+  wake_lock_options.release_delay =
+      base::TimeDelta::FromMilliseconds(FLAGS_release_delay_ms);
+  wake_lock_options.kernel_lock_timeout =
+      base::TimeDelta::FromMilliseconds(FLAGS_kernel_lock_timeout_ms);
+
+  android::Autosleeper::Options autosleep_options;
+  if (!ParseAutosleepMode(FLAGS_autosleep, &autosleep_options.mode)) {
+    LOG(ERROR) << "Invalid --autosleep value \"" << FLAGS_autosleep << "\"";
+    return EX_USAGE;
+  }
+  autosleep_options.initial_backoff =
+      base::TimeDelta::FromMilliseconds(FLAGS_autosleep_initial_backoff_ms);
+  autosleep_options.max_backoff =
+      base::TimeDelta::FromMilliseconds(FLAGS_autosleep_max_backoff_ms);
+
+  android::SuspendRetrier::Options suspend_retry_options;
+  suspend_retry_options.max_retries = FLAGS_suspend_max_retries;
+  suspend_retry_options.initial_delay =
+      base::TimeDelta::FromMilliseconds(FLAGS_suspend_retry_initial_delay_ms);
+  suspend_retry_options.max_delay =
+      base::TimeDelta::FromMilliseconds(FLAGS_suspend_retry_max_delay_ms);
+
+  return PowerManagerDaemon(wake_lock_options, autosleep_options,
+                            suspend_retry_options, FLAGS_binder_threads)
+      .Run();
 }
@@ -16,39 +16,66 @@
 
 #include "power_manager.h"
 
+#include <string>
+
+#include <base/bind.h>
 #include <base/files/file_util.h>
 #include <base/logging.h>
-#include <base/sys_info.h>
+#include <base/strings/stringprintf.h>
 #include <binderwrapper/binder_wrapper.h>
 #include <cutils/android_reboot.h>
 #include <nativepower/constants.h>
 #include <powermanager/IPowerManager.h>
+#include <private/android_filesystem_config.h>
 #include <utils/Errors.h>
+#include <utils/String16.h>
 #include <utils/String8.h>
+#include <utils/Vector.h>
 
 namespace android {
 namespace {
 
-// Path to real sysfs file that can be written to change the power state.
-const char kDefaultPowerStatePath[] = "/sys/power/state";
+// dump() argument that clears the wake lock event log after writing it.
+const char kDumpDrainArg[] = "--drain";
+
+// Returns true if |uid| may see other processes' wake lock tags.
+bool IsPrivilegedUid(uid_t uid) {
+  return uid == AID_ROOT || uid == AID_SYSTEM;
+}
 
 }  // namespace
 
 const char PowerManager::kRebootPrefix[] = "reboot,";
 const char PowerManager::kShutdownPrefix[] = "shutdown,";
-const char PowerManager::kPowerStateSuspend[] = "mem";
 
 PowerManager::PowerManager()
-    : power_state_path_(kDefaultPowerStatePath) {}
+    : autosleeper_(&suspender_), suspend_retrier_(&suspender_) {}
 
-PowerManager::~PowerManager() = default;
+PowerManager::~PowerManager() {
+  // The manager releases the kernel lock when destroyed, which notifies
+  // |autosleeper_| and |suspend_retrier_|.
+  wake_lock_manager_.reset();
+}
 
 bool PowerManager::Init() {
   if (!property_setter_)
     property_setter_.reset(new SystemPropertySetter());
+
+  if (!suspender_.Init(base::Bind(&PowerManager::HandleSuspendResult,
+                                  base::Unretained(this)))) {
+    return false;
+  }
+  if (!autosleeper_.Init(autosleep_options_))
+    return false;
+  suspend_retrier_.Init(suspend_retry_options_);
+
   if (!wake_lock_manager_) {
-    wake_lock_manager_.reset(new WakeLockManager());
-    if (!static_cast<WakeLockManager*>(wake_lock_manager_.get())->Init())
+    WakeLockManager* manager = new WakeLockManager();
+    wake_lock_manager_.reset(manager);
+    manager->set_options(wake_lock_manager_options_);
+    manager->set_kernel_lock_callback(base::Bind(
+        &PowerManager::HandleKernelLockChange, base::Unretained(this)));
+    if (!manager->Init())
       return false;
   }
 
@@ -62,10 +89,16 @@ status_t PowerManager::acquireWakeLock(int flags,
                                        const String16& tag,
                                        const String16& packageName,
                                        bool isOneWay) {
-  return AddWakeLockRequest(lock, tag, packageName,
-                            BinderWrapper::Get()->GetCallingUid())
-             ? OK
-             : UNKNOWN_ERROR;
+  if (AddWakeLockRequest(lock, tag, packageName,
+                         BinderWrapper::Get()->GetCallingUid(),
+                         base::TimeDelta())) {
+    return OK;
+  }
+
+  // One-way callers (e.g. re-acquired ScopedWakeLocks) never see the status.
+  if (isOneWay)
+    LOG(WARNING) << "One-way acquire of wake lock " << lock.get() << " failed";
+  return UNKNOWN_ERROR;
 }
 
 status_t PowerManager::acquireWakeLockWithUid(int flags,
@@ -74,7 +107,8 @@ status_t PowerManager::acquireWakeLockWithUid(int flags,
                                               const String16& packageName,
                                               int uid,
                                               bool isOneWay) {
-  return AddWakeLockRequest(lock, tag, packageName, static_cast<uid_t>(uid))
+  return AddWakeLockRequest(lock, tag, packageName, static_cast<uid_t>(uid),
+                            base::TimeDelta())
              ? OK
              : UNKNOWN_ERROR;
 }
@@ -82,16 +116,34 @@ status_t PowerManager::acquireWakeLockWithUid(int flags,
 status_t PowerManager::releaseWakeLock(const sp<IBinder>& lock,
                                        int flags,
                                        bool isOneWay) {
-  return wake_lock_manager_->RemoveRequest(lock) ? OK : UNKNOWN_ERROR;
+  if (wake_lock_manager_->RemoveRequest(lock))
+    return OK;
+
+  // One-way callers never see the status, so make sure the failure is logged.
+  if (isOneWay)
+    LOG(WARNING) << "One-way release of wake lock " << lock.get() << " failed";
+  return UNKNOWN_ERROR;
 }
 
 status_t PowerManager::updateWakeLockUids(const sp<IBinder>& lock,
                                           int len,
                                           const int* uids,
                                           bool isOneWay) {
-  NOTIMPLEMENTED() << "updateWakeLockUids: lock=" << lock.get()
-                   << " len=" << len;
-  return OK;
+  // uid_t and the int32_t values sent over binder have the same
+  // representation, so the array can be used without copying it.
+  static_assert(sizeof(uid_t) == sizeof(int), "uid_t must be int-sized");
+  if (len < 0 || (len > 0 && !uids))
+    return BAD_VALUE;
+  if (wake_lock_manager_->UpdateRequestUids(
+          lock, reinterpret_cast<const uid_t*>(uids), len)) {
+    return OK;
+  }
+
+  if (isOneWay) {
+    LOG(WARNING) << "One-way uid update of wake lock " << lock.get()
+                 << " failed";
+  }
+  return UNKNOWN_ERROR;
 }
 
 status_t PowerManager::powerHint(int hintId, int data) {
@@ -100,27 +152,16 @@ status_t PowerManager::powerHint(int hintId, int data) {
 }
 
 status_t PowerManager::goToSleep(int64_t event_time_ms, int reason, int flags) {
-  if (event_time_ms < last_resume_uptime_.InMilliseconds()) {
-    LOG(WARNING) << "Ignoring request to suspend in response to event at "
-                 << event_time_ms << " preceding last resume time "
-                 << last_resume_uptime_.InMilliseconds();
-    return BAD_VALUE;
-  }
-
-  LOG(INFO) << "Suspending immediately for event at " << event_time_ms
-            << " (reason=" << reason << " flags=" << flags << ")";
-  if (base::WriteFile(power_state_path_, kPowerStateSuspend,
-                      strlen(kPowerStateSuspend)) !=
-      static_cast<int>(strlen(kPowerStateSuspend))) {
-    PLOG(ERROR) << "Failed to write \"" << kPowerStateSuspend << "\" to "
-                << power_state_path_.value();
-    return UNKNOWN_ERROR;
-  }
+  // A kernel lock that's only held for the release delay would make the
+  // suspend be avoided, so it's released first. Releasing it notifies
+  // |suspender_| synchronously. If it can't be released, the suspend is
+  // avoided and retried as usual.
+  wake_lock_manager_->ReleaseIdleKernelLock();
 
-  last_resume_uptime_ = base::SysInfo::Uptime();
-  LOG(INFO) << "Resumed from suspend at "
-            << last_resume_uptime_.InMilliseconds();
-  return OK;
+  // The suspend thread blocks until the system resumes, so the caller only
+  // waits for the request to be accepted.
+  return suspender_.RequestSuspend(event_time_ms, reason, flags) ? OK
+                                                                 : BAD_VALUE;
 }
 
 status_t PowerManager::reboot(bool confirm, const String16& reason, bool wait) {
@@ -162,12 +203,135 @@ status_t PowerManager::crash(const String16& message) {
   return OK;
 }
 
+status_t PowerManager::acquireWakeLockWithTimeout(int flags,
+                                                  const sp<IBinder>& lock,
+                                                  const String16& tag,
+                                                  const String16& packageName,
+                                                  int64_t timeout_ms) {
+  if (timeout_ms <= 0) {
+    LOG(WARNING) << "Ignoring wake lock request with invalid timeout "
+                 << timeout_ms;
+    return BAD_VALUE;
+  }
+  return AddWakeLockRequest(lock, tag, packageName,
+                            BinderWrapper::Get()->GetCallingUid(),
+                            base::TimeDelta::FromMilliseconds(timeout_ms))
+             ? OK
+             : UNKNOWN_ERROR;
+}
+
+status_t PowerManager::getWakeLockStats(std::vector<WakeLockStats>* stats) {
+  // The stats include every app's package, tags and uid.
+  const uid_t uid = BinderWrapper::Get()->GetCallingUid();
+  if (!IsPrivilegedUid(uid)) {
+    LOG(WARNING) << "Rejecting wake lock stats request from uid " << uid;
+    return PERMISSION_DENIED;
+  }
+
+  wake_lock_manager_->GetStats(stats);
+  return OK;
+}
+
+status_t PowerManager::getSuspendLatencyStats(SuspendLatencyStats* stats) {
+  suspender_.GetLatencyStats(stats);
+  return OK;
+}
+
+status_t PowerManager::updateWakeLocks(
+    const std::vector<WakeLockUpdate>& updates) {
+  const uid_t uid = BinderWrapper::Get()->GetCallingUid();
+  bool kernel_lock_updated = true;
+  wake_lock_manager_->BeginBatch();
+  for (const WakeLockUpdate& update : updates) {
+    if (update.type == WAKE_LOCK_UPDATE_ACQUIRE) {
+      kernel_lock_updated &= AddWakeLockRequest(
+          update.lock, update.tag, update.package_name, uid,
+          base::TimeDelta::FromMilliseconds(update.timeout_ms));
+    } else {
+      wake_lock_manager_->RemoveRequest(update.lock);
+    }
+  }
+  kernel_lock_updated &= wake_lock_manager_->EndBatch();
+
+  // The updates have been applied at this point: AddRequest() only fails
+  // without adding the request if the caller's binder already died, in which
+  // case nobody is left to read the reply. Reporting an error would make the
+  // client drop its new locks without releasing them, so a failure to update
+  // the kernel lock (which is retried by its heartbeat) is only logged.
+  if (!kernel_lock_updated)
+    LOG(ERROR) << "Failed to update kernel wake lock for batched update";
+  return OK;
+}
+
+status_t PowerManager::dump(int fd, const Vector<String16>& args) {
+  // The output includes other processes' wake lock tags, and draining discards
+  // events, so only privileged callers may dump.
+  const uid_t uid = BinderWrapper::Get()->GetCallingUid();
+  if (!IsPrivilegedUid(uid)) {
+    LOG(WARNING) << "Rejecting dump request from uid " << uid;
+    const std::string message = base::StringPrintf(
+        "Permission denial: can't dump from uid %u\n", uid);
+    base::WriteFileDescriptor(fd, message.data(), message.size());
+    return PERMISSION_DENIED;
+  }
+
+  bool drain = false;
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (args[i] == String16(kDumpDrainArg))
+      drain = true;
+  }
+
+  std::string output = "Wake lock events:\n";
+  wake_lock_manager_->DumpEvents(drain, &output);
+  output += "Suspends:\n";
+  suspender_.DumpStats(&output);
+  output += "Suspend retries:\n";
+  suspend_retrier_.DumpStats(&output);
+  output += "Resumes:\n";
+  suspender_.resume_collector()->DumpStats(&output);
+  return base::WriteFileDescriptor(fd, output.data(), output.size())
+             ? OK
+             : UNKNOWN_ERROR;
+}
+
+void PowerManager::HandleSuspendResult(const Suspender::Result& result) {
+  if (result.autosleep)
+    autosleeper_.HandleSuspendResult(result);
+  suspend_retrier_.HandleSuspendResult(result);
+
+  switch (result.status) {
+    case Suspender::Result::Status::SUSPENDED:
+      LOG(INFO) << "Resumed at " << result.resume_uptime.InMilliseconds()
+                << " from suspend for " << result.GetRequestDescription();
+      break;
+    case Suspender::Result::Status::FAILED:
+      // Failed autosleep attempts are retried with back-off, so they're only
+      // logged if they were merged with other requests.
+      if (!result.reasons.empty()) {
+        LOG(ERROR) << "Failed to suspend for "
+                   << result.GetRequestDescription();
+      }
+      break;
+    case Suspender::Result::Status::AVOIDED:
+    case Suspender::Result::Status::ABORTED:
+    case Suspender::Result::Status::STALE:
+      // Suspender logs these; the system stays awake to handle the event.
+      break;
+  }
+}
+
+void PowerManager::HandleKernelLockChange(bool held) {
+  suspender_.SetKernelLockHeld(held);
+  autosleeper_.SetKernelLockHeld(held);
+  suspend_retrier_.SetKernelLockHeld(held);
+}
+
 bool PowerManager::AddWakeLockRequest(const sp<IBinder>& lock,
                                       const String16& tag,
                                       const String16& packageName,
-                                      int uid) {
-  return wake_lock_manager_->AddRequest(lock, String8(tag).string(),
-                                        String8(packageName).string(), uid);
+                                      int uid,
+                                      base::TimeDelta timeout) {
+  return wake_lock_manager_->AddRequest(lock, tag, packageName, uid, timeout);
 }
 
 }  // namespace android
@@ -24,6 +24,9 @@
 #include <base/time/time.h>
 #include <nativepower/BnPowerManager.h>
 
+#include "autosleeper.h"
+#include "suspend_retrier.h"
+#include "suspender.h"
 #include "system_property_setter.h"
 #include "wake_lock_manager.h"
 
@@ -37,9 +40,6 @@ class PowerManager : public BnPowerManager {
   static const char kRebootPrefix[];
   static const char kShutdownPrefix[];
 
-  // Value written to |power_state_path_| to suspend the system to memory.
-  static const char kPowerStateSuspend[];
-
   PowerManager();
   ~PowerManager() override;
 
@@ -55,10 +55,41 @@ class PowerManager : public BnPowerManager {
     wake_lock_manager_ = std::move(manager);
   }
 
+  // Must be called before Init(). Ignored if a WakeLockManagerInterface was
+  // passed to set_wake_lock_manager_for_testing().
+  void set_wake_lock_manager_options(const WakeLockManager::Options& options) {
+    wake_lock_manager_options_ = options;
+  }
+
+  // Must be called before Init().
   void set_power_state_path_for_testing(const base::FilePath& path) {
-    power_state_path_ = path;
+    suspender_.set_power_state_path_for_testing(path);
+  }
+  void set_wakeup_count_path_for_testing(const base::FilePath& path) {
+    suspender_.set_wakeup_count_path_for_testing(path);
   }
 
+  // Must be called before Init(). Autosleep is only driven by the real
+  // WakeLockManager, so USERSPACE mode has no effect if a
+  // WakeLockManagerInterface was passed to set_wake_lock_manager_for_testing().
+  void set_autosleep_options(const Autosleeper::Options& options) {
+    autosleep_options_ = options;
+  }
+
+  // Must be called before Init().
+  void set_autosleep_path_for_testing(const base::FilePath& path) {
+    autosleeper_.set_autosleep_path_for_testing(path);
+  }
+
+  // Must be called before Init().
+  void set_suspend_retry_options(const SuspendRetrier::Options& options) {
+    suspend_retry_options_ = options;
+  }
+
+  Suspender* suspender_for_testing() { return &suspender_; }
+  Autosleeper* autosleeper_for_testing() { return &autosleeper_; }
+  SuspendRetrier* suspend_retrier_for_testing() { return &suspend_retrier_; }
+
   // Initializes the object, returning true on success.
   bool Init();
 
@@ -86,23 +117,53 @@ class PowerManager : public BnPowerManager {
   status_t reboot(bool confirm, const String16& reason, bool wait) override;
   status_t shutdown(bool confirm, const String16& reason, bool wait) override;
   status_t crash(const String16& message) override;
+  status_t acquireWakeLockWithTimeout(int flags,
+                                      const sp<IBinder>& lock,
+                                      const String16& tag,
+                                      const String16& packageName,
+                                      int64_t timeout_ms) override;
+  status_t getWakeLockStats(std::vector<WakeLockStats>* stats) override;
+  status_t getSuspendLatencyStats(SuspendLatencyStats* stats) override;
+  status_t updateWakeLocks(const std::vector<WakeLockUpdate>& updates) override;
+
+  // BBinder:
+  // Writes recent wake lock events, suspend counters and wakeup reasons to
+  // |fd|. If |args| contains "--drain", the events are discarded afterward.
+  // Only root and system callers are permitted.
+  status_t dump(int fd, const Vector<String16>& args) override;
 
  private:
+  // Called on the main thread when a request made by goToSleep() or
+  // |autosleeper_| completes.
+  void HandleSuspendResult(const Suspender::Result& result);
+
+  // Called by |wake_lock_manager_| on arbitrary threads when the kernel wake
+  // lock is acquired or released.
+  void HandleKernelLockChange(bool held);
+
   // Helper method for acquireWakeLock*(). Returns true on success.
   bool AddWakeLockRequest(const sp<IBinder>& lock,
                           const String16& tag,
                           const String16& packageName,
-                          int uid);
+                          int uid,
+                          base::TimeDelta timeout);
 
   std::unique_ptr<SystemPropertySetterInterface> property_setter_;
   std::unique_ptr<WakeLockManagerInterface> wake_lock_manager_;
+  WakeLockManager::Options wake_lock_manager_options_;
+
+  // Makes suspend requests on a dedicated thread.
+  Suspender suspender_;
 
-  // Path to sysfs file that can be written to change the power state.
-  base::FilePath power_state_path_;
+  // Suspends opportunistically while no wake locks are held. Notified of
+  // kernel lock transitions by |wake_lock_manager_|, which is destroyed first.
+  Autosleeper autosleeper_;
+  Autosleeper::Options autosleep_options_;
 
-  // System uptime (as duration since boot) when userspace was last resumed from
-  // suspend. Initially unset.
-  base::TimeDelta last_resume_uptime_;
+  // Retries failed goToSleep() requests. Also notified of kernel lock
+  // transitions.
+  SuspendRetrier suspend_retrier_;
+  SuspendRetrier::Options suspend_retry_options_;
 
   DISALLOW_COPY_AND_ASSIGN(PowerManager);
 };
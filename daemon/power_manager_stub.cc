@@ -14,9 +14,13 @@
  * limitations under the License.
  */
 
+#include <base/bind.h>
 #include <base/format_macros.h>
+#include <base/location.h>
 #include <base/logging.h>
+#include <base/message_loop/message_loop.h>
 #include <base/strings/stringprintf.h>
+#include <base/threading/platform_thread.h>
 #include <binderwrapper/binder_wrapper.h>
 #include <nativepower/power_manager_stub.h>
 #include <utils/String8.h>
@@ -49,7 +53,11 @@ std::string PowerManagerStub::ConstructSuspendRequestString(
 }
 
 PowerManagerStub::PowerManagerStub()
-    : wake_lock_manager_(new WakeLockManagerStub()) {}
+    : wake_lock_manager_(new WakeLockManagerStub()),
+      num_acquires_(0),
+      num_one_way_acquires_(0),
+      num_one_way_releases_(0),
+      num_pending_one_way_releases_(0) {}
 
 PowerManagerStub::~PowerManagerStub() = default;
 
@@ -62,6 +70,15 @@ std::string PowerManagerStub::GetWakeLockString(
   return wake_lock_manager_->GetRequestString(binder);
 }
 
+base::TimeDelta PowerManagerStub::GetWakeLockTimeout(
+    const sp<IBinder>& binder) const {
+  return wake_lock_manager_->GetRequestTimeout(binder);
+}
+
+int PowerManagerStub::GetNumWakeLockBatches() const {
+  return wake_lock_manager_->num_batches();
+}
+
 std::string PowerManagerStub::GetSuspendRequestString(size_t index) const {
   if (index >= suspend_requests_.size())
     return std::string();
@@ -76,9 +93,19 @@ status_t PowerManagerStub::acquireWakeLock(int flags,
                                            const String16& tag,
                                            const String16& packageName,
                                            bool isOneWay) {
-  CHECK(wake_lock_manager_->AddRequest(lock, String8(tag).string(),
-                                       String8(packageName).string(),
-                                       BinderWrapper::Get()->GetCallingUid()));
+  const uid_t uid = BinderWrapper::Get()->GetCallingUid();
+  if (isOneWay) {
+    num_one_way_acquires_++;
+    base::MessageLoop::current()->task_runner()->PostTask(
+        FROM_HERE, base::Bind(&PowerManagerStub::HandleOneWayAcquire,
+                              base::Unretained(this), lock, tag, packageName,
+                              uid));
+    return OK;
+  }
+
+  HandleAcquire();
+  CHECK(wake_lock_manager_->AddRequest(lock, tag, packageName, uid,
+                                       base::TimeDelta()));
   return OK;
 }
 
@@ -88,16 +115,25 @@ status_t PowerManagerStub::acquireWakeLockWithUid(int flags,
                                                   const String16& packageName,
                                                   int uid,
                                                   bool isOneWay) {
-  CHECK(wake_lock_manager_->AddRequest(lock, String8(tag).string(),
-                                       String8(packageName).string(),
-                                       static_cast<uid_t>(uid)));
+  HandleAcquire();
+  CHECK(wake_lock_manager_->AddRequest(lock, tag, packageName,
+                                       static_cast<uid_t>(uid),
+                                       base::TimeDelta()));
   return OK;
 }
 
 status_t PowerManagerStub::releaseWakeLock(const sp<IBinder>& lock,
                                            int flags,
                                            bool isOneWay) {
-  CHECK(wake_lock_manager_->RemoveRequest(lock));
+  if (isOneWay) {
+    num_one_way_releases_++;
+    num_pending_one_way_releases_++;
+    base::MessageLoop::current()->task_runner()->PostTask(
+        FROM_HERE, base::Bind(&PowerManagerStub::HandleOneWayRelease,
+                              base::Unretained(this), lock));
+  } else {
+    CHECK(wake_lock_manager_->RemoveRequest(lock));
+  }
   return OK;
 }
 
@@ -105,7 +141,10 @@ status_t PowerManagerStub::updateWakeLockUids(const sp<IBinder>& lock,
                                               int len,
                                               const int* uids,
                                               bool isOneWay) {
-  return OK;
+  return wake_lock_manager_->UpdateRequestUids(
+             lock, reinterpret_cast<const uid_t*>(uids), len)
+             ? OK
+             : UNKNOWN_ERROR;
 }
 
 status_t PowerManagerStub::powerHint(int hintId, int data) {
@@ -137,4 +176,66 @@ status_t PowerManagerStub::crash(const String16& message) {
   return OK;
 }
 
+status_t PowerManagerStub::acquireWakeLockWithTimeout(
+    int flags,
+    const sp<IBinder>& lock,
+    const String16& tag,
+    const String16& packageName,
+    int64_t timeout_ms) {
+  HandleAcquire();
+  CHECK(wake_lock_manager_->AddRequest(
+      lock, tag, packageName, BinderWrapper::Get()->GetCallingUid(),
+      base::TimeDelta::FromMilliseconds(timeout_ms)));
+  return OK;
+}
+
+status_t PowerManagerStub::getWakeLockStats(
+    std::vector<WakeLockStats>* stats) {
+  wake_lock_manager_->GetStats(stats);
+  return OK;
+}
+
+status_t PowerManagerStub::getSuspendLatencyStats(
+    SuspendLatencyStats* stats) {
+  *stats = suspend_latency_stats_;
+  return OK;
+}
+
+status_t PowerManagerStub::updateWakeLocks(
+    const std::vector<WakeLockUpdate>& updates) {
+  const uid_t uid = BinderWrapper::Get()->GetCallingUid();
+  wake_lock_manager_->BeginBatch();
+  for (const WakeLockUpdate& update : updates) {
+    if (update.type == WAKE_LOCK_UPDATE_ACQUIRE) {
+      CHECK(wake_lock_manager_->AddRequest(
+          update.lock, update.tag, update.package_name, uid,
+          base::TimeDelta::FromMilliseconds(update.timeout_ms)));
+    } else {
+      wake_lock_manager_->RemoveRequest(update.lock);
+    }
+  }
+  CHECK(wake_lock_manager_->EndBatch());
+  return OK;
+}
+
+void PowerManagerStub::HandleAcquire() {
+  if (acquire_latency_ > base::TimeDelta())
+    base::PlatformThread::Sleep(acquire_latency_);
+  num_acquires_++;
+}
+
+void PowerManagerStub::HandleOneWayAcquire(const sp<IBinder>& lock,
+                                           const String16& tag,
+                                           const String16& package,
+                                           uid_t uid) {
+  HandleAcquire();
+  CHECK(wake_lock_manager_->AddRequest(lock, tag, package, uid,
+                                       base::TimeDelta()));
+}
+
+void PowerManagerStub::HandleOneWayRelease(const sp<IBinder>& lock) {
+  num_pending_one_way_releases_--;
+  CHECK(wake_lock_manager_->RemoveRequest(lock));
+}
+
 }  // namespace android
@@ -14,17 +14,32 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
 #include <base/files/file_util.h>
+#include <base/files/scoped_file.h>
 #include <base/files/scoped_temp_dir.h>
 #include <base/macros.h>
+#include <base/message_loop/message_loop.h>
+#include <base/run_loop.h>
 #include <base/sys_info.h>
+#include <base/test/simple_test_tick_clock.h>
 #include <binder/IBinder.h>
 #include <binder/IInterface.h>
+#include <binder/Parcel.h>
 #include <binderwrapper/binder_test_base.h>
 #include <binderwrapper/stub_binder_wrapper.h>
 #include <cutils/android_reboot.h>
 #include <nativepower/constants.h>
 #include <powermanager/PowerManager.h>
+#include <private/android_filesystem_config.h>
+#include <utils/String16.h>
+#include <utils/Vector.h>
 
 #include "power_manager.h"
 #include "system_property_setter_stub.h"
@@ -44,6 +59,10 @@ class PowerManagerTest : public BinderTestBase {
     power_state_path_ = temp_dir_.path().Append("power_state");
     power_manager_->set_power_state_path_for_testing(power_state_path_);
     ClearPowerState();
+    const base::FilePath wakeup_count_path =
+        temp_dir_.path().Append("wakeup_count");
+    PCHECK(base::WriteFile(wakeup_count_path, "1\n", 2) == 2);
+    power_manager_->set_wakeup_count_path_for_testing(wakeup_count_path);
 
     power_manager_->set_property_setter_for_testing(
         std::unique_ptr<SystemPropertySetterInterface>(property_setter_));
@@ -69,6 +88,14 @@ class PowerManagerTest : public BinderTestBase {
         << "Failed to write " << power_state_path_.value();
   }
 
+  // Waits for the suspend thread to handle pending requests and then runs the
+  // tasks that it posted to report their results.
+  void FlushSuspends() {
+    power_manager_->suspender_for_testing()->FlushForTesting();
+    base::RunLoop().RunUntilIdle();
+  }
+
+  base::MessageLoop message_loop_;
   base::ScopedTempDir temp_dir_;
   sp<PowerManager> power_manager_;
   sp<IPowerManager> interface_;
@@ -117,17 +144,97 @@ TEST_F(PowerManagerTest, AcquireAndReleaseWakeLock) {
           binder_wrapper()->local_binders()[0]));
 }
 
+TEST_F(PowerManagerTest, OneWayRelease) {
+  sp<BBinder> binder = binder_wrapper()->CreateLocalBinder();
+  EXPECT_EQ(OK, interface_->acquireWakeLock(0, binder, String16("foo"),
+                                            String16("bar")));
+  EXPECT_EQ(1, wake_lock_manager_->num_requests());
+
+  // Send the release the way that BpPowerManager does for one-way calls.
+  Parcel data, reply;
+  data.writeInterfaceToken(IPowerManager::getInterfaceDescriptor());
+  data.writeStrongBinder(binder);
+  data.writeInt32(0);
+  EXPECT_EQ(OK, power_manager_->transact(IPowerManager::RELEASE_WAKE_LOCK, data,
+                                         &reply, IBinder::FLAG_ONEWAY));
+  EXPECT_EQ(0, wake_lock_manager_->num_requests());
+}
+
+TEST_F(PowerManagerTest, UpdateWakeLockUids) {
+  sp<BBinder> binder = binder_wrapper()->CreateLocalBinder();
+  EXPECT_EQ(OK, interface_->acquireWakeLock(0, binder, String16("foo"),
+                                            String16("bar")));
+
+  // Send the update the way that BpPowerManager does.
+  const int32_t kUids[] = {100, 200, 300};
+  Parcel data, reply;
+  data.writeInterfaceToken(IPowerManager::getInterfaceDescriptor());
+  data.writeStrongBinder(binder);
+  data.writeInt32Array(arraysize(kUids), kUids);
+  EXPECT_EQ(OK, power_manager_->transact(IPowerManager::UPDATE_WAKE_LOCK_UIDS,
+                                         data, &reply));
+  EXPECT_EQ(std::vector<uid_t>({100, 200, 300}),
+            wake_lock_manager_->GetRequestUids(binder));
+
+  // A null array should clear the work source.
+  data.setDataSize(0);
+  data.writeInterfaceToken(IPowerManager::getInterfaceDescriptor());
+  data.writeStrongBinder(binder);
+  data.writeInt32Array(0, nullptr);
+  EXPECT_EQ(OK, power_manager_->transact(IPowerManager::UPDATE_WAKE_LOCK_UIDS,
+                                         data, &reply));
+  EXPECT_TRUE(wake_lock_manager_->GetRequestUids(binder).empty());
+
+  // An array whose length exceeds the parcel's size should be rejected.
+  data.setDataSize(0);
+  data.writeInterfaceToken(IPowerManager::getInterfaceDescriptor());
+  data.writeStrongBinder(binder);
+  data.writeInt32(arraysize(kUids) + 1);
+  for (int32_t uid : kUids)
+    data.writeInt32(uid);
+  EXPECT_EQ(BAD_VALUE,
+            power_manager_->transact(IPowerManager::UPDATE_WAKE_LOCK_UIDS,
+                                     data, &reply));
+
+  // Updates for unknown locks should fail.
+  EXPECT_EQ(OK, interface_->releaseWakeLock(binder, 0));
+  EXPECT_NE(OK, interface_->updateWakeLockUids(binder, arraysize(kUids),
+                                               kUids));
+}
+
+TEST_F(PowerManagerTest, AcquireWakeLockWithTimeout) {
+  sp<BBinder> binder = binder_wrapper()->CreateLocalBinder();
+  EXPECT_EQ(OK, power_manager_->acquireWakeLockWithTimeout(
+                    0, binder, String16("foo"), String16("bar"), 1500));
+  EXPECT_EQ(1, wake_lock_manager_->num_requests());
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(1500),
+            wake_lock_manager_->GetRequestTimeout(binder));
+
+  // Nonpositive timeouts should be rejected.
+  EXPECT_EQ(OK, interface_->releaseWakeLock(binder, 0));
+  EXPECT_EQ(BAD_VALUE, power_manager_->acquireWakeLockWithTimeout(
+                           0, binder, String16("foo"), String16("bar"), 0));
+  EXPECT_EQ(0, wake_lock_manager_->num_requests());
+}
+
 TEST_F(PowerManagerTest, GoToSleep) {
   EXPECT_EQ("", ReadPowerState());
 
+  // The request should be accepted immediately and then carried out by the
+  // suspend thread.
   const int64_t kStartTime = base::SysInfo::Uptime().InMilliseconds();
   EXPECT_EQ(OK,
             interface_->goToSleep(kStartTime, 0 /* reason */, 0 /* flags */));
-  EXPECT_EQ(PowerManager::kPowerStateSuspend, ReadPowerState());
+  FlushSuspends();
+  EXPECT_EQ(Suspender::kPowerStateSuspend, ReadPowerState());
+  Suspender* suspender = power_manager_->suspender_for_testing();
+  EXPECT_EQ(1, suspender->num_suspend_attempts());
+  EXPECT_GE(suspender->GetLastResumeUptime().InMilliseconds(), kStartTime);
 
   // A request with a timestamp preceding the last resume should be ignored.
   ClearPowerState();
   EXPECT_EQ(BAD_VALUE, interface_->goToSleep(kStartTime - 1, 0, 0));
+  FlushSuspends();
   EXPECT_EQ("", ReadPowerState());
 
   // A second attempt with a timestamp occurring after the last
@@ -136,7 +243,106 @@ TEST_F(PowerManagerTest, GoToSleep) {
   EXPECT_EQ(
       OK,
       interface_->goToSleep(base::SysInfo::Uptime().InMilliseconds(), 0, 0));
-  EXPECT_EQ(PowerManager::kPowerStateSuspend, ReadPowerState());
+  FlushSuspends();
+  EXPECT_EQ(Suspender::kPowerStateSuspend, ReadPowerState());
+  EXPECT_EQ(2, suspender->num_suspend_attempts());
+}
+
+TEST_F(PowerManagerTest, GoToSleepReleasesIdleKernelLock) {
+  // The kernel lock may still be held for the release delay after the last
+  // wake lock was released; it should be dropped before suspending.
+  EXPECT_EQ(OK, interface_->goToSleep(
+                    base::SysInfo::Uptime().InMilliseconds(), 0, 0));
+  EXPECT_EQ(1, wake_lock_manager_->num_idle_kernel_lock_releases());
+  FlushSuspends();
+  EXPECT_EQ(Suspender::kPowerStateSuspend, ReadPowerState());
+}
+
+TEST_F(PowerManagerTest, GoToSleepRetry) {
+  base::SimpleTestTickClock* clock = new base::SimpleTestTickClock();
+  SuspendRetrier* retrier = power_manager_->suspend_retrier_for_testing();
+  retrier->set_tick_clock_for_testing(std::unique_ptr<base::TickClock>(clock));
+
+  // If the kernel refuses to suspend, the request should be retried later
+  // without the client making another call.
+  Suspender* suspender = power_manager_->suspender_for_testing();
+  suspender->FlushForTesting();
+  suspender->power_state_writer_for_testing()->set_write_error_for_testing(
+      EBUSY);
+  EXPECT_EQ(OK, interface_->goToSleep(
+                    base::SysInfo::Uptime().InMilliseconds(), 0, 0));
+  FlushSuspends();
+  EXPECT_EQ("", ReadPowerState());
+  EXPECT_GT(retrier->current_delay(), base::TimeDelta());
+
+  suspender->power_state_writer_for_testing()->set_write_error_for_testing(0);
+  clock->Advance(retrier->retry_time() - clock->NowTicks());
+  EXPECT_TRUE(retrier->TriggerRetryForTesting());
+  FlushSuspends();
+  EXPECT_EQ(Suspender::kPowerStateSuspend, ReadPowerState());
+  EXPECT_EQ(1, retrier->num_retries());
+  EXPECT_EQ(base::TimeDelta(), retrier->current_delay());
+}
+
+TEST_F(PowerManagerTest, UpdateWakeLocksWithKernelLockFailure) {
+  sp<BBinder> old_binder = binder_wrapper()->CreateLocalBinder();
+  sp<BBinder> new_binder = binder_wrapper()->CreateLocalBinder();
+  ASSERT_EQ(OK, interface_->acquireWakeLock(0, old_binder, String16("old"),
+                                            String16("pkg")));
+
+  // The batch should still be reported as applied if the kernel lock couldn't
+  // be updated, since the client would otherwise lose track of the new lock.
+  wake_lock_manager_->set_kernel_lock_failure(true);
+  std::vector<BnPowerManager::WakeLockUpdate> updates(2);
+  updates[0].type = BnPowerManager::WAKE_LOCK_UPDATE_RELEASE;
+  updates[0].lock = old_binder;
+  updates[1].lock = new_binder;
+  updates[1].tag = String16("new");
+  updates[1].package_name = String16("pkg");
+  EXPECT_EQ(OK, power_manager_->updateWakeLocks(updates));
+  EXPECT_EQ(1, wake_lock_manager_->num_requests());
+  EXPECT_EQ("", wake_lock_manager_->GetRequestString(old_binder));
+  EXPECT_NE("", wake_lock_manager_->GetRequestString(new_binder));
+}
+
+TEST_F(PowerManagerTest, DumpPermission) {
+  const base::FilePath path = temp_dir_.path().Append("dump");
+  Vector<String16> args;
+  args.push(String16("--drain"));
+
+  // Unprivileged callers shouldn't be able to dump or drain the event log.
+  base::ScopedFD fd(open(path.value().c_str(),
+                         O_WRONLY | O_CREAT | O_TRUNC, 0600));
+  ASSERT_TRUE(fd.is_valid());
+  binder_wrapper()->set_calling_uid(AID_SHELL);
+  EXPECT_EQ(PERMISSION_DENIED, power_manager_->dump(fd.get(), args));
+  std::string output;
+  ASSERT_TRUE(base::ReadFileToString(path, &output));
+  EXPECT_EQ(std::string::npos, output.find("Wake lock events"));
+
+  fd.reset(open(path.value().c_str(), O_WRONLY | O_TRUNC));
+  ASSERT_TRUE(fd.is_valid());
+  binder_wrapper()->set_calling_uid(AID_SYSTEM);
+  EXPECT_EQ(OK, power_manager_->dump(fd.get(), args));
+  ASSERT_TRUE(base::ReadFileToString(path, &output));
+  EXPECT_EQ(0u, output.find("Wake lock events"));
+}
+
+TEST_F(PowerManagerTest, WakeLockStatsPermission) {
+  sp<BBinder> binder = binder_wrapper()->CreateLocalBinder();
+  binder_wrapper()->set_calling_uid(AID_SHELL);
+  EXPECT_EQ(OK, interface_->acquireWakeLock(0, binder, String16("tag"),
+                                            String16("pkg")));
+
+  // Unprivileged callers shouldn't see other apps' wake locks.
+  std::vector<WakeLockStats> stats;
+  EXPECT_EQ(PERMISSION_DENIED, power_manager_->getWakeLockStats(&stats));
+  EXPECT_TRUE(stats.empty());
+
+  binder_wrapper()->set_calling_uid(AID_SYSTEM);
+  EXPECT_EQ(OK, power_manager_->getWakeLockStats(&stats));
+  ASSERT_EQ(1u, stats.size());
+  EXPECT_EQ("tag", stats[0].tag);
 }
 
 TEST_F(PowerManagerTest, Reboot) {
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "resume_collector.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <base/format_macros.h>
+#include <base/logging.h>
+#include <base/posix/eintr_wrapper.h>
+#include <base/strings/stringprintf.h>
+
+namespace android {
+namespace {
+
+// Paths to the real sysfs file listing the interrupts that caused the last
+// resume and the directory containing the kernel's suspend counters.
+const char kDefaultWakeupReasonPath[] =
+    "/sys/kernel/wakeup_reasons/last_resume_reason";
+const char kDefaultSuspendStatsDir[] = "/sys/power/suspend_stats";
+
+// Names of files within the suspend_stats directory.
+const char kSuccessFile[] = "success";
+const char kFailFile[] = "fail";
+
+// Copies up to |size| - 1 bytes of the first line of |src| into |dest| and
+// NUL-terminates it.
+void CopyFirstLine(const char* src, char* dest, size_t size) {
+  size_t length = strcspn(src, "\n");
+  length = std::min(length, size - 1);
+  memcpy(dest, src, length);
+  dest[length] = '\0';
+}
+
+}  // namespace
+
+const size_t ResumeCollector::kMaxReasonSize;
+const size_t ResumeCollector::kDefaultMaxRecords;
+const size_t ResumeCollector::kMaxReasons;
+const char ResumeCollector::kOtherReasons[] = "(other)";
+
+ResumeCollector::Record::Record()
+    : irq(-1), kernel_successes(-1), kernel_failures(-1) {
+  reason[0] = '\0';
+}
+
+ResumeCollector::ResumeCollector(size_t max_records)
+    : wakeup_reason_path_(kDefaultWakeupReasonPath),
+      suspend_stats_dir_(kDefaultSuspendStatsDir),
+      records_(max_records),
+      num_resumes_(0),
+      num_other_reasons_(0) {
+  DCHECK_GT(max_records, 0u);
+  buffer_[0] = '\0';
+  reason_counts_.reserve(kMaxReasons);
+}
+
+ResumeCollector::~ResumeCollector() = default;
+
+void ResumeCollector::Open() {
+  OpenFile(wakeup_reason_path_, &wakeup_reason_fd_);
+  OpenFile(suspend_stats_dir_.Append(kSuccessFile), &success_fd_);
+  OpenFile(suspend_stats_dir_.Append(kFailFile), &fail_fd_);
+}
+
+void ResumeCollector::HandleResume(base::TimeDelta resume_uptime,
+                                   base::TimeDelta sleep_time) {
+  Record record;
+  record.resume_uptime = resume_uptime;
+  record.sleep_time = sleep_time;
+
+  // Each line of last_resume_reason is either "<irq> <name>" or, if the
+  // suspend was aborted, "Abort: <description>".
+  if (ReadFile(wakeup_reason_fd_) > 0) {
+    CopyFirstLine(buffer_, record.reason, sizeof(record.reason));
+    if (isdigit(static_cast<unsigned char>(buffer_[0])))
+      record.irq = static_cast<int>(strtol(buffer_, nullptr, 10));
+  }
+  record.kernel_successes = ReadCount(success_fd_);
+  record.kernel_failures = ReadCount(fail_fd_);
+
+  base::AutoLock lock(lock_);
+  records_[num_resumes_ % records_.size()] = record;
+  num_resumes_++;
+
+  for (ReasonCount& count : reason_counts_) {
+    if (strcmp(count.reason, record.reason) == 0) {
+      count.count++;
+      return;
+    }
+  }
+  if (reason_counts_.size() < kMaxReasons) {
+    reason_counts_.push_back(ReasonCount());
+    memcpy(reason_counts_.back().reason, record.reason,
+           sizeof(record.reason));
+    reason_counts_.back().count = 1;
+  } else {
+    num_other_reasons_++;
+  }
+}
+
+int ResumeCollector::GetNumResumes() const {
+  base::AutoLock lock(lock_);
+  return num_resumes_;
+}
+
+void ResumeCollector::GetRecords(std::vector<Record>* records) const {
+  base::AutoLock lock(lock_);
+  const size_t size = records_.size();
+  const size_t num_resumes = static_cast<size_t>(num_resumes_);
+  const size_t num_records = std::min(num_resumes, size);
+  records->clear();
+  records->reserve(num_records);
+  for (size_t i = num_resumes - num_records; i < num_resumes; ++i)
+    records->push_back(records_[i % size]);
+}
+
+void ResumeCollector::GetReasonCounts(std::map<std::string, int>* counts)
+    const {
+  base::AutoLock lock(lock_);
+  counts->clear();
+  for (const ReasonCount& count : reason_counts_)
+    (*counts)[count.reason] = count.count;
+  if (num_other_reasons_)
+    (*counts)[kOtherReasons] = num_other_reasons_;
+}
+
+void ResumeCollector::DumpStats(std::string* output) const {
+  std::map<std::string, int> counts;
+  GetReasonCounts(&counts);
+
+  // Negated counts sort the most frequent reasons first.
+  std::vector<std::pair<int, std::string>> sorted_counts;
+  for (const auto& it : counts)
+    sorted_counts.push_back(std::make_pair(-it.second, it.first));
+  std::sort(sorted_counts.begin(), sorted_counts.end());
+
+  std::vector<Record> records;
+  GetRecords(&records);
+
+  base::StringAppendF(output, "resumes=%d\n", GetNumResumes());
+  for (const auto& it : sorted_counts) {
+    base::StringAppendF(output, "%d: %s\n", -it.first,
+                        it.second.empty() ? "(unknown)" : it.second.c_str());
+  }
+  for (const Record& record : records) {
+    base::StringAppendF(
+        output, "resumed at %" PRId64 " after %" PRId64 " ms asleep: %s\n",
+        record.resume_uptime.InMilliseconds(),
+        record.sleep_time.InMilliseconds(),
+        record.reason[0] ? record.reason : "(unknown)");
+  }
+}
+
+// static
+void ResumeCollector::OpenFile(const base::FilePath& path,
+                               base::ScopedFD* fd) {
+  fd->reset(HANDLE_EINTR(open(path.value().c_str(), O_RDONLY | O_CLOEXEC)));
+  if (!fd->is_valid())
+    PLOG(WARNING) << "Failed to open " << path.value();
+}
+
+ssize_t ResumeCollector::ReadFile(const base::ScopedFD& fd) {
+  if (!fd.is_valid())
+    return -1;
+
+  // Reading a sysfs attribute from offset 0 regenerates its contents, so the
+  // descriptor can be reused without seeking.
+  const ssize_t length =
+      HANDLE_EINTR(pread(fd.get(), buffer_, sizeof(buffer_) - 1, 0));
+  if (length < 0) {
+    PLOG(ERROR) << "Failed to read descriptor " << fd.get();
+    buffer_[0] = '\0';
+    return -1;
+  }
+  buffer_[length] = '\0';
+  return length;
+}
+
+int64_t ResumeCollector::ReadCount(const base::ScopedFD& fd) {
+  if (ReadFile(fd) <= 0)
+    return -1;
+  char* end = nullptr;
+  const long long count = strtoll(buffer_, &end, 10);
+  if (end == buffer_ || count < 0)
+    return -1;
+  return count;
+}
+
+}  // namespace android
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SYSTEM_NATIVEPOWER_DAEMON_RESUME_COLLECTOR_H_
+#define SYSTEM_NATIVEPOWER_DAEMON_RESUME_COLLECTOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <base/files/file_path.h>
+#include <base/files/scoped_file.h>
+#include <base/macros.h>
+#include <base/synchronization/lock.h>
+#include <base/time/time.h>
+
+namespace android {
+
+// Records why and for how long the system slept each time it resumes, so that
+// the interrupts that most often wake it can be identified.
+//
+// After each resume, the kernel's wakeup reason and suspend counters are read
+// from sysfs through descriptors that are opened once, into a fixed buffer,
+// and parsed in place. The most recent records are kept in a ring, and counts
+// are aggregated by wakeup reason in a fixed-size table, so recording a resume
+// doesn't allocate memory.
+//
+// Only suspends made through Suspender are recorded: HandleResume() is called
+// by the suspend thread when its write to /sys/power/state returns. Suspends
+// that the kernel makes on its own while Autosleeper is in KERNEL mode don't
+// notify userspace, so those resumes aren't recorded, although the kernel
+// counters read after the next recorded resume still include them.
+class ResumeCollector {
+ public:
+  // Size of the buffer holding a recorded wakeup reason, including the
+  // terminating NUL. Longer reasons are truncated.
+  static const size_t kMaxReasonSize = 64;
+
+  // Number of records kept by default.
+  static const size_t kDefaultMaxRecords = 32;
+
+  // Number of distinct wakeup reasons that are counted separately. Resumes
+  // with further reasons are counted under kOtherReasons.
+  static const size_t kMaxReasons = 32;
+  static const char kOtherReasons[];
+
+  struct Record {
+    Record();
+
+    // Uptime (i.e. CLOCK_MONOTONIC) at which the system resumed.
+    base::TimeDelta resume_uptime;
+
+    // Time spent asleep, as reported by Suspender.
+    base::TimeDelta sleep_time;
+
+    // IRQ number of the first wakeup reason, or -1 if the kernel didn't
+    // report one (e.g. it only reported an aborted suspend).
+    int irq;
+
+    // First line of last_resume_reason (e.g. "123 gpio_keys"), NUL-terminated
+    // and empty if it couldn't be read.
+    char reason[kMaxReasonSize];
+
+    // The kernel's cumulative counts of successful and failed suspends from
+    // suspend_stats, or -1 if they couldn't be read.
+    int64_t kernel_successes;
+    int64_t kernel_failures;
+  };
+
+  explicit ResumeCollector(size_t max_records = kDefaultMaxRecords);
+  ~ResumeCollector();
+
+  // Must be called before Open().
+  void set_wakeup_reason_path_for_testing(const base::FilePath& path) {
+    wakeup_reason_path_ = path;
+  }
+  void set_suspend_stats_dir_for_testing(const base::FilePath& path) {
+    suspend_stats_dir_ = path;
+  }
+
+  // Opens the sysfs files. Files that can't be opened (e.g. because the
+  // kernel doesn't support wakeup reasons) are logged once and skipped.
+  void Open();
+
+  // Records a resume at |resume_uptime| after sleeping for |sleep_time|.
+  // Should be called right after resuming, before the system can suspend
+  // again. Must not be called concurrently with itself or Open().
+  void HandleResume(base::TimeDelta resume_uptime,
+                    base::TimeDelta sleep_time);
+
+  // Total number of resumes recorded.
+  int GetNumResumes() const;
+
+  // Copies the retained records, oldest first, to |records|.
+  void GetRecords(std::vector<Record>* records) const;
+
+  // Copies the number of resumes attributed to each wakeup reason (keyed by
+  // Record::reason, so unknown reasons are under "") to |counts|.
+  void GetReasonCounts(std::map<std::string, int>* counts) const;
+
+  // Appends the reason counts (most frequent first) and the retained records
+  // to |output|.
+  void DumpStats(std::string* output) const;
+
+ private:
+  // Opens |path| for reading into |fd|, which is left invalid on failure.
+  static void OpenFile(const base::FilePath& path, base::ScopedFD* fd);
+
+  // Reads the contents of |fd| into |buffer_| and NUL-terminates them.
+  // Returns the length, or -1 on failure.
+  ssize_t ReadFile(const base::ScopedFD& fd);
+
+  // Reads a decimal count from |fd|, returning -1 on failure.
+  int64_t ReadCount(const base::ScopedFD& fd);
+
+  base::FilePath wakeup_reason_path_;
+  base::FilePath suspend_stats_dir_;
+
+  // Descriptors for last_resume_reason and suspend_stats/{success,fail}.
+  base::ScopedFD wakeup_reason_fd_;
+  base::ScopedFD success_fd_;
+  base::ScopedFD fail_fd_;
+
+  // Scratch space for reads. Only used by HandleResume().
+  char buffer_[256];
+
+  // Guards the members below it, which are written by HandleResume() and
+  // read on arbitrary threads.
+  mutable base::Lock lock_;
+
+  // Ring of the most recent records. The oldest is at |num_resumes_| modulo
+  // its size once it's full.
+  std::vector<Record> records_;
+  int num_resumes_;
+
+  // Counts of resumes by wakeup reason, in order of first occurrence. Holds
+  // at most kMaxReasons entries.
+  struct ReasonCount {
+    char reason[kMaxReasonSize];
+    int count;
+  };
+  std::vector<ReasonCount> reason_counts_;
+  int num_other_reasons_;
+
+  DISALLOW_COPY_AND_ASSIGN(ResumeCollector);
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_DAEMON_RESUME_COLLECTOR_H_
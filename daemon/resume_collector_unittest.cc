@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
+#include <base/macros.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/time/time.h>
+#include <gtest/gtest.h>
+
+#include "resume_collector.h"
+
+namespace android {
+
+class ResumeCollectorTest : public testing::Test {
+ public:
+  ResumeCollectorTest() : num_successes_(0) {
+    CHECK(temp_dir_.CreateUniqueTempDir());
+    wakeup_reason_path_ = temp_dir_.path().Append("last_resume_reason");
+    suspend_stats_dir_ = temp_dir_.path().Append("suspend_stats");
+    CHECK(base::CreateDirectory(suspend_stats_dir_));
+    WriteFile(wakeup_reason_path_, "");
+    WriteFile(suspend_stats_dir_.Append("success"), "0\n");
+    WriteFile(suspend_stats_dir_.Append("fail"), "0\n");
+  }
+  ~ResumeCollectorTest() override = default;
+
+ protected:
+  // Points |collector| at the files in |temp_dir_| and opens them.
+  void Open(ResumeCollector* collector) {
+    collector->set_wakeup_reason_path_for_testing(wakeup_reason_path_);
+    collector->set_suspend_stats_dir_for_testing(suspend_stats_dir_);
+    collector->Open();
+  }
+
+  // Simulates the kernel's files after a resume with |reason| and then
+  // records a resume at |uptime_ms| after sleeping for |sleep_ms|.
+  void Resume(ResumeCollector* collector,
+              const std::string& reason,
+              int64_t uptime_ms,
+              int64_t sleep_ms) {
+    WriteFile(wakeup_reason_path_, reason);
+    num_successes_++;
+    WriteFile(suspend_stats_dir_.Append("success"),
+              base::IntToString(num_successes_) + "\n");
+    collector->HandleResume(base::TimeDelta::FromMilliseconds(uptime_ms),
+                            base::TimeDelta::FromMilliseconds(sleep_ms));
+  }
+
+  // Replaces the contents of |path| with |data|.
+  static void WriteFile(const base::FilePath& path, const std::string& data) {
+    CHECK(base::WriteFile(path, data.data(), data.size()) ==
+          static_cast<int>(data.size()));
+  }
+
+  base::ScopedTempDir temp_dir_;
+
+  // Files within |temp_dir_| simulating
+  // /sys/kernel/wakeup_reasons/last_resume_reason and
+  // /sys/power/suspend_stats.
+  base::FilePath wakeup_reason_path_;
+  base::FilePath suspend_stats_dir_;
+
+  // Value most recently written to suspend_stats/success.
+  int num_successes_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ResumeCollectorTest);
+};
+
+TEST_F(ResumeCollectorTest, RecordResumes) {
+  ResumeCollector collector;
+  Open(&collector);
+  Resume(&collector, "123 gpio_keys\n45 rtc\n", 1000, 5000);
+  Resume(&collector, "Abort: Pending Wakeup Sources: radio\n", 2000, 0);
+  EXPECT_EQ(2, collector.GetNumResumes());
+
+  std::vector<ResumeCollector::Record> records;
+  collector.GetRecords(&records);
+  ASSERT_EQ(2u, records.size());
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(1000),
+            records[0].resume_uptime);
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(5000), records[0].sleep_time);
+  EXPECT_EQ(123, records[0].irq);
+  EXPECT_STREQ("123 gpio_keys", records[0].reason);
+  EXPECT_EQ(1, records[0].kernel_successes);
+  EXPECT_EQ(0, records[0].kernel_failures);
+
+  // Aborts don't identify an interrupt.
+  EXPECT_EQ(-1, records[1].irq);
+  EXPECT_STREQ("Abort: Pending Wakeup Sources: radio", records[1].reason);
+  EXPECT_EQ(2, records[1].kernel_successes);
+}
+
+TEST_F(ResumeCollectorTest, CountReasons) {
+  ResumeCollector collector;
+  Open(&collector);
+  Resume(&collector, "45 rtc\n", 1000, 10);
+  Resume(&collector, "123 gpio_keys\n", 2000, 10);
+  Resume(&collector, "45 rtc\n", 3000, 10);
+
+  std::map<std::string, int> counts;
+  collector.GetReasonCounts(&counts);
+  EXPECT_EQ((std::map<std::string, int>{{"45 rtc", 2}, {"123 gpio_keys", 1}}),
+            counts);
+
+  // The most frequent reason should be listed first.
+  std::string dump;
+  collector.DumpStats(&dump);
+  EXPECT_EQ(0u, dump.find("resumes=3\n2: 45 rtc\n1: 123 gpio_keys\n"));
+  EXPECT_NE(std::string::npos,
+            dump.find("resumed at 3000 after 10 ms asleep: 45 rtc\n"));
+}
+
+TEST_F(ResumeCollectorTest, TooManyReasons) {
+  ResumeCollector collector;
+  Open(&collector);
+  const int kNumReasons = ResumeCollector::kMaxReasons + 2;
+  for (int i = 0; i < kNumReasons; ++i)
+    Resume(&collector, base::IntToString(i) + " irq\n", i, 0);
+
+  // Reasons beyond the table's capacity should be counted together.
+  std::map<std::string, int> counts;
+  collector.GetReasonCounts(&counts);
+  EXPECT_EQ(ResumeCollector::kMaxReasons + 1, counts.size());
+  EXPECT_EQ(2, counts[ResumeCollector::kOtherReasons]);
+  EXPECT_EQ(1, counts["0 irq"]);
+}
+
+TEST_F(ResumeCollectorTest, Ring) {
+  ResumeCollector collector(2);
+  Open(&collector);
+  for (int i = 1; i <= 5; ++i)
+    Resume(&collector, "45 rtc\n", i * 1000, 0);
+
+  // Only the most recent records should be retained, oldest first.
+  std::vector<ResumeCollector::Record> records;
+  collector.GetRecords(&records);
+  ASSERT_EQ(2u, records.size());
+  EXPECT_EQ(base::TimeDelta::FromSeconds(4), records[0].resume_uptime);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(5), records[1].resume_uptime);
+  EXPECT_EQ(5, collector.GetNumResumes());
+}
+
+TEST_F(ResumeCollectorTest, LongReason) {
+  ResumeCollector collector;
+  Open(&collector);
+  const std::string kReason = "7 " + std::string(100, 'x');
+  Resume(&collector, kReason, 1000, 0);
+
+  std::vector<ResumeCollector::Record> records;
+  collector.GetRecords(&records);
+  ASSERT_EQ(1u, records.size());
+  EXPECT_EQ(7, records[0].irq);
+  EXPECT_EQ(kReason.substr(0, ResumeCollector::kMaxReasonSize - 1),
+            records[0].reason);
+}
+
+TEST_F(ResumeCollectorTest, MissingFiles) {
+  // Resumes should still be recorded if the kernel doesn't report reasons or
+  // counters.
+  ResumeCollector collector;
+  collector.set_wakeup_reason_path_for_testing(
+      temp_dir_.path().Append("missing"));
+  collector.set_suspend_stats_dir_for_testing(
+      temp_dir_.path().Append("missing_dir"));
+  collector.Open();
+  collector.HandleResume(base::TimeDelta::FromSeconds(1),
+                         base::TimeDelta::FromSeconds(2));
+
+  std::vector<ResumeCollector::Record> records;
+  collector.GetRecords(&records);
+  ASSERT_EQ(1u, records.size());
+  EXPECT_EQ(-1, records[0].irq);
+  EXPECT_STREQ("", records[0].reason);
+  EXPECT_EQ(-1, records[0].kernel_successes);
+  EXPECT_EQ(-1, records[0].kernel_failures);
+
+  std::string dump;
+  collector.DumpStats(&dump);
+  EXPECT_NE(std::string::npos, dump.find("1: (unknown)\n"));
+}
+
+}  // namespace android
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSTEM_NATIVEPOWER_DAEMON_SMALL_ARRAY_H_
+#define SYSTEM_NATIVEPOWER_DAEMON_SMALL_ARRAY_H_
+
+#include <stddef.h>
+#include <string.h>
+
+#include <memory>
+#include <type_traits>
+
+#include <base/logging.h>
+#include <base/macros.h>
+
+namespace android {
+
+// Array of trivially-copyable values that stores up to |kInlineCapacity|
+// elements inline, only allocating when it grows beyond that. This keeps
+// short lists (e.g. the work source of a typical wake lock) in the object that
+// owns them.
+template <typename T, size_t kInlineCapacity>
+class SmallArray {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SmallArray elements are copied with memcpy()");
+
+ public:
+  SmallArray() : size_(0), capacity_(kInlineCapacity) {}
+  SmallArray(SmallArray&& other) : SmallArray() { *this = std::move(other); }
+  ~SmallArray() = default;
+
+  SmallArray& operator=(SmallArray&& other) {
+    if (this == &other)
+      return *this;
+    heap_ = std::move(other.heap_);
+    size_ = other.size_;
+    capacity_ = other.capacity_;
+    if (!heap_)
+      memcpy(inline_, other.inline_, size_ * sizeof(T));
+    other.size_ = 0;
+    other.capacity_ = kInlineCapacity;
+    return *this;
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Returns true if the elements have spilled over to the heap.
+  bool on_heap() const { return heap_ != nullptr; }
+
+  T* data() { return heap_ ? heap_.get() : inline_; }
+  const T* data() const { return heap_ ? heap_.get() : inline_; }
+
+  T* begin() { return data(); }
+  T* end() { return data() + size_; }
+  const T* begin() const { return data(); }
+  const T* end() const { return data() + size_; }
+
+  T& operator[](size_t index) {
+    DCHECK_LT(index, size_);
+    return data()[index];
+  }
+  const T& operator[](size_t index) const {
+    DCHECK_LT(index, size_);
+    return data()[index];
+  }
+
+  // Grows or shrinks the array to |count| elements. New elements are
+  // value-initialized.
+  void Resize(size_t count) {
+    Reserve(count);
+    for (size_t i = size_; i < count; ++i)
+      data()[i] = T();
+    size_ = count;
+  }
+
+  void PushBack(const T& value) {
+    if (size_ == capacity_)
+      Reserve(capacity_ * 2);
+    data()[size_++] = value;
+  }
+
+  // Removes all elements and returns to inline storage.
+  void Clear() {
+    heap_.reset();
+    size_ = 0;
+    capacity_ = kInlineCapacity;
+  }
+
+ private:
+  // Ensures that at least |capacity| elements can be stored.
+  void Reserve(size_t capacity) {
+    if (capacity <= capacity_)
+      return;
+    std::unique_ptr<T[]> storage(new T[capacity]);
+    if (size_)
+      memcpy(storage.get(), data(), size_ * sizeof(T));
+    heap_ = std::move(storage);
+    capacity_ = capacity;
+  }
+
+  T inline_[kInlineCapacity];
+  std::unique_ptr<T[]> heap_;
+
+  size_t size_;
+  size_t capacity_;
+
+  DISALLOW_COPY_AND_ASSIGN(SmallArray);
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_DAEMON_SMALL_ARRAY_H_
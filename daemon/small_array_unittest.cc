@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <utility>
+
+#include <gtest/gtest.h>
+
+#include "small_array.h"
+
+namespace android {
+
+using IntArray = SmallArray<int32_t, 4>;
+
+TEST(SmallArrayTest, Inline) {
+  IntArray array;
+  EXPECT_TRUE(array.empty());
+  for (int32_t i = 0; i < 4; ++i)
+    array.PushBack(i);
+  EXPECT_EQ(4u, array.size());
+  EXPECT_FALSE(array.on_heap());
+  for (int32_t i = 0; i < 4; ++i)
+    EXPECT_EQ(i, array[i]);
+}
+
+TEST(SmallArrayTest, HeapFallback) {
+  IntArray array;
+  for (int32_t i = 0; i < 10; ++i)
+    array.PushBack(i);
+  EXPECT_EQ(10u, array.size());
+  EXPECT_TRUE(array.on_heap());
+  int32_t expected = 0;
+  for (int32_t value : array)
+    EXPECT_EQ(expected++, value);
+
+  // Clearing the array should return it to inline storage.
+  array.Clear();
+  EXPECT_TRUE(array.empty());
+  EXPECT_FALSE(array.on_heap());
+}
+
+TEST(SmallArrayTest, Resize) {
+  IntArray array;
+  array.PushBack(5);
+  array.Resize(3);
+  ASSERT_EQ(3u, array.size());
+  EXPECT_FALSE(array.on_heap());
+  EXPECT_EQ(5, array[0]);
+  EXPECT_EQ(0, array[2]);
+
+  // Growing past the inline capacity should preserve existing elements.
+  array[1] = 6;
+  array.Resize(100);
+  ASSERT_EQ(100u, array.size());
+  EXPECT_TRUE(array.on_heap());
+  EXPECT_EQ(6, array[1]);
+  EXPECT_EQ(0, array[99]);
+
+  array.Resize(0);
+  EXPECT_TRUE(array.empty());
+}
+
+TEST(SmallArrayTest, Move) {
+  IntArray small;
+  small.PushBack(1);
+  IntArray moved(std::move(small));
+  ASSERT_EQ(1u, moved.size());
+  EXPECT_EQ(1, moved[0]);
+  EXPECT_TRUE(small.empty());
+
+  // Moving heap storage should transfer the allocation.
+  IntArray large;
+  for (int32_t i = 0; i < 10; ++i)
+    large.PushBack(i);
+  const int32_t* data = large.data();
+  moved = std::move(large);
+  EXPECT_EQ(10u, moved.size());
+  EXPECT_EQ(data, moved.data());
+  EXPECT_TRUE(large.empty());
+  EXPECT_FALSE(large.on_heap());
+}
+
+}  // namespace android
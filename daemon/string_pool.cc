@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "string_pool.h"
+
+#include <string.h>
+
+#include <base/logging.h>
+#include <utils/String8.h>
+
+namespace android {
+
+const StringPool::Handle StringPool::kInvalidHandle =
+    static_cast<StringPool::Handle>(-1);
+
+StringPool::Entry::Entry()
+    : hash(0),
+      refs(0),
+      next_free(kInvalidHandle) {}
+
+StringPool::StringPool()
+    : free_list_(kInvalidHandle),
+      size_(0),
+      num_conversions_(0) {}
+
+StringPool::~StringPool() = default;
+
+StringPool::Handle StringPool::Intern(const String16& str) {
+  const size_t hash = Hash(str);
+  size_t slot = Probe(str, hash);
+  if (slot != kNotFound && index_[slot] != kInvalidHandle) {
+    entries_[index_[slot]].refs++;
+    return index_[slot];
+  }
+
+  // Keep the index at most three-quarters full.
+  if ((size_ + 1) * 4 > index_.size() * 3) {
+    ResizeIndex(index_.empty() ? kMinIndexCapacity : index_.size() * 2);
+    slot = Probe(str, hash);
+  }
+
+  Handle handle = free_list_;
+  if (handle != kInvalidHandle) {
+    free_list_ = entries_[handle].next_free;
+  } else {
+    handle = entries_.size();
+    entries_.push_back(Entry());
+  }
+
+  Entry& entry = entries_[handle];
+  entry.utf16 = str;
+  entry.utf8 = String8(str).string();
+  entry.hash = hash;
+  entry.refs = 1;
+  entry.next_free = kInvalidHandle;
+  num_conversions_++;
+
+  index_[slot] = handle;
+  size_++;
+  return handle;
+}
+
+void StringPool::AddRef(Handle handle) {
+  DCHECK_LT(handle, entries_.size());
+  DCHECK_GT(entries_[handle].refs, 0);
+  entries_[handle].refs++;
+}
+
+void StringPool::Release(Handle handle) {
+  DCHECK_LT(handle, entries_.size());
+  Entry& entry = entries_[handle];
+  DCHECK_GT(entry.refs, 0);
+  if (--entry.refs > 0)
+    return;
+
+  EraseFromIndex(handle);
+  entry.utf16 = String16();
+  entry.utf8.clear();
+  entry.utf8.shrink_to_fit();
+  entry.next_free = free_list_;
+  free_list_ = handle;
+  size_--;
+}
+
+const std::string& StringPool::Get(Handle handle) const {
+  DCHECK_LT(handle, entries_.size());
+  DCHECK_GT(entries_[handle].refs, 0);
+  return entries_[handle].utf8;
+}
+
+size_t StringPool::GetMemoryUsage() const {
+  size_t bytes = entries_.capacity() * sizeof(Entry) +
+      index_.capacity() * sizeof(Handle);
+  for (const Entry& entry : entries_) {
+    if (!entry.refs)
+      continue;
+    bytes += (entry.utf16.size() + 1) * sizeof(char16_t) +
+        entry.utf8.capacity() + 1;
+  }
+  return bytes;
+}
+
+// static
+size_t StringPool::Hash(const String16& str) {
+  // FNV-1a over the UTF-16 code units.
+  uint32_t hash = 2166136261u;
+  const char16_t* data = str.string();
+  for (size_t i = 0; i < str.size(); ++i) {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+size_t StringPool::Probe(const String16& str, size_t hash) const {
+  if (index_.empty())
+    return kNotFound;
+
+  const size_t mask = index_.size() - 1;
+  for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+    const Handle handle = index_[slot];
+    if (handle == kInvalidHandle)
+      return slot;
+    const Entry& entry = entries_[handle];
+    if (entry.hash == hash && entry.utf16.size() == str.size() &&
+        !memcmp(entry.utf16.string(), str.string(),
+                str.size() * sizeof(char16_t))) {
+      return slot;
+    }
+  }
+}
+
+void StringPool::EraseFromIndex(Handle handle) {
+  const size_t mask = index_.size() - 1;
+  size_t hole = entries_[handle].hash & mask;
+  while (index_[hole] != handle)
+    hole = (hole + 1) & mask;
+
+  // Shift later members of the probe run back into the hole, as in BinderMap.
+  for (size_t next = (hole + 1) & mask; index_[next] != kInvalidHandle;
+       next = (next + 1) & mask) {
+    const size_t home = entries_[index_[next]].hash & mask;
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      index_[hole] = index_[next];
+      hole = next;
+    }
+  }
+  index_[hole] = kInvalidHandle;
+}
+
+void StringPool::ResizeIndex(size_t capacity) {
+  DCHECK_EQ(capacity & (capacity - 1), 0u);
+  index_.assign(capacity, kInvalidHandle);
+  const size_t mask = capacity - 1;
+  for (Handle handle = 0; handle < entries_.size(); ++handle) {
+    if (!entries_[handle].refs)
+      continue;
+    size_t slot = entries_[handle].hash & mask;
+    while (index_[slot] != kInvalidHandle)
+      slot = (slot + 1) & mask;
+    index_[slot] = handle;
+  }
+}
+
+}  // namespace android
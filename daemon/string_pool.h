@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSTEM_NATIVEPOWER_DAEMON_STRING_POOL_H_
+#define SYSTEM_NATIVEPOWER_DAEMON_STRING_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <base/macros.h>
+#include <utils/String16.h>
+
+namespace android {
+
+// Reference-counted pool of interned strings, used so that wake lock requests
+// can refer to their tags and package names via small handles instead of
+// holding their own copies. Strings are looked up by the UTF-16 form in which
+// they arrive over binder, so the conversion to UTF-8 only happens the first
+// time that a string is seen.
+//
+// Handles are reused once a string's last reference is released.
+class StringPool {
+ public:
+  typedef uint32_t Handle;
+
+  // Never returned by Intern().
+  static const Handle kInvalidHandle;
+
+  StringPool();
+  ~StringPool();
+
+  // Number of distinct strings currently in the pool.
+  size_t size() const { return size_; }
+
+  // Number of UTF-16 to UTF-8 conversions performed so far.
+  int64_t num_conversions() const { return num_conversions_; }
+
+  // Returns a handle for |str|, adding it to the pool if it isn't already
+  // present, and takes a reference to it.
+  Handle Intern(const String16& str);
+
+  // Takes an additional reference to |handle|.
+  void AddRef(Handle handle);
+
+  // Drops a reference to |handle|, removing its string from the pool once no
+  // references remain.
+  void Release(Handle handle);
+
+  // Returns the UTF-8 form of the string identified by |handle|.
+  const std::string& Get(Handle handle) const;
+
+  // Returns an estimate of the pool's heap usage in bytes.
+  size_t GetMemoryUsage() const;
+
+ private:
+  struct Entry {
+    Entry();
+
+    // Shares |str|'s buffer rather than copying it.
+    String16 utf16;
+    std::string utf8;
+
+    size_t hash;
+
+    // Zero for unused entries, which are linked through |next_free|.
+    int refs;
+    Handle next_free;
+  };
+
+  static const size_t kNotFound = static_cast<size_t>(-1);
+  static const size_t kMinIndexCapacity = 16;
+
+  static size_t Hash(const String16& str);
+
+  // Returns the index in |index_| holding the handle of the entry matching
+  // |str|, or of the empty slot where it would be inserted. Returns kNotFound
+  // if |index_| has no storage.
+  size_t Probe(const String16& str, size_t hash) const;
+
+  // Removes |handle| from |index_|.
+  void EraseFromIndex(Handle handle);
+
+  // Rehashes |index_| into |capacity| slots, which must be a power of two.
+  void ResizeIndex(size_t capacity);
+
+  // Strings, indexed by handle.
+  std::vector<Entry> entries_;
+
+  // Head of the list of unused entries in |entries_|.
+  Handle free_list_;
+
+  // Open-addressing hash table of handles, with kInvalidHandle marking empty
+  // slots. The size is always zero or a power of two.
+  std::vector<Handle> index_;
+
+  // Number of strings in the pool.
+  size_t size_;
+
+  int64_t num_conversions_;
+
+  DISALLOW_COPY_AND_ASSIGN(StringPool);
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_DAEMON_STRING_POOL_H_
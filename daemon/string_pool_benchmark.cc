@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares storing wake lock tags and package names as std::string copies
+// converted from UTF-16 on every acquire, as WakeLockManager did previously,
+// with interning them in a StringPool.
+
+#include <string>
+#include <vector>
+
+#include <base/strings/stringprintf.h>
+#include <benchmark/benchmark.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+
+#include "allocation_counter.h"
+#include "string_pool.h"
+
+namespace android {
+namespace {
+
+// Realistic tag and package lengths; both are too long for std::string's
+// inline storage.
+const char kTag[] = "*job*/com.example.app/.sync.SyncJobService";
+const char kPackage[] = "com.example.app.background";
+
+// Number of requests held in the memory benchmarks.
+const int kNumRequests = 1000;
+
+// Previous per-request storage.
+struct CopiedStrings {
+  std::string tag;
+  std::string package;
+};
+
+// Returns |count| distinct tags.
+std::vector<String16> CreateTags(int count) {
+  std::vector<String16> tags;
+  for (int i = 0; i < count; ++i)
+    tags.push_back(String16(base::StringPrintf("%s.%d", kTag, i).c_str()));
+  return tags;
+}
+
+// Returns the heap usage of |str|'s contents, assuming no inline storage.
+size_t GetHeapUsage(const std::string& str) {
+  return str.capacity() + 1;
+}
+
+void BM_ConvertStrings(benchmark::State& state) {
+  const String16 tag(kTag), package(kPackage);
+  CopiedStrings request;
+  const int64_t start_allocations = GetNumAllocations();
+  while (state.KeepRunning()) {
+    request.tag = String8(tag).string();
+    request.package = String8(package).string();
+    benchmark::DoNotOptimize(request);
+  }
+  state.counters["allocs_per_acquire"] =
+      static_cast<double>(GetNumAllocations() - start_allocations) /
+      state.iterations();
+}
+BENCHMARK(BM_ConvertStrings);
+
+void BM_InternStrings(benchmark::State& state) {
+  const String16 tag(kTag), package(kPackage);
+  StringPool pool;
+  // Another request keeps the strings interned, as when a process repeatedly
+  // acquires the same lock.
+  pool.Intern(tag);
+  pool.Intern(package);
+  const int64_t start_allocations = GetNumAllocations();
+  while (state.KeepRunning()) {
+    const StringPool::Handle tag_handle = pool.Intern(tag);
+    const StringPool::Handle package_handle = pool.Intern(package);
+    pool.Release(tag_handle);
+    pool.Release(package_handle);
+  }
+  state.counters["allocs_per_acquire"] =
+      static_cast<double>(GetNumAllocations() - start_allocations) /
+      state.iterations();
+}
+BENCHMARK(BM_InternStrings);
+
+// Holds kNumRequests requests spread across state.range(0) distinct tags.
+void BM_CopiedStringsMemory(benchmark::State& state) {
+  const std::vector<String16> tags = CreateTags(state.range(0));
+  const String16 package(kPackage);
+  size_t bytes = 0;
+  while (state.KeepRunning()) {
+    std::vector<CopiedStrings> requests(kNumRequests);
+    for (int i = 0; i < kNumRequests; ++i) {
+      requests[i].tag = String8(tags[i % tags.size()]).string();
+      requests[i].package = String8(package).string();
+    }
+    bytes = requests.size() * sizeof(CopiedStrings);
+    for (const CopiedStrings& request : requests)
+      bytes += GetHeapUsage(request.tag) + GetHeapUsage(request.package);
+  }
+  state.counters["bytes_per_request"] =
+      static_cast<double>(bytes) / kNumRequests;
+}
+BENCHMARK(BM_CopiedStringsMemory)->Arg(1)->Arg(10)->Arg(kNumRequests);
+
+void BM_StringPoolMemory(benchmark::State& state) {
+  const std::vector<String16> tags = CreateTags(state.range(0));
+  const String16 package(kPackage);
+  size_t bytes = 0;
+  while (state.KeepRunning()) {
+    StringPool pool;
+    std::vector<StringPool::Handle> handles;
+    handles.reserve(kNumRequests * 2);
+    for (int i = 0; i < kNumRequests; ++i) {
+      handles.push_back(pool.Intern(tags[i % tags.size()]));
+      handles.push_back(pool.Intern(package));
+    }
+    bytes = handles.size() * sizeof(StringPool::Handle) +
+        pool.GetMemoryUsage();
+  }
+  state.counters["bytes_per_request"] =
+      static_cast<double>(bytes) / kNumRequests;
+}
+BENCHMARK(BM_StringPoolMemory)->Arg(1)->Arg(10)->Arg(kNumRequests);
+
+}  // namespace
+}  // namespace android
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <base/strings/stringprintf.h>
+#include <gtest/gtest.h>
+#include <utils/String16.h>
+
+#include "string_pool.h"
+
+namespace android {
+
+TEST(StringPoolTest, InternsStrings) {
+  StringPool pool;
+  const StringPool::Handle foo = pool.Intern(String16("foo"));
+  EXPECT_EQ("foo", pool.Get(foo));
+  EXPECT_EQ(1, pool.num_conversions());
+
+  // Equal strings should share a handle without being converted again, even
+  // if they're stored in different buffers.
+  EXPECT_EQ(foo, pool.Intern(String16("foo")));
+  EXPECT_EQ(1, pool.num_conversions());
+  const StringPool::Handle bar = pool.Intern(String16("bar"));
+  EXPECT_NE(foo, bar);
+  EXPECT_EQ("bar", pool.Get(bar));
+  EXPECT_EQ(2u, pool.size());
+
+  // The string should stay in the pool until its last reference is released.
+  pool.Release(foo);
+  EXPECT_EQ("foo", pool.Get(foo));
+  pool.Release(foo);
+  EXPECT_EQ(1u, pool.size());
+
+  // The freed handle should be reused.
+  const StringPool::Handle baz = pool.Intern(String16("baz"));
+  EXPECT_EQ(foo, baz);
+  EXPECT_EQ("baz", pool.Get(baz));
+  EXPECT_EQ("bar", pool.Get(bar));
+}
+
+TEST(StringPoolTest, ManyStrings) {
+  const int kNumStrings = 1000;
+  StringPool pool;
+  std::vector<StringPool::Handle> handles;
+  for (int i = 0; i < kNumStrings; ++i) {
+    handles.push_back(
+        pool.Intern(String16(base::StringPrintf("tag%d", i).c_str())));
+  }
+  EXPECT_EQ(static_cast<size_t>(kNumStrings), pool.size());
+
+  // Release every other string and check that the rest are still found.
+  for (int i = 0; i < kNumStrings; i += 2)
+    pool.Release(handles[i]);
+  EXPECT_EQ(static_cast<size_t>(kNumStrings / 2), pool.size());
+  for (int i = 1; i < kNumStrings; i += 2) {
+    const std::string str = base::StringPrintf("tag%d", i);
+    EXPECT_EQ(handles[i], pool.Intern(String16(str.c_str())));
+    EXPECT_EQ(str, pool.Get(handles[i]));
+  }
+  EXPECT_EQ(kNumStrings, pool.num_conversions());
+}
+
+}  // namespace android
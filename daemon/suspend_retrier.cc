@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "suspend_retrier.h"
+
+#include <algorithm>
+
+#include <base/bind.h>
+#include <base/location.h>
+#include <base/logging.h>
+#include <base/rand_util.h>
+#include <base/strings/stringprintf.h>
+#include <base/thread_task_runner_handle.h>
+#include <base/time/default_tick_clock.h>
+
+namespace android {
+namespace {
+
+// Default back-off between retries.
+const int kDefaultMaxRetries = 5;
+const int kDefaultInitialDelayMs = 1000;
+const int kDefaultMaxDelaySec = 30;
+const double kDefaultJitter = 0.5;
+
+}  // namespace
+
+SuspendRetrier::Options::Options()
+    : max_retries(kDefaultMaxRetries),
+      initial_delay(base::TimeDelta::FromMilliseconds(kDefaultInitialDelayMs)),
+      max_delay(base::TimeDelta::FromSeconds(kDefaultMaxDelaySec)),
+      jitter(kDefaultJitter) {}
+
+SuspendRetrier::SuspendRetrier(Suspender* suspender)
+    : suspender_(suspender),
+      clock_(new base::DefaultTickClock()),
+      lock_held_(false),
+      num_failures_(0),
+      retry_timer_(base::Bind(&SuspendRetrier::HandleRetryTimeout,
+                              base::Unretained(this))),
+      num_retries_(0),
+      num_cancelled_retries_(0),
+      num_abandoned_requests_(0),
+      weak_ptr_factory_(this) {
+  DCHECK(suspender_);
+}
+
+SuspendRetrier::~SuspendRetrier() = default;
+
+void SuspendRetrier::DumpStats(std::string* output) const {
+  base::StringAppendF(output, "retries=%d cancelled=%d abandoned=%d\n",
+                      num_retries_.load(), num_cancelled_retries_.load(),
+                      num_abandoned_requests_.load());
+}
+
+void SuspendRetrier::Init(const Options& options) {
+  DCHECK_GE(options.jitter, 0.0);
+  DCHECK_LE(options.jitter, 1.0);
+  options_ = options;
+  task_runner_ = base::ThreadTaskRunnerHandle::Get();
+  weak_this_ = weak_ptr_factory_.GetWeakPtr();
+}
+
+void SuspendRetrier::SetKernelLockHeld(bool held) {
+  task_runner_->PostTask(
+      FROM_HERE,
+      base::Bind(&SuspendRetrier::HandleLockChange, weak_this_, held));
+}
+
+void SuspendRetrier::HandleSuspendResult(const Suspender::Result& result) {
+  if (result.reasons.empty())
+    return;
+
+  switch (result.status) {
+    case Suspender::Result::Status::SUSPENDED:
+      // The suspend also handled any events awaiting a retry.
+      Reset();
+      break;
+    case Suspender::Result::Status::STALE:
+      break;
+    case Suspender::Result::Status::AVOIDED:
+      // Whoever reported the wakeup event needs the system to stay awake.
+      CancelRetry("wakeup event reported");
+      break;
+    case Suspender::Result::Status::ABORTED:
+    case Suspender::Result::Status::FAILED:
+      ScheduleRetry(result);
+      break;
+  }
+}
+
+bool SuspendRetrier::TriggerRetryForTesting() {
+  if (!retry_timer_.Stop())
+    return false;
+
+  HandleRetryTimeout();
+  return true;
+}
+
+void SuspendRetrier::HandleLockChange(bool held) {
+  lock_held_ = held;
+  if (lock_held_)
+    CancelRetry("wake lock acquired");
+}
+
+void SuspendRetrier::ScheduleRetry(const Suspender::Result& result) {
+  if (options_.max_retries <= 0)
+    return;
+
+  pending_.event_time_ms =
+      std::max(pending_.event_time_ms, result.event_time_ms);
+  pending_.reasons.insert(pending_.reasons.end(), result.reasons.begin(),
+                          result.reasons.end());
+  pending_.flags |= result.flags;
+
+  if (lock_held_) {
+    CancelRetry("wake lock held");
+    return;
+  }
+  if (num_failures_ >= options_.max_retries) {
+    LOG(ERROR) << "Giving up on suspend for "
+               << pending_.GetRequestDescription() << " after "
+               << num_failures_ << " retries";
+    num_abandoned_requests_++;
+    Reset();
+    return;
+  }
+
+  num_failures_++;
+  delay_ = num_failures_ == 1 ? options_.initial_delay
+                              : std::min(delay_ * 2, options_.max_delay);
+  const base::TimeDelta jittered_delay = base::TimeDelta::FromMicroseconds(
+      delay_.InMicroseconds() * (1.0 - options_.jitter * base::RandDouble()));
+  retry_time_ = clock_->NowTicks() + jittered_delay;
+  LOG(WARNING) << "Retrying suspend for " << pending_.GetRequestDescription()
+               << " in " << jittered_delay.InMilliseconds() << " ms (retry "
+               << num_failures_ << " of " << options_.max_retries
+               << ") after error " << result.error;
+  retry_timer_.Start(jittered_delay);
+}
+
+void SuspendRetrier::CancelRetry(const std::string& reason) {
+  if (!pending_.reasons.empty()) {
+    LOG(INFO) << "Cancelling suspend retry for "
+              << pending_.GetRequestDescription() << ": " << reason;
+    num_cancelled_retries_++;
+  }
+  Reset();
+}
+
+void SuspendRetrier::Reset() {
+  retry_timer_.Stop();
+  pending_ = Suspender::Result();
+  num_failures_ = 0;
+  delay_ = base::TimeDelta();
+}
+
+void SuspendRetrier::HandleRetryTimeout() {
+  if (retry_timer_.RestartIfEarly(retry_time_, clock_->NowTicks()))
+    return;
+
+  // The back-off is kept until the retry's result is reported.
+  Suspender::Result retry;
+  std::swap(retry, pending_);
+  num_retries_++;
+  for (int reason : retry.reasons) {
+    // All of the requests share the latest event time, so either all or none
+    // are accepted.
+    if (!suspender_->RequestSuspend(retry.event_time_ms, reason,
+                                    retry.flags)) {
+      Reset();
+      return;
+    }
+  }
+}
+
+}  // namespace android
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SYSTEM_NATIVEPOWER_DAEMON_SUSPEND_RETRIER_H_
+#define SYSTEM_NATIVEPOWER_DAEMON_SUSPEND_RETRIER_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include <base/macros.h>
+#include <base/memory/ref_counted.h>
+#include <base/memory/weak_ptr.h>
+#include <base/single_thread_task_runner.h>
+#include <base/time/tick_clock.h>
+#include <base/time/time.h>
+
+#include "cross_thread_timer.h"
+#include "suspender.h"
+
+namespace android {
+
+// Retries suspend requests made via goToSleep() after the kernel refuses or
+// fails to suspend (e.g. with EBUSY because a driver wasn't ready), so that
+// clients don't need to poll the daemon.
+//
+// Retries are made after a delay that doubles with each consecutive failure
+// and is randomly shortened by up to a configurable fraction, so that they
+// don't stay in lockstep with whatever periodic activity caused the failure.
+// A pending retry is cancelled when a wake lock is acquired, since its holder
+// wants the system to stay awake; the request is then dropped rather than
+// resumed after the lock is released.
+class SuspendRetrier {
+ public:
+  // Tunable behavior.
+  struct Options {
+    Options();
+
+    // Maximum number of consecutive retries before giving up on a request.
+    // 0 disables retrying.
+    int max_retries;
+
+    // Delay before the first retry. It doubles after each consecutive failure
+    // up to |max_delay|.
+    base::TimeDelta initial_delay;
+    base::TimeDelta max_delay;
+
+    // Fraction in [0, 1] of each delay that's randomized: the actual delay is
+    // chosen uniformly from [delay * (1 - jitter), delay].
+    double jitter;
+  };
+
+  // |suspender| must outlive this object.
+  explicit SuspendRetrier(Suspender* suspender);
+  ~SuspendRetrier();
+
+  // Takes ownership of |clock|, which is used to compute retry deadlines.
+  void set_tick_clock_for_testing(std::unique_ptr<base::TickClock> clock) {
+    clock_ = std::move(clock);
+  }
+
+  // Number of retries made, pending retries cancelled by wake lock
+  // acquisitions or wakeup events, and requests dropped after |max_retries|.
+  int num_retries() const { return num_retries_; }
+  int num_cancelled_retries() const { return num_cancelled_retries_; }
+  int num_abandoned_requests() const { return num_abandoned_requests_; }
+
+  // Unjittered delay before the pending or most recent retry, or zero if the
+  // back-off has been reset (or no request has failed yet).
+  base::TimeDelta current_delay() const { return delay_; }
+
+  // Time at which the pending retry is due. Only meaningful while one is
+  // pending.
+  base::TimeTicks retry_time() const { return retry_time_; }
+
+  // Appends a human-readable summary of the above counters to |output|.
+  void DumpStats(std::string* output) const;
+
+  // Applies |options|. Must be called on a thread with a message loop, which
+  // is used for all subsequent work.
+  void Init(const Options& options);
+
+  // Reports whether WakeLockManager holds the kernel wake lock. May be called
+  // on any thread, including while other locks are held; the change is
+  // handled asynchronously on the Init() thread.
+  void SetKernelLockHeld(bool held);
+
+  // Must be called with each result reported by Suspender. Results without
+  // requests from RequestSuspend() (i.e. autosleep attempts) are ignored.
+  void HandleSuspendResult(const Suspender::Result& result);
+
+  // Runs the pending retry immediately. The retry is only made if |clock_|
+  // has reached the deadline; otherwise it's rescheduled. Returns false if no
+  // retry was pending.
+  bool TriggerRetryForTesting();
+
+ private:
+  // Updates |lock_held_| on the Init() thread.
+  void HandleLockChange(bool held);
+
+  // Schedules a retry of |result|'s requests, merging them with those of the
+  // pending retry (if any).
+  void ScheduleRetry(const Suspender::Result& result);
+
+  // Drops the pending retry (if any) and resets the back-off. |reason| is
+  // logged.
+  void CancelRetry(const std::string& reason);
+
+  // Drops the pending retry (if any) and resets the back-off.
+  void Reset();
+
+  // Called by |retry_timer_|.
+  void HandleRetryTimeout();
+
+  Suspender* suspender_;  // Not owned.
+
+  std::unique_ptr<base::TickClock> clock_;
+
+  Options options_;
+
+  // True if the kernel wake lock is held.
+  bool lock_held_;
+
+  // Requests awaiting a retry, merged as by Suspender. Empty if no retry is
+  // pending.
+  Suspender::Result pending_;
+
+  // Number of consecutive failed suspends since the back-off was reset.
+  int num_failures_;
+
+  // Unjittered delay before the pending retry and the time at which it's due.
+  base::TimeDelta delay_;
+  base::TimeTicks retry_time_;
+
+  // Runs HandleRetryTimeout() once |retry_time_| is reached.
+  CrossThreadTimer retry_timer_;
+
+  // Updated on |task_runner_| but read by DumpStats() on binder threads.
+  std::atomic<int> num_retries_;
+  std::atomic<int> num_cancelled_retries_;
+  std::atomic<int> num_abandoned_requests_;
+
+  // Thread that Init() was called on.
+  scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
+
+  // Created by Init() and copied into tasks posted by SetKernelLockHeld().
+  base::WeakPtr<SuspendRetrier> weak_this_;
+  base::WeakPtrFactory<SuspendRetrier> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(SuspendRetrier);
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_DAEMON_SUSPEND_RETRIER_H_
@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <errno.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <base/logging.h>
+#include <base/macros.h>
+#include <base/run_loop.h>
+#include <base/sys_info.h>
+#include <gtest/gtest.h>
+
+#include "suspend_retrier.h"
+#include "suspender.h"
+#include "suspender_test_util.h"
+
+namespace android {
+
+class SuspendRetrierTest : public SuspenderTestBase {
+ public:
+  SuspendRetrierTest() : retrier_(&suspender_) {
+    InitSuspender();
+    retrier_.set_tick_clock_for_testing(CreateTickClock());
+
+    options_.max_retries = 3;
+    options_.initial_delay = base::TimeDelta::FromSeconds(1);
+    options_.max_delay = base::TimeDelta::FromSeconds(3);
+    options_.jitter = 0.0;
+  }
+  ~SuspendRetrierTest() override = default;
+
+ protected:
+  // Requests a suspend for an event happening now.
+  void RequestSuspend(int reason) {
+    CHECK(suspender_.RequestSuspend(
+        base::SysInfo::Uptime().InMilliseconds(), reason, 0));
+  }
+
+  // Makes |suspender_|'s writes to the power state file fail with |error|, or
+  // succeed if |error| is 0.
+  void SetPowerStateWriteError(int error) {
+    SetWriteError(suspender_.power_state_writer_for_testing(), error);
+  }
+
+  // Reports a kernel lock transition and runs the resulting task.
+  void SetKernelLockHeld(bool held) {
+    retrier_.SetKernelLockHeld(held);
+    base::RunLoop().RunUntilIdle();
+  }
+
+  // Advances |clock_| to the pending retry's deadline and runs it.
+  bool RunRetry() {
+    clock_->Advance(retrier_.retry_time() - clock_->NowTicks());
+    return retrier_.TriggerRetryForTesting();
+  }
+
+  // Passes each result to |retrier_| as well as recording it.
+  void HandleResult(const Suspender::Result& result) override {
+    SuspenderTestBase::HandleResult(result);
+    retrier_.HandleSuspendResult(result);
+  }
+
+  SuspendRetrier retrier_;
+  SuspendRetrier::Options options_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SuspendRetrierTest);
+};
+
+TEST_F(SuspendRetrierTest, RetryWithBackOff) {
+  retrier_.Init(options_);
+  SetPowerStateWriteError(EBUSY);
+  RequestSuspend(4);
+  Flush();
+  ASSERT_EQ(1u, results_.size());
+  EXPECT_EQ(Suspender::Result::Status::ABORTED, results_[0].status);
+  EXPECT_EQ(options_.initial_delay, retrier_.current_delay());
+
+  // The retry shouldn't be made before the clock reaches the deadline.
+  EXPECT_TRUE(retrier_.TriggerRetryForTesting());
+  EXPECT_EQ(0, retrier_.num_retries());
+
+  // The delay should double after each failure until it reaches the maximum.
+  const int kExpectedDelaySec[] = {2, 3};
+  for (size_t i = 0; i < arraysize(kExpectedDelaySec); ++i) {
+    EXPECT_TRUE(RunRetry());
+    EXPECT_EQ(static_cast<int>(i) + 1, retrier_.num_retries());
+    Flush();
+    ASSERT_EQ(i + 2, results_.size());
+    EXPECT_EQ(std::vector<int>{4}, results_.back().reasons);
+    EXPECT_EQ(base::TimeDelta::FromSeconds(kExpectedDelaySec[i]),
+              retrier_.current_delay());
+  }
+
+  // A successful retry should reset the back-off.
+  SetPowerStateWriteError(0);
+  EXPECT_TRUE(RunRetry());
+  Flush();
+  EXPECT_EQ(Suspender::Result::Status::SUSPENDED, results_.back().status);
+  EXPECT_EQ(3, retrier_.num_retries());
+  EXPECT_EQ(base::TimeDelta(), retrier_.current_delay());
+  EXPECT_FALSE(retrier_.TriggerRetryForTesting());
+  EXPECT_EQ(0, retrier_.num_abandoned_requests());
+}
+
+TEST_F(SuspendRetrierTest, GiveUpAfterMaxRetries) {
+  retrier_.Init(options_);
+  SetPowerStateWriteError(EIO);
+  RequestSuspend(0);
+  Flush();
+  for (int i = 0; i < options_.max_retries; ++i) {
+    EXPECT_TRUE(RunRetry());
+    Flush();
+  }
+  EXPECT_EQ(options_.max_retries, retrier_.num_retries());
+  EXPECT_EQ(1, retrier_.num_abandoned_requests());
+  EXPECT_FALSE(retrier_.TriggerRetryForTesting());
+  EXPECT_EQ(base::TimeDelta(), retrier_.current_delay());
+
+  std::string dump;
+  retrier_.DumpStats(&dump);
+  EXPECT_EQ("retries=3 cancelled=0 abandoned=1\n", dump);
+}
+
+TEST_F(SuspendRetrierTest, LockCancelsRetry) {
+  retrier_.Init(options_);
+  SetPowerStateWriteError(EBUSY);
+  RequestSuspend(0);
+  Flush();
+
+  // Acquiring a wake lock should drop the pending retry and reset the
+  // back-off; releasing it shouldn't bring the retry back.
+  SetKernelLockHeld(true);
+  EXPECT_FALSE(retrier_.TriggerRetryForTesting());
+  EXPECT_EQ(1, retrier_.num_cancelled_retries());
+  EXPECT_EQ(base::TimeDelta(), retrier_.current_delay());
+  SetKernelLockHeld(false);
+  EXPECT_FALSE(retrier_.TriggerRetryForTesting());
+
+  // Requests that fail while a lock is held shouldn't be retried at all.
+  SetKernelLockHeld(true);
+  RequestSuspend(0);
+  Flush();
+  EXPECT_FALSE(retrier_.TriggerRetryForTesting());
+  EXPECT_EQ(2, retrier_.num_cancelled_retries());
+  EXPECT_EQ(0, retrier_.num_retries());
+}
+
+TEST_F(SuspendRetrierTest, WakeupEventCancelsRetry) {
+  retrier_.Init(options_);
+  SetPowerStateWriteError(EBUSY);
+  RequestSuspend(0);
+  Flush();
+
+  // A retry that's avoided because of a wakeup event shouldn't be retried
+  // again.
+  suspender_.wakeup_count_writer_for_testing()->set_write_error_for_testing(
+      EINVAL);
+  EXPECT_TRUE(RunRetry());
+  Flush();
+  EXPECT_EQ(Suspender::Result::Status::AVOIDED, results_.back().status);
+  EXPECT_FALSE(retrier_.TriggerRetryForTesting());
+  EXPECT_EQ(1, retrier_.num_retries());
+}
+
+TEST_F(SuspendRetrierTest, MergeFailedRequests) {
+  retrier_.Init(options_);
+  SetPowerStateWriteError(EBUSY);
+  RequestSuspend(1);
+  Flush();
+
+  // A request that fails while a retry is pending should be retried along
+  // with it.
+  RequestSuspend(2);
+  Flush();
+  EXPECT_EQ(base::TimeDelta::FromSeconds(2), retrier_.current_delay());
+  SetPowerStateWriteError(0);
+  EXPECT_TRUE(RunRetry());
+  Flush();
+  EXPECT_EQ(Suspender::Result::Status::SUSPENDED, results_.back().status);
+  EXPECT_EQ((std::vector<int>{1, 2}), results_.back().reasons);
+}
+
+TEST_F(SuspendRetrierTest, IgnoreAutosleep) {
+  retrier_.Init(options_);
+  SetPowerStateWriteError(EBUSY);
+  suspender_.RequestAutosleep();
+  Flush();
+  ASSERT_EQ(1u, results_.size());
+  EXPECT_EQ(Suspender::Result::Status::ABORTED, results_[0].status);
+  EXPECT_FALSE(retrier_.TriggerRetryForTesting());
+}
+
+TEST_F(SuspendRetrierTest, Jitter) {
+  options_.jitter = 0.5;
+  options_.max_retries = 20;
+  options_.max_delay = options_.initial_delay;
+  retrier_.Init(options_);
+  SetPowerStateWriteError(EBUSY);
+  RequestSuspend(0);
+  Flush();
+
+  // Each delay should be between half and all of the unjittered delay.
+  for (int i = 0; i < options_.max_retries; ++i) {
+    const base::TimeDelta delay = retrier_.retry_time() - clock_->NowTicks();
+    EXPECT_GE(delay, options_.initial_delay / 2);
+    EXPECT_LE(delay, options_.initial_delay);
+    EXPECT_TRUE(RunRetry());
+    Flush();
+  }
+}
+
+TEST_F(SuspendRetrierTest, Disabled) {
+  options_.max_retries = 0;
+  retrier_.Init(options_);
+  SetPowerStateWriteError(EBUSY);
+  RequestSuspend(0);
+  Flush();
+  EXPECT_FALSE(retrier_.TriggerRetryForTesting());
+  EXPECT_EQ(0, retrier_.num_abandoned_requests());
+}
+
+}  // namespace android
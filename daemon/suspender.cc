@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "suspender.h"
+
+#include <errno.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+
+#include <base/bind.h>
+#include <base/files/file_util.h>
+#include <base/format_macros.h>
+#include <base/location.h>
+#include <base/logging.h>
+#include <base/posix/safe_strerror.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/string_util.h>
+#include <base/strings/stringprintf.h>
+#include <base/synchronization/waitable_event.h>
+#include <base/thread_task_runner_handle.h>
+
+namespace android {
+namespace {
+
+// Paths to real sysfs files that can be written to change the power state and
+// used for the wakeup_count handshake.
+const char kDefaultPowerStatePath[] = "/sys/power/state";
+const char kDefaultWakeupCountPath[] = "/sys/power/wakeup_count";
+
+// Reads the number of wakeup events reported so far from |path| into |count|.
+// The kernel blocks the read while wakeup events are being processed. Returns
+// false on failure, setting |error| to errno if the read itself failed.
+bool ReadWakeupCount(const base::FilePath& path,
+                     std::string* count,
+                     int* error) {
+  std::string data;
+  if (!base::ReadFileToString(path, &data)) {
+    *error = errno;
+    PLOG(ERROR) << "Failed to read " << path.value();
+    return false;
+  }
+  base::TrimWhitespaceASCII(data, base::TRIM_ALL, count);
+  uint64_t value = 0;
+  if (!base::StringToUint64(*count, &value)) {
+    LOG(ERROR) << "Failed to parse \"" << *count << "\" from "
+               << path.value();
+    return false;
+  }
+  return true;
+}
+
+// Returns the current time on |clock_id|.
+base::TimeDelta GetClockTime(clockid_t clock_id) {
+  struct timespec ts;
+  PCHECK(clock_gettime(clock_id, &ts) == 0) << "clock_gettime failed";
+  return base::TimeDelta::FromSeconds(ts.tv_sec) +
+         base::TimeDelta::FromMicroseconds(
+             ts.tv_nsec / base::Time::kNanosecondsPerMicrosecond);
+}
+
+}  // namespace
+
+const char Suspender::kPowerStateSuspend[] = "mem";
+
+Suspender::Result::Result()
+    : status(Status::FAILED),
+      event_time_ms(0),
+      flags(0),
+      autosleep(false),
+      error(0) {}
+
+std::string Suspender::Result::GetRequestDescription() const {
+  std::string description;
+  if (!reasons.empty()) {
+    description = base::StringPrintf("%" PRIuS " request(s) for event at %"
+                                     PRId64 " with reason(s) ",
+                                     reasons.size(), event_time_ms);
+    for (size_t i = 0; i < reasons.size(); ++i)
+      description += (i ? "," : "") + base::IntToString(reasons[i]);
+    description += base::StringPrintf(" and flags 0x%x", flags);
+  }
+  if (autosleep)
+    description += description.empty() ? "autosleep" : " plus autosleep";
+  return description;
+}
+
+Suspender::Suspender()
+    : power_state_path_(kDefaultPowerStatePath),
+      wakeup_count_path_(kDefaultWakeupCountPath),
+      autosleep_requested_(false),
+      suspend_task_pending_(false),
+      kernel_lock_held_(false),
+      num_suspend_attempts_(0),
+      num_avoided_suspends_(0),
+      num_aborted_suspends_(0),
+      num_failed_suspends_(0),
+      num_coalesced_requests_(0),
+      num_stale_requests_(0),
+      thread_("suspend"),
+      weak_ptr_factory_(this) {}
+
+Suspender::~Suspender() {
+  // Wait for the current request (if any) to finish before destroying members
+  // that it uses.
+  thread_.Stop();
+}
+
+base::TimeDelta Suspender::GetLastResumeUptime() const {
+  base::AutoLock lock(lock_);
+  return last_resume_uptime_;
+}
+
+void Suspender::DumpStats(std::string* output) const {
+  base::StringAppendF(
+      output,
+      "attempts=%d avoided=%d aborted=%d failed=%d coalesced=%d stale=%d\n",
+      num_suspend_attempts_.load(), num_avoided_suspends_.load(),
+      num_aborted_suspends_.load(), num_failed_suspends_.load(),
+      num_coalesced_requests_.load(), num_stale_requests_.load());
+
+  std::map<int, int> error_counts;
+  GetErrorCounts(&error_counts);
+  for (const auto& it : error_counts) {
+    base::StringAppendF(output, "errno %d (%s): %d\n", it.first,
+                        base::safe_strerror(it.first).c_str(), it.second);
+  }
+
+  base::AutoLock lock(latency_lock_);
+  *output += "request_to_write: ";
+  request_to_write_.AppendSummary(output);
+  *output += "kernel: ";
+  kernel_time_.AppendSummary(output);
+  *output += "sleep: ";
+  sleep_time_.AppendSummary(output);
+  *output += "resume_to_report: ";
+  resume_to_report_.AppendSummary(output);
+}
+
+void Suspender::GetErrorCounts(std::map<int, int>* counts) const {
+  base::AutoLock lock(lock_);
+  *counts = error_counts_;
+}
+
+void Suspender::GetLatencyStats(SuspendLatencyStats* stats) const {
+  base::AutoLock lock(latency_lock_);
+  request_to_write_.GetDistribution(&stats->request_to_write);
+  kernel_time_.GetDistribution(&stats->kernel);
+  sleep_time_.GetDistribution(&stats->sleep);
+  resume_to_report_.GetDistribution(&stats->resume_to_report);
+}
+
+bool Suspender::Init(const ResultCallback& callback) {
+  origin_task_runner_ = base::ThreadTaskRunnerHandle::Get();
+  callback_ = callback;
+  weak_this_ = weak_ptr_factory_.GetWeakPtr();
+  if (!thread_.Start()) {
+    LOG(ERROR) << "Failed to start suspend thread";
+    return false;
+  }
+
+  // Failure isn't fatal here (SysfsWriter logs it); the file will be reopened
+  // when suspending.
+  thread_.task_runner()->PostTask(
+      FROM_HERE,
+      base::Bind(&Suspender::OpenFiles, base::Unretained(this)));
+  return true;
+}
+
+bool Suspender::RequestSuspend(int64_t event_time_ms, int reason, int flags) {
+  base::AutoLock lock(lock_);
+  if (event_time_ms < last_resume_uptime_.InMilliseconds()) {
+    LOG(WARNING) << "Ignoring request to suspend in response to event at "
+                 << event_time_ms << " preceding last resume time "
+                 << last_resume_uptime_.InMilliseconds();
+    return false;
+  }
+
+  pending_requests_.push_back(
+      PendingRequest{event_time_ms, reason, flags, GetMonotonicTime()});
+  PostSuspendTaskLocked();
+  return true;
+}
+
+void Suspender::RequestAutosleep() {
+  base::AutoLock lock(lock_);
+  if (!autosleep_requested_) {
+    autosleep_requested_ = true;
+    autosleep_accept_time_ = GetMonotonicTime();
+  }
+  PostSuspendTaskLocked();
+}
+
+void Suspender::FlushForTesting() {
+  base::WaitableEvent event(false /* manual_reset */,
+                            false /* initially_signaled */);
+  thread_.task_runner()->PostTask(
+      FROM_HERE,
+      base::Bind(&base::WaitableEvent::Signal, base::Unretained(&event)));
+  event.Wait();
+}
+
+void Suspender::BlockForTesting(base::WaitableEvent* event) {
+  thread_.task_runner()->PostTask(
+      FROM_HERE,
+      base::Bind(&base::WaitableEvent::Wait, base::Unretained(event)));
+}
+
+void Suspender::OpenFiles() {
+  power_state_writer_.Open(power_state_path_);
+  wakeup_count_writer_.Open(wakeup_count_path_);
+  resume_collector_.Open();
+}
+
+// static
+base::TimeDelta Suspender::GetMonotonicTime() {
+  return GetClockTime(CLOCK_MONOTONIC);
+}
+
+// static
+Suspender::ClockReadings Suspender::ReadClocks() {
+  ClockReadings readings;
+  readings.monotonic = GetClockTime(CLOCK_MONOTONIC);
+  readings.boottime = GetClockTime(CLOCK_BOOTTIME);
+  return readings;
+}
+
+void Suspender::PostSuspendTaskLocked() {
+  lock_.AssertAcquired();
+  if (suspend_task_pending_)
+    return;
+  suspend_task_pending_ = true;
+  thread_.task_runner()->PostTask(
+      FROM_HERE, base::Bind(&Suspender::Suspend, base::Unretained(this)));
+}
+
+void Suspender::Suspend() {
+  std::vector<PendingRequest> requests;
+  Result result, stale_result;
+  base::TimeDelta first_accept_time = base::TimeDelta::Max();
+  {
+    base::AutoLock lock(lock_);
+    requests.swap(pending_requests_);
+    result.autosleep = autosleep_requested_;
+    if (autosleep_requested_)
+      first_accept_time = autosleep_accept_time_;
+    autosleep_requested_ = false;
+    suspend_task_pending_ = false;
+  }
+
+  // Requests queued while the previous suspend was in progress may be for
+  // events that it already handled. Only this thread updates
+  // |last_resume_uptime_|, so it can't change before the write below.
+  const int64_t last_resume_ms = GetLastResumeUptime().InMilliseconds();
+  stale_result.status = Result::Status::STALE;
+  for (const PendingRequest& request : requests) {
+    Result* merged =
+        request.event_time_ms < last_resume_ms ? &stale_result : &result;
+    merged->event_time_ms =
+        std::max(merged->event_time_ms, request.event_time_ms);
+    merged->reasons.push_back(request.reason);
+    merged->flags |= request.flags;
+    if (merged == &result)
+      first_accept_time = std::min(first_accept_time, request.accept_time);
+  }
+
+  if (!stale_result.reasons.empty()) {
+    LOG(INFO) << "Dropping " << stale_result.GetRequestDescription()
+              << " preceding last resume time " << last_resume_ms;
+    num_stale_requests_ += stale_result.reasons.size();
+    origin_task_runner_->PostTask(
+        FROM_HERE,
+        base::Bind(&Suspender::ReportResult, weak_this_, stale_result));
+  }
+
+  const int num_requests =
+      static_cast<int>(result.reasons.size()) + (result.autosleep ? 1 : 0);
+  if (num_requests == 0)
+    return;
+  num_coalesced_requests_ += num_requests - 1;
+
+  if (result.reasons.empty())
+    VLOG(1) << "Attempting autosleep";
+  else
+    LOG(INFO) << "Suspending for " << result.GetRequestDescription();
+  ClockReadings before_write, after_write;
+  result.status =
+      SuspendWithWakeupCount(&before_write, &after_write, &result.error);
+  if (result.error) {
+    base::AutoLock lock(lock_);
+    error_counts_[result.error]++;
+  }
+  if (result.status == Result::Status::SUSPENDED) {
+    result.resume_uptime = after_write.monotonic;
+    result.request_to_write = before_write.monotonic - first_accept_time;
+    result.kernel_time = after_write.monotonic - before_write.monotonic;
+    result.sleep_time =
+        after_write.boottime - before_write.boottime - result.kernel_time;
+    {
+      base::AutoLock lock(latency_lock_);
+      request_to_write_.Add(result.request_to_write);
+      kernel_time_.Add(result.kernel_time);
+      sleep_time_.Add(result.sleep_time);
+    }
+    resume_collector_.HandleResume(result.resume_uptime, result.sleep_time);
+    base::AutoLock lock(lock_);
+    last_resume_uptime_ = result.resume_uptime;
+  }
+
+  origin_task_runner_->PostTask(
+      FROM_HERE, base::Bind(&Suspender::ReportResult, weak_this_, result));
+}
+
+Suspender::Result::Status Suspender::SuspendWithWakeupCount(
+    ClockReadings* before_write,
+    ClockReadings* after_write,
+    int* error) {
+  // The wakeup_count read would block until the kernel wake lock is released
+  // and then suspend, long after the request was made. The lock can still be
+  // acquired after this check, in which case the read waits for it as usual.
+  if (kernel_lock_held_) {
+    LOG(INFO) << "Not suspending; kernel wake lock is held";
+    num_avoided_suspends_++;
+    return Result::Status::AVOIDED;
+  }
+
+  std::string count;
+  if (!ReadWakeupCount(wakeup_count_path_, &count, error)) {
+    num_failed_suspends_++;
+    return Result::Status::FAILED;
+  }
+
+  // The kernel rejects the count with EINVAL if wakeup events were reported
+  // after it was read.
+  if (!wakeup_count_writer_.Write(count)) {
+    *error = wakeup_count_writer_.last_error();
+    if (*error == EINVAL) {
+      LOG(INFO) << "Not suspending; wakeup event reported since count "
+                << count << " was read";
+      num_avoided_suspends_++;
+      return Result::Status::AVOIDED;
+    }
+    num_failed_suspends_++;
+    return Result::Status::FAILED;
+  }
+
+  num_suspend_attempts_++;
+  *before_write = ReadClocks();
+  const bool success = power_state_writer_.Write(kPowerStateSuspend);
+  *after_write = ReadClocks();
+  if (!success) {
+    *error = power_state_writer_.last_error();
+    if (*error == EBUSY) {
+      LOG(INFO) << "Suspend aborted by kernel";
+      num_aborted_suspends_++;
+      return Result::Status::ABORTED;
+    }
+    num_failed_suspends_++;
+    return Result::Status::FAILED;
+  }
+  return Result::Status::SUSPENDED;
+}
+
+void Suspender::ReportResult(const Result& result) {
+  if (result.status == Result::Status::SUSPENDED) {
+    base::AutoLock lock(latency_lock_);
+    resume_to_report_.Add(GetMonotonicTime() - result.resume_uptime);
+  }
+  if (!callback_.is_null())
+    callback_.Run(result);
+}
+
+}  // namespace android
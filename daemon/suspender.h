@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSTEM_NATIVEPOWER_DAEMON_SUSPENDER_H_
+#define SYSTEM_NATIVEPOWER_DAEMON_SUSPENDER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <base/callback.h>
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/memory/ref_counted.h>
+#include <base/memory/weak_ptr.h>
+#include <base/single_thread_task_runner.h>
+#include <base/synchronization/lock.h>
+#include <base/threading/thread.h>
+#include <base/time/time.h>
+#include <nativepower/suspend_latency_stats.h>
+
+#include "latency_histogram.h"
+#include "resume_collector.h"
+#include "sysfs_writer.h"
+
+namespace base {
+class WaitableEvent;
+}  // namespace base
+
+namespace android {
+
+// Suspends the system by writing to the sysfs power state file. The write
+// doesn't return until the system has resumed, possibly hours later, so it's
+// made on a dedicated thread; requests are accepted immediately and their
+// outcomes are reported asynchronously on the thread that called Init().
+//
+// Each suspend uses the kernel's wakeup_count handshake: the count of wakeup
+// events is read and written back before writing to the power state file. The
+// write-back fails if any wakeup events were reported since the read, so an
+// event that arrives just before suspending prevents the suspend instead of
+// being lost or aborting it after devices have been frozen. Reading the count
+// blocks while any wakeup source is active, so requests made while the daemon's
+// own kernel wake lock is held (see SetKernelLockHeld()) are avoided up front
+// instead of parking the suspend thread until the lock is released.
+//
+// Requests are queued until the suspend thread is ready for them. All queued
+// requests whose events follow the last resume are then handled by a single
+// suspend, so that near-simultaneous requests (e.g. from the lid switch and
+// the power button) don't suspend the system again right after it resumes.
+//
+// The kernel's wakeup reason is recorded by a ResumeCollector on the suspend
+// thread after each resume, before another suspend can overwrite it.
+class Suspender {
+ public:
+  // Value written to the power state file to suspend the system to memory.
+  static const char kPowerStateSuspend[];
+
+  // Outcome of one or more coalesced suspend requests.
+  struct Result {
+    enum class Status {
+      // The system suspended and then resumed.
+      SUSPENDED,
+      // A wakeup event was reported during the wakeup_count handshake, or
+      // the kernel wake lock was held, so the power state file wasn't
+      // written.
+      AVOIDED,
+      // The kernel started suspending but aborted, e.g. because a wakeup
+      // event arrived after the handshake.
+      ABORTED,
+      // Reading or writing a sysfs file failed for some other reason.
+      FAILED,
+      // The system resumed from a different suspend after the requests were
+      // accepted, so the triggering events had already been handled.
+      STALE,
+    };
+
+    Result();
+
+    Status status;
+
+    // Returns a description of the requests, for logging.
+    std::string GetRequestDescription() const;
+
+    // Uptime in milliseconds of the latest event among the requests made via
+    // RequestSuspend(), or 0 if there were none.
+    int64_t event_time_ms;
+
+    // Reasons passed to RequestSuspend() in the order that the requests were
+    // made, and the bitwise OR of their flags.
+    std::vector<int> reasons;
+    int flags;
+
+    // Uptime (i.e. CLOCK_MONOTONIC) at which the system resumed. Only set for
+    // SUSPENDED.
+    base::TimeDelta resume_uptime;
+
+    // Durations of the phases described in SuspendLatencyStats. Only set for
+    // SUSPENDED.
+    base::TimeDelta request_to_write;
+    base::TimeDelta kernel_time;
+    base::TimeDelta sleep_time;
+
+    // True if an attempt requested by RequestAutosleep() was merged into the
+    // suspend. Never set for STALE results.
+    bool autosleep;
+
+    // errno value from the sysfs read or write that prevented the suspend, or
+    // 0 if there was none (e.g. the wakeup count couldn't be parsed). Only
+    // set for AVOIDED, ABORTED and FAILED.
+    int error;
+  };
+
+  using ResultCallback = base::Callback<void(const Result&)>;
+
+  Suspender();
+  ~Suspender();
+
+  // Must be called before Init().
+  void set_power_state_path_for_testing(const base::FilePath& path) {
+    power_state_path_ = path;
+  }
+  void set_wakeup_count_path_for_testing(const base::FilePath& path) {
+    wakeup_count_path_ = path;
+  }
+
+  // The writers are used on the suspend thread, so they should only be
+  // modified after FlushForTesting() with no requests pending.
+  SysfsWriter* power_state_writer_for_testing() {
+    return &power_state_writer_;
+  }
+  SysfsWriter* wakeup_count_writer_for_testing() {
+    return &wakeup_count_writer_;
+  }
+
+  // Records wakeup reasons. Its paths may only be changed before Init().
+  ResumeCollector* resume_collector() { return &resume_collector_; }
+  const ResumeCollector* resume_collector() const { return &resume_collector_; }
+
+  // Number of writes to the power state file.
+  int num_suspend_attempts() const { return num_suspend_attempts_; }
+
+  // Number of suspends that ended in each non-SUSPENDED, non-STALE status.
+  int num_avoided_suspends() const { return num_avoided_suspends_; }
+  int num_aborted_suspends() const { return num_aborted_suspends_; }
+  int num_failed_suspends() const { return num_failed_suspends_; }
+
+  // Number of requests (including autosleep attempts) that were merged into a
+  // suspend made for an earlier request, and number of requests that were
+  // dropped as STALE.
+  int num_coalesced_requests() const { return num_coalesced_requests_; }
+  int num_stale_requests() const { return num_stale_requests_; }
+
+  // Copies the number of failed sysfs reads and writes made while suspending,
+  // keyed by errno value, to |counts|.
+  void GetErrorCounts(std::map<int, int>* counts) const;
+
+  // Copies latency histograms for successful suspends to |stats|.
+  void GetLatencyStats(SuspendLatencyStats* stats) const;
+
+  // Appends a human-readable summary of the above counters, errors and
+  // latencies to |output|.
+  void DumpStats(std::string* output) const;
+
+  // Returns the uptime at which the system last resumed from a suspend made by
+  // this class, or zero if it hasn't suspended yet.
+  base::TimeDelta GetLastResumeUptime() const;
+
+  // Starts the suspend thread. |callback| is run with the outcome of each
+  // request on the calling thread, which must have a message loop. Returns
+  // true on success.
+  bool Init(const ResultCallback& callback);
+
+  // Asks the suspend thread to suspend the system in response to an event at
+  // uptime |event_time_ms|. Returns false without doing anything if the event
+  // precedes the last resume. May be called on any thread.
+  bool RequestSuspend(int64_t event_time_ms, int reason, int flags);
+
+  // Records whether the kernel wake lock is held. While it is, requests are
+  // reported as AVOIDED without starting the handshake. May be called on any
+  // thread.
+  void SetKernelLockHeld(bool held) { kernel_lock_held_ = held; }
+
+  // Asks the suspend thread to make an opportunistic suspend attempt on
+  // behalf of Autosleeper. Autosleep attempts aren't triggered by an event, so
+  // they're never stale. May be called on any thread.
+  void RequestAutosleep();
+
+  // Blocks until the suspend thread has handled all previously-accepted
+  // requests. Their results are posted to the Init() thread's message loop.
+  void FlushForTesting();
+
+  // Keeps the suspend thread from handling requests until |event| is
+  // signaled, so that tests can queue several requests deterministically.
+  void BlockForTesting(base::WaitableEvent* event);
+
+ private:
+  // Opens |power_state_writer_|, |wakeup_count_writer_| and
+  // |resume_collector_|'s files. Runs on |thread_|.
+  void OpenFiles();
+
+  // A request passed to RequestSuspend().
+  struct PendingRequest {
+    int64_t event_time_ms;
+    int reason;
+    int flags;
+
+    // CLOCK_MONOTONIC time at which the request was accepted.
+    base::TimeDelta accept_time;
+  };
+
+  // Simultaneous CLOCK_MONOTONIC and CLOCK_BOOTTIME readings.
+  struct ClockReadings {
+    base::TimeDelta monotonic;
+    base::TimeDelta boottime;
+  };
+
+  // Returns the current CLOCK_MONOTONIC time.
+  static base::TimeDelta GetMonotonicTime();
+
+  // Reads both clocks.
+  static ClockReadings ReadClocks();
+
+  // Posts a task to run Suspend() unless one is already pending. |lock_|
+  // must be held.
+  void PostSuspendTaskLocked();
+
+  // Handles all queued requests. Runs on |thread_|.
+  void Suspend();
+
+  // Performs the wakeup_count handshake and then writes to the power state
+  // file, reading the clocks immediately before and after the write. Returns
+  // SUSPENDED, AVOIDED, ABORTED or FAILED, and sets |error| to the errno value
+  // of the failed read or write (if any). Runs on |thread_|.
+  Result::Status SuspendWithWakeupCount(ClockReadings* before_write,
+                                        ClockReadings* after_write,
+                                        int* error);
+
+  // Records |result|'s resume-to-report latency and passes it to |callback_|.
+  // Runs on |origin_task_runner_|.
+  void ReportResult(const Result& result);
+
+  // Paths to the sysfs file that's written to change the power state and to
+  // the file used for the wakeup_count handshake.
+  base::FilePath power_state_path_;
+  base::FilePath wakeup_count_path_;
+
+  // Persistent writers for the above paths. Only used on |thread_|.
+  SysfsWriter power_state_writer_;
+  SysfsWriter wakeup_count_writer_;
+
+  // Records each resume. Written on |thread_| and read on arbitrary threads.
+  ResumeCollector resume_collector_;
+
+  // Guards the members below it, which are written by RequestSuspend() and
+  // RequestAutosleep() on arbitrary threads and drained on |thread_|.
+  mutable base::Lock lock_;
+  base::TimeDelta last_resume_uptime_;
+  std::vector<PendingRequest> pending_requests_;
+  bool autosleep_requested_;
+  base::TimeDelta autosleep_accept_time_;
+
+  // True while a Suspend() task is posted but hasn't drained the queue.
+  bool suspend_task_pending_;
+
+  // Set by SetKernelLockHeld() and read on |thread_|.
+  std::atomic<bool> kernel_lock_held_;
+
+  // Number of failed sysfs reads and writes, keyed by errno value.
+  std::map<int, int> error_counts_;
+
+  std::atomic<int> num_suspend_attempts_;
+  std::atomic<int> num_avoided_suspends_;
+  std::atomic<int> num_aborted_suspends_;
+  std::atomic<int> num_failed_suspends_;
+  std::atomic<int> num_coalesced_requests_;
+  std::atomic<int> num_stale_requests_;
+
+  // Latencies of successful suspends, recorded on |thread_| (and
+  // |resume_to_report_| on |origin_task_runner_|) and read on arbitrary
+  // threads. See SuspendLatencyStats for descriptions.
+  mutable base::Lock latency_lock_;
+  LatencyHistogram request_to_write_;
+  LatencyHistogram kernel_time_;
+  LatencyHistogram sleep_time_;
+  LatencyHistogram resume_to_report_;
+
+  // Thread that Init() was called on and the callback passed to it.
+  scoped_refptr<base::SingleThreadTaskRunner> origin_task_runner_;
+  ResultCallback callback_;
+
+  // Created by Init() and copied into tasks posted to |origin_task_runner_|.
+  base::WeakPtr<Suspender> weak_this_;
+
+  // Declared after the members used by its tasks, so that it's stopped (and
+  // its current task finishes) before they're destroyed.
+  base::Thread thread_;
+
+  base::WeakPtrFactory<Suspender> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(Suspender);
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_DAEMON_SUSPENDER_H_
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "suspender_test_util.h"
+
+#include <base/bind.h>
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/run_loop.h>
+
+#include "sysfs_writer.h"
+
+namespace android {
+
+SuspenderTestBase::SuspenderTestBase() {
+  CHECK(temp_dir_.CreateUniqueTempDir());
+  power_state_path_ = temp_dir_.path().Append("power_state");
+  CHECK(base::WriteFile(power_state_path_, "", 0) == 0);
+  wakeup_count_path_ = temp_dir_.path().Append("wakeup_count");
+  WriteWakeupCount("42\n");
+  wakeup_reason_path_ = temp_dir_.path().Append("last_resume_reason");
+  CHECK(base::WriteFile(wakeup_reason_path_, "57 rtc\n", 7) == 7);
+}
+
+SuspenderTestBase::~SuspenderTestBase() = default;
+
+void SuspenderTestBase::InitSuspender() {
+  suspender_.set_power_state_path_for_testing(power_state_path_);
+  suspender_.set_wakeup_count_path_for_testing(wakeup_count_path_);
+  suspender_.resume_collector()->set_wakeup_reason_path_for_testing(
+      wakeup_reason_path_);
+  suspender_.resume_collector()->set_suspend_stats_dir_for_testing(
+      temp_dir_.path().Append("suspend_stats"));
+  CHECK(suspender_.Init(base::Bind(&SuspenderTestBase::HandleResult,
+                                   base::Unretained(this))));
+}
+
+void SuspenderTestBase::Flush() {
+  suspender_.FlushForTesting();
+  base::RunLoop().RunUntilIdle();
+}
+
+void SuspenderTestBase::SetWriteError(SysfsWriter* writer, int error) {
+  suspender_.FlushForTesting();
+  writer->set_write_error_for_testing(error);
+}
+
+void SuspenderTestBase::WriteWakeupCount(const std::string& count) {
+  CHECK(base::WriteFile(wakeup_count_path_, count.data(), count.size()) ==
+        static_cast<int>(count.size()));
+}
+
+std::unique_ptr<base::TickClock> SuspenderTestBase::CreateTickClock() {
+  clock_ = new base::SimpleTestTickClock();
+  clock_->Advance(base::TimeDelta::FromSeconds(1000));
+  return std::unique_ptr<base::TickClock>(clock_);
+}
+
+// static
+std::string SuspenderTestBase::ReadFile(const base::FilePath& path) {
+  std::string value;
+  CHECK(base::ReadFileToString(path, &value));
+  return value;
+}
+
+void SuspenderTestBase::HandleResult(const Suspender::Result& result) {
+  results_.push_back(result);
+}
+
+}  // namespace android
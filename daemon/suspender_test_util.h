@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSTEM_NATIVEPOWER_DAEMON_SUSPENDER_TEST_UTIL_H_
+#define SYSTEM_NATIVEPOWER_DAEMON_SUSPENDER_TEST_UTIL_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/files/file_path.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/macros.h>
+#include <base/message_loop/message_loop.h>
+#include <base/test/simple_test_tick_clock.h>
+#include <gtest/gtest.h>
+
+#include "suspender.h"
+
+namespace android {
+
+class SysfsWriter;
+
+// Base fixture for tests that drive a real Suspender against fake sysfs files
+// in a temporary directory.
+class SuspenderTestBase : public testing::Test {
+ public:
+  SuspenderTestBase();
+  ~SuspenderTestBase() override;
+
+ protected:
+  // Points |suspender_| at the fake files and initializes it to report
+  // results to HandleResult().
+  void InitSuspender();
+
+  // Waits for |suspender_| to handle pending requests and runs the tasks that
+  // report their results.
+  void Flush();
+
+  // Makes |suspender_|'s writes to |writer| fail with |error|, or succeed if
+  // |error| is 0.
+  void SetWriteError(SysfsWriter* writer, int error);
+
+  // Replaces the contents of |wakeup_count_path_| with |count|.
+  void WriteWakeupCount(const std::string& count);
+
+  // Returns a clock for the class under test, advanced well past zero, and
+  // points |clock_| at it.
+  std::unique_ptr<base::TickClock> CreateTickClock();
+
+  // Returns the contents of |path|.
+  static std::string ReadFile(const base::FilePath& path);
+
+  // Called with each result reported by |suspender_|. Appends |result| to
+  // |results_|.
+  virtual void HandleResult(const Suspender::Result& result);
+
+  base::MessageLoop message_loop_;
+  base::ScopedTempDir temp_dir_;
+
+  // Files within |temp_dir_| simulating /sys/power/state,
+  // /sys/power/wakeup_count and /sys/kernel/wakeup_reasons/last_resume_reason.
+  base::FilePath power_state_path_;
+  base::FilePath wakeup_count_path_;
+  base::FilePath wakeup_reason_path_;
+
+  // Set by CreateTickClock() and owned by the class under test.
+  base::SimpleTestTickClock* clock_ = nullptr;
+
+  Suspender suspender_;
+
+  // Results reported by |suspender_|.
+  std::vector<Suspender::Result> results_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SuspenderTestBase);
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_DAEMON_SUSPENDER_TEST_UTIL_H_
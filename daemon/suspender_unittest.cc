@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/macros.h>
+#include <base/run_loop.h>
+#include <base/strings/stringprintf.h>
+#include <base/synchronization/waitable_event.h>
+#include <base/sys_info.h>
+#include <base/threading/platform_thread.h>
+#include <gtest/gtest.h>
+#include <nativepower/suspend_latency_stats.h>
+
+#include "suspender.h"
+#include "suspender_test_util.h"
+
+namespace android {
+
+class SuspenderTest : public SuspenderTestBase {
+ public:
+  SuspenderTest() = default;
+  ~SuspenderTest() override = default;
+
+ protected:
+  std::string ReadPowerState() const { return ReadFile(power_state_path_); }
+
+  // Returns the current uptime in milliseconds.
+  static int64_t GetUptimeMs() {
+    return base::SysInfo::Uptime().InMilliseconds();
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SuspenderTest);
+};
+
+TEST_F(SuspenderTest, Suspend) {
+  InitSuspender();
+  const int64_t kEventTime = GetUptimeMs();
+  EXPECT_TRUE(suspender_.RequestSuspend(kEventTime, 0, 0));
+
+  // The result should only be reported once the caller's loop runs.
+  suspender_.FlushForTesting();
+  EXPECT_EQ(Suspender::kPowerStateSuspend, ReadPowerState());
+  EXPECT_TRUE(results_.empty());
+
+  // The wakeup count should have been written back before suspending.
+  EXPECT_EQ(1, suspender_.wakeup_count_writer_for_testing()->num_writes());
+  EXPECT_EQ("42\n", ReadFile(wakeup_count_path_));
+  base::RunLoop().RunUntilIdle();
+
+  ASSERT_EQ(1u, results_.size());
+  EXPECT_EQ(Suspender::Result::Status::SUSPENDED, results_[0].status);
+  EXPECT_EQ(kEventTime, results_[0].event_time_ms);
+  EXPECT_GE(results_[0].resume_uptime.InMilliseconds(), kEventTime);
+  EXPECT_EQ(results_[0].resume_uptime, suspender_.GetLastResumeUptime());
+  EXPECT_EQ(1, suspender_.num_suspend_attempts());
+  EXPECT_EQ(0, suspender_.num_failed_suspends());
+
+  // Events preceding the resume should be rejected immediately.
+  EXPECT_FALSE(suspender_.RequestSuspend(kEventTime - 1, 0, 0));
+  Flush();
+  EXPECT_EQ(1u, results_.size());
+  EXPECT_EQ(1, suspender_.num_suspend_attempts());
+}
+
+TEST_F(SuspenderTest, Autosleep) {
+  InitSuspender();
+  const int64_t kStartTime = GetUptimeMs();
+  suspender_.RequestAutosleep();
+  Flush();
+  EXPECT_EQ(Suspender::kPowerStateSuspend, ReadPowerState());
+  ASSERT_EQ(1u, results_.size());
+  EXPECT_TRUE(results_[0].autosleep);
+  EXPECT_EQ(Suspender::Result::Status::SUSPENDED, results_[0].status);
+  EXPECT_TRUE(results_[0].reasons.empty());
+  EXPECT_GE(results_[0].resume_uptime.InMilliseconds(), kStartTime);
+
+  // Autosleep attempts are never stale, since they aren't triggered by an
+  // earlier event.
+  suspender_.RequestAutosleep();
+  Flush();
+  ASSERT_EQ(2u, results_.size());
+  EXPECT_EQ(Suspender::Result::Status::SUSPENDED, results_[1].status);
+  EXPECT_EQ(2, suspender_.num_suspend_attempts());
+}
+
+TEST_F(SuspenderTest, EventHandledByEarlierSuspend) {
+  InitSuspender();
+
+  // Two requests for the same event should only suspend once: the second is
+  // merged with the first if it's queued before the suspend starts, dropped
+  // by the suspend thread if it's queued during the suspend, or rejected if
+  // it's made after the resume.
+  const int64_t kEventTime = GetUptimeMs() - 1000;
+  EXPECT_TRUE(suspender_.RequestSuspend(kEventTime, 0, 0));
+  const bool accepted = suspender_.RequestSuspend(kEventTime, 0, 0);
+  Flush();
+  EXPECT_EQ(1, suspender_.num_suspend_attempts());
+  ASSERT_GE(results_.size(), 1u);
+  EXPECT_EQ(Suspender::Result::Status::SUSPENDED, results_[0].status);
+  if (results_.size() == 2u) {
+    EXPECT_TRUE(accepted);
+    EXPECT_EQ(Suspender::Result::Status::STALE, results_[1].status);
+    EXPECT_EQ(1, suspender_.num_stale_requests());
+  } else {
+    ASSERT_EQ(1u, results_.size());
+    EXPECT_EQ(accepted ? 2u : 1u, results_[0].reasons.size());
+  }
+}
+
+TEST_F(SuspenderTest, CoalesceRequests) {
+  InitSuspender();
+
+  // Requests queued while the suspend thread is busy should be handled by a
+  // single suspend.
+  base::WaitableEvent event(false /* manual_reset */,
+                            false /* initially_signaled */);
+  suspender_.BlockForTesting(&event);
+  const int64_t kEventTime = GetUptimeMs();
+  EXPECT_TRUE(suspender_.RequestSuspend(kEventTime, 3, 0x1));
+  EXPECT_TRUE(suspender_.RequestSuspend(kEventTime + 5, 4, 0x2));
+  suspender_.RequestAutosleep();
+  EXPECT_TRUE(suspender_.RequestSuspend(kEventTime + 2, 6, 0));
+  event.Signal();
+  Flush();
+
+  EXPECT_EQ(1, suspender_.num_suspend_attempts());
+  EXPECT_EQ(1, suspender_.wakeup_count_writer_for_testing()->num_writes());
+  EXPECT_EQ(3, suspender_.num_coalesced_requests());
+  ASSERT_EQ(1u, results_.size());
+  const Suspender::Result& result = results_[0];
+  EXPECT_EQ(Suspender::Result::Status::SUSPENDED, result.status);
+  EXPECT_EQ(kEventTime + 5, result.event_time_ms);
+  ASSERT_EQ(3u, result.reasons.size());
+  EXPECT_EQ(3, result.reasons[0]);
+  EXPECT_EQ(4, result.reasons[1]);
+  EXPECT_EQ(6, result.reasons[2]);
+  EXPECT_EQ(0x3, result.flags);
+  EXPECT_TRUE(result.autosleep);
+
+  // A later request should get its own suspend.
+  EXPECT_TRUE(suspender_.RequestSuspend(GetUptimeMs(), 2, 0));
+  Flush();
+  EXPECT_EQ(2, suspender_.num_suspend_attempts());
+  EXPECT_EQ(3, suspender_.num_coalesced_requests());
+  ASSERT_EQ(2u, results_.size());
+  EXPECT_EQ(1u, results_[1].reasons.size());
+  EXPECT_FALSE(results_[1].autosleep);
+}
+
+TEST_F(SuspenderTest, Latency) {
+  InitSuspender();
+
+  // Time spent waiting for the suspend thread should count toward the
+  // request-to-write latency.
+  const base::TimeDelta kDelay = base::TimeDelta::FromMilliseconds(20);
+  base::WaitableEvent event(false /* manual_reset */,
+                            false /* initially_signaled */);
+  suspender_.BlockForTesting(&event);
+  EXPECT_TRUE(suspender_.RequestSuspend(GetUptimeMs(), 0, 0));
+  base::PlatformThread::Sleep(kDelay);
+  event.Signal();
+  Flush();
+  ASSERT_EQ(1u, results_.size());
+  EXPECT_GE(results_[0].request_to_write, kDelay);
+  EXPECT_GE(results_[0].kernel_time, base::TimeDelta());
+
+  SuspendLatencyStats stats;
+  suspender_.GetLatencyStats(&stats);
+  EXPECT_EQ(1, stats.request_to_write.count);
+  EXPECT_GE(stats.request_to_write.p50, kDelay);
+  EXPECT_EQ(1, stats.kernel.count);
+  EXPECT_EQ(1, stats.sleep.count);
+  EXPECT_EQ(1, stats.resume_to_report.count);
+
+  // Failed suspends shouldn't be recorded.
+  suspender_.FlushForTesting();
+  suspender_.power_state_writer_for_testing()->set_write_error_for_testing(
+      EIO);
+  EXPECT_TRUE(suspender_.RequestSuspend(GetUptimeMs(), 0, 0));
+  Flush();
+  suspender_.GetLatencyStats(&stats);
+  EXPECT_EQ(1, stats.kernel.count);
+  EXPECT_EQ(1, stats.resume_to_report.count);
+
+  std::string dump;
+  suspender_.DumpStats(&dump);
+  EXPECT_NE(std::string::npos, dump.find("failed=1"));
+  EXPECT_NE(std::string::npos, dump.find("kernel: count=1 "));
+}
+
+TEST_F(SuspenderTest, RecordResume) {
+  InitSuspender();
+  EXPECT_TRUE(suspender_.RequestSuspend(GetUptimeMs(), 0, 0));
+  Flush();
+  ASSERT_EQ(1u, results_.size());
+
+  // The wakeup reason should be recorded along with the sleep time.
+  std::vector<ResumeCollector::Record> records;
+  suspender_.resume_collector()->GetRecords(&records);
+  ASSERT_EQ(1u, records.size());
+  EXPECT_EQ(results_[0].resume_uptime, records[0].resume_uptime);
+  EXPECT_EQ(results_[0].sleep_time, records[0].sleep_time);
+  EXPECT_EQ(57, records[0].irq);
+  EXPECT_STREQ("57 rtc", records[0].reason);
+
+  // Failed suspends aren't resumes.
+  suspender_.FlushForTesting();
+  suspender_.power_state_writer_for_testing()->set_write_error_for_testing(
+      EBUSY);
+  EXPECT_TRUE(suspender_.RequestSuspend(GetUptimeMs(), 0, 0));
+  Flush();
+  EXPECT_EQ(1, suspender_.resume_collector()->GetNumResumes());
+}
+
+TEST_F(SuspenderTest, WakeupEventDuringHandshake) {
+  InitSuspender();
+  suspender_.FlushForTesting();
+
+  // If the kernel rejects the wakeup count, the power state file shouldn't be
+  // written.
+  suspender_.wakeup_count_writer_for_testing()->set_write_error_for_testing(
+      EINVAL);
+  EXPECT_TRUE(suspender_.RequestSuspend(GetUptimeMs(), 0, 0));
+  Flush();
+  ASSERT_EQ(1u, results_.size());
+  EXPECT_EQ(Suspender::Result::Status::AVOIDED, results_[0].status);
+  EXPECT_EQ(EINVAL, results_[0].error);
+  EXPECT_EQ("", ReadPowerState());
+  EXPECT_EQ(1, suspender_.num_avoided_suspends());
+  EXPECT_EQ(0, suspender_.num_suspend_attempts());
+  EXPECT_EQ(base::TimeDelta(), suspender_.GetLastResumeUptime());
+
+  // A kernel-aborted suspend should be counted separately.
+  suspender_.wakeup_count_writer_for_testing()->set_write_error_for_testing(0);
+  suspender_.power_state_writer_for_testing()->set_write_error_for_testing(
+      EBUSY);
+  EXPECT_TRUE(suspender_.RequestSuspend(GetUptimeMs(), 0, 0));
+  Flush();
+  ASSERT_EQ(2u, results_.size());
+  EXPECT_EQ(Suspender::Result::Status::ABORTED, results_[1].status);
+  EXPECT_EQ(EBUSY, results_[1].error);
+  EXPECT_EQ(1, suspender_.num_aborted_suspends());
+  EXPECT_EQ(1, suspender_.num_suspend_attempts());
+  EXPECT_EQ(0, suspender_.num_failed_suspends());
+  EXPECT_EQ(base::TimeDelta(), suspender_.GetLastResumeUptime());
+
+  // Other errors are plain failures.
+  suspender_.power_state_writer_for_testing()->set_write_error_for_testing(
+      EIO);
+  EXPECT_TRUE(suspender_.RequestSuspend(GetUptimeMs(), 0, 0));
+  Flush();
+  ASSERT_EQ(3u, results_.size());
+  EXPECT_EQ(Suspender::Result::Status::FAILED, results_[2].status);
+  EXPECT_EQ(EIO, results_[2].error);
+  EXPECT_EQ(1, suspender_.num_failed_suspends());
+
+  // Each error should be counted by its errno value.
+  EXPECT_TRUE(suspender_.RequestSuspend(GetUptimeMs(), 0, 0));
+  Flush();
+  std::map<int, int> error_counts;
+  suspender_.GetErrorCounts(&error_counts);
+  EXPECT_EQ((std::map<int, int>{{EINVAL, 1}, {EBUSY, 1}, {EIO, 2}}),
+            error_counts);
+
+  std::string dump;
+  suspender_.DumpStats(&dump);
+  EXPECT_NE(std::string::npos,
+            dump.find(base::StringPrintf("errno %d (", EIO)));
+}
+
+TEST_F(SuspenderTest, KernelLockHeld) {
+  InitSuspender();
+
+  // While the kernel lock is held, requests should be avoided without reading
+  // the wakeup count, which would block until the lock is released.
+  ASSERT_TRUE(base::DeleteFile(wakeup_count_path_, false));
+  suspender_.SetKernelLockHeld(true);
+  EXPECT_TRUE(suspender_.RequestSuspend(GetUptimeMs(), 0, 0));
+  Flush();
+  ASSERT_EQ(1u, results_.size());
+  EXPECT_EQ(Suspender::Result::Status::AVOIDED, results_[0].status);
+  EXPECT_EQ(0, results_[0].error);
+  EXPECT_EQ("", ReadPowerState());
+  EXPECT_EQ(1, suspender_.num_avoided_suspends());
+  EXPECT_EQ(0, suspender_.num_failed_suspends());
+
+  // Once it's released, the next request should suspend.
+  WriteWakeupCount("1\n");
+  suspender_.SetKernelLockHeld(false);
+  EXPECT_TRUE(suspender_.RequestSuspend(GetUptimeMs(), 0, 0));
+  Flush();
+  ASSERT_EQ(2u, results_.size());
+  EXPECT_EQ(Suspender::Result::Status::SUSPENDED, results_[1].status);
+  EXPECT_EQ(Suspender::kPowerStateSuspend, ReadPowerState());
+}
+
+TEST_F(SuspenderTest, UnreadableWakeupCount) {
+  WriteWakeupCount("bogus");
+  InitSuspender();
+  EXPECT_TRUE(suspender_.RequestSuspend(GetUptimeMs(), 0, 0));
+  Flush();
+  ASSERT_EQ(1u, results_.size());
+  EXPECT_EQ(Suspender::Result::Status::FAILED, results_[0].status);
+  EXPECT_EQ(0, results_[0].error);
+  EXPECT_EQ("", ReadPowerState());
+  EXPECT_EQ(0, suspender_.num_suspend_attempts());
+}
+
+TEST_F(SuspenderTest, WriteFailure) {
+  power_state_path_ = temp_dir_.path().Append("missing");
+  InitSuspender();
+  EXPECT_TRUE(suspender_.RequestSuspend(GetUptimeMs(), 0, 0));
+  Flush();
+  ASSERT_EQ(1u, results_.size());
+  EXPECT_EQ(Suspender::Result::Status::FAILED, results_[0].status);
+  EXPECT_EQ(ENOENT, results_[0].error);
+  EXPECT_EQ(1, suspender_.num_failed_suspends());
+
+  // The failed attempt shouldn't be treated as a resume.
+  EXPECT_EQ(base::TimeDelta(), suspender_.GetLastResumeUptime());
+}
+
+}  // namespace android
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sysfs_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <base/logging.h>
+#include <base/posix/eintr_wrapper.h>
+
+namespace android {
+
+SysfsWriter::SysfsWriter()
+    : num_opens_(0),
+      num_writes_(0),
+      last_error_(0),
+      write_error_for_testing_(0) {}
+
+SysfsWriter::~SysfsWriter() = default;
+
+bool SysfsWriter::Open(const base::FilePath& path) {
+  Close();
+  path_ = path;
+  return EnsureOpen();
+}
+
+void SysfsWriter::Close() {
+  fd_.reset();
+}
+
+bool SysfsWriter::Write(const std::string& data) {
+  VLOG(1) << "Writing \"" << data << "\" to " << path_.value();
+  if (!EnsureOpen())
+    return false;
+
+  // sysfs attributes are always written from offset 0, so use pwrite() to
+  // avoid needing to seek between writes to the same descriptor.
+  num_writes_++;
+  ssize_t result = -1;
+  if (write_error_for_testing_)
+    errno = write_error_for_testing_;
+  else
+    result = HANDLE_EINTR(pwrite(fd_.get(), data.data(), data.size(), 0));
+  if (result != static_cast<ssize_t>(data.size())) {
+    last_error_ = errno;
+    PLOG(ERROR) << "Failed to write \"" << data << "\" to " << path_.value();
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool SysfsWriter::EnsureOpen() {
+  if (fd_.is_valid())
+    return true;
+  if (path_.empty())
+    return false;
+
+  num_opens_++;
+  fd_.reset(HANDLE_EINTR(open(path_.value().c_str(), O_WRONLY | O_CLOEXEC)));
+  if (!fd_.is_valid()) {
+    last_error_ = errno;
+    PLOG(ERROR) << "Failed to open " << path_.value();
+    return false;
+  }
+  return true;
+}
+
+}  // namespace android
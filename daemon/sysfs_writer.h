@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSTEM_NATIVEPOWER_DAEMON_SYSFS_WRITER_H_
+#define SYSTEM_NATIVEPOWER_DAEMON_SYSFS_WRITER_H_
+
+#include <string>
+
+#include <base/files/file_path.h>
+#include <base/files/scoped_file.h>
+#include <base/macros.h>
+
+namespace android {
+
+// Writes values to a sysfs attribute (e.g. /sys/power/wake_lock) through a
+// file descriptor that is opened once and then reused, avoiding an open() and
+// close() and the associated path lookup for every write.
+//
+// If a write fails, the descriptor is closed and transparently reopened by the
+// next call to Write().
+class SysfsWriter {
+ public:
+  SysfsWriter();
+  ~SysfsWriter();
+
+  const base::FilePath& path() const { return path_; }
+  bool is_open() const { return fd_.is_valid(); }
+
+  // Number of open() and pwrite() calls made so far.
+  int num_opens() const { return num_opens_; }
+  int num_writes() const { return num_writes_; }
+
+  // errno value from the most recent failed open() or pwrite() call, or 0 if
+  // none has failed. Not cleared by successful calls.
+  int last_error() const { return last_error_; }
+
+  // If |error| is nonzero, makes subsequent calls to Write() fail with it as
+  // if pwrite() had returned the error, so that callers' handling of specific
+  // kernel errors can be tested. Passing 0 restores normal behavior. Must not
+  // be called concurrently with Write().
+  void set_write_error_for_testing(int error) {
+    write_error_for_testing_ = error;
+  }
+
+  // Opens |path| for writing, closing any previously-opened file. Returns true
+  // on success. |path| is retained even on failure so that later writes can
+  // attempt to reopen it.
+  bool Open(const base::FilePath& path);
+
+  // Closes the file. It will be reopened by the next call to Write().
+  void Close();
+
+  // Writes |data| at the start of the file, returning true on success or
+  // logging an error and returning false otherwise.
+  bool Write(const std::string& data);
+
+ private:
+  // Opens |path_| if it isn't already open. Returns true on success.
+  bool EnsureOpen();
+
+  base::FilePath path_;
+  base::ScopedFD fd_;
+
+  int num_opens_;
+  int num_writes_;
+  int last_error_;
+  int write_error_for_testing_;
+
+  DISALLOW_COPY_AND_ASSIGN(SysfsWriter);
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_DAEMON_SYSFS_WRITER_H_
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares writing wake lock transitions through a persistent SysfsWriter with
+// the previous approach of calling base::AppendToFile() (i.e. open(), write()
+// and close()) for every transition. Both benchmarks report the syscalls that
+// they actually made per transition.
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
+#include <base/posix/eintr_wrapper.h>
+#include <benchmark/benchmark.h>
+
+#include "sysfs_writer.h"
+#include "wake_lock_manager.h"
+
+namespace android {
+namespace {
+
+// Creates empty lock and unlock files in |temp_dir|.
+void CreateFiles(const base::ScopedTempDir& temp_dir,
+                 base::FilePath* lock_path,
+                 base::FilePath* unlock_path) {
+  *lock_path = temp_dir.path().Append("lock");
+  *unlock_path = temp_dir.path().Append("unlock");
+  CHECK_EQ(0, base::WriteFile(*lock_path, "", 0));
+  CHECK_EQ(0, base::WriteFile(*unlock_path, "", 0));
+}
+
+// Appends |data| to |path| the same way as base::AppendToFile(), adding the
+// number of syscalls made to |syscalls|.
+bool AppendToFile(const base::FilePath& path,
+                  const std::string& data,
+                  int64_t* syscalls) {
+  (*syscalls)++;
+  const int fd = HANDLE_EINTR(open(path.value().c_str(), O_WRONLY | O_APPEND));
+  if (fd < 0)
+    return false;
+
+  bool success = true;
+  size_t written = 0;
+  while (written < data.size()) {
+    (*syscalls)++;
+    const ssize_t rv = HANDLE_EINTR(
+        write(fd, data.data() + written, data.size() - written));
+    if (rv < 0) {
+      success = false;
+      break;
+    }
+    written += rv;
+  }
+  (*syscalls)++;
+  if (IGNORE_EINTR(close(fd)) < 0)
+    success = false;
+  return success;
+}
+
+void BM_AppendToFile(benchmark::State& state) {
+  base::ScopedTempDir temp_dir;
+  CHECK(temp_dir.CreateUniqueTempDir());
+  base::FilePath lock_path, unlock_path;
+  CreateFiles(temp_dir, &lock_path, &unlock_path);
+
+  const std::string name(WakeLockManager::kLockName);
+  int64_t transitions = 0;
+  int64_t syscalls = 0;
+  while (state.KeepRunning()) {
+    CHECK(AppendToFile(lock_path, name, &syscalls));
+    CHECK(AppendToFile(unlock_path, name, &syscalls));
+    transitions += 2;
+  }
+  state.SetItemsProcessed(transitions);
+  state.counters["syscalls_per_transition"] =
+      transitions ? static_cast<double>(syscalls) / transitions : 0.0;
+}
+BENCHMARK(BM_AppendToFile);
+
+void BM_SysfsWriter(benchmark::State& state) {
+  base::ScopedTempDir temp_dir;
+  CHECK(temp_dir.CreateUniqueTempDir());
+  base::FilePath lock_path, unlock_path;
+  CreateFiles(temp_dir, &lock_path, &unlock_path);
+
+  SysfsWriter lock_writer, unlock_writer;
+  CHECK(lock_writer.Open(lock_path));
+  CHECK(unlock_writer.Open(unlock_path));
+
+  const std::string name(WakeLockManager::kLockName);
+  int64_t transitions = 0;
+  while (state.KeepRunning()) {
+    CHECK(lock_writer.Write(name));
+    CHECK(unlock_writer.Write(name));
+    transitions += 2;
+  }
+  state.SetItemsProcessed(transitions);
+
+  const int syscalls = lock_writer.num_opens() + lock_writer.num_writes() +
+      unlock_writer.num_opens() + unlock_writer.num_writes();
+  state.counters["syscalls_per_transition"] =
+      transitions ? static_cast<double>(syscalls) / transitions : 0.0;
+}
+BENCHMARK(BM_SysfsWriter);
+
+}  // namespace
+}  // namespace android
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+
+#include <string>
+
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
+#include <base/macros.h>
+#include <gtest/gtest.h>
+
+#include "sysfs_writer.h"
+
+namespace android {
+
+class SysfsWriterTest : public testing::Test {
+ public:
+  SysfsWriterTest() {
+    CHECK(temp_dir_.CreateUniqueTempDir());
+    path_ = temp_dir_.path().Append("attr");
+    CHECK(base::WriteFile(path_, "", 0) == 0);
+  }
+  ~SysfsWriterTest() override = default;
+
+ protected:
+  // Returns the contents of |path_|.
+  std::string ReadFile() const {
+    std::string value;
+    CHECK(base::ReadFileToString(path_, &value));
+    return value;
+  }
+
+  base::ScopedTempDir temp_dir_;
+
+  // File within |temp_dir_| simulating a sysfs attribute.
+  base::FilePath path_;
+
+  SysfsWriter writer_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SysfsWriterTest);
+};
+
+TEST_F(SysfsWriterTest, ReusesDescriptor) {
+  ASSERT_TRUE(writer_.Open(path_));
+  EXPECT_TRUE(writer_.Write("foo"));
+  EXPECT_EQ("foo", ReadFile());
+
+  // Subsequent writes should go to the start of the already-open file.
+  EXPECT_TRUE(writer_.Write("bar"));
+  EXPECT_EQ("bar", ReadFile());
+  EXPECT_EQ(1, writer_.num_opens());
+  EXPECT_EQ(2, writer_.num_writes());
+}
+
+TEST_F(SysfsWriterTest, ReopenAfterFailure) {
+  // Opening a missing file should fail, but the path should be retained.
+  const base::FilePath missing_path = temp_dir_.path().Append("missing");
+  EXPECT_FALSE(writer_.Open(missing_path));
+  EXPECT_FALSE(writer_.is_open());
+  EXPECT_FALSE(writer_.Write("foo"));
+  EXPECT_EQ(ENOENT, writer_.last_error());
+
+  // Once the file exists, the next write should open it transparently.
+  ASSERT_EQ(0, base::WriteFile(missing_path, "", 0));
+  EXPECT_TRUE(writer_.Write("foo"));
+  EXPECT_TRUE(writer_.is_open());
+  EXPECT_EQ(3, writer_.num_opens());
+
+  // The same should happen after the descriptor is closed.
+  writer_.Close();
+  EXPECT_TRUE(writer_.Write("bar"));
+  EXPECT_EQ(4, writer_.num_opens());
+  std::string value;
+  ASSERT_TRUE(base::ReadFileToString(missing_path, &value));
+  EXPECT_EQ("bar", value);
+}
+
+TEST_F(SysfsWriterTest, InjectedError) {
+  ASSERT_TRUE(writer_.Open(path_));
+  writer_.set_write_error_for_testing(EBUSY);
+  EXPECT_FALSE(writer_.Write("foo"));
+  EXPECT_EQ(EBUSY, writer_.last_error());
+  EXPECT_EQ("", ReadFile());
+
+  // The failure should close the file like a real one, and writes should
+  // succeed again once the error is cleared.
+  EXPECT_FALSE(writer_.is_open());
+  writer_.set_write_error_for_testing(0);
+  EXPECT_TRUE(writer_.Write("bar"));
+  EXPECT_EQ("bar", ReadFile());
+  EXPECT_EQ(EBUSY, writer_.last_error());
+}
+
+}  // namespace android
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "timer_wheel.h"
+
+#include <utility>
+
+namespace android {
+
+TimerWheel::TimerWheel() : next_tick_(0), size_(0) {}
+
+TimerWheel::~TimerWheel() = default;
+
+void TimerWheel::Schedule(int64_t now_tick,
+                          int64_t expiry_tick,
+                          const sp<IBinder>& binder,
+                          uint64_t id) {
+  if (size_ == 0 && now_tick > next_tick_)
+    next_tick_ = now_tick;
+
+  Entry entry;
+  entry.expiry_tick = expiry_tick;
+  entry.binder = binder;
+  entry.id = id;
+  Insert(std::move(entry));
+  size_++;
+}
+
+void TimerWheel::Advance(int64_t now_tick, std::vector<Entry>* expired) {
+  while (size_ > 0 && next_tick_ <= now_tick) {
+    // When the finest level wraps around, pull the next slot of each coarser
+    // level down, stopping at the first level that didn't wrap itself.
+    const int index = next_tick_ & kSlotMask;
+    if (index == 0) {
+      for (int level = 1; level < kNumLevels && Cascade(level) == 0; ++level) {
+      }
+    }
+
+    std::vector<Entry> due;
+    due.swap(slots_[0][index]);
+    next_tick_++;
+    size_ -= due.size();
+    for (Entry& entry : due)
+      expired->push_back(std::move(entry));
+  }
+
+  // There's nothing to walk through if the wheel is empty.
+  if (size_ == 0 && next_tick_ <= now_tick)
+    next_tick_ = now_tick + 1;
+}
+
+void TimerWheel::Clear() {
+  for (int level = 0; level < kNumLevels; ++level) {
+    for (int index = 0; index < kSlotsPerLevel; ++index)
+      slots_[level][index].clear();
+  }
+  size_ = 0;
+}
+
+void TimerWheel::Insert(Entry entry) {
+  int64_t delta = entry.expiry_tick - next_tick_;
+  if (delta < 0) {
+    slots_[0][next_tick_ & kSlotMask].push_back(std::move(entry));
+    return;
+  }
+
+  // Entries beyond the wheel's span go in the furthest slot but keep their
+  // expiry tick, so they're placed again when that slot cascades.
+  int64_t slot_tick = entry.expiry_tick;
+  const int64_t kMaxDelta = (1LL << (kBitsPerLevel * kNumLevels)) - 1;
+  if (delta > kMaxDelta) {
+    slot_tick = next_tick_ + kMaxDelta;
+    delta = kMaxDelta;
+  }
+
+  int level = 0;
+  while (delta >= (1LL << (kBitsPerLevel * (level + 1))))
+    level++;
+  const int index = (slot_tick >> (kBitsPerLevel * level)) & kSlotMask;
+  slots_[level][index].push_back(std::move(entry));
+}
+
+int TimerWheel::Cascade(int level) {
+  const int index = (next_tick_ >> (kBitsPerLevel * level)) & kSlotMask;
+  std::vector<Entry> entries;
+  entries.swap(slots_[level][index]);
+  for (Entry& entry : entries)
+    Insert(std::move(entry));
+  return index;
+}
+
+}  // namespace android
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSTEM_NATIVEPOWER_DAEMON_TIMER_WHEEL_H_
+#define SYSTEM_NATIVEPOWER_DAEMON_TIMER_WHEEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <base/macros.h>
+#include <binder/IBinder.h>
+#include <utils/StrongPointer.h>
+
+namespace android {
+
+// Hierarchical timing wheel used to expire wake lock requests. Time is measured
+// in abstract ticks. Scheduling is O(1), and advancing by one tick is O(1) plus
+// the number of entries that expire or cascade down from a coarser level, so
+// thousands of deadlines can be tracked without a separate timer for each.
+//
+// Individual entries can't be cancelled; callers should instead ignore expired
+// entries whose |id| no longer matches the state that they're tracking, and
+// Clear() the wheel once none of its entries are still live.
+class TimerWheel {
+ public:
+  struct Entry {
+    int64_t expiry_tick;
+    sp<IBinder> binder;
+    uint64_t id;
+  };
+
+  // Number of bits of the tick count that index each level, and number of
+  // levels. Deadlines further than 2^(kBitsPerLevel * kNumLevels) ticks in the
+  // future are parked in the coarsest level and reinserted whenever their slot
+  // cascades, so they still expire at their original tick.
+  static const int kBitsPerLevel = 6;
+  static const int kNumLevels = 4;
+
+  TimerWheel();
+  ~TimerWheel();
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Adds an entry that will be returned by Advance() once |expiry_tick| is
+  // reached (or on the next tick, if |expiry_tick| was already processed).
+  // |now_tick| is the current tick; it's used to fast-forward the wheel if it
+  // is empty.
+  void Schedule(int64_t now_tick,
+                int64_t expiry_tick,
+                const sp<IBinder>& binder,
+                uint64_t id);
+
+  // Processes all ticks up to and including |now_tick|, appending entries that
+  // have expired to |expired|.
+  void Advance(int64_t now_tick, std::vector<Entry>* expired);
+
+  // Removes all entries, e.g. once the caller knows that they're all stale.
+  void Clear();
+
+ private:
+  static const int kSlotsPerLevel = 1 << kBitsPerLevel;
+  static const int64_t kSlotMask = kSlotsPerLevel - 1;
+
+  // Places |entry| in the slot corresponding to its expiry tick relative to
+  // |next_tick_|, or in the furthest slot if the expiry tick is beyond the
+  // wheel's span.
+  void Insert(Entry entry);
+
+  // Moves the entries in level |level|'s slot for |next_tick_| down to finer
+  // levels. Returns the index of the slot that was cascaded.
+  int Cascade(int level);
+
+  // |slots_[level][index]| holds entries expiring within the slot.
+  std::vector<Entry> slots_[kNumLevels][kSlotsPerLevel];
+
+  // Next tick to be processed by Advance().
+  int64_t next_tick_;
+
+  // Total number of scheduled entries.
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(TimerWheel);
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_DAEMON_TIMER_WHEEL_H_
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+
+#include <binder/Binder.h>
+#include <gtest/gtest.h>
+
+#include "timer_wheel.h"
+
+namespace android {
+
+namespace {
+
+// Advances |wheel| to |now_tick| and returns the IDs of expired entries.
+std::vector<uint64_t> Advance(TimerWheel* wheel, int64_t now_tick) {
+  std::vector<TimerWheel::Entry> expired;
+  wheel->Advance(now_tick, &expired);
+  std::vector<uint64_t> ids;
+  for (const auto& entry : expired)
+    ids.push_back(entry.id);
+  return ids;
+}
+
+}  // namespace
+
+TEST(TimerWheelTest, ExpiresInOrder) {
+  TimerWheel wheel;
+  sp<IBinder> binder = new BBinder();
+  const int64_t kStart = 1000;
+
+  // Schedule entries that land in each level of the wheel.
+  wheel.Schedule(kStart, kStart + 5, binder, 1);
+  wheel.Schedule(kStart, kStart + 100, binder, 2);
+  wheel.Schedule(kStart, kStart + 10000, binder, 3);
+  wheel.Schedule(kStart, kStart + 300000, binder, 4);
+  EXPECT_EQ(4u, wheel.size());
+
+  EXPECT_TRUE(Advance(&wheel, kStart + 4).empty());
+  EXPECT_EQ(std::vector<uint64_t>{1}, Advance(&wheel, kStart + 5));
+  EXPECT_TRUE(Advance(&wheel, kStart + 99).empty());
+  EXPECT_EQ(std::vector<uint64_t>{2}, Advance(&wheel, kStart + 100));
+  EXPECT_TRUE(Advance(&wheel, kStart + 9999).empty());
+  EXPECT_EQ(std::vector<uint64_t>{3}, Advance(&wheel, kStart + 10000));
+  EXPECT_TRUE(Advance(&wheel, kStart + 299999).empty());
+  EXPECT_EQ(std::vector<uint64_t>{4}, Advance(&wheel, kStart + 300000));
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheelTest, SkipsAheadWhenEmpty) {
+  TimerWheel wheel;
+  sp<IBinder> binder = new BBinder();
+
+  // Scheduling into an empty wheel shouldn't depend on how long it's been
+  // since it was last advanced.
+  const int64_t kNow = 1LL << 40;
+  wheel.Schedule(kNow, kNow + 3, binder, 1);
+  EXPECT_TRUE(Advance(&wheel, kNow + 2).empty());
+  EXPECT_EQ(std::vector<uint64_t>{1}, Advance(&wheel, kNow + 3));
+
+  // Entries scheduled for ticks that were already processed should expire on
+  // the next advance.
+  wheel.Schedule(kNow + 3, kNow, binder, 2);
+  EXPECT_EQ(std::vector<uint64_t>{2}, Advance(&wheel, kNow + 4));
+}
+
+TEST(TimerWheelTest, BeyondSpan) {
+  TimerWheel wheel;
+  sp<IBinder> binder = new BBinder();
+  const int64_t kSpan =
+      1LL << (TimerWheel::kBitsPerLevel * TimerWheel::kNumLevels);
+  const int64_t kStart = 1000;
+
+  // Deadlines past the end of the wheel shouldn't expire early, even if they
+  // need to be reinserted more than once.
+  wheel.Schedule(kStart, kStart + kSpan - 1, binder, 1);
+  wheel.Schedule(kStart, kStart + kSpan, binder, 2);
+  wheel.Schedule(kStart, kStart + 2 * kSpan + 5, binder, 3);
+  EXPECT_TRUE(Advance(&wheel, kStart + kSpan - 2).empty());
+  EXPECT_EQ(std::vector<uint64_t>{1}, Advance(&wheel, kStart + kSpan - 1));
+  EXPECT_EQ(std::vector<uint64_t>{2}, Advance(&wheel, kStart + kSpan));
+  EXPECT_TRUE(Advance(&wheel, kStart + 2 * kSpan + 4).empty());
+  EXPECT_EQ(std::vector<uint64_t>{3}, Advance(&wheel, kStart + 2 * kSpan + 5));
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheelTest, Clear) {
+  TimerWheel wheel;
+  sp<IBinder> binder = new BBinder();
+  wheel.Schedule(0, 5, binder, 1);
+  wheel.Schedule(0, 10000, binder, 2);
+  wheel.Clear();
+  EXPECT_TRUE(wheel.empty());
+  EXPECT_TRUE(Advance(&wheel, 20000).empty());
+
+  // The wheel should remain usable afterward.
+  wheel.Schedule(20000, 20003, binder, 3);
+  EXPECT_EQ(1u, wheel.size());
+  EXPECT_EQ(std::vector<uint64_t>{3}, Advance(&wheel, 20003));
+}
+
+}  // namespace android
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "wake_lock_event_log.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <base/logging.h>
+#include <base/strings/stringprintf.h>
+
+namespace android {
+
+// static
+const char* WakeLockEventLog::GetEventTypeName(EventType type) {
+  switch (type) {
+    case EventType::ADD_REQUEST:
+      return "add";
+    case EventType::UPDATE_REQUEST:
+      return "update";
+    case EventType::REMOVE_REQUEST:
+      return "remove";
+    case EventType::BINDER_DEATH:
+      return "death";
+    case EventType::REQUEST_TIMEOUT:
+      return "timeout";
+    case EventType::KERNEL_LOCK:
+      return "kernel-lock";
+    case EventType::KERNEL_UNLOCK:
+      return "kernel-unlock";
+    case EventType::NUM_TYPES:
+      break;
+  }
+  NOTREACHED() << "Invalid event type " << static_cast<int>(type);
+  return "unknown";
+}
+
+// static
+void WakeLockEventLog::FormatEvents(const std::vector<Event>& events,
+                                    int64_t num_dropped,
+                                    std::string* output) {
+  DCHECK(output);
+  if (num_dropped) {
+    base::StringAppendF(output, "(%" PRId64 " earlier events dropped)\n",
+                        num_dropped);
+  }
+  for (const Event& event : events) {
+    base::StringAppendF(output, "%" PRId64 ".%03" PRId64 " %s",
+                        event.time_us / 1000000,
+                        (event.time_us / 1000) % 1000,
+                        GetEventTypeName(event.type));
+    if (event.binder) {
+      base::StringAppendF(output, " binder=0x%" PRIxPTR " uid=%d tag=\"%s\"",
+                          event.binder, static_cast<int>(event.uid),
+                          event.tag);
+    }
+    output->push_back('\n');
+  }
+}
+
+// static
+std::string WakeLockEventLog::FormatSummary(const Counts& counts) {
+  std::string summary;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    if (!counts[i])
+      continue;
+    base::StringAppendF(&summary, "%s%s=%" PRId64, summary.empty() ? "" : " ",
+                        GetEventTypeName(static_cast<EventType>(i)),
+                        counts[i]);
+  }
+  return summary;
+}
+
+WakeLockEventLog::WakeLockEventLog(size_t capacity)
+    : events_(capacity),
+      start_(0),
+      size_(0),
+      num_dropped_(0) {
+  DCHECK_GT(capacity, 0u);
+  summary_counts_.fill(0);
+}
+
+WakeLockEventLog::~WakeLockEventLog() = default;
+
+void WakeLockEventLog::Record(EventType type,
+                              base::TimeTicks now,
+                              const void* binder,
+                              uid_t uid,
+                              const char* tag) {
+  size_t index = 0;
+  if (size_ < events_.size()) {
+    index = (start_ + size_) % events_.size();
+    size_++;
+  } else {
+    index = start_;
+    start_ = (start_ + 1) % events_.size();
+    num_dropped_++;
+  }
+
+  Event& event = events_[index];
+  event.time_us = (now - base::TimeTicks()).InMicroseconds();
+  event.binder = reinterpret_cast<uintptr_t>(binder);
+  event.uid = uid;
+  event.type = type;
+  size_t tag_length = 0;
+  if (tag) {
+    tag_length = strnlen(tag, Event::kMaxTagSize - 1);
+    memcpy(event.tag, tag, tag_length);
+  }
+  event.tag[tag_length] = '\0';
+
+  summary_counts_[static_cast<int>(type)]++;
+}
+
+const WakeLockEventLog::Event& WakeLockEventLog::GetEvent(size_t index) const {
+  DCHECK_LT(index, size_);
+  return events_[(start_ + index) % events_.size()];
+}
+
+int64_t WakeLockEventLog::CopyEvents(bool drain, std::vector<Event>* events) {
+  DCHECK(events);
+  for (size_t i = 0; i < size_; ++i)
+    events->push_back(GetEvent(i));
+  const int64_t num_dropped = num_dropped_;
+
+  if (drain) {
+    start_ = 0;
+    size_ = 0;
+    num_dropped_ = 0;
+  }
+  return num_dropped;
+}
+
+void WakeLockEventLog::Dump(bool drain, std::string* output) {
+  std::vector<Event> events;
+  const int64_t num_dropped = CopyEvents(drain, &events);
+  FormatEvents(events, num_dropped, output);
+}
+
+void WakeLockEventLog::TakeCounts(Counts* counts) {
+  DCHECK(counts);
+  for (size_t i = 0; i < counts->size(); ++i)
+    (*counts)[i] += summary_counts_[i];
+  summary_counts_.fill(0);
+}
+
+std::string WakeLockEventLog::TakeSummary() {
+  Counts counts;
+  counts.fill(0);
+  TakeCounts(&counts);
+  return FormatSummary(counts);
+}
+
+}  // namespace android
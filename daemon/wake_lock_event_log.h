@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSTEM_NATIVEPOWER_DAEMON_WAKE_LOCK_EVENT_LOG_H_
+#define SYSTEM_NATIVEPOWER_DAEMON_WAKE_LOCK_EVENT_LOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include <base/macros.h>
+#include <base/time/time.h>
+
+namespace android {
+
+// Fixed-size ring buffer of binary wake lock events. Recording an event copies
+// a small struct into preallocated storage without allocating or formatting
+// anything; events are only converted to text when the log is dumped. Once the
+// buffer is full, the oldest events are overwritten.
+class WakeLockEventLog {
+ public:
+  enum class EventType : uint8_t {
+    ADD_REQUEST = 0,
+    UPDATE_REQUEST,
+    REMOVE_REQUEST,
+    BINDER_DEATH,
+    REQUEST_TIMEOUT,
+    KERNEL_LOCK,
+    KERNEL_UNLOCK,
+    NUM_TYPES,
+  };
+
+  struct Event {
+    // Maximum tag length, including the terminating NUL. Longer tags are
+    // truncated.
+    static const size_t kMaxTagSize = 32;
+
+    int64_t time_us;  // base::TimeTicks, relative to its zero value.
+    uintptr_t binder;
+    uid_t uid;
+    EventType type;
+    char tag[kMaxTagSize];
+  };
+
+  // Number of events of each type, indexed by EventType.
+  using Counts = std::array<int64_t, static_cast<size_t>(EventType::NUM_TYPES)>;
+
+  // Returns a short name for |type|.
+  static const char* GetEventTypeName(EventType type);
+
+  // Appends a line describing each of |events| to |output|, preceded by a note
+  // about |num_dropped| earlier events if it's nonzero.
+  static void FormatEvents(const std::vector<Event>& events,
+                           int64_t num_dropped,
+                           std::string* output);
+
+  // Returns a single line summarizing |counts|, or an empty string if there
+  // were no events.
+  static std::string FormatSummary(const Counts& counts);
+
+  // |capacity| is the number of events retained.
+  explicit WakeLockEventLog(size_t capacity);
+  ~WakeLockEventLog();
+
+  size_t size() const { return size_; }
+
+  // Number of events overwritten before being dumped.
+  int64_t num_dropped() const { return num_dropped_; }
+
+  // Records an event. |binder| and |tag| may be null.
+  void Record(EventType type,
+              base::TimeTicks now,
+              const void* binder,
+              uid_t uid,
+              const char* tag);
+
+  // Returns the event |index| positions after the oldest retained one.
+  const Event& GetEvent(size_t index) const;
+
+  // Appends the retained events, oldest first, to |events| and returns the
+  // number of earlier events that were dropped. If |drain| is true, the log is
+  // emptied afterward.
+  int64_t CopyEvents(bool drain, std::vector<Event>* events);
+
+  // Appends a line describing each retained event, oldest first, to |output|.
+  // If |drain| is true, the events are removed afterward.
+  void Dump(bool drain, std::string* output);
+
+  // Adds the number of events of each type recorded since the last call to
+  // |counts| and resets the log's counts. Logs that are filled separately can
+  // share a single summary this way.
+  void TakeCounts(Counts* counts);
+
+  // Returns a single line summarizing the events recorded since the last call,
+  // or an empty string if there were none.
+  std::string TakeSummary();
+
+ private:
+  // Preallocated storage. The oldest event is at |start_|.
+  std::vector<Event> events_;
+  size_t start_;
+  size_t size_;
+
+  int64_t num_dropped_;
+
+  // Number of events of each type recorded since the last TakeCounts() call.
+  Counts summary_counts_;
+
+  DISALLOW_COPY_AND_ASSIGN(WakeLockEventLog);
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_DAEMON_WAKE_LOCK_EVENT_LOG_H_
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <base/time/time.h>
+#include <gtest/gtest.h>
+
+#include "wake_lock_event_log.h"
+
+namespace android {
+
+using EventType = WakeLockEventLog::EventType;
+
+TEST(WakeLockEventLogTest, Wraparound) {
+  WakeLockEventLog log(2);
+  const base::TimeTicks now =
+      base::TimeTicks() + base::TimeDelta::FromMilliseconds(1500);
+  int binder = 0;
+  log.Record(EventType::ADD_REQUEST, now, &binder, 10, "first");
+  log.Record(EventType::KERNEL_LOCK, now, nullptr, -1, nullptr);
+  EXPECT_EQ(2u, log.size());
+  EXPECT_EQ(0, log.num_dropped());
+  EXPECT_STREQ("first", log.GetEvent(0).tag);
+
+  // The oldest event should be overwritten once the log is full.
+  log.Record(EventType::REMOVE_REQUEST, now, &binder, 10, "first");
+  EXPECT_EQ(2u, log.size());
+  EXPECT_EQ(1, log.num_dropped());
+  EXPECT_EQ(EventType::KERNEL_LOCK, log.GetEvent(0).type);
+  EXPECT_EQ(EventType::REMOVE_REQUEST, log.GetEvent(1).type);
+  EXPECT_EQ(10u, log.GetEvent(1).uid);
+
+  std::string output;
+  log.Dump(false /* drain */, &output);
+  EXPECT_NE(std::string::npos, output.find("1 earlier events dropped"));
+  EXPECT_NE(std::string::npos, output.find("1.500 kernel-lock\n"));
+  EXPECT_NE(std::string::npos, output.find("remove binder="));
+  EXPECT_EQ(2u, log.size());
+
+  // Draining should empty the log.
+  output.clear();
+  log.Dump(true /* drain */, &output);
+  EXPECT_EQ(0u, log.size());
+  EXPECT_EQ(0, log.num_dropped());
+}
+
+TEST(WakeLockEventLogTest, TruncatesTags) {
+  WakeLockEventLog log(1);
+  const std::string tag(WakeLockEventLog::Event::kMaxTagSize * 2, 'a');
+  log.Record(EventType::ADD_REQUEST, base::TimeTicks(), &log, 0, tag.c_str());
+  EXPECT_EQ(tag.substr(0, WakeLockEventLog::Event::kMaxTagSize - 1),
+            log.GetEvent(0).tag);
+}
+
+TEST(WakeLockEventLogTest, Summary) {
+  WakeLockEventLog log(1);
+  EXPECT_EQ("", log.TakeSummary());
+
+  // Summaries should count all events, including ones that were overwritten.
+  for (int i = 0; i < 3; ++i)
+    log.Record(EventType::ADD_REQUEST, base::TimeTicks(), &log, 0, "tag");
+  log.Record(EventType::KERNEL_UNLOCK, base::TimeTicks(), nullptr, -1, nullptr);
+  EXPECT_EQ("add=3 kernel-unlock=1", log.TakeSummary());
+  EXPECT_EQ("", log.TakeSummary());
+}
+
+TEST(WakeLockEventLogTest, CopyAndCount) {
+  WakeLockEventLog log(2);
+  int binder = 0;
+  for (int i = 0; i < 3; ++i)
+    log.Record(EventType::ADD_REQUEST, base::TimeTicks(), &binder, 0, "tag");
+
+  // Copies should be appended, and draining should empty the log.
+  std::vector<WakeLockEventLog::Event> events(1);
+  EXPECT_EQ(1, log.CopyEvents(false /* drain */, &events));
+  EXPECT_EQ(3u, events.size());
+  EXPECT_EQ(2u, log.size());
+  events.clear();
+  EXPECT_EQ(1, log.CopyEvents(true /* drain */, &events));
+  EXPECT_EQ(2u, events.size());
+  EXPECT_EQ(0u, log.size());
+  EXPECT_EQ(0, log.CopyEvents(false /* drain */, &events));
+
+  // Counts from multiple logs should be added together.
+  WakeLockEventLog other_log(1);
+  other_log.Record(EventType::ADD_REQUEST, base::TimeTicks(), &binder, 0,
+                   "tag");
+  WakeLockEventLog::Counts counts;
+  counts.fill(0);
+  log.TakeCounts(&counts);
+  other_log.TakeCounts(&counts);
+  EXPECT_EQ("add=4", WakeLockEventLog::FormatSummary(counts));
+  EXPECT_EQ("", log.TakeSummary());
+}
+
+}  // namespace android
@@ -16,11 +16,19 @@
 
 #include "wake_lock_manager.h"
 
+#include <stdint.h>
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <vector>
+
 #include <base/bind.h>
-#include <base/files/file_util.h>
 #include <base/format_macros.h>
 #include <base/logging.h>
 #include <base/strings/stringprintf.h>
+#include <base/time/default_tick_clock.h>
 #include <binder/IBinder.h>
 #include <binderwrapper/binder_wrapper.h>
 
@@ -31,19 +39,29 @@ namespace {
 const char kLockPath[] = "/sys/power/wake_lock";
 const char kUnlockPath[] = "/sys/power/wake_unlock";
 
-// Writes |data| to |path|, returning true on success or logging an error and
-// returning false otherwise.
-bool WriteToFile(const base::FilePath& path, const std::string& data) {
-  // This are sysfs "files" in real life, so it doesn't matter if we overwrite
-  // them or append to them, but appending makes it easier for tests to detect
-  // multiple writes when using real temporary files.
-  VLOG(1) << "Writing \"" << data << "\" to " << path.value();
-  if (!base::AppendToFile(path, data.data(), data.size())) {
-    PLOG(ERROR) << "Failed to write \"" << data << "\" to " << path.value();
-    return false;
-  }
-  return true;
-}
+// Delay before retrying a heartbeat whose write to the sysfs lock file failed.
+// Capped at half of the kernel lock's timeout.
+const int kHeartbeatRetryMs = 100;
+
+// Granularity with which request timeouts are enforced.
+const int kTimeoutTickMs = 100;
+
+// Maximum number of distinct (uid, package, tag) keys tracked by each shard's
+// stats table.
+const size_t kMaxStatsEntriesPerShard = 1024;
+
+// Number of events retained by each shard's event log and by the kernel lock's
+// event log.
+const size_t kShardEventLogSize = 256;
+const size_t kKernelEventLogSize = 128;
+
+// Minimum interval between summaries of the event logs in the system log.
+const int kEventSummaryIntervalSec = 60;
+
+// Delay before dropping the death notifications of binders whose requests have
+// been removed. A request that's re-added for the same binder in the meantime
+// reuses the existing registration.
+const int kUnregisterDelayMs = 1000;
 
 }  // namespace
 
@@ -51,27 +69,96 @@ const char WakeLockManager::kLockName[] = "nativepowerman";
 
 WakeLockManager::Request::Request(const std::string& tag,
                                   const std::string& package,
-                                  uid_t uid)
+                                  uid_t uid,
+                                  base::TimeDelta timeout)
     : tag(tag),
       package(package),
-      uid(uid) {}
+      uid(uid),
+      timeout(timeout) {}
 
 WakeLockManager::Request::Request(const Request& request) = default;
 
 WakeLockManager::Request::Request() : uid(-1) {}
 
+WakeLockManager::Options::Options() = default;
+
+WakeLockManager::ActiveRequest::ActiveRequest()
+    : tag(StringPool::kInvalidHandle),
+      package(StringPool::kInvalidHandle),
+      uid(-1),
+      timeout_id(0),
+      has_work_source(false) {}
+
+WakeLockManager::Shard::Shard()
+    : next_timeout_id(1),
+      num_timeouts(0),
+      stats(&strings, kMaxStatsEntriesPerShard),
+      events(kShardEventLogSize) {}
+
 WakeLockManager::WakeLockManager()
     : lock_path_(kLockPath),
-      unlock_path_(kUnlockPath) {}
+      unlock_path_(kUnlockPath),
+      clock_(new base::DefaultTickClock()),
+      shards_(new Shard[kNumShards]),
+      num_requests_(0),
+      death_timer_(base::Bind(&WakeLockManager::HandleDeadBinders,
+                              base::Unretained(this))),
+      unregister_timer_(base::Bind(&WakeLockManager::UnregisterIdleClients,
+                                   base::Unretained(this))),
+      timeout_timer_(base::Bind(&WakeLockManager::HandleTimeoutTick,
+                                base::Unretained(this))),
+      num_pending_timeouts_(0),
+      summary_timer_(base::Bind(&WakeLockManager::HandleEventSummary,
+                                base::Unretained(this))),
+      kernel_events_(kKernelEventLogSize),
+      num_kernel_lock_refs_(0),
+      kernel_lock_held_(false),
+      kernel_lock_releasing_(false),
+      release_timer_(base::Bind(&WakeLockManager::HandleReleaseTimeout,
+                                base::Unretained(this))),
+      heartbeat_timer_(base::Bind(&WakeLockManager::HandleHeartbeat,
+                                  base::Unretained(this))),
+      num_kernel_locks_(0),
+      num_kernel_unlocks_(0),
+      num_avoided_releases_(0),
+      num_kernel_lock_rearms_(0),
+      num_failed_kernel_lock_rearms_(0),
+      num_expired_requests_(0),
+      num_death_registrations_(0),
+      num_client_deaths_(0),
+      num_death_passes_(0) {}
 
 WakeLockManager::~WakeLockManager() {
-  while (!requests_.empty())
-    RemoveRequest(requests_.begin()->first);
+  for (size_t i = 0; i < kNumShards; ++i) {
+    Shard* shard = &shards_[i];
+    while (true) {
+      sp<IBinder> binder;
+      {
+        base::AutoLock lock(shard->lock);
+        if (shard->requests.empty())
+          break;
+        binder = shard->requests.begin()->key;
+      }
+      RemoveRequest(binder);
+    }
+  }
+  unregister_timer_.Stop();
+  UnregisterIdleClients();
+
+  // Don't leave the kernel lock held after exiting.
+  base::AutoLock lock(kernel_lock_);
+  release_timer_.Stop();
+  ReleaseKernelLockLocked();
+}
+
+void WakeLockManager::set_options(const Options& options) {
+  base::AutoLock lock(kernel_lock_);
+  options_ = options;
 }
 
 bool WakeLockManager::Init() {
-  if (!base::PathIsWritable(lock_path_) ||
-      !base::PathIsWritable(unlock_path_)) {
+  base::AutoLock lock(kernel_lock_);
+  if (!lock_writer_.Open(lock_path_) || !unlock_writer_.Open(unlock_path_)) {
     LOG(ERROR) << lock_path_.value() << " and/or " << unlock_path_.value()
                << " are not writable";
     return false;
@@ -79,52 +166,654 @@ bool WakeLockManager::Init() {
   return true;
 }
 
+bool WakeLockManager::TriggerReleaseTimeoutForTesting() {
+  if (!release_timer_.Stop())
+    return false;
+
+  HandleReleaseTimeout();
+  return true;
+}
+
+base::TimeDelta WakeLockManager::GetHeartbeatDelayForTesting() {
+  base::AutoLock lock(kernel_lock_);
+  return heartbeat_timer_.IsRunning() ? heartbeat_delay_ : base::TimeDelta();
+}
+
+bool WakeLockManager::TriggerHeartbeatForTesting() {
+  if (!heartbeat_timer_.Stop())
+    return false;
+
+  HandleHeartbeat();
+  return true;
+}
+
+bool WakeLockManager::TriggerTimeoutTickForTesting() {
+  if (!timeout_timer_.Stop())
+    return false;
+
+  HandleTimeoutTick();
+  return true;
+}
+
+bool WakeLockManager::TriggerEventSummaryForTesting() {
+  if (!summary_timer_.Stop())
+    return false;
+
+  HandleEventSummary();
+  return true;
+}
+
+bool WakeLockManager::TriggerUnregisterTimeoutForTesting() {
+  if (!unregister_timer_.Stop())
+    return false;
+
+  UnregisterIdleClients();
+  return true;
+}
+
+void WakeLockManager::GetEventsForTesting(
+    std::vector<WakeLockEventLog::Event>* events) {
+  events->clear();
+  CopyEvents(false /* drain */, events);
+}
+
 bool WakeLockManager::AddRequest(sp<IBinder> client_binder,
-                                 const std::string& tag,
-                                 const std::string& package,
-                                 uid_t uid) {
-  const bool new_request = !requests_.count(client_binder);
-  LOG(INFO) << (new_request ? "Adding" : "Updating") << " request for binder "
-            << client_binder.get() << ": tag=\"" << tag << "\""
-            << " package=\"" << package << "\" uid=" << uid;
-
-  const bool first_request = requests_.empty();
-
-  if (new_request) {
-    if (!BinderWrapper::Get()->RegisterForDeathNotifications(
-            client_binder,
-            base::Bind(&WakeLockManager::HandleBinderDeath,
-                       base::Unretained(this), client_binder))) {
+                                 const String16& tag,
+                                 const String16& package,
+                                 uid_t uid,
+                                 base::TimeDelta timeout) {
+  Shard* shard = GetShard(client_binder);
+  bool inserted = false;
+  int previous_refs = 0;
+  {
+    base::AutoLock lock(shard->lock);
+    ActiveRequest* request =
+        shard->requests.FindOrInsert(client_binder, &inserted);
+
+    // Interning the strings before releasing any old references keeps them in
+    // the pool when an existing request is updated with the same values.
+    const StringPool::Handle tag_handle = shard->strings.Intern(tag);
+    const StringPool::Handle package_handle = shard->strings.Intern(package);
+
+    if (inserted) {
+      // A binder whose previous request was removed recently may still be
+      // registered for death notifications.
+      if (!shard->idle_clients.Erase(client_binder) &&
+          !RegisterClient(client_binder)) {
+        shard->requests.Erase(client_binder);
+        shard->strings.Release(tag_handle);
+        shard->strings.Release(package_handle);
+        return false;
+      }
+      num_requests_++;
+
+      // The reference is taken while the shard is locked so that it's always
+      // dropped after it's taken, even if another thread removes the request
+      // right away.
+      previous_refs = num_kernel_lock_refs_++;
+    }
+
+    // An update that changes the request's key is accounted as a release of
+    // the old lock and an acquisition of the new one.
+    const base::TimeTicks now = clock_->NowTicks();
+    bool new_key = inserted;
+    if (!inserted) {
+      if (request->uid != uid || request->package != package_handle ||
+          request->tag != tag_handle) {
+        RecordOwnersRelease(shard, *request, now);
+        new_key = true;
+      }
+      shard->strings.Release(request->tag);
+      shard->strings.Release(request->package);
+    }
+    request->tag = tag_handle;
+    request->package = package_handle;
+    request->uid = uid;
+    request->timeout = timeout;
+    if (new_key)
+      RecordOwnersAcquire(shard, request, now);
+    RecordEvent(new_key ? WakeLockEventLog::EventType::ADD_REQUEST
+                        : WakeLockEventLog::EventType::UPDATE_REQUEST,
+                client_binder, shard, request);
+
+    // Any previously-scheduled timeout is superseded by this one.
+    const bool had_timeout = request->timeout_id != 0;
+    request->timeout_id = 0;
+    if (timeout > base::TimeDelta()) {
+      request->timeout_id = shard->next_timeout_id++;
+      // Round the deadline up so that requests never expire early.
+      shard->timer_wheel.Schedule(GetTick(now, false),
+                                  GetTick(now + timeout, true), client_binder,
+                                  request->timeout_id);
+      if (!had_timeout)
+        AddTimeoutLocked(shard);
+    } else if (had_timeout) {
+      RemoveTimeoutLocked(shard);
+    }
+  }
+
+  // If other references already existed and the lock is held, it can't be
+  // released until this request's reference is dropped. |releasing| must be
+  // read before |kernel_lock_held_|; see ReleaseKernelLockLocked().
+  if (!inserted || previous_refs > 0) {
+    const bool releasing = kernel_lock_releasing_;
+    if (!releasing && kernel_lock_held_)
+      return true;
+  }
+
+  base::AutoLock lock(kernel_lock_);
+  // The request may have been removed by another thread in the meantime.
+  if (num_kernel_lock_refs_ <= 0)
+    return true;
+  return AcquireKernelLockLocked();
+}
+
+bool WakeLockManager::RemoveRequest(sp<IBinder> client_binder) {
+  Shard* shard = GetShard(client_binder);
+  bool released_last_ref = false;
+  {
+    base::AutoLock lock(shard->lock);
+    const ActiveRequest* request = shard->requests.Find(client_binder);
+    if (!request) {
+      LOG(WARNING) << "Ignoring removal request for unknown binder "
+                   << client_binder.get();
       return false;
     }
+    EraseRequestLocked(shard, client_binder, request);
+    RetireClientLocked(shard, client_binder);
+    released_last_ref = --num_kernel_lock_refs_ == 0;
   }
-  requests_[client_binder] = Request(tag, package, uid);
 
-  if (first_request && !WriteToFile(lock_path_, kLockName))
+  if (!released_last_ref)
+    return true;
+  base::AutoLock lock(kernel_lock_);
+  return num_kernel_lock_refs_ > 0 || ScheduleKernelLockReleaseLocked();
+}
+
+bool WakeLockManager::UpdateRequestUids(sp<IBinder> client_binder,
+                                        const uid_t* uids,
+                                        size_t num_uids) {
+  Shard* shard = GetShard(client_binder);
+  base::AutoLock lock(shard->lock);
+  ActiveRequest* request = shard->requests.Find(client_binder);
+  if (!request) {
+    LOG(WARNING) << "Ignoring uid update for unknown binder "
+                 << client_binder.get();
     return false;
+  }
+
+  // As with other updates, time before now stays with the previous owners.
+  const base::TimeTicks now = clock_->NowTicks();
+  RecordOwnersRelease(shard, *request, now);
 
+  // A uid that's listed more than once is still only charged once. Work
+  // sources are short, so a linear scan of the owners added so far is cheaper
+  // than sorting a copy of |uids|.
+  request->owners.Resize(0);
+  for (size_t i = 0; i < num_uids; ++i) {
+    bool duplicate = false;
+    for (const Owner& owner : request->owners) {
+      if (owner.uid == uids[i]) {
+        duplicate = true;
+        break;
+      }
+    }
+    if (!duplicate)
+      request->owners.PushBack(Owner{uids[i], 0});
+  }
+  request->has_work_source = !request->owners.empty();
+  RecordOwnersAcquire(shard, request, now);
+  RecordEvent(WakeLockEventLog::EventType::UPDATE_REQUEST, client_binder,
+              shard, request);
   return true;
 }
 
-bool WakeLockManager::RemoveRequest(sp<IBinder> client_binder) {
-  LOG(INFO) << "Removing request for binder " << client_binder.get();
+void WakeLockManager::BeginBatch() {
+  num_kernel_lock_refs_++;
+}
 
-  if (!requests_.erase(client_binder)) {
-    LOG(WARNING) << "Ignoring removal request for unknown binder "
-                 << client_binder.get();
+bool WakeLockManager::EndBatch() {
+  if (--num_kernel_lock_refs_ > 0)
+    return true;
+  base::AutoLock lock(kernel_lock_);
+  return num_kernel_lock_refs_ > 0 || ScheduleKernelLockReleaseLocked();
+}
+
+bool WakeLockManager::ReleaseIdleKernelLock() {
+  base::AutoLock lock(kernel_lock_);
+  if (num_kernel_lock_refs_ > 0)
+    return true;
+  if (release_timer_.Stop())
+    VLOG(1) << "Releasing kernel wake lock before its release delay elapsed";
+  return ReleaseKernelLockLocked();
+}
+
+void WakeLockManager::GetStats(std::vector<WakeLockStats>* stats) const {
+  DCHECK(stats);
+  stats->clear();
+  const base::TimeTicks now = clock_->NowTicks();
+
+  // A key may have been seen by multiple shards, so entries are merged. Keys
+  // are reported in the order in which they're first encountered.
+  std::map<std::tuple<uid_t, std::string, std::string>, size_t> indices;
+  std::vector<WakeLockStats> shard_stats;
+  for (size_t i = 0; i < kNumShards; ++i) {
+    {
+      base::AutoLock lock(shards_[i].lock);
+      shards_[i].stats.GetStats(now, &shard_stats);
+    }
+    for (const WakeLockStats& entry : shard_stats) {
+      const auto result = indices.insert(std::make_pair(
+          std::make_tuple(entry.uid, entry.package, entry.tag),
+          stats->size()));
+      if (result.second) {
+        stats->push_back(entry);
+        continue;
+      }
+      WakeLockStats& merged = (*stats)[result.first->second];
+      merged.acquire_count += entry.acquire_count;
+      merged.active_count += entry.active_count;
+      merged.total_hold_time += entry.total_hold_time;
+      merged.max_hold_time =
+          std::max(merged.max_hold_time, entry.max_hold_time);
+      merged.blamed_hold_time += entry.blamed_hold_time;
+    }
+  }
+}
+
+void WakeLockManager::DumpEvents(bool drain, std::string* output) {
+  std::vector<WakeLockEventLog::Event> events;
+  const int64_t num_dropped = CopyEvents(drain, &events);
+  WakeLockEventLog::FormatEvents(events, num_dropped, output);
+}
+
+WakeLockManager::Shard* WakeLockManager::GetShard(
+    const sp<IBinder>& binder) const {
+  // BinderMap uses the low bits of the same mixed hash to pick slots, so the
+  // shard is taken from the high bits to keep each shard's slots evenly used.
+  uint64_t hash = reinterpret_cast<uintptr_t>(binder.get());
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return &shards_[(hash >> 32) % kNumShards];
+}
+
+bool WakeLockManager::RegisterClient(const sp<IBinder>& binder) {
+  base::AutoLock lock(clients_lock_);
+  if (!BinderWrapper::Get()->RegisterForDeathNotifications(
+          binder, base::Bind(&WakeLockManager::HandleBinderDeath,
+                             base::Unretained(this), binder))) {
+    return false;
+  }
+  num_death_registrations_++;
+  return true;
+}
+
+void WakeLockManager::UnregisterClient(const sp<IBinder>& binder) {
+  base::AutoLock lock(clients_lock_);
+  BinderWrapper::Get()->UnregisterForDeathNotifications(binder);
+}
+
+void WakeLockManager::RetireClientLocked(Shard* shard,
+                                         const sp<IBinder>& binder) {
+  shard->lock.AssertAcquired();
+  bool inserted = false;
+  shard->idle_clients.FindOrInsert(binder, &inserted);
+  unregister_timer_.StartIfStopped(
+      base::TimeDelta::FromMilliseconds(kUnregisterDelayMs));
+}
+
+void WakeLockManager::UnregisterIdleClients() {
+  for (size_t i = 0; i < kNumShards; ++i) {
+    // The shard stays locked so that a new request can't pick up a
+    // registration that's being dropped.
+    Shard* shard = &shards_[i];
+    base::AutoLock lock(shard->lock);
+    for (const auto& entry : shard->idle_clients)
+      UnregisterClient(entry.key);
+    shard->idle_clients.Clear();
+  }
+}
+
+void WakeLockManager::RecordOwnersAcquire(Shard* shard,
+                                          ActiveRequest* request,
+                                          base::TimeTicks now) {
+  if (!request->has_work_source) {
+    request->owners.Resize(1);
+    request->owners[0].uid = request->uid;
+  }
+  const int num_owners = request->owners.size();
+  for (Owner& owner : request->owners) {
+    owner.stats_handle = shard->stats.RecordAcquire(
+        owner.uid, request->package, request->tag, now, num_owners);
+  }
+  request->acquire_time = now;
+}
+
+void WakeLockManager::RecordOwnersRelease(Shard* shard,
+                                          const ActiveRequest& request,
+                                          base::TimeTicks now) {
+  const int num_owners = request.owners.size();
+  for (const Owner& owner : request.owners) {
+    shard->stats.RecordRelease(owner.stats_handle, request.acquire_time, now,
+                               num_owners);
+  }
+}
+
+void WakeLockManager::EraseRequestLocked(Shard* shard,
+                                         const sp<IBinder>& binder,
+                                         const ActiveRequest* request) {
+  shard->lock.AssertAcquired();
+  RecordEvent(WakeLockEventLog::EventType::REMOVE_REQUEST, binder, shard,
+              request);
+  RecordOwnersRelease(shard, *request, clock_->NowTicks());
+  shard->strings.Release(request->tag);
+  shard->strings.Release(request->package);
+  if (request->timeout_id)
+    RemoveTimeoutLocked(shard);
+  shard->requests.Erase(binder);
+  num_requests_--;
+}
+
+void WakeLockManager::HandleBinderDeath(sp<IBinder> binder) {
+  // A crashed process's binders all die at about the same time, so their
+  // requests are usually removed together by a single HandleDeadBinders()
+  // call. Notifications delivered on other binder threads after that call has
+  // taken |dead_binders_| restart the timer for another pass.
+  {
+    base::AutoLock lock(clients_lock_);
+    dead_binders_.push_back(binder);
+  }
+  death_timer_.StartIfStopped(base::TimeDelta());
+}
+
+void WakeLockManager::HandleDeadBinders() {
+  std::vector<sp<IBinder>> dead_binders;
+  {
+    base::AutoLock lock(clients_lock_);
+    dead_binders.swap(dead_binders_);
+  }
+  num_death_passes_++;
+
+  // Each binder's registration is dropped here if it's still held, either for
+  // a request or as an idle one; otherwise, UnregisterIdleClients() already
+  // dropped it.
+  bool released_last_ref = false;
+  int num_removed = 0;
+  std::vector<sp<IBinder>> registered;
+  for (size_t i = 0; i < kNumShards; ++i) {
+    Shard* shard = &shards_[i];
+    base::AutoLock lock(shard->lock);
+    int count = 0;
+    for (const sp<IBinder>& binder : dead_binders) {
+      if (GetShard(binder) != shard)
+        continue;
+      const ActiveRequest* request = shard->requests.Find(binder);
+      RecordEvent(WakeLockEventLog::EventType::BINDER_DEATH, binder, shard,
+                  request);
+      if (!request) {
+        if (shard->idle_clients.Erase(binder))
+          registered.push_back(binder);
+        continue;
+      }
+      EraseRequestLocked(shard, binder, request);
+      registered.push_back(binder);
+      count++;
+    }
+    if (count && num_kernel_lock_refs_.fetch_sub(count) == count)
+      released_last_ref = true;
+    num_removed += count;
+  }
+  num_client_deaths_ += dead_binders.size();
+  if (num_removed) {
+    LOG(INFO) << "Removed " << num_removed << " request(s) with dead "
+              << "binders";
+  }
+
+  for (const sp<IBinder>& binder : registered)
+    UnregisterClient(binder);
+  if (released_last_ref) {
+    base::AutoLock lock(kernel_lock_);
+    if (num_kernel_lock_refs_ == 0)
+      ScheduleKernelLockReleaseLocked();
+  }
+}
+
+void WakeLockManager::RecordEvent(WakeLockEventLog::EventType type,
+                                  const sp<IBinder>& binder,
+                                  Shard* shard,
+                                  const ActiveRequest* request) {
+  WakeLockEventLog* log = &kernel_events_;
+  if (shard) {
+    shard->lock.AssertAcquired();
+    log = &shard->events;
+  } else {
+    kernel_lock_.AssertAcquired();
+  }
+  log->Record(type, clock_->NowTicks(), binder.get(),
+              request ? request->uid : -1,
+              request ? shard->strings.Get(request->tag).c_str() : nullptr);
+  summary_timer_.StartIfStopped(
+      base::TimeDelta::FromSeconds(kEventSummaryIntervalSec));
+}
+
+int64_t WakeLockManager::CopyEvents(
+    bool drain,
+    std::vector<WakeLockEventLog::Event>* events) {
+  int64_t num_dropped = 0;
+  for (size_t i = 0; i < kNumShards; ++i) {
+    base::AutoLock lock(shards_[i].lock);
+    num_dropped += shards_[i].events.CopyEvents(drain, events);
+  }
+  {
+    base::AutoLock lock(kernel_lock_);
+    num_dropped += kernel_events_.CopyEvents(drain, events);
+  }
+
+  // Events with equal times keep the order of the logs they came from, so a
+  // request's event precedes the kernel lock event that it caused.
+  std::stable_sort(events->begin(), events->end(),
+                   [](const WakeLockEventLog::Event& a,
+                      const WakeLockEventLog::Event& b) {
+                     return a.time_us < b.time_us;
+                   });
+  return num_dropped;
+}
+
+void WakeLockManager::HandleEventSummary() {
+  WakeLockEventLog::Counts counts;
+  counts.fill(0);
+  for (size_t i = 0; i < kNumShards; ++i) {
+    base::AutoLock lock(shards_[i].lock);
+    shards_[i].events.TakeCounts(&counts);
+  }
+  {
+    base::AutoLock lock(kernel_lock_);
+    kernel_events_.TakeCounts(&counts);
+  }
+  const std::string summary = WakeLockEventLog::FormatSummary(counts);
+  if (!summary.empty()) {
+    LOG(INFO) << "Wake lock events in last " << kEventSummaryIntervalSec
+              << " sec: " << summary << " (" << num_requests_ << " active)";
+  }
+}
+
+// static
+int64_t WakeLockManager::GetTick(base::TimeTicks time, bool round_up) {
+  const int64_t kTickUs =
+      kTimeoutTickMs * base::Time::kMicrosecondsPerMillisecond;
+  const int64_t time_us = (time - base::TimeTicks()).InMicroseconds();
+  return (time_us + (round_up ? kTickUs - 1 : 0)) / kTickUs;
+}
+
+void WakeLockManager::HandleTimeoutTick() {
+  const int64_t now_tick = GetTick(clock_->NowTicks(), false);
+  std::vector<TimerWheel::Entry> expired;
+  bool released_last_ref = false;
+  for (size_t i = 0; i < kNumShards; ++i) {
+    Shard* shard = &shards_[i];
+    base::AutoLock lock(shard->lock);
+    expired.clear();
+    shard->timer_wheel.Advance(now_tick, &expired);
+
+    for (const TimerWheel::Entry& entry : expired) {
+      // Skip entries for requests that have since been removed or updated.
+      const ActiveRequest* request = shard->requests.Find(entry.binder);
+      if (!request || request->timeout_id != entry.id)
+        continue;
+
+      RecordEvent(WakeLockEventLog::EventType::REQUEST_TIMEOUT, entry.binder,
+                  shard, request);
+      num_expired_requests_++;
+      EraseRequestLocked(shard, entry.binder, request);
+      RetireClientLocked(shard, entry.binder);
+      if (--num_kernel_lock_refs_ == 0)
+        released_last_ref = true;
+    }
+  }
+  {
+    base::AutoLock lock(timeout_lock_);
+    if (num_pending_timeouts_ > 0) {
+      timeout_timer_.StartIfStopped(
+          base::TimeDelta::FromMilliseconds(kTimeoutTickMs));
+    }
+  }
+
+  if (released_last_ref) {
+    base::AutoLock lock(kernel_lock_);
+    if (num_kernel_lock_refs_ == 0)
+      ScheduleKernelLockReleaseLocked();
+  }
+}
+
+void WakeLockManager::AddTimeoutLocked(Shard* shard) {
+  shard->lock.AssertAcquired();
+  shard->num_timeouts++;
+  base::AutoLock lock(timeout_lock_);
+  if (num_pending_timeouts_++ == 0) {
+    timeout_timer_.StartIfStopped(
+        base::TimeDelta::FromMilliseconds(kTimeoutTickMs));
+  }
+}
+
+void WakeLockManager::RemoveTimeoutLocked(Shard* shard) {
+  shard->lock.AssertAcquired();
+  // Whatever is left in the wheel belongs to requests that were removed or
+  // updated, so there's no need to keep walking through it.
+  if (--shard->num_timeouts == 0)
+    shard->timer_wheel.Clear();
+  base::AutoLock lock(timeout_lock_);
+  if (--num_pending_timeouts_ == 0)
+    timeout_timer_.Stop();
+}
+
+bool WakeLockManager::AcquireKernelLockLocked() {
+  kernel_lock_.AssertAcquired();
+  if (release_timer_.Stop()) {
+    VLOG(1) << "Cancelling pending release of kernel wake lock";
+    num_avoided_releases_++;
+  }
+  if (kernel_lock_held_)
+    return true;
+
+  num_kernel_locks_++;
+  if (!lock_writer_.Write(GetLockString()))
     return false;
+
+  kernel_lock_held_ = true;
+  RecordEvent(WakeLockEventLog::EventType::KERNEL_LOCK, nullptr, nullptr,
+              nullptr);
+  if (options_.kernel_lock_timeout > base::TimeDelta())
+    StartHeartbeatLocked(options_.kernel_lock_timeout / 2);
+  if (!kernel_lock_callback_.is_null())
+    kernel_lock_callback_.Run(true);
+  return true;
+}
+
+bool WakeLockManager::ScheduleKernelLockReleaseLocked() {
+  kernel_lock_.AssertAcquired();
+  if (options_.release_delay <= base::TimeDelta())
+    return ReleaseKernelLockLocked();
+
+  if (kernel_lock_held_)
+    release_timer_.Start(options_.release_delay);
+  return true;
+}
+
+bool WakeLockManager::ReleaseKernelLockLocked() {
+  kernel_lock_.AssertAcquired();
+  if (!kernel_lock_held_)
+    return true;
+
+  // AddRequest() skips |kernel_lock_| if it sees the lock held and not being
+  // released after taking a reference, so |kernel_lock_releasing_| is set
+  // before checking for references: a racing call either sees it set and waits
+  // for |kernel_lock_|, or its reference is seen here and the lock is kept.
+  kernel_lock_releasing_ = true;
+  if (num_kernel_lock_refs_ > 0) {
+    kernel_lock_releasing_ = false;
+    return true;
   }
-  BinderWrapper::Get()->UnregisterForDeathNotifications(client_binder);
 
-  if (requests_.empty() && !WriteToFile(unlock_path_, kLockName))
+  num_kernel_unlocks_++;
+  const bool success = unlock_writer_.Write(kLockName);
+  if (success)
+    kernel_lock_held_ = false;
+  kernel_lock_releasing_ = false;
+  if (!success)
     return false;
 
+  heartbeat_timer_.Stop();
+  RecordEvent(WakeLockEventLog::EventType::KERNEL_UNLOCK, nullptr, nullptr,
+              nullptr);
+  if (!kernel_lock_callback_.is_null())
+    kernel_lock_callback_.Run(false);
   return true;
 }
 
-void WakeLockManager::HandleBinderDeath(sp<IBinder> binder) {
-  LOG(INFO) << "Received death notification for binder " << binder.get();
-  RemoveRequest(binder);
+void WakeLockManager::HandleReleaseTimeout() {
+  base::AutoLock lock(kernel_lock_);
+  // A request may have been added without cancelling the release if it raced
+  // with a batch.
+  if (num_kernel_lock_refs_ == 0)
+    ReleaseKernelLockLocked();
+}
+
+void WakeLockManager::HandleHeartbeat() {
+  base::AutoLock lock(kernel_lock_);
+  if (!kernel_lock_held_ || options_.kernel_lock_timeout <= base::TimeDelta())
+    return;
+
+  // A single write re-arms the timeout regardless of how many requests are
+  // active. If it fails, the kernel lock will expire at its old deadline even
+  // though requests are active, so the write is retried soon rather than after
+  // another half-period.
+  num_kernel_lock_rearms_++;
+  const base::TimeDelta period = options_.kernel_lock_timeout / 2;
+  if (lock_writer_.Write(GetLockString())) {
+    StartHeartbeatLocked(period);
+  } else {
+    num_failed_kernel_lock_rearms_++;
+    LOG(ERROR) << "Failed to re-arm kernel wake lock; retrying";
+    StartHeartbeatLocked(
+        std::min(period, base::TimeDelta::FromMilliseconds(kHeartbeatRetryMs)));
+  }
+}
+
+void WakeLockManager::StartHeartbeatLocked(base::TimeDelta delay) {
+  kernel_lock_.AssertAcquired();
+  heartbeat_delay_ = delay;
+  heartbeat_timer_.Start(delay);
+}
+
+std::string WakeLockManager::GetLockString() const {
+  if (options_.kernel_lock_timeout <= base::TimeDelta())
+    return kLockName;
+
+  return base::StringPrintf(
+      "%s %" PRId64, kLockName,
+      options_.kernel_lock_timeout.InMicroseconds() *
+          base::Time::kNanosecondsPerMicrosecond);
 }
 
 }  // namespace android
@@ -17,16 +17,34 @@
 #ifndef SYSTEM_NATIVEPOWER_DAEMON_WAKE_LOCK_MANAGER_H_
 #define SYSTEM_NATIVEPOWER_DAEMON_WAKE_LOCK_MANAGER_H_
 
+#include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
-#include <map>
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
+#include <base/callback.h>
 #include <base/files/file_path.h>
 #include <base/macros.h>
+#include <base/synchronization/lock.h>
+#include <base/time/tick_clock.h>
 #include <base/time/time.h>
+#include <nativepower/wake_lock_stats.h>
+#include <utils/String16.h>
 #include <utils/StrongPointer.h>
 
+#include "binder_map.h"
+#include "cross_thread_timer.h"
+#include "small_array.h"
+#include "string_pool.h"
+#include "sysfs_writer.h"
+#include "timer_wheel.h"
+#include "wake_lock_event_log.h"
+#include "wake_lock_stats_table.h"
+
 namespace android {
 
 class IBinder;
@@ -36,56 +54,460 @@ class WakeLockManagerInterface {
   WakeLockManagerInterface() {}
   virtual ~WakeLockManagerInterface() {}
 
+  // Adds or updates the request associated with |client_binder|. If |timeout|
+  // is nonzero, the request is removed automatically once it elapses.
   virtual bool AddRequest(sp<IBinder> client_binder,
-                          const std::string& tag,
-                          const std::string& package,
-                          uid_t uid) = 0;
+                          const String16& tag,
+                          const String16& package,
+                          uid_t uid,
+                          base::TimeDelta timeout) = 0;
   virtual bool RemoveRequest(sp<IBinder> client_binder) = 0;
 
+  // Attributes the request associated with |client_binder| to the |num_uids|
+  // uids in |uids| (i.e. its work source) instead of the uid passed to
+  // AddRequest(). Duplicate uids are ignored. Passing an empty list restores
+  // the original attribution. Returns false if no request is associated with
+  // |client_binder|.
+  virtual bool UpdateRequestUids(sp<IBinder> client_binder,
+                                 const uid_t* uids,
+                                 size_t num_uids) = 0;
+
+  // Keeps the kernel wake lock from being released by RemoveRequest() until
+  // EndBatch() is called, so that a batch that replaces some requests with
+  // others doesn't release and reacquire it. Batches made from different
+  // threads may overlap. EndBatch() returns false if the kernel lock couldn't
+  // be updated.
+  virtual void BeginBatch() = 0;
+  virtual bool EndBatch() = 0;
+
+  // Releases the kernel wake lock immediately if no requests or batches are
+  // active, i.e. if it's only being held for the release delay. Called before
+  // an explicit suspend, which shouldn't wait out the delay. Returns false if
+  // the kernel lock couldn't be released.
+  virtual bool ReleaseIdleKernelLock() = 0;
+
+  // Copies cumulative per-(uid, package, tag) statistics to |stats|.
+  virtual void GetStats(std::vector<WakeLockStats>* stats) const = 0;
+
+  // Appends a description of recent request events to |output|, discarding
+  // them afterward if |drain| is true.
+  virtual void DumpEvents(bool drain, std::string* output) = 0;
+
  protected:
   // Information about a request from a client.
   struct Request {
-    Request(const std::string& tag, const std::string& package, uid_t uid);
+    Request(const std::string& tag,
+            const std::string& package,
+            uid_t uid,
+            base::TimeDelta timeout);
     Request(const Request& request);
     Request();
 
     std::string tag;
     std::string package;
     uid_t uid;
+    base::TimeDelta timeout;
   };
 };
 
+// Tracks wake lock requests and holds a kernel wake lock while any are active.
+// All public methods may be called concurrently from binder threads. Requests
+// are partitioned across shards by binder, each with its own lock, string pool,
+// statistics and event log, so adding or removing a request whose binder is
+// already registered for death notifications only takes its shard's lock.
+// Registering a new binder, adding or removing a timeout and changing the
+// kernel lock's state also take global locks. Once AddRequest() returns true,
+// the kernel lock is held. The object must be created and destroyed on a thread
+// with a message loop, which is used to run timers.
 class WakeLockManager : public WakeLockManagerInterface {
  public:
   // Name of the kernel wake lock created by this class.
   static const char kLockName[];
 
+  // Number of shards that requests are partitioned into.
+  static const size_t kNumShards = 8;
+
+  // Tunable behavior.
+  struct Options {
+    Options();
+
+    // Time to keep holding the kernel wake lock after the last request is
+    // removed. If a new request arrives in the meantime, the kernel lock is
+    // kept instead of being released and immediately reacquired. A zero delay
+    // releases the lock immediately.
+    base::TimeDelta release_delay;
+
+    // If nonzero, the kernel wake lock is created with this timeout and
+    // re-armed every |kernel_lock_timeout| / 2 while it is held. If the daemon
+    // wedges, the kernel drops the lock on its own instead of blocking suspend
+    // forever.
+    base::TimeDelta kernel_lock_timeout;
+  };
+
+  // Run with true after the kernel wake lock is acquired and with false after
+  // it is released.
+  using KernelLockCallback = base::Callback<void(bool held)>;
+
   WakeLockManager();
   ~WakeLockManager() override;
 
+  // Applies to lock transitions made after the call.
+  void set_options(const Options& options);
+
+  // Must be called before Init().
   void set_paths_for_testing(const base::FilePath& lock_path,
                              const base::FilePath& unlock_path) {
     lock_path_ = lock_path;
     unlock_path_ = unlock_path;
   }
 
+  // Must be called before any requests are added. |callback| runs on whichever
+  // thread made the transition while internal locks are held, so it must not
+  // call back into this object.
+  void set_kernel_lock_callback(const KernelLockCallback& callback) {
+    kernel_lock_callback_ = callback;
+  }
+
+  // Opens the sysfs lock and unlock files, returning true on success.
   bool Init();
 
+  // Is the kernel wake lock currently held?
+  bool kernel_lock_held() const { return kernel_lock_held_; }
+
+  // Number of writes to the sysfs lock and unlock files.
+  int num_kernel_locks() const { return num_kernel_locks_; }
+  int num_kernel_unlocks() const { return num_kernel_unlocks_; }
+
+  // Number of times that a pending release was cancelled by a new request,
+  // with each one avoiding an unlock and a lock write.
+  int num_avoided_releases() const { return num_avoided_releases_; }
+
+  // Number of times that a kernel lock with a timeout has been re-armed, and
+  // number of those attempts whose writes failed.
+  int num_kernel_lock_rearms() const { return num_kernel_lock_rearms_; }
+  int num_failed_kernel_lock_rearms() const {
+    return num_failed_kernel_lock_rearms_;
+  }
+
+  SysfsWriter* lock_writer_for_testing() { return &lock_writer_; }
+
+  // Number of requests that were removed because their timeouts elapsed.
+  int num_expired_requests() const { return num_expired_requests_; }
+
+  // Number of death notifications registered with the binder driver, number
+  // of death notifications that have been received, and number of passes in
+  // which the dead binders' requests were removed. Each binder is registered
+  // when its first request is added, and stays registered until a while after
+  // its last request has been removed.
+  int num_death_registrations() const { return num_death_registrations_; }
+  int num_client_deaths() const { return num_client_deaths_; }
+  int num_death_passes() const { return num_death_passes_; }
+
+  // Number of currently-active requests.
+  int num_requests() const { return num_requests_; }
+
+  // Copies the shards' and kernel lock's events to |events|, in chronological
+  // order.
+  void GetEventsForTesting(std::vector<WakeLockEventLog::Event>* events);
+
+  // Takes ownership of |clock|, which is used to compute request deadlines.
+  // |clock| must be thread-safe.
+  void set_tick_clock_for_testing(std::unique_ptr<base::TickClock> clock) {
+    clock_ = std::move(clock);
+  }
+
+  // Runs the pending delayed release of the kernel lock immediately. Returns
+  // false if no release was pending.
+  bool TriggerReleaseTimeoutForTesting();
+
+  // Returns the delay with which the pending heartbeat was scheduled, or zero
+  // if none is pending.
+  base::TimeDelta GetHeartbeatDelayForTesting();
+
+  // Re-arms the kernel lock's timeout immediately. Returns false if no
+  // heartbeat was scheduled.
+  bool TriggerHeartbeatForTesting();
+
+  // Expires requests whose timeouts have elapsed according to |clock_|.
+  // Returns false if no requests with timeouts are pending.
+  bool TriggerTimeoutTickForTesting();
+
+  // Logs the pending summary of recent events immediately. Returns false if no
+  // summary was scheduled.
+  bool TriggerEventSummaryForTesting();
+
+  // Drops the death notifications of binders without requests immediately.
+  // Returns false if none were pending.
+  bool TriggerUnregisterTimeoutForTesting();
+
   // WakeLockManagerInterface:
   bool AddRequest(sp<IBinder> client_binder,
-                  const std::string& tag,
-                  const std::string& package,
-                  uid_t uid) override;
+                  const String16& tag,
+                  const String16& package,
+                  uid_t uid,
+                  base::TimeDelta timeout) override;
   bool RemoveRequest(sp<IBinder> client_binder) override;
+  bool UpdateRequestUids(sp<IBinder> client_binder,
+                         const uid_t* uids,
+                         size_t num_uids) override;
+  void BeginBatch() override;
+  bool EndBatch() override;
+  bool ReleaseIdleKernelLock() override;
+  void GetStats(std::vector<WakeLockStats>* stats) const override;
+  void DumpEvents(bool drain, std::string* output) override;
 
  private:
+  // Number of uids that a request can be attributed to without allocating.
+  static const size_t kInlineOwners = 4;
+
+  // A uid that a request is attributed to, and the handle returned by its
+  // shard's |stats| for it.
+  struct Owner {
+    uid_t uid;
+    size_t stats_handle;
+  };
+
+  // Daemon-side state for an active request.
+  struct ActiveRequest {
+    ActiveRequest();
+
+    // Handles in the shard's |strings|, each holding a reference.
+    StringPool::Handle tag;
+    StringPool::Handle package;
+
+    uid_t uid;
+    base::TimeDelta timeout;
+
+    // Identifies the request's entry in the shard's |timer_wheel|, or 0 if the
+    // request doesn't have a timeout.
+    uint64_t timeout_id;
+
+    // Uids that the request is accounted to in the shard's |stats| and the
+    // time at which it was accounted as acquired. Unless |has_work_source| is
+    // set, |owners| just contains |uid|.
+    SmallArray<Owner, kInlineOwners> owners;
+    bool has_work_source;
+    base::TimeTicks acquire_time;
+  };
+
+  // A partition of the active requests. All members are guarded by |lock|.
+  struct Shard {
+    Shard();
+
+    base::Lock lock;
+
+    // Requests whose binders map to this shard.
+    BinderMap<ActiveRequest> requests;
+
+    // Deadlines of requests with timeouts. |timer_wheel| may also hold stale
+    // entries for requests that were since removed or updated; it's cleared
+    // once |num_timeouts|, the number of requests with a nonzero |timeout_id|,
+    // drops to zero.
+    TimerWheel timer_wheel;
+    uint64_t next_timeout_id;
+    int num_timeouts;
+
+    // Tags and package names referenced by |requests| and |stats|.
+    StringPool strings;
+
+    // Hold-time statistics for all requests seen so far in this shard.
+    // GetStats() merges the shards' entries.
+    WakeLockStatsTable stats;
+
+    // Recent events for this shard's requests. DumpEvents() merges the shards'
+    // logs with |kernel_events_|.
+    WakeLockEventLog events;
+
+    // Binders that are still registered for death notifications although
+    // their requests have been removed. The values are unused.
+    BinderMap<bool> idle_clients;
+  };
+
+  // Returns the shard that |binder|'s request belongs to.
+  Shard* GetShard(const sp<IBinder>& binder) const;
+
+  // Registers for notification of the death of |binder|. Each request is
+  // watched via its own binder: the process that hosts a binder can't be
+  // determined, and it isn't necessarily the one that passed the binder, so
+  // one binder's death says nothing about the others. Returns false on
+  // failure.
+  bool RegisterClient(const sp<IBinder>& binder);
+
+  // Undoes RegisterClient().
+  void UnregisterClient(const sp<IBinder>& binder);
+
+  // Called once |binder|'s request has been removed from |shard|, whose lock
+  // must be held. The binder stays registered in the shard's |idle_clients|
+  // until UnregisterIdleClients() runs, so that releasing and re-acquiring a
+  // lock doesn't touch |clients_lock_| or the binder driver.
+  void RetireClientLocked(Shard* shard, const sp<IBinder>& binder);
+
+  // Called by |unregister_timer_| to unregister all idle clients.
+  void UnregisterIdleClients();
+
+  // Records |request| as acquired by its owners at |now|, first resetting
+  // |request->owners| to |request->uid| if the request doesn't have a work
+  // source. The key fields of |request| must already be up to date.
+  void RecordOwnersAcquire(Shard* shard,
+                           ActiveRequest* request,
+                           base::TimeTicks now);
+
+  // Records |request| as released by its owners at |now|.
+  void RecordOwnersRelease(Shard* shard,
+                           const ActiveRequest& request,
+                           base::TimeTicks now);
+
+  // Drops the request associated with |binder| from |shard|, whose lock must
+  // be held, without updating the kernel lock or death notifications.
+  void EraseRequestLocked(Shard* shard,
+                          const sp<IBinder>& binder,
+                          const ActiveRequest* request);
+
+  // Called when a request's binder dies. The binder is added to
+  // |dead_binders_|, and |death_timer_| runs HandleDeadBinders() on the message
+  // loop to remove the requests of all binders collected so far with a single
+  // re-evaluation of the kernel lock. A crashed process's notifications are
+  // usually batched together, but with multiple binder threads some may only
+  // arrive after a pass has started; they're handled by a later pass.
   void HandleBinderDeath(sp<IBinder> binder);
+  void HandleDeadBinders();
+
+  // Records an event in |shard|'s log, whose lock must be held, and schedules
+  // a summary if one isn't already pending. If |shard| is null, the event is
+  // recorded in |kernel_events_| and |kernel_lock_| must be held instead.
+  // |request| may be null.
+  void RecordEvent(WakeLockEventLog::EventType type,
+                   const sp<IBinder>& binder,
+                   Shard* shard,
+                   const ActiveRequest* request);
+
+  // Appends all logged events to |events| in chronological order and returns
+  // the number of events that were dropped. If |drain| is true, the logs are
+  // emptied.
+  int64_t CopyEvents(bool drain, std::vector<WakeLockEventLog::Event>* events);
+
+  // Called by |summary_timer_| to log a summary of recent events.
+  void HandleEventSummary();
+
+  // Returns the |timer_wheel| tick corresponding to |time|.
+  static int64_t GetTick(base::TimeTicks time, bool round_up);
+
+  // Called periodically by |timeout_timer_| to remove requests whose timeouts
+  // have elapsed.
+  void HandleTimeoutTick();
+
+  // Update |shard|'s and |num_pending_timeouts_|'s counts when a request gains
+  // or loses its timeout, starting or stopping |timeout_timer_| as needed.
+  // |shard|'s lock must be held.
+  void AddTimeoutLocked(Shard* shard);
+  void RemoveTimeoutLocked(Shard* shard);
+
+  // Kernel lock transitions, made once |num_kernel_lock_refs_| has become
+  // nonzero or zero. |kernel_lock_| must be held, and the count must be
+  // rechecked after acquiring it, since other threads may have changed it in
+  // the meantime.
+  bool AcquireKernelLockLocked();
+  bool ScheduleKernelLockReleaseLocked();
+  bool ReleaseKernelLockLocked();
+
+  // Called by |release_timer_|.
+  void HandleReleaseTimeout();
+
+  // Called by |heartbeat_timer_| to re-arm the kernel lock's timeout.
+  void HandleHeartbeat();
+
+  // Starts |heartbeat_timer_| with |delay|. |kernel_lock_| must be held.
+  void StartHeartbeatLocked(base::TimeDelta delay);
+
+  // Returns the string to write to the sysfs lock file. |kernel_lock_| must be
+  // held.
+  std::string GetLockString() const;
 
   base::FilePath lock_path_;
   base::FilePath unlock_path_;
 
-  // Currently-active requests, keyed by client binders.
-  std::map<sp<IBinder>, Request> requests_;
+  std::unique_ptr<base::TickClock> clock_;
+
+  std::unique_ptr<Shard[]> shards_;
+
+  // Number of requests across all shards.
+  std::atomic<int> num_requests_;
+
+  // Guards |dead_binders_| and all calls to BinderWrapper's death
+  // notification methods, which aren't thread-safe. May be acquired while a
+  // shard's lock is held, but not vice versa.
+  base::Lock clients_lock_;
+
+  // Binders whose deaths haven't been handled by HandleDeadBinders() yet.
+  std::vector<sp<IBinder>> dead_binders_;
+  CrossThreadTimer death_timer_;
+
+  // Runs UnregisterIdleClients() while any shard has idle clients.
+  CrossThreadTimer unregister_timer_;
+
+  // Runs HandleTimeoutTick() while any request has a timeout.
+  CrossThreadTimer timeout_timer_;
+
+  // Guards |num_pending_timeouts_| so that |timeout_timer_| is started and
+  // stopped consistently with it. May be acquired while a shard's lock is held.
+  base::Lock timeout_lock_;
+
+  // Number of requests with timeouts across all shards.
+  int num_pending_timeouts_;
+
+  // Recent events are logged only as a periodic summary that's emitted by
+  // |summary_timer_| at most once per interval; the full logs can be obtained
+  // via DumpEvents().
+  CrossThreadTimer summary_timer_;
+
+  // Serializes kernel lock transitions. Guards the members below it, other
+  // than the atomic ones, which may be read without it.
+  base::Lock kernel_lock_;
+
+  Options options_;
+
+  KernelLockCallback kernel_lock_callback_;
+
+  // Recent kernel lock transitions.
+  WakeLockEventLog kernel_events_;
+
+  // Persistent writers for |lock_path_| and |unlock_path_|.
+  SysfsWriter lock_writer_;
+  SysfsWriter unlock_writer_;
+
+  // Number of active requests plus in-progress batches. The kernel lock is
+  // acquired when a request is added while it isn't held, and released when
+  // this drops to zero. Updated without |kernel_lock_| when no transition
+  // can be needed.
+  std::atomic<int> num_kernel_lock_refs_;
+
+  // True if |kLockName| has been written to the sysfs lock file and not yet
+  // to the unlock file. Only written while |kernel_lock_| is held.
+  std::atomic<bool> kernel_lock_held_;
+
+  // True while ReleaseKernelLockLocked() is deciding whether to release the
+  // lock or writing to the unlock file. Only written while |kernel_lock_| is
+  // held.
+  std::atomic<bool> kernel_lock_releasing_;
+
+  // Runs HandleReleaseTimeout() after the last request has been removed.
+  CrossThreadTimer release_timer_;
+
+  // Runs HandleHeartbeat() while the kernel lock is held with a timeout.
+  CrossThreadTimer heartbeat_timer_;
+
+  // Delay passed to the most recent start of |heartbeat_timer_|.
+  base::TimeDelta heartbeat_delay_;
+
+  std::atomic<int> num_kernel_locks_;
+  std::atomic<int> num_kernel_unlocks_;
+  std::atomic<int> num_avoided_releases_;
+  std::atomic<int> num_kernel_lock_rearms_;
+  std::atomic<int> num_failed_kernel_lock_rearms_;
+  std::atomic<int> num_expired_requests_;
+  std::atomic<int> num_death_registrations_;
+  std::atomic<int> num_client_deaths_;
+  std::atomic<int> num_death_passes_;
 
   DISALLOW_COPY_AND_ASSIGN(WakeLockManager);
 };
@@ -18,6 +18,7 @@
 
 #include <base/strings/stringprintf.h>
 #include <binder/IBinder.h>
+#include <utils/String8.h>
 
 namespace android {
 
@@ -29,7 +30,10 @@ std::string WakeLockManagerStub::ConstructRequestString(
   return base::StringPrintf("%s,%s,%d", tag.c_str(), package.c_str(), uid);
 }
 
-WakeLockManagerStub::WakeLockManagerStub() = default;
+WakeLockManagerStub::WakeLockManagerStub()
+    : num_batches_(0),
+      num_idle_kernel_lock_releases_(0),
+      kernel_lock_failure_(false) {}
 
 WakeLockManagerStub::~WakeLockManagerStub() = default;
 
@@ -43,12 +47,26 @@ std::string WakeLockManagerStub::GetRequestString(
   return ConstructRequestString(req.tag, req.package, req.uid);
 }
 
+base::TimeDelta WakeLockManagerStub::GetRequestTimeout(
+    const sp<IBinder>& binder) const {
+  const auto it = requests_.find(binder);
+  return it != requests_.end() ? it->second.timeout : base::TimeDelta();
+}
+
+std::vector<uid_t> WakeLockManagerStub::GetRequestUids(
+    const sp<IBinder>& binder) const {
+  const auto it = request_uids_.find(binder);
+  return it != request_uids_.end() ? it->second : std::vector<uid_t>();
+}
+
 bool WakeLockManagerStub::AddRequest(sp<IBinder> client_binder,
-                                     const std::string& tag,
-                                     const std::string& package,
-                                     uid_t uid) {
-  requests_[client_binder] = Request(tag, package, uid);
-  return true;
+                                     const String16& tag,
+                                     const String16& package,
+                                     uid_t uid,
+                                     base::TimeDelta timeout) {
+  requests_[client_binder] = Request(
+      String8(tag).string(), String8(package).string(), uid, timeout);
+  return !kernel_lock_failure_;
 }
 
 bool WakeLockManagerStub::RemoveRequest(sp<IBinder> client_binder) {
@@ -56,7 +74,44 @@ bool WakeLockManagerStub::RemoveRequest(sp<IBinder> client_binder) {
     return false;
 
   requests_.erase(client_binder);
+  request_uids_.erase(client_binder);
+  return true;
+}
+
+bool WakeLockManagerStub::UpdateRequestUids(sp<IBinder> client_binder,
+                                            const uid_t* uids,
+                                            size_t num_uids) {
+  if (!requests_.count(client_binder))
+    return false;
+
+  if (num_uids)
+    request_uids_[client_binder].assign(uids, uids + num_uids);
+  else
+    request_uids_.erase(client_binder);
   return true;
 }
 
+bool WakeLockManagerStub::EndBatch() {
+  num_batches_++;
+  return !kernel_lock_failure_;
+}
+
+bool WakeLockManagerStub::ReleaseIdleKernelLock() {
+  num_idle_kernel_lock_releases_++;
+  return !kernel_lock_failure_;
+}
+
+void WakeLockManagerStub::GetStats(std::vector<WakeLockStats>* stats) const {
+  stats->clear();
+  for (const auto& it : requests_) {
+    WakeLockStats entry;
+    entry.uid = it.second.uid;
+    entry.package = it.second.package;
+    entry.tag = it.second.tag;
+    entry.acquire_count = 1;
+    entry.active_count = 1;
+    stats->push_back(entry);
+  }
+}
+
 }  // namespace android
@@ -17,11 +17,14 @@
 #ifndef SYSTEM_NATIVEPOWER_DAEMON_WAKE_LOCK_MANAGER_STUB_H_
 #define SYSTEM_NATIVEPOWER_DAEMON_WAKE_LOCK_MANAGER_STUB_H_
 
-#include <set>
+#include <map>
 #include <string>
 #include <sys/types.h>
+#include <vector>
 
 #include <base/macros.h>
+#include <base/time/time.h>
+#include <utils/String16.h>
 #include <utils/StrongPointer.h>
 
 #include "wake_lock_manager.h"
@@ -43,22 +46,62 @@ class WakeLockManagerStub : public WakeLockManagerInterface {
                                             uid_t uid);
 
   int num_requests() const { return requests_.size(); }
+  int num_batches() const { return num_batches_; }
+  int num_idle_kernel_lock_releases() const {
+    return num_idle_kernel_lock_releases_;
+  }
+
+  // If true, AddRequest(), EndBatch() and ReleaseIdleKernelLock() report that
+  // the kernel lock couldn't be updated (after updating requests as usual).
+  void set_kernel_lock_failure(bool failure) {
+    kernel_lock_failure_ = failure;
+  }
 
   // Returns a string describing the request associated with |binder|, or an
   // empty string if no request is present.
   std::string GetRequestString(const sp<IBinder>& binder) const;
 
+  // Returns the timeout of the request associated with |binder|, or zero if no
+  // request is present.
+  base::TimeDelta GetRequestTimeout(const sp<IBinder>& binder) const;
+
+  // Returns the uids passed to UpdateRequestUids() for the request associated
+  // with |binder|, or an empty list if none were passed.
+  std::vector<uid_t> GetRequestUids(const sp<IBinder>& binder) const;
+
   // WakeLockManagerInterface:
   bool AddRequest(sp<IBinder> client_binder,
-                  const std::string& tag,
-                  const std::string& package,
-                  uid_t uid) override;
+                  const String16& tag,
+                  const String16& package,
+                  uid_t uid,
+                  base::TimeDelta timeout) override;
   bool RemoveRequest(sp<IBinder> client_binder) override;
+  bool UpdateRequestUids(sp<IBinder> client_binder,
+                         const uid_t* uids,
+                         size_t num_uids) override;
+  void BeginBatch() override {}
+  bool EndBatch() override;
+  bool ReleaseIdleKernelLock() override;
+
+  // Reports a single acquisition for each active request.
+  void GetStats(std::vector<WakeLockStats>* stats) const override;
+  void DumpEvents(bool drain, std::string* output) override {}
 
  private:
   // Currently-active requests, keyed by client binders.
   std::map<sp<IBinder>, Request> requests_;
 
+  // Work sources of requests in |requests_|, keyed by client binders.
+  std::map<sp<IBinder>, std::vector<uid_t>> request_uids_;
+
+  // Number of EndBatch() calls.
+  int num_batches_;
+
+  // Number of ReleaseIdleKernelLock() calls.
+  int num_idle_kernel_lock_releases_;
+
+  bool kernel_lock_failure_;
+
   DISALLOW_COPY_AND_ASSIGN(WakeLockManagerStub);
 };
 
@@ -14,22 +14,91 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+
+#include <memory>
+#include <vector>
+
+#include <base/bind.h>
 #include <base/files/file_path.h>
 #include <base/files/file_util.h>
 #include <base/files/scoped_temp_dir.h>
 #include <base/logging.h>
 #include <base/macros.h>
+#include <base/message_loop/message_loop.h>
+#include <base/run_loop.h>
+#include <base/strings/stringprintf.h>
+#include <base/test/simple_test_tick_clock.h>
+#include <base/threading/simple_thread.h>
+#include <base/time/time.h>
 #include <binder/IBinder.h>
 #include <binderwrapper/binder_test_base.h>
 #include <binderwrapper/stub_binder_wrapper.h>
+#include <nativepower/wake_lock_stats.h>
+#include <utils/String16.h>
 
 #include "wake_lock_manager.h"
 
 namespace android {
+namespace {
+
+// Appends |held| to |transitions|. Passed to
+// WakeLockManager::set_kernel_lock_callback().
+void RecordKernelLockTransition(std::vector<bool>* transitions, bool held) {
+  transitions->push_back(held);
+}
+
+// Repeatedly adds and removes requests for a set of binders from its own
+// thread. Removals are made in a batch on every other iteration.
+class RequestChurner : public base::DelegateSimpleThread::Delegate {
+ public:
+  RequestChurner(WakeLockManager* manager,
+                 const std::vector<sp<BBinder>>& binders,
+                 int num_iterations)
+      : manager_(manager),
+        binders_(binders),
+        num_iterations_(num_iterations) {}
+  ~RequestChurner() override = default;
+
+  // base::DelegateSimpleThread::Delegate:
+  void Run() override {
+    for (int i = 0; i < num_iterations_; ++i) {
+      for (const sp<BBinder>& binder : binders_) {
+        EXPECT_TRUE(manager_->AddRequest(binder, String16("tag"),
+                                         String16("pkg"), -1,
+                                         base::TimeDelta()));
+        // The kernel lock must be held as soon as AddRequest() returns, even
+        // if another thread has just removed the last of its requests.
+        EXPECT_TRUE(manager_->kernel_lock_held());
+      }
+
+      const bool batch = i % 2;
+      if (batch)
+        manager_->BeginBatch();
+      for (const sp<BBinder>& binder : binders_)
+        EXPECT_TRUE(manager_->RemoveRequest(binder));
+      if (batch)
+        EXPECT_TRUE(manager_->EndBatch());
+    }
+  }
+
+ private:
+  WakeLockManager* manager_;  // Not owned.
+  std::vector<sp<BBinder>> binders_;
+  int num_iterations_;
+
+  DISALLOW_COPY_AND_ASSIGN(RequestChurner);
+};
+
+}  // namespace
 
 class WakeLockManagerTest : public BinderTestBase {
  public:
-  WakeLockManagerTest() {
+  WakeLockManagerTest() : clock_(new base::SimpleTestTickClock()) {
+    clock_->Advance(base::TimeDelta::FromSeconds(1000));
+    manager_.set_tick_clock_for_testing(
+        std::unique_ptr<base::TickClock>(clock_));
+
     CHECK(temp_dir_.CreateUniqueTempDir());
     lock_path_ = temp_dir_.path().Append("lock");
     unlock_path_ = temp_dir_.path().Append("unlock");
@@ -48,12 +117,24 @@ class WakeLockManagerTest : public BinderTestBase {
     return value;
   }
 
+  // Adds a request to |manager_|, converting |tag| and |package| to UTF-16 as
+  // they would be received over binder.
+  bool AddRequest(const sp<IBinder>& binder,
+                  const char* tag,
+                  const char* package,
+                  uid_t uid,
+                  base::TimeDelta timeout) {
+    return manager_.AddRequest(binder, String16(tag), String16(package), uid,
+                               timeout);
+  }
+
   // Clears |lock_path_| and |unlock_path_|.
   void ClearFiles() {
     CHECK(base::WriteFile(lock_path_, "", 0) == 0);
     CHECK(base::WriteFile(unlock_path_, "", 0) == 0);
   }
 
+  base::MessageLoop message_loop_;
   base::ScopedTempDir temp_dir_;
 
   // Files within |temp_dir_| simulating /sys/power/wake_lock and wake_unlock.
@@ -61,6 +142,7 @@ class WakeLockManagerTest : public BinderTestBase {
   base::FilePath unlock_path_;
 
   WakeLockManager manager_;
+  base::SimpleTestTickClock* clock_;  // Owned by |manager_|.
 
  private:
   DISALLOW_COPY_AND_ASSIGN(WakeLockManagerTest);
@@ -69,14 +151,14 @@ class WakeLockManagerTest : public BinderTestBase {
 TEST_F(WakeLockManagerTest, AddAndRemoveRequests) {
   // A kernel wake lock should be created for the first request.
   sp<BBinder> binder1 = binder_wrapper()->CreateLocalBinder();
-  EXPECT_TRUE(manager_.AddRequest(binder1, "1", "1", -1));
+  EXPECT_TRUE(AddRequest(binder1, "1", "1", -1, base::TimeDelta()));
   EXPECT_EQ(WakeLockManager::kLockName, ReadFile(lock_path_));
   EXPECT_EQ("", ReadFile(unlock_path_));
 
   // Nothing should happen when a second request is made.
   ClearFiles();
   sp<BBinder> binder2 = binder_wrapper()->CreateLocalBinder();
-  EXPECT_TRUE(manager_.AddRequest(binder2, "2", "2", -1));
+  EXPECT_TRUE(AddRequest(binder2, "2", "2", -1, base::TimeDelta()));
   EXPECT_EQ("", ReadFile(lock_path_));
   EXPECT_EQ("", ReadFile(unlock_path_));
 
@@ -95,14 +177,14 @@ TEST_F(WakeLockManagerTest, AddAndRemoveRequests) {
 
 TEST_F(WakeLockManagerTest, DuplicateRequest) {
   sp<BBinder> binder = binder_wrapper()->CreateLocalBinder();
-  EXPECT_TRUE(manager_.AddRequest(binder, "foo", "bar", -1));
+  EXPECT_TRUE(AddRequest(binder, "foo", "bar", -1, base::TimeDelta()));
   EXPECT_EQ(WakeLockManager::kLockName, ReadFile(lock_path_));
   EXPECT_EQ("", ReadFile(unlock_path_));
 
   // Send a second request using the same binder and check a new wake lock isn't
   // created.
   ClearFiles();
-  EXPECT_TRUE(manager_.AddRequest(binder, "a", "b", -1));
+  EXPECT_TRUE(AddRequest(binder, "a", "b", -1, base::TimeDelta()));
   EXPECT_EQ("", ReadFile(lock_path_));
   EXPECT_EQ("", ReadFile(unlock_path_));
 
@@ -122,21 +204,469 @@ TEST_F(WakeLockManagerTest, InvalidRemoval) {
 
 TEST_F(WakeLockManagerTest, BinderDeath) {
   sp<BBinder> binder = binder_wrapper()->CreateLocalBinder();
-  EXPECT_TRUE(manager_.AddRequest(binder, "foo", "bar", -1));
+  EXPECT_TRUE(AddRequest(binder, "foo", "bar", -1, base::TimeDelta()));
   EXPECT_EQ(WakeLockManager::kLockName, ReadFile(lock_path_));
   EXPECT_EQ("", ReadFile(unlock_path_));
 
   // If the binder dies, the wake lock should be released.
   ClearFiles();
   binder_wrapper()->NotifyAboutBinderDeath(binder);
+  base::RunLoop().RunUntilIdle();
   EXPECT_EQ("", ReadFile(lock_path_));
   EXPECT_EQ(WakeLockManager::kLockName, ReadFile(unlock_path_));
 
   // Check that a new request can be created using the same binder.
   ClearFiles();
-  EXPECT_TRUE(manager_.AddRequest(binder, "foo", "bar", -1));
+  EXPECT_TRUE(AddRequest(binder, "foo", "bar", -1, base::TimeDelta()));
+  EXPECT_EQ(WakeLockManager::kLockName, ReadFile(lock_path_));
+  EXPECT_EQ("", ReadFile(unlock_path_));
+}
+
+TEST_F(WakeLockManagerTest, ProcessDeath) {
+  const int kNumRequests = 500;
+
+  // Process 100 passes its own binders and one hosted by another process.
+  binder_wrapper()->set_calling_pid(100);
+  std::vector<sp<BBinder>> binders;
+  for (int i = 0; i < kNumRequests; ++i) {
+    binders.push_back(binder_wrapper()->CreateLocalBinder());
+    EXPECT_TRUE(AddRequest(binders.back(), "foo", "bar", -1,
+                           base::TimeDelta()));
+  }
+  sp<BBinder> other_binder = binder_wrapper()->CreateLocalBinder();
+  EXPECT_TRUE(AddRequest(other_binder, "foo", "bar", -1, base::TimeDelta()));
+  EXPECT_EQ(kNumRequests + 1, manager_.num_death_registrations());
+
+  // The death of the other binder's host shouldn't affect requests whose
+  // binders are still alive, even though they came from the same caller.
+  binder_wrapper()->NotifyAboutBinderDeath(other_binder);
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(kNumRequests, manager_.num_requests());
+  EXPECT_EQ(1, manager_.num_death_passes());
+
+  // When the caller dies, notifications for all of its binders that arrive
+  // before the loop runs should be handled in a single pass that releases the
+  // kernel lock once.
+  ClearFiles();
+  for (const sp<BBinder>& binder : binders)
+    binder_wrapper()->NotifyAboutBinderDeath(binder);
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(0, manager_.num_requests());
+  EXPECT_EQ(kNumRequests + 1, manager_.num_client_deaths());
+  EXPECT_EQ(2, manager_.num_death_passes());
+  EXPECT_EQ(WakeLockManager::kLockName, ReadFile(unlock_path_));
+  EXPECT_EQ(1, manager_.num_kernel_locks());
+  EXPECT_EQ(1, manager_.num_kernel_unlocks());
+  std::vector<WakeLockStats> stats;
+  manager_.GetStats(&stats);
+  ASSERT_EQ(1u, stats.size());
+  EXPECT_EQ(0, stats[0].active_count);
+  EXPECT_EQ(kNumRequests + 1, stats[0].acquire_count);
+}
+
+TEST_F(WakeLockManagerTest, ReleaseDelay) {
+  WakeLockManager::Options options;
+  options.release_delay = base::TimeDelta::FromSeconds(1);
+  manager_.set_options(options);
+
+  sp<BBinder> binder1 = binder_wrapper()->CreateLocalBinder();
+  EXPECT_TRUE(AddRequest(binder1, "1", "1", -1, base::TimeDelta()));
   EXPECT_EQ(WakeLockManager::kLockName, ReadFile(lock_path_));
+
+  // The kernel lock shouldn't be released as soon as the last request is
+  // removed.
+  ClearFiles();
+  EXPECT_TRUE(manager_.RemoveRequest(binder1));
+  EXPECT_EQ("", ReadFile(unlock_path_));
+  EXPECT_TRUE(manager_.kernel_lock_held());
+
+  // A new request during the delay should cancel the pending release without
+  // touching the kernel lock.
+  sp<BBinder> binder2 = binder_wrapper()->CreateLocalBinder();
+  EXPECT_TRUE(AddRequest(binder2, "2", "2", -1, base::TimeDelta()));
+  EXPECT_EQ("", ReadFile(lock_path_));
+  EXPECT_EQ("", ReadFile(unlock_path_));
+  EXPECT_FALSE(manager_.TriggerReleaseTimeoutForTesting());
+  EXPECT_EQ(1, manager_.num_avoided_releases());
+
+  // After the delay elapses with no requests, the lock should be released.
+  EXPECT_TRUE(manager_.RemoveRequest(binder2));
+  EXPECT_EQ("", ReadFile(unlock_path_));
+  EXPECT_TRUE(manager_.TriggerReleaseTimeoutForTesting());
+  EXPECT_EQ(WakeLockManager::kLockName, ReadFile(unlock_path_));
+  EXPECT_FALSE(manager_.kernel_lock_held());
+  EXPECT_EQ(1, manager_.num_kernel_locks());
+  EXPECT_EQ(1, manager_.num_kernel_unlocks());
+}
+
+TEST_F(WakeLockManagerTest, ReleaseIdleKernelLock) {
+  std::vector<bool> transitions;
+  manager_.set_kernel_lock_callback(
+      base::Bind(&RecordKernelLockTransition, &transitions));
+  WakeLockManager::Options options;
+  options.release_delay = base::TimeDelta::FromSeconds(1);
+  manager_.set_options(options);
+
+  // The kernel lock should be kept while a request is active.
+  sp<BBinder> binder = binder_wrapper()->CreateLocalBinder();
+  EXPECT_TRUE(AddRequest(binder, "1", "1", -1, base::TimeDelta()));
+  EXPECT_TRUE(manager_.ReleaseIdleKernelLock());
+  EXPECT_TRUE(manager_.kernel_lock_held());
+
+  // Once the last request is removed, e.g. just before a suspend request, the
+  // lock should be released without waiting for the delay.
+  ClearFiles();
+  EXPECT_TRUE(manager_.RemoveRequest(binder));
+  EXPECT_TRUE(manager_.kernel_lock_held());
+  EXPECT_TRUE(manager_.ReleaseIdleKernelLock());
+  EXPECT_FALSE(manager_.kernel_lock_held());
+  EXPECT_EQ(WakeLockManager::kLockName, ReadFile(unlock_path_));
+  ASSERT_EQ(2u, transitions.size());
+  EXPECT_FALSE(transitions[1]);
+
+  // The pending release should have been cancelled.
+  EXPECT_FALSE(manager_.TriggerReleaseTimeoutForTesting());
+  EXPECT_EQ(1, manager_.num_kernel_unlocks());
+  EXPECT_TRUE(manager_.ReleaseIdleKernelLock());
+  EXPECT_EQ(1, manager_.num_kernel_unlocks());
+}
+
+TEST_F(WakeLockManagerTest, KernelLockCallback) {
+  std::vector<bool> transitions;
+  manager_.set_kernel_lock_callback(
+      base::Bind(&RecordKernelLockTransition, &transitions));
+  WakeLockManager::Options options;
+  options.release_delay = base::TimeDelta::FromSeconds(1);
+  manager_.set_options(options);
+
+  // The callback should only be run for actual kernel lock transitions.
+  sp<BBinder> binder1 = binder_wrapper()->CreateLocalBinder();
+  sp<BBinder> binder2 = binder_wrapper()->CreateLocalBinder();
+  EXPECT_TRUE(AddRequest(binder1, "1", "1", -1, base::TimeDelta()));
+  EXPECT_TRUE(AddRequest(binder2, "2", "2", -1, base::TimeDelta()));
+  EXPECT_TRUE(manager_.RemoveRequest(binder1));
+  EXPECT_TRUE(manager_.RemoveRequest(binder2));
+  ASSERT_EQ(1u, transitions.size());
+  EXPECT_TRUE(transitions[0]);
+
+  EXPECT_TRUE(manager_.TriggerReleaseTimeoutForTesting());
+  ASSERT_EQ(2u, transitions.size());
+  EXPECT_FALSE(transitions[1]);
+}
+
+TEST_F(WakeLockManagerTest, KernelLockTimeout) {
+  WakeLockManager::Options options;
+  options.kernel_lock_timeout = base::TimeDelta::FromSeconds(10);
+  manager_.set_options(options);
+  const std::string kLockString =
+      base::StringPrintf("%s 10000000000", WakeLockManager::kLockName);
+
+  // The kernel lock should be created with a timeout, and nothing should be
+  // scheduled until then.
+  EXPECT_FALSE(manager_.TriggerHeartbeatForTesting());
+  sp<BBinder> binder1 = binder_wrapper()->CreateLocalBinder();
+  EXPECT_TRUE(AddRequest(binder1, "1", "1", -1, base::TimeDelta()));
+  EXPECT_EQ(kLockString, ReadFile(lock_path_));
+
+  // Each heartbeat should re-arm the lock with a single write, regardless of
+  // the number of active requests.
+  sp<BBinder> binder2 = binder_wrapper()->CreateLocalBinder();
+  EXPECT_TRUE(AddRequest(binder2, "2", "2", -1, base::TimeDelta()));
+  ClearFiles();
+  EXPECT_TRUE(manager_.TriggerHeartbeatForTesting());
+  EXPECT_EQ(kLockString, ReadFile(lock_path_));
+  EXPECT_EQ(1, manager_.num_kernel_lock_rearms());
+  EXPECT_EQ(1, manager_.num_kernel_locks());
+  EXPECT_EQ(base::TimeDelta::FromSeconds(5),
+            manager_.GetHeartbeatDelayForTesting());
+
+  // A failed re-arm should be retried soon instead of after a half-period,
+  // and the lock should still be considered held.
+  manager_.lock_writer_for_testing()->set_write_error_for_testing(EIO);
+  EXPECT_TRUE(manager_.TriggerHeartbeatForTesting());
+  EXPECT_EQ(1, manager_.num_failed_kernel_lock_rearms());
+  EXPECT_TRUE(manager_.kernel_lock_held());
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(100),
+            manager_.GetHeartbeatDelayForTesting());
+  manager_.lock_writer_for_testing()->set_write_error_for_testing(0);
+  ClearFiles();
+  EXPECT_TRUE(manager_.TriggerHeartbeatForTesting());
+  EXPECT_EQ(kLockString, ReadFile(lock_path_));
+  EXPECT_EQ(3, manager_.num_kernel_lock_rearms());
+  EXPECT_EQ(1, manager_.num_failed_kernel_lock_rearms());
+  EXPECT_EQ(base::TimeDelta::FromSeconds(5),
+            manager_.GetHeartbeatDelayForTesting());
+
+  // The heartbeat should stop once the lock is released.
+  ClearFiles();
+  EXPECT_TRUE(manager_.RemoveRequest(binder1));
+  EXPECT_TRUE(manager_.RemoveRequest(binder2));
+  EXPECT_EQ("", ReadFile(lock_path_));
+  EXPECT_EQ(WakeLockManager::kLockName, ReadFile(unlock_path_));
+  EXPECT_FALSE(manager_.TriggerHeartbeatForTesting());
+}
+
+TEST_F(WakeLockManagerTest, RequestTimeout) {
+  // Add requests with short and long timeouts and one without a timeout.
+  sp<BBinder> short_binder = binder_wrapper()->CreateLocalBinder();
+  sp<BBinder> long_binder = binder_wrapper()->CreateLocalBinder();
+  sp<BBinder> forever_binder = binder_wrapper()->CreateLocalBinder();
+  EXPECT_TRUE(AddRequest(short_binder, "short", "pkg", -1,
+                         base::TimeDelta::FromSeconds(2)));
+  EXPECT_TRUE(AddRequest(long_binder, "long", "pkg", -1,
+                         base::TimeDelta::FromSeconds(10)));
+  EXPECT_TRUE(AddRequest(forever_binder, "forever", "pkg", -1,
+                         base::TimeDelta()));
+
+  // Nothing should expire early.
+  clock_->Advance(base::TimeDelta::FromMilliseconds(1900));
+  EXPECT_TRUE(manager_.TriggerTimeoutTickForTesting());
+  EXPECT_EQ(0, manager_.num_expired_requests());
+
+  // The short request should be removed once its timeout elapses, and its
+  // binder should be usable for a new request.
+  clock_->Advance(base::TimeDelta::FromMilliseconds(200));
+  EXPECT_TRUE(manager_.TriggerTimeoutTickForTesting());
+  EXPECT_EQ(1, manager_.num_expired_requests());
+  EXPECT_FALSE(manager_.RemoveRequest(short_binder));
+
+  // Re-adding the long request without a timeout should cancel its timeout
+  // and, since no other request has one, stop the timer right away.
+  EXPECT_TRUE(AddRequest(long_binder, "long", "pkg", -1, base::TimeDelta()));
+  EXPECT_FALSE(manager_.TriggerTimeoutTickForTesting());
+  clock_->Advance(base::TimeDelta::FromSeconds(20));
+  EXPECT_EQ(1, manager_.num_expired_requests());
+
+  // Removing a timed request should also stop the timer.
+  EXPECT_TRUE(AddRequest(short_binder, "short", "pkg", -1,
+                         base::TimeDelta::FromSeconds(5)));
+  EXPECT_TRUE(manager_.RemoveRequest(short_binder));
+  EXPECT_FALSE(manager_.TriggerTimeoutTickForTesting());
+
+  // The kernel lock should be released once the remaining requests expire.
+  EXPECT_TRUE(manager_.RemoveRequest(forever_binder));
+  ClearFiles();
+  EXPECT_TRUE(AddRequest(long_binder, "long", "pkg", -1,
+                         base::TimeDelta::FromSeconds(1)));
+  clock_->Advance(base::TimeDelta::FromSeconds(1));
+  EXPECT_TRUE(manager_.TriggerTimeoutTickForTesting());
+  EXPECT_EQ(2, manager_.num_expired_requests());
+  EXPECT_EQ(WakeLockManager::kLockName, ReadFile(unlock_path_));
+}
+
+TEST_F(WakeLockManagerTest, Stats) {
+  sp<BBinder> binder1 = binder_wrapper()->CreateLocalBinder();
+  sp<BBinder> binder2 = binder_wrapper()->CreateLocalBinder();
+  EXPECT_TRUE(AddRequest(binder1, "tag", "pkg", 100, base::TimeDelta()));
+  clock_->Advance(base::TimeDelta::FromSeconds(2));
+  EXPECT_TRUE(AddRequest(binder2, "tag", "pkg", 100, base::TimeDelta()));
+  clock_->Advance(base::TimeDelta::FromSeconds(3));
+  EXPECT_TRUE(manager_.RemoveRequest(binder1));
+
+  std::vector<WakeLockStats> stats;
+  manager_.GetStats(&stats);
+  ASSERT_EQ(1u, stats.size());
+  EXPECT_EQ(100u, stats[0].uid);
+  EXPECT_EQ(2, stats[0].acquire_count);
+  EXPECT_EQ(1, stats[0].active_count);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(8), stats[0].total_hold_time);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(5), stats[0].max_hold_time);
+
+  // Updating a request with a different tag should start a new entry, and
+  // binder death should end the request's hold time.
+  EXPECT_TRUE(AddRequest(binder2, "other", "pkg", 100, base::TimeDelta()));
+  clock_->Advance(base::TimeDelta::FromSeconds(1));
+  binder_wrapper()->NotifyAboutBinderDeath(binder2);
+  base::RunLoop().RunUntilIdle();
+  manager_.GetStats(&stats);
+  ASSERT_EQ(2u, stats.size());
+  EXPECT_EQ(0, stats[0].active_count);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(8), stats[0].total_hold_time);
+  EXPECT_EQ("other", stats[1].tag);
+  EXPECT_EQ(0, stats[1].active_count);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(1), stats[1].total_hold_time);
+}
+
+TEST_F(WakeLockManagerTest, WorkSource) {
+  sp<BBinder> binder = binder_wrapper()->CreateLocalBinder();
+  EXPECT_TRUE(AddRequest(binder, "tag", "pkg", 100, base::TimeDelta()));
+  clock_->Advance(base::TimeDelta::FromSeconds(2));
+
+  // Once the request has a work source, its time should be split among the
+  // work source's uids instead of going to the requester.
+  const uid_t kUids[] = {1, 2, 3, 4, 5, 6};
+  EXPECT_TRUE(manager_.UpdateRequestUids(binder, kUids, arraysize(kUids)));
+  clock_->Advance(base::TimeDelta::FromSeconds(6));
+
+  // Clearing the work source should return the blame to the requester.
+  EXPECT_TRUE(manager_.UpdateRequestUids(binder, nullptr, 0));
+  clock_->Advance(base::TimeDelta::FromSeconds(1));
+
+  std::vector<WakeLockStats> stats;
+  manager_.GetStats(&stats);
+  ASSERT_EQ(arraysize(kUids) + 1, stats.size());
+  EXPECT_EQ(100u, stats[0].uid);
+  EXPECT_EQ(1, stats[0].active_count);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(3), stats[0].blamed_hold_time);
+  for (size_t i = 0; i < arraysize(kUids); ++i) {
+    EXPECT_EQ(kUids[i], stats[i + 1].uid);
+    EXPECT_EQ(0, stats[i + 1].active_count);
+    EXPECT_EQ(base::TimeDelta::FromSeconds(6), stats[i + 1].total_hold_time);
+    EXPECT_EQ(base::TimeDelta::FromSeconds(1), stats[i + 1].blamed_hold_time);
+  }
+
+  // Duplicate uids should only be charged once.
+  const uid_t kDuplicateUids[] = {1, 2, 1};
+  EXPECT_TRUE(manager_.UpdateRequestUids(binder, kDuplicateUids,
+                                         arraysize(kDuplicateUids)));
+  clock_->Advance(base::TimeDelta::FromSeconds(2));
+  EXPECT_TRUE(manager_.RemoveRequest(binder));
+  manager_.GetStats(&stats);
+  ASSERT_EQ(arraysize(kUids) + 1, stats.size());
+  for (size_t i = 1; i <= 2; ++i) {
+    EXPECT_EQ(i, stats[i].uid);
+    EXPECT_EQ(2, stats[i].acquire_count);
+    EXPECT_EQ(base::TimeDelta::FromSeconds(8), stats[i].total_hold_time);
+    EXPECT_EQ(base::TimeDelta::FromSeconds(2), stats[i].blamed_hold_time);
+  }
+
+  // Updating an unknown request should fail.
+  sp<BBinder> other_binder = binder_wrapper()->CreateLocalBinder();
+  EXPECT_FALSE(manager_.UpdateRequestUids(other_binder, kUids, 1));
+}
+
+TEST_F(WakeLockManagerTest, EventLog) {
+  // The request's events and the kernel lock's events are logged separately
+  // and merged by time.
+  sp<BBinder> binder = binder_wrapper()->CreateLocalBinder();
+  EXPECT_TRUE(AddRequest(binder, "foo", "bar", 5, base::TimeDelta()));
+  clock_->Advance(base::TimeDelta::FromMilliseconds(1));
+  EXPECT_TRUE(AddRequest(binder, "foo", "bar", 5, base::TimeDelta()));
+  clock_->Advance(base::TimeDelta::FromMilliseconds(1));
+  binder_wrapper()->NotifyAboutBinderDeath(binder);
+  base::RunLoop().RunUntilIdle();
+
+  using EventType = WakeLockEventLog::EventType;
+  std::vector<WakeLockEventLog::Event> events;
+  manager_.GetEventsForTesting(&events);
+  ASSERT_EQ(6u, events.size());
+  EXPECT_EQ(EventType::ADD_REQUEST, events[0].type);
+  EXPECT_EQ(5u, events[0].uid);
+  EXPECT_STREQ("foo", events[0].tag);
+  EXPECT_EQ(EventType::KERNEL_LOCK, events[1].type);
+  EXPECT_EQ(EventType::UPDATE_REQUEST, events[2].type);
+  EXPECT_EQ(EventType::BINDER_DEATH, events[3].type);
+  EXPECT_EQ(EventType::REMOVE_REQUEST, events[4].type);
+  EXPECT_EQ(EventType::KERNEL_UNLOCK, events[5].type);
+
+  // A single summary should be scheduled for the burst of events.
+  EXPECT_TRUE(manager_.TriggerEventSummaryForTesting());
+  EXPECT_FALSE(manager_.TriggerEventSummaryForTesting());
+
+  std::string output;
+  manager_.DumpEvents(true /* drain */, &output);
+  EXPECT_NE(std::string::npos, output.find("tag=\"foo\""));
+  EXPECT_LT(output.find("add"), output.find("kernel-unlock"));
+  manager_.GetEventsForTesting(&events);
+  EXPECT_TRUE(events.empty());
+}
+
+TEST_F(WakeLockManagerTest, ReuseDeathRegistration) {
+  // Re-adding a request for a binder shortly after removing its previous one
+  // should reuse the binder's death notification.
+  sp<BBinder> binder = binder_wrapper()->CreateLocalBinder();
+  EXPECT_TRUE(AddRequest(binder, "foo", "bar", -1, base::TimeDelta()));
+  EXPECT_TRUE(manager_.RemoveRequest(binder));
+  EXPECT_TRUE(AddRequest(binder, "foo", "bar", -1, base::TimeDelta()));
+  EXPECT_EQ(1, manager_.num_death_registrations());
+
+  // Once a removed request's registration has been dropped, a new request
+  // should register again.
+  EXPECT_TRUE(manager_.RemoveRequest(binder));
+  EXPECT_TRUE(manager_.TriggerUnregisterTimeoutForTesting());
+  EXPECT_FALSE(manager_.TriggerUnregisterTimeoutForTesting());
+  EXPECT_TRUE(AddRequest(binder, "foo", "bar", -1, base::TimeDelta()));
+  EXPECT_EQ(2, manager_.num_death_registrations());
+
+  // The death of a binder without a request shouldn't do anything.
+  EXPECT_TRUE(manager_.RemoveRequest(binder));
+  ClearFiles();
+  binder_wrapper()->NotifyAboutBinderDeath(binder);
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(0, manager_.num_requests());
+  EXPECT_EQ("", ReadFile(lock_path_));
+  EXPECT_TRUE(AddRequest(binder, "foo", "bar", -1, base::TimeDelta()));
+  EXPECT_EQ(3, manager_.num_death_registrations());
+}
+
+TEST_F(WakeLockManagerTest, Batch) {
+  sp<BBinder> binder1 = binder_wrapper()->CreateLocalBinder();
+  sp<BBinder> binder2 = binder_wrapper()->CreateLocalBinder();
+  EXPECT_TRUE(AddRequest(binder1, "1", "1", -1, base::TimeDelta()));
+  EXPECT_EQ(1, manager_.num_kernel_locks());
+
+  // Replacing one request with another in a batch shouldn't touch the kernel
+  // lock, even though no requests are active partway through.
+  ClearFiles();
+  manager_.BeginBatch();
+  EXPECT_TRUE(manager_.RemoveRequest(binder1));
+  EXPECT_TRUE(AddRequest(binder2, "2", "2", -1, base::TimeDelta()));
+  EXPECT_TRUE(manager_.EndBatch());
+  EXPECT_EQ("", ReadFile(lock_path_));
   EXPECT_EQ("", ReadFile(unlock_path_));
+  EXPECT_EQ(0, manager_.num_kernel_unlocks());
+
+  // Once a batch leaves no requests active, the lock should be released.
+  manager_.BeginBatch();
+  EXPECT_TRUE(AddRequest(binder1, "1", "1", -1, base::TimeDelta()));
+  EXPECT_TRUE(manager_.RemoveRequest(binder1));
+  EXPECT_TRUE(manager_.RemoveRequest(binder2));
+  EXPECT_EQ("", ReadFile(unlock_path_));
+  EXPECT_TRUE(manager_.EndBatch());
+  EXPECT_EQ(WakeLockManager::kLockName, ReadFile(unlock_path_));
+  EXPECT_EQ(1, manager_.num_kernel_locks());
+  EXPECT_EQ(1, manager_.num_kernel_unlocks());
+}
+
+TEST_F(WakeLockManagerTest, ConcurrentRequests) {
+  const int kNumThreads = 8;
+  const int kBindersPerThread = 16;
+  const int kNumIterations = 200;
+
+  // The stub binder wrapper isn't thread-safe, so binders are created before
+  // any threads start.
+  std::vector<std::unique_ptr<RequestChurner>> churners;
+  for (int i = 0; i < kNumThreads; ++i) {
+    std::vector<sp<BBinder>> binders;
+    for (int j = 0; j < kBindersPerThread; ++j)
+      binders.push_back(binder_wrapper()->CreateLocalBinder());
+    churners.emplace_back(
+        new RequestChurner(&manager_, binders, kNumIterations));
+  }
+
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back(new base::DelegateSimpleThread(
+        churners[i].get(), base::StringPrintf("churner%d", i)));
+    threads.back()->Start();
+  }
+  for (const auto& thread : threads)
+    thread->Join();
+
+  // Every acquisition of the kernel lock should have been paired with a
+  // release, with nothing left behind.
+  EXPECT_EQ(0, manager_.num_requests());
+  EXPECT_FALSE(manager_.kernel_lock_held());
+  EXPECT_GE(manager_.num_kernel_locks(), 1);
+  EXPECT_EQ(manager_.num_kernel_locks(), manager_.num_kernel_unlocks());
+  EXPECT_EQ(WakeLockManager::kLockName, ReadFile(unlock_path_));
+
+  std::vector<WakeLockStats> stats;
+  manager_.GetStats(&stats);
+  ASSERT_EQ(1u, stats.size());
+  EXPECT_EQ(0, stats[0].active_count);
+  EXPECT_EQ(kNumThreads * kBindersPerThread * kNumIterations,
+            stats[0].acquire_count);
 }
 
 }  // namespace android
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "wake_lock_stats_table.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <base/logging.h>
+#include <utils/String16.h>
+
+namespace android {
+
+const char WakeLockStatsTable::kOverflowTag[] = "*overflow*";
+
+size_t WakeLockStatsTable::KeyHash::operator()(const Key& key) const {
+  size_t hash = key.tag;
+  hash = hash * 31 + key.package;
+  return hash * 31 + key.uid;
+}
+
+WakeLockStatsTable::Entry::Entry()
+    : acquire_count(0),
+      active_count(0),
+      active_share(0.0),
+      active_share_acquire_us(0.0) {}
+
+WakeLockStatsTable::WakeLockStatsTable(StringPool* pool, size_t max_entries)
+    : pool_(pool),
+      max_entries_(max_entries),
+      overflow_index_(-1) {
+  DCHECK(pool_);
+  DCHECK_GT(max_entries_, 0u);
+}
+
+WakeLockStatsTable::~WakeLockStatsTable() {
+  for (const Key& key : keys_) {
+    pool_->Release(key.package);
+    pool_->Release(key.tag);
+  }
+}
+
+size_t WakeLockStatsTable::RecordAcquire(uid_t uid,
+                                         StringPool::Handle package,
+                                         StringPool::Handle tag,
+                                         base::TimeTicks now,
+                                         int num_owners) {
+  DCHECK_GT(num_owners, 0);
+  Key key;
+  key.uid = uid;
+  key.package = package;
+  key.tag = tag;
+
+  size_t index = 0;
+  auto it = indices_.find(key);
+  if (it != indices_.end()) {
+    index = it->second;
+  } else if (overflow_index_ >= 0) {
+    index = overflow_index_;
+  } else {
+    // The last available entry is used for overflow.
+    if (entries_.size() + 1 == max_entries_) {
+      LOG(WARNING) << "Wake lock stats table is full; aggregating new keys";
+      key.uid = -1;
+      key.package = pool_->Intern(String16());
+      key.tag = pool_->Intern(String16(kOverflowTag));
+    } else {
+      pool_->AddRef(key.package);
+      pool_->AddRef(key.tag);
+    }
+    index = entries_.size();
+    entries_.push_back(Entry());
+    keys_.push_back(key);
+    indices_.insert(std::make_pair(key, index));
+    if (entries_.size() == max_entries_)
+      overflow_index_ = index;
+  }
+
+  Entry& entry = entries_[index];
+  entry.acquire_count++;
+  entry.active_count++;
+  entry.active_acquire_time_sum += now - base::TimeTicks();
+  entry.active_share += 1.0 / num_owners;
+  const int64_t now_us = (now - base::TimeTicks()).InMicroseconds();
+  entry.active_share_acquire_us += static_cast<double>(now_us) / num_owners;
+  return index;
+}
+
+void WakeLockStatsTable::RecordRelease(size_t handle,
+                                       base::TimeTicks acquire_time,
+                                       base::TimeTicks now,
+                                       int num_owners) {
+  DCHECK_LT(handle, entries_.size());
+  DCHECK_GT(num_owners, 0);
+  Entry& entry = entries_[handle];
+  DCHECK_GT(entry.active_count, 0);
+
+  const base::TimeDelta held = now - acquire_time;
+  entry.active_count--;
+  entry.active_acquire_time_sum -= acquire_time - base::TimeTicks();
+  entry.total_hold_time += held;
+  entry.max_hold_time = std::max(entry.max_hold_time, held);
+  entry.blamed_hold_time += held / num_owners;
+
+  // Reset the floating-point sums once nothing is held so that rounding errors
+  // don't accumulate.
+  if (entry.active_count == 0) {
+    entry.active_share = 0.0;
+    entry.active_share_acquire_us = 0.0;
+  } else {
+    entry.active_share -= 1.0 / num_owners;
+    const int64_t acquire_us =
+        (acquire_time - base::TimeTicks()).InMicroseconds();
+    entry.active_share_acquire_us -=
+        static_cast<double>(acquire_us) / num_owners;
+  }
+}
+
+void WakeLockStatsTable::GetStats(base::TimeTicks now,
+                                  std::vector<WakeLockStats>* stats) const {
+  DCHECK(stats);
+  stats->clear();
+  stats->reserve(entries_.size());
+  const base::TimeDelta since_origin = now - base::TimeTicks();
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    const Entry& entry = entries_[i];
+    const Key& key = keys_[i];
+    WakeLockStats out;
+    out.uid = key.uid;
+    out.package = pool_->Get(key.package);
+    out.tag = pool_->Get(key.tag);
+    out.acquire_count = entry.acquire_count;
+    out.active_count = entry.active_count;
+    out.total_hold_time = entry.total_hold_time +
+        since_origin * entry.active_count - entry.active_acquire_time_sum;
+    out.max_hold_time = entry.max_hold_time;
+    out.blamed_hold_time = entry.blamed_hold_time +
+        base::TimeDelta::FromMicroseconds(static_cast<int64_t>(
+            entry.active_share * since_origin.InMicroseconds() -
+            entry.active_share_acquire_us));
+    stats->push_back(out);
+  }
+}
+
+}  // namespace android
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSTEM_NATIVEPOWER_DAEMON_WAKE_LOCK_STATS_TABLE_H_
+#define SYSTEM_NATIVEPOWER_DAEMON_WAKE_LOCK_STATS_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include <base/macros.h>
+#include <base/time/time.h>
+#include <nativepower/wake_lock_stats.h>
+
+#include "string_pool.h"
+
+namespace android {
+
+// Aggregates wake lock hold times by (uid, package, tag), with the package and
+// tag identified by handles from a StringPool. The table holds a reference to
+// each handle that it uses as a key.
+//
+// RecordAcquire() returns a handle identifying the aggregate entry, which the
+// caller stores alongside the request so that RecordRelease() can update the
+// entry without another lookup. Entries are never removed; once |max_entries|
+// distinct keys have been seen, further keys are folded into a single overflow
+// entry.
+class WakeLockStatsTable {
+ public:
+  // Tag reported for the overflow entry.
+  static const char kOverflowTag[];
+
+  // |pool| must outlive this object.
+  WakeLockStatsTable(StringPool* pool, size_t max_entries);
+  ~WakeLockStatsTable();
+
+  size_t size() const { return entries_.size(); }
+
+  // Records that a lock with the given key was acquired at |now|. Returns a
+  // handle to pass to RecordRelease(). A lock held on behalf of several uids is
+  // recorded once per uid with |num_owners| set to the number of uids, so that
+  // each is blamed for an equal share of the hold time.
+  size_t RecordAcquire(uid_t uid,
+                       StringPool::Handle package,
+                       StringPool::Handle tag,
+                       base::TimeTicks now,
+                       int num_owners = 1);
+
+  // Records that a lock previously passed to RecordAcquire() (which returned
+  // |handle| and was called at |acquire_time| with |num_owners|) was released
+  // at |now|.
+  void RecordRelease(size_t handle,
+                     base::TimeTicks acquire_time,
+                     base::TimeTicks now,
+                     int num_owners = 1);
+
+  // Copies all entries to |stats|, crediting locks that are still held with
+  // the time that they've been held so far.
+  void GetStats(base::TimeTicks now, std::vector<WakeLockStats>* stats) const;
+
+ private:
+  struct Key {
+    bool operator==(const Key& other) const {
+      return uid == other.uid && package == other.package && tag == other.tag;
+    }
+
+    uid_t uid;
+    StringPool::Handle package;
+    StringPool::Handle tag;
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+
+  struct Entry {
+    Entry();
+
+    int64_t acquire_count;
+    int active_count;
+    base::TimeDelta total_hold_time;
+    base::TimeDelta max_hold_time;
+
+    // Sum of the acquisition times of currently-held locks, relative to
+    // base::TimeTicks(). Along with |active_count|, this gives the total time
+    // accrued by held locks in constant time.
+    base::TimeDelta active_acquire_time_sum;
+
+    // Hold time divided among each lock's owners.
+    base::TimeDelta blamed_hold_time;
+
+    // Sums of 1 / num_owners and of the acquisition times (in microseconds)
+    // divided by num_owners over currently-held locks, giving the share of
+    // time accrued by held locks in constant time.
+    double active_share;
+    double active_share_acquire_us;
+  };
+
+  StringPool* pool_;  // Not owned.
+
+  const size_t max_entries_;
+
+  // Maps keys to indices in |entries_| and |keys_|.
+  std::unordered_map<Key, size_t, KeyHash> indices_;
+
+  std::vector<Entry> entries_;
+  std::vector<Key> keys_;
+
+  // Index of the overflow entry, or -1 if it hasn't been created yet.
+  ssize_t overflow_index_;
+
+  DISALLOW_COPY_AND_ASSIGN(WakeLockStatsTable);
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_DAEMON_WAKE_LOCK_STATS_TABLE_H_
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+
+#include <base/time/time.h>
+#include <gtest/gtest.h>
+#include <nativepower/wake_lock_stats.h>
+#include <utils/String16.h>
+
+#include "string_pool.h"
+#include "wake_lock_stats_table.h"
+
+namespace android {
+
+TEST(WakeLockStatsTableTest, AccumulatesHoldTimes) {
+  StringPool pool;
+  WakeLockStatsTable table(&pool, 16);
+  const StringPool::Handle pkg = pool.Intern(String16("pkg"));
+  const StringPool::Handle tag = pool.Intern(String16("tag"));
+  const base::TimeTicks start =
+      base::TimeTicks() + base::TimeDelta::FromSeconds(100);
+
+  // Two overlapping locks with the same key should share an entry.
+  const size_t first = table.RecordAcquire(1, pkg, tag, start);
+  const size_t second = table.RecordAcquire(
+      1, pkg, tag, start + base::TimeDelta::FromSeconds(1));
+  EXPECT_EQ(first, second);
+  const size_t other = table.RecordAcquire(2, pkg, tag, start);
+
+  // The table should keep its keys' strings alive.
+  pool.Release(pkg);
+  pool.Release(tag);
+  EXPECT_EQ(2u, pool.size());
+  EXPECT_NE(first, other);
+  EXPECT_EQ(2u, table.size());
+
+  table.RecordRelease(first, start, start + base::TimeDelta::FromSeconds(3));
+
+  // The lock that's still held should be credited with its time so far.
+  std::vector<WakeLockStats> stats;
+  table.GetStats(start + base::TimeDelta::FromSeconds(5), &stats);
+  ASSERT_EQ(2u, stats.size());
+  EXPECT_EQ(1u, stats[0].uid);
+  EXPECT_EQ("pkg", stats[0].package);
+  EXPECT_EQ("tag", stats[0].tag);
+  EXPECT_EQ(2, stats[0].acquire_count);
+  EXPECT_EQ(1, stats[0].active_count);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(7), stats[0].total_hold_time);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(3), stats[0].max_hold_time);
+
+  EXPECT_EQ(2u, stats[1].uid);
+  EXPECT_EQ(1, stats[1].active_count);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(5), stats[1].total_hold_time);
+  EXPECT_EQ(base::TimeDelta(), stats[1].max_hold_time);
+
+  // Locks with a single owner should be blamed for all of their time.
+  EXPECT_EQ(stats[0].total_hold_time, stats[0].blamed_hold_time);
+  EXPECT_EQ(stats[1].total_hold_time, stats[1].blamed_hold_time);
+}
+
+TEST(WakeLockStatsTableTest, SplitBlame) {
+  StringPool pool;
+  WakeLockStatsTable table(&pool, 16);
+  const StringPool::Handle pkg = pool.Intern(String16("pkg"));
+  const StringPool::Handle tag = pool.Intern(String16("tag"));
+  const base::TimeTicks start =
+      base::TimeTicks() + base::TimeDelta::FromSeconds(100);
+
+  // A lock held for six seconds on behalf of three uids should blame each of
+  // them for two seconds.
+  const uid_t kUids[] = {1, 2, 3};
+  std::vector<size_t> handles;
+  for (uid_t uid : kUids)
+    handles.push_back(table.RecordAcquire(uid, pkg, tag, start, 3));
+  for (size_t handle : handles) {
+    table.RecordRelease(handle, start, start + base::TimeDelta::FromSeconds(6),
+                        3);
+  }
+
+  // A lock that's still held on behalf of two uids should be split too.
+  table.RecordAcquire(1, pkg, tag, start, 2);
+  table.RecordAcquire(2, pkg, tag, start, 2);
+
+  std::vector<WakeLockStats> stats;
+  table.GetStats(start + base::TimeDelta::FromSeconds(8), &stats);
+  ASSERT_EQ(3u, stats.size());
+  EXPECT_EQ(1u, stats[0].uid);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(14), stats[0].total_hold_time);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(6), stats[0].blamed_hold_time);
+  EXPECT_EQ(2u, stats[1].uid);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(6), stats[1].blamed_hold_time);
+  EXPECT_EQ(3u, stats[2].uid);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(6), stats[2].total_hold_time);
+  EXPECT_EQ(base::TimeDelta::FromSeconds(2), stats[2].blamed_hold_time);
+}
+
+TEST(WakeLockStatsTableTest, Overflow) {
+  const size_t kMaxEntries = 3;
+  StringPool pool;
+  WakeLockStatsTable table(&pool, kMaxEntries);
+  const StringPool::Handle pkg = pool.Intern(String16("pkg"));
+  const base::TimeTicks now =
+      base::TimeTicks() + base::TimeDelta::FromSeconds(1);
+
+  const StringPool::Handle tag_a = pool.Intern(String16("a"));
+  const size_t a = table.RecordAcquire(1, pkg, tag_a, now);
+  const size_t b = table.RecordAcquire(1, pkg, pool.Intern(String16("b")), now);
+  const size_t c = table.RecordAcquire(1, pkg, pool.Intern(String16("c")), now);
+  const size_t d = table.RecordAcquire(1, pkg, pool.Intern(String16("d")), now);
+  EXPECT_NE(a, b);
+  EXPECT_EQ(c, d);
+  EXPECT_EQ(kMaxEntries, table.size());
+
+  // Known keys should still get their own entries.
+  EXPECT_EQ(a, table.RecordAcquire(1, pkg, tag_a, now));
+
+  std::vector<WakeLockStats> stats;
+  table.GetStats(now, &stats);
+  ASSERT_EQ(kMaxEntries, stats.size());
+  EXPECT_EQ(WakeLockStatsTable::kOverflowTag, stats[2].tag);
+  EXPECT_EQ(2, stats[2].acquire_count);
+}
+
+}  // namespace android
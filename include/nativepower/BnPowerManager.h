@@ -17,14 +17,83 @@
 #ifndef SYSTEM_NATIVEPOWER_INCLUDE_NATIVEPOWER_BN_POWER_MANAGER_H_
 #define SYSTEM_NATIVEPOWER_INCLUDE_NATIVEPOWER_BN_POWER_MANAGER_H_
 
+#include <vector>
+
 #include <binder/IInterface.h>
+#include <nativepower/suspend_latency_stats.h>
+#include <nativepower/wake_lock_stats.h>
 #include <powermanager/IPowerManager.h>
+#include <utils/String16.h>
 
 namespace android {
 
 // Receiver-side binder implementation.
 class BnPowerManager : public BnInterface<IPowerManager> {
 public:
+  // Codes for nativepower-specific transactions that aren't part of
+  // IPowerManager. They're allocated well above IPowerManager's codes so that
+  // methods added to it upstream won't collide with them.
+  enum {
+    ACQUIRE_WAKE_LOCK_WITH_TIMEOUT = IBinder::FIRST_CALL_TRANSACTION + 1000,
+    GET_WAKE_LOCK_STATS,
+    UPDATE_WAKE_LOCKS,
+    GET_SUSPEND_LATENCY_STATS,
+  };
+
+  // Maximum number of updates in an UPDATE_WAKE_LOCKS transaction.
+  static const int kMaxWakeLockUpdates = 1024;
+
+  enum WakeLockUpdateType {
+    WAKE_LOCK_UPDATE_ACQUIRE = 0,
+    WAKE_LOCK_UPDATE_RELEASE = 1,
+  };
+
+  // A single acquisition or release within an UPDATE_WAKE_LOCKS transaction.
+  // The transaction's parcel contains an int32 count followed by each update's
+  // int32 type and binder. Acquisitions additionally contain int32 flags,
+  // String16 tag and package name, and an int64 timeout in milliseconds (zero
+  // for none).
+  struct WakeLockUpdate {
+    WakeLockUpdate()
+        : type(WAKE_LOCK_UPDATE_ACQUIRE), flags(0), timeout_ms(0) {}
+
+    WakeLockUpdateType type;
+    sp<IBinder> lock;
+
+    // Only used for acquisitions.
+    int flags;
+    String16 tag;
+    String16 package_name;
+    int64_t timeout_ms;
+  };
+
+  // Like acquireWakeLock(), but the request is dropped automatically if it
+  // hasn't been released within |timeout_ms| milliseconds.
+  virtual status_t acquireWakeLockWithTimeout(int flags,
+                                              const sp<IBinder>& lock,
+                                              const String16& tag,
+                                              const String16& packageName,
+                                              int64_t timeout_ms) = 0;
+
+  // Copies cumulative wake lock statistics to |stats|. Returns
+  // PERMISSION_DENIED unless the caller is root or system.
+  virtual status_t getWakeLockStats(std::vector<WakeLockStats>* stats) = 0;
+
+  // Copies cumulative suspend and resume latency histograms to |stats|. The
+  // reply contains each of SuspendLatencyStats's distributions in order, each
+  // written as int64 count, min, max, total, p50, p90 and p99 (durations in
+  // microseconds), followed by an int32 bucket count and each bucket's int64
+  // upper bound in microseconds and int64 count.
+  virtual status_t getSuspendLatencyStats(SuspendLatencyStats* stats) = 0;
+
+  // Applies |updates| in order as a single operation, so that the kernel wake
+  // lock is only updated once all of them have been processed. Releases of
+  // unknown locks (e.g. ones that already timed out) are ignored. The parcel is
+  // fully validated before this is called, so malformed batches are rejected
+  // without any of their updates being applied.
+  virtual status_t updateWakeLocks(
+      const std::vector<WakeLockUpdate>& updates) = 0;
+
   // BnInterface:
   status_t onTransact(uint32_t code,
                       const Parcel& data,
@@ -14,17 +14,31 @@
  * limitations under the License.
  */
 
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include <base/callback.h>
 #include <base/macros.h>
+#include <base/memory/ref_counted.h>
 #include <base/memory/weak_ptr.h>
+#include <base/single_thread_task_runner.h>
+#include <base/threading/thread.h>
 #include <base/time/time.h>
+#include <base/timer/timer.h>
+#include <nativepower/suspend_latency_stats.h>
 #include <nativepower/wake_lock.h>
+#include <nativepower/wake_lock_stats.h>
 #include <powermanager/IPowerManager.h>
 #include <utils/StrongPointer.h>
 
 namespace android {
 
+class ScopedWakeLock;
+
 // Reasons that can be passed to PowerManagerClient::Suspend().
 enum class SuspendReason {
   // These values must match the ones in android.os.PowerManager.
@@ -54,17 +68,99 @@ enum class RebootReason {
   RECOVERY,
 };
 
+// Describes a wake lock to be created by PowerManagerClient::UpdateWakeLocks().
+struct WakeLockSpec {
+  WakeLockSpec(const std::string& tag, const std::string& package)
+      : tag(tag), package(package) {}
+
+  std::string tag;
+  std::string package;
+
+  // If nonzero, the power manager drops the lock once this elapses.
+  base::TimeDelta timeout;
+};
+
 // Class used to communicate with the system power manager.
 //
-// android::BinderWrapper must be initialized before constructing this class.
+// If the power manager dies, the client periodically looks up the service
+// again (waiting longer after each failed attempt, up to a limit) and then
+// re-acquires all of its live WakeLocks from the new instance in a single
+// batch. The locks aren't honored in between.
+//
+// android::BinderWrapper must be initialized before constructing this class,
+// and the calling thread must have a message loop.
 class PowerManagerClient {
  public:
+  // Run after reconnecting to a restarted power manager and re-acquiring the
+  // client's wake locks, with the time since the previous instance died.
+  using ReconnectCallback = base::Callback<void(base::TimeDelta gap)>;
+
+  // Run when an acquisition started by CreateWakeLockAsync() completes.
+  using AcquireCallback = base::Callback<void(bool success)>;
+
+  // Counts of how lock binders were obtained and disposed of.
+  struct BinderPoolStats {
+    BinderPoolStats();
+
+    // Binders created because the pool was empty.
+    int num_created;
+
+    // Binders taken from the pool.
+    int num_reused;
+
+    // Released binders returned to the pool.
+    int num_recycled;
+
+    // Released binders dropped because the pool was full.
+    int num_discarded;
+  };
+
   PowerManagerClient();
   ~PowerManagerClient();
 
   // This should not be used directly; it's just exposed for WakeLock.
   const sp<IPowerManager>& power_manager() { return power_manager_; }
 
+  void set_reconnect_callback(const ReconnectCallback& callback) {
+    reconnect_callback_ = callback;
+  }
+
+  // If |coalesce| is true, each lock created by CreateWakeLock() shares a
+  // single power manager request with the client's other live locks that have
+  // the same tag and package, so only the first acquisition and the last
+  // release in each group make binder transactions. This suits processes that
+  // create many short-lived locks with the same tag, at the cost of
+  // per-lock counts in the power manager's stats and event log. Locks with
+  // timeouts and locks created by UpdateWakeLocks() are never coalesced. Must
+  // be called before any locks are created.
+  void set_coalesce_wake_locks(bool coalesce) {
+    coalesce_wake_locks_ = coalesce;
+  }
+
+  // Number of locks that joined an existing shared request instead of making
+  // a transaction.
+  int num_coalesced_acquires() const { return num_coalesced_acquires_; }
+
+  // Sets the maximum number of local lock binders kept for reuse by later
+  // locks, saving the cost of creating binder objects for high-churn users.
+  // When nonzero, locks are released synchronously on a background thread,
+  // and their binders are pooled once the power manager confirms the release.
+  // Binders that the power manager never held are pooled immediately. Zero
+  // (the default) disables pooling.
+  void set_max_pooled_binders(size_t max_binders) {
+    max_pooled_binders_ = max_binders;
+  }
+
+  const BinderPoolStats& binder_pool_stats() const {
+    return binder_pool_stats_;
+  }
+  size_t num_pooled_binders() const { return binder_pool_.size(); }
+
+  // Number of times that the client has reconnected after the power manager
+  // died, and the time that wake locks went unhonored the last time.
+  int num_reconnects() const { return num_reconnects_; }
+  base::TimeDelta last_reconnect_gap() const { return last_reconnect_gap_; }
+
   // Initializes the object, returning true on success. Must be called before
   // any other methods.
   bool Init();
@@ -76,6 +172,50 @@ class PowerManagerClient {
   std::unique_ptr<WakeLock> CreateWakeLock(const std::string& tag,
                                            const std::string& package);
 
+  // Like CreateWakeLock(), but the power manager stops honoring the lock once
+  // |timeout| elapses even if the returned object hasn't been destroyed. This
+  // guards against locks leaked by long-running processes.
+  std::unique_ptr<WakeLock> CreateWakeLockWithTimeout(
+      const std::string& tag,
+      const std::string& package,
+      base::TimeDelta timeout);
+
+  // Like CreateWakeLockWithTimeout() (with a zero |timeout| meaning no
+  // timeout), but returns without waiting for the power manager. The request is
+  // sent on a background thread, and |callback| is run on the calling thread's
+  // message loop once it completes; on failure, the returned lock should be
+  // destroyed. If the lock is destroyed first, |callback| isn't run and the
+  // lock is released as soon as the acquisition finishes. An empty pointer is
+  // only returned if there's no connection to the power manager. These locks
+  // are never coalesced.
+  std::unique_ptr<WakeLock> CreateWakeLockAsync(
+      const std::string& tag,
+      const std::string& package,
+      base::TimeDelta timeout,
+      const AcquireCallback& callback);
+
+  // Releases |locks_to_release| and creates locks described by |new_locks| via
+  // a single transaction, which the power manager applies atomically: the
+  // kernel wake lock is only updated after all of the changes are made, so
+  // replacing a set of locks never lets the system suspend in between. On
+  // success, |locks_to_release| is cleared, the new locks are appended to
+  // |created_locks| in the order of |new_locks|, and true is returned. On
+  // failure, |locks_to_release| and |created_locks| are left unchanged. At
+  // most BnPowerManager::kMaxWakeLockUpdates changes may be made at once.
+  bool UpdateWakeLocks(
+      const std::vector<WakeLockSpec>& new_locks,
+      std::vector<std::unique_ptr<WakeLock>>* locks_to_release,
+      std::vector<std::unique_ptr<WakeLock>>* created_locks);
+
+  // Copies cumulative per-(uid, package, tag) wake lock statistics from the
+  // power manager to |stats|, returning true on success. Only root and system
+  // callers may read the statistics.
+  bool GetWakeLockStats(std::vector<WakeLockStats>* stats);
+
+  // Copies cumulative suspend and resume latency histograms from the power
+  // manager to |stats|, returning true on success.
+  bool GetSuspendLatencyStats(SuspendLatencyStats* stats);
+
   // Suspends the system immediately, returning true on success.
   //
   // |event_uptime| contains the time since the system was booted (e.g.
@@ -90,13 +230,119 @@ class PowerManagerClient {
   bool ShutDown(ShutdownReason reason);
   bool Reboot(RebootReason reason);
 
+  // Makes the pending reconnection attempt immediately. Returns false if none
+  // was pending.
+  bool TriggerReconnectForTesting();
+
+  // Waits for all requests made on the IPC thread to complete and for their
+  // replies to be handled.
+  void FlushIpcThreadForTesting();
+
  private:
+  friend class ScopedWakeLock;
+  friend class WakeLock;
+
+  // Looks up the power manager service and registers for notification of its
+  // death. Returns true on success.
+  bool Connect();
+
+  // Called by WakeLock's constructor and destructor.
+  void AddWakeLock(WakeLock* lock);
+  void RemoveWakeLock(WakeLock* lock);
+
+  // Called by ScopedWakeLock while it holds its lock and when it's moved.
+  void AddScopedWakeLock(ScopedWakeLock* lock);
+  void RemoveScopedWakeLock(ScopedWakeLock* lock);
+
+  // Called by WakeLock::Init() and WakeLock's destructor for coalesced locks.
+  // AcquireSharedLock() returns true on success.
+  bool AcquireSharedLock(WakeLock* lock);
+  void ReleaseSharedLock(WakeLock* lock);
+
+  // Returns a lock binder from |binder_pool_|, or a new one if it's empty.
+  sp<IBinder> GetLockBinder();
+
+  // Releases |binder|, which was used by a lock identified by |tag|, from the
+  // power manager if |acquired| is true. The binder is recycled once it's no
+  // longer held.
+  void ReleaseLockBinder(const sp<IBinder>& binder,
+                         bool acquired,
+                         const std::string& tag);
+
+  // Called on the main thread once a release sent by ReleaseLockBinder()
+  // completes with |status|.
+  void HandleLockBinderRelease(const sp<IBinder>& binder, status_t status);
+
+  // Adds |binder| to |binder_pool_| if there's room.
+  void RecycleLockBinder(const sp<IBinder>& binder);
+
+  // Returns the task runner for |ipc_thread_|, starting the thread if needed.
+  // Returns null if the thread couldn't be started.
+  scoped_refptr<base::SingleThreadTaskRunner> GetIpcTaskRunner();
+
   // Called in response to |power_manager_|'s binder dying.
   void OnPowerManagerDied();
 
+  // Called by |reconnect_timer_| to reconnect and re-acquire wake locks after
+  // the power manager died. Retries after |reconnect_delay_| on failure.
+  void Reconnect();
+
+  // Acquires all of the requests for |wake_locks_|, |scoped_wake_locks_|, and
+  // |shared_locks_| from the power manager via UPDATE_WAKE_LOCKS transactions.
+  // Returns true on success.
+  bool ReacquireWakeLocks();
+
   // Interface for communicating with the power manager.
   sp<IPowerManager> power_manager_;
 
+  // Live locks created by this client. Not owned.
+  std::set<WakeLock*> wake_locks_;
+
+  // ScopedWakeLocks that are currently held. Not owned.
+  std::set<ScopedWakeLock*> scoped_wake_locks_;
+
+  // Power manager request shared by coalesced locks.
+  struct SharedLock {
+    SharedLock();
+
+    sp<IBinder> binder;
+
+    // Number of live WakeLocks using the request.
+    int num_locks;
+
+    // True if the request is held by the current power manager instance.
+    bool acquired;
+  };
+
+  // Shared requests keyed by (tag, package).
+  using SharedLockKey = std::pair<std::string, std::string>;
+  std::map<SharedLockKey, SharedLock> shared_locks_;
+
+  bool coalesce_wake_locks_;
+  int num_coalesced_acquires_;
+
+  // Local binders that the power manager no longer holds.
+  std::vector<sp<IBinder>> binder_pool_;
+  size_t max_pooled_binders_;
+  BinderPoolStats binder_pool_stats_;
+
+  // Runs Reconnect() while the power manager is unavailable.
+  base::OneShotTimer reconnect_timer_;
+
+  // Delay before the next reconnection attempt.
+  base::TimeDelta reconnect_delay_;
+
+  // Time at which the power manager most recently died.
+  base::TimeTicks death_time_;
+
+  int num_reconnects_;
+  base::TimeDelta last_reconnect_gap_;
+  ReconnectCallback reconnect_callback_;
+
+  // Sends requests for locks created by CreateWakeLockAsync() and, when
+  // pooling binders, releases. Started on demand.
+  base::Thread ipc_thread_;
+
   // Keep this member last.
   base::WeakPtrFactory<PowerManagerClient> weak_ptr_factory_;
 
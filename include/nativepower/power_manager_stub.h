@@ -22,6 +22,7 @@
 #include <vector>
 
 #include <base/macros.h>
+#include <base/time/time.h>
 #include <nativepower/BnPowerManager.h>
 
 namespace android {
@@ -31,6 +32,9 @@ class WakeLockManagerStub;
 // Stub implementation of BnPowerManager for use in tests.
 //
 // The BinderWrapper singleton must be initialized before using this class.
+// One-way calls are queued to the current base::MessageLoop rather than being
+// handled before returning, mirroring how binder delivers them, so a message
+// loop must exist when they're made.
 class PowerManagerStub : public BnPowerManager {
  public:
   PowerManagerStub();
@@ -55,6 +59,26 @@ class PowerManagerStub : public BnPowerManager {
   const std::vector<std::string>& shutdown_reasons() const {
     return shutdown_reasons_;
   }
+  int num_acquires() const { return num_acquires_; }
+  int num_one_way_acquires() const { return num_one_way_acquires_; }
+  int num_one_way_releases() const { return num_one_way_releases_; }
+
+  // Returns the number of one-way releases that have been queued but not yet
+  // handled.
+  int num_pending_one_way_releases() const {
+    return num_pending_one_way_releases_;
+  }
+
+  // Sets the time spent handling each wake lock acquisition, simulating a slow
+  // binder round trip.
+  void set_acquire_latency(base::TimeDelta latency) {
+    acquire_latency_ = latency;
+  }
+
+  // Sets the stats returned by getSuspendLatencyStats().
+  void set_suspend_latency_stats(const SuspendLatencyStats& stats) {
+    suspend_latency_stats_ = stats;
+  }
 
   // Returns the number of currently-registered wake locks.
   int GetNumWakeLocks() const;
@@ -63,6 +87,13 @@ class PowerManagerStub : public BnPowerManager {
   // empty string if no wake lock is present.
   std::string GetWakeLockString(const sp<IBinder>& binder) const;
 
+  // Returns the timeout of the wake lock registered for |binder|, or zero if no
+  // wake lock is present or it has no timeout.
+  base::TimeDelta GetWakeLockTimeout(const sp<IBinder>& binder) const;
+
+  // Returns the number of UPDATE_WAKE_LOCKS transactions that were received.
+  int GetNumWakeLockBatches() const;
+
   // Returns a string describing position |index| in |suspend_requests_|.
   std::string GetSuspendRequestString(size_t index) const;
 
@@ -90,6 +121,14 @@ class PowerManagerStub : public BnPowerManager {
   status_t reboot(bool confirm, const String16& reason, bool wait) override;
   status_t shutdown(bool confirm, const String16& reason, bool wait) override;
   status_t crash(const String16& message) override;
+  status_t acquireWakeLockWithTimeout(int flags,
+                                      const sp<IBinder>& lock,
+                                      const String16& tag,
+                                      const String16& packageName,
+                                      int64_t timeout_ms) override;
+  status_t getWakeLockStats(std::vector<WakeLockStats>* stats) override;
+  status_t getSuspendLatencyStats(SuspendLatencyStats* stats) override;
+  status_t updateWakeLocks(const std::vector<WakeLockUpdate>& updates) override;
 
  private:
   // Details about a request passed to goToSleep().
@@ -101,8 +140,35 @@ class PowerManagerStub : public BnPowerManager {
     int flags;
   };
 
+  // Counts an acquireWakeLock*() call after sleeping for |acquire_latency_|.
+  void HandleAcquire();
+
+  // Adds a request to |wake_lock_manager_| on behalf of a queued one-way
+  // acquireWakeLock() call made by |uid|.
+  void HandleOneWayAcquire(const sp<IBinder>& lock,
+                           const String16& tag,
+                           const String16& package,
+                           uid_t uid);
+
+  // Removes |lock|'s request from |wake_lock_manager_| on behalf of a queued
+  // one-way releaseWakeLock() call.
+  void HandleOneWayRelease(const sp<IBinder>& lock);
+
   std::unique_ptr<WakeLockManagerStub> wake_lock_manager_;
 
+  base::TimeDelta acquire_latency_;
+
+  // Number of acquireWakeLock*() calls.
+  int num_acquires_;
+
+  // Number of acquireWakeLock() calls with |isOneWay| set.
+  int num_one_way_acquires_;
+
+  // Number of releaseWakeLock() calls with |isOneWay| set, and number of
+  // those that haven't been handled yet.
+  int num_one_way_releases_;
+  int num_pending_one_way_releases_;
+
   // Information about calls to goToSleep(), in the order they were made.
   using SuspendRequests = std::vector<SuspendRequest>;
   SuspendRequests suspend_requests_;
@@ -112,6 +178,8 @@ class PowerManagerStub : public BnPowerManager {
   std::vector<std::string> reboot_reasons_;
   std::vector<std::string> shutdown_reasons_;
 
+  SuspendLatencyStats suspend_latency_stats_;
+
   DISALLOW_COPY_AND_ASSIGN(PowerManagerStub);
 };
 
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSTEM_NATIVEPOWER_INCLUDE_NATIVEPOWER_SCOPED_WAKE_LOCK_H_
+#define SYSTEM_NATIVEPOWER_INCLUDE_NATIVEPOWER_SCOPED_WAKE_LOCK_H_
+
+#include <string>
+
+#include <base/macros.h>
+#include <base/time/time.h>
+#include <base/timer/timer.h>
+#include <utils/StrongPointer.h>
+
+namespace android {
+
+class IBinder;
+class PowerManagerClient;
+
+// Movable wake lock that can be stored by value and acquired and released
+// repeatedly, unlike WakeLock, which is heap-allocated by PowerManagerClient
+// and held for its whole lifetime.
+//
+// The lock isn't acquired until Acquire() or AcquireWithTimeout() is called.
+// Acquiring a lock that's already held doesn't contact the power manager.
+// Release() doesn't wait for the power manager, and the destructor releases
+// the lock if it's held. The same binder is used for every acquisition. Like
+// WakeLock, a held lock is re-acquired if the power manager restarts. The
+// client must outlive the lock, and all methods must be called on the client's
+// thread.
+class ScopedWakeLock {
+ public:
+  // Creates an empty lock that can't be acquired. Useful as a placeholder to
+  // be assigned later.
+  ScopedWakeLock();
+
+  // Ownership of |client| remains with the caller.
+  ScopedWakeLock(PowerManagerClient* client,
+                 const std::string& tag,
+                 const std::string& package);
+
+  // The moved-from lock is left empty. If it was held, the new lock holds it
+  // without contacting the power manager.
+  ScopedWakeLock(ScopedWakeLock&& other);
+  ScopedWakeLock& operator=(ScopedWakeLock&& other);
+
+  ~ScopedWakeLock();
+
+  bool is_held() const { return held_; }
+
+  // Acquires the lock if it isn't already held, returning true on success.
+  // Cancels a pending timeout from AcquireWithTimeout().
+  bool Acquire();
+
+  // Like Acquire(), but Release() is called automatically once |timeout|
+  // elapses. If the lock is already held, its timeout is replaced without
+  // contacting the power manager. The timeout is tracked by the client rather
+  // than by the power manager, so it requires a message loop.
+  bool AcquireWithTimeout(base::TimeDelta timeout);
+
+  // Releases the lock if it's held.
+  void Release();
+
+ private:
+  friend class PowerManagerClient;
+
+  // Releases the lock if it's held and gives up |binder_|, returning it to
+  // the client's pool if the power manager can't still be holding it.
+  void ReleaseBinder();
+
+  // Takes |other|'s state, leaving it empty. The lock must not be held.
+  void TakeFrom(ScopedWakeLock* other);
+
+  // Starts |timeout_timer_| to call Release() after |delay|.
+  void StartTimeoutTimer(base::TimeDelta delay);
+
+  // Weak pointer to the client used to acquire the lock. Null if the lock is
+  // empty.
+  PowerManagerClient* client_;
+
+  std::string tag_;
+  std::string package_;
+
+  // Binder passed to the power manager, obtained on the first acquisition
+  // (possibly from the pool; see PowerManagerClient::set_max_pooled_binders())
+  // and kept until the lock is destroyed or assigned to.
+  sp<IBinder> binder_;
+
+  // True once Release() has sent a one-way release for |binder_|. Binder only
+  // orders one-way calls relative to each other, so later acquisitions are
+  // also sent one-way to ensure that the power manager handles them after the
+  // release, and the binder isn't pooled afterward.
+  bool release_sent_;
+
+  // True between successful calls to Acquire*() and Release().
+  bool held_;
+
+  // True if the current power manager instance holds |binder_|. Cleared by
+  // PowerManagerClient if the power manager dies.
+  bool acquired_;
+
+  // Calls Release() for AcquireWithTimeout().
+  base::OneShotTimer timeout_timer_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedWakeLock);
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_INCLUDE_NATIVEPOWER_SCOPED_WAKE_LOCK_H_
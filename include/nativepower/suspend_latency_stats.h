@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SYSTEM_NATIVEPOWER_INCLUDE_NATIVEPOWER_SUSPEND_LATENCY_STATS_H_
+#define SYSTEM_NATIVEPOWER_INCLUDE_NATIVEPOWER_SUSPEND_LATENCY_STATS_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <base/time/time.h>
+
+namespace android {
+
+// Distribution of the durations of one phase of suspending and resuming, as
+// reported by the power manager. Durations are recorded in log-linear buckets,
+// so percentiles are accurate to within 1/8 of their value.
+struct LatencyDistribution {
+  // Number of durations that fell in a bucket, each of which is longer than
+  // the previous bucket's |upper_bound| and no longer than its own.
+  struct Bucket {
+    Bucket() : count(0) {}
+
+    base::TimeDelta upper_bound;
+    int64_t count;
+  };
+
+  LatencyDistribution() : count(0) {}
+
+  // Number of recorded durations.
+  int64_t count;
+
+  base::TimeDelta min;
+  base::TimeDelta max;
+  base::TimeDelta total;
+
+  // Upper bounds of the buckets containing the 50th, 90th and 99th
+  // percentiles, clamped to |max|.
+  base::TimeDelta p50;
+  base::TimeDelta p90;
+  base::TimeDelta p99;
+
+  // Non-empty buckets in increasing order.
+  std::vector<Bucket> buckets;
+};
+
+// Cumulative suspend and resume latencies, as reported by the power manager.
+// Only suspends that succeeded are included.
+struct SuspendLatencyStats {
+  // From the earliest request handled by a suspend to the start of the write
+  // to /sys/power/state, measured with CLOCK_MONOTONIC. Includes time spent
+  // waiting behind an earlier suspend and the wakeup_count handshake.
+  LatencyDistribution request_to_write;
+
+  // Time that the system was awake during the write, i.e. the kernel's
+  // suspend and resume paths, measured with CLOCK_MONOTONIC (which stops
+  // while the system is asleep).
+  LatencyDistribution kernel;
+
+  // Time that the system was asleep: the CLOCK_BOOTTIME advance during the
+  // write minus |kernel|.
+  LatencyDistribution sleep;
+
+  // From the write returning to the daemon's main thread handling the result,
+  // measured with CLOCK_MONOTONIC.
+  LatencyDistribution resume_to_report;
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_INCLUDE_NATIVEPOWER_SUSPEND_LATENCY_STATS_H_
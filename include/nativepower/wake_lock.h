@@ -19,7 +19,11 @@
 
 #include <string>
 
+#include <base/callback.h>
 #include <base/macros.h>
+#include <base/memory/ref_counted.h>
+#include <base/memory/weak_ptr.h>
+#include <base/time/time.h>
 #include <utils/StrongPointer.h>
 
 namespace android {
@@ -29,7 +33,10 @@ class PowerManagerClient;
 
 // RAII-style class that prevents the system from suspending.
 //
-// Instantiate by calling PowerManagerClient::CreateWakeLock().
+// Instantiate by calling PowerManagerClient::CreateWakeLock() or
+// CreateWakeLockAsync(). The destructor doesn't wait for the power manager to
+// process the release. If the power manager restarts, the client re-acquires
+// the lock from the new instance.
 class WakeLock {
  public:
   ~WakeLock();
@@ -37,26 +44,61 @@ class WakeLock {
  private:
   friend class PowerManagerClient;
 
-  // Ownership of |client| remains with the caller.
+  // Ownership of |client| remains with the caller. If |timeout| is nonzero,
+  // the power manager drops the lock once it elapses.
   WakeLock(const std::string& tag,
            const std::string& package,
+           base::TimeDelta timeout,
            PowerManagerClient* client);
 
+  // An acquire request sent on PowerManagerClient's IPC thread by InitAsync().
+  struct AsyncRequest;
+
   // Initializes the object and acquires the lock, returning true on success.
   bool Init();
 
-  // Was a lock successfully acquired from the power manager?
+  // Initializes the object and starts acquiring the lock on
+  // PowerManagerClient's IPC thread, returning false if the request couldn't
+  // be sent. |callback| is run on the calling thread once the request
+  // completes, unless the lock has been destroyed by then.
+  bool InitAsync(const base::Callback<void(bool)>& callback);
+
+  // Sends |request| to the power manager. Runs on the IPC thread.
+  static void SendAsyncAcquire(const scoped_refptr<AsyncRequest>& request);
+
+  // Releases |request|'s lock if SendAsyncAcquire() acquired it. Runs on the
+  // IPC thread.
+  static void SendAsyncRelease(const scoped_refptr<AsyncRequest>& request);
+
+  // Called on the calling thread once |pending_request_| completes.
+  void HandleAsyncAcquire(const base::Callback<void(bool)>& callback);
+
+  // Was a lock successfully acquired from the power manager? For shared
+  // locks, this instead indicates whether the lock holds a reference to its
+  // shared request.
   bool acquired_lock_;
 
+  // True if the lock shares a power manager request (and |lock_binder_|) with
+  // other locks via PowerManagerClient::set_coalesce_wake_locks().
+  bool shared_;
+
   std::string tag_;
   std::string package_;
+  base::TimeDelta timeout_;
 
-  // Weak pointer to the client that created this wake lock.
+  // Weak pointer to the client that created this wake lock, which tracks it
+  // for re-acquisition.
   PowerManagerClient* client_;
 
   // Locally-created binder passed to the power manager.
   sp<IBinder> lock_binder_;
 
+  // In-flight request made by InitAsync().
+  scoped_refptr<AsyncRequest> pending_request_;
+
+  // Keep this member last.
+  base::WeakPtrFactory<WakeLock> weak_ptr_factory_;
+
   DISALLOW_COPY_AND_ASSIGN(WakeLock);
 };
 
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSTEM_NATIVEPOWER_INCLUDE_NATIVEPOWER_WAKE_LOCK_STATS_H_
+#define SYSTEM_NATIVEPOWER_INCLUDE_NATIVEPOWER_WAKE_LOCK_STATS_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+
+#include <base/time/time.h>
+
+namespace android {
+
+// Cumulative statistics about the wake locks sharing a (uid, package, tag)
+// key, as reported by the power manager.
+struct WakeLockStats {
+  WakeLockStats() : uid(-1), acquire_count(0), active_count(0) {}
+
+  uid_t uid;
+  std::string package;
+  std::string tag;
+
+  // Number of times that a lock was acquired.
+  int64_t acquire_count;
+
+  // Number of locks that are currently held.
+  int active_count;
+
+  // Total time that locks have been held, including time accrued by locks that
+  // are still held.
+  base::TimeDelta total_hold_time;
+
+  // Longest time that a single released lock was held.
+  base::TimeDelta max_hold_time;
+
+  // Portion of |total_hold_time| blamed on |uid|. A lock held on behalf of N
+  // uids contributes 1/N of its hold time to each of them.
+  base::TimeDelta blamed_hold_time;
+};
+
+}  // namespace android
+
+#endif  // SYSTEM_NATIVEPOWER_INCLUDE_NATIVEPOWER_WAKE_LOCK_STATS_H_